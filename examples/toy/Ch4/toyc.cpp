@@ -84,7 +84,8 @@ mlir::LogicalResult optimize(mlir::Module &module) {
   pm.addPass(createShapeInferencePass());
   pm.addPass(mlir::createCanonicalizerPass());
   // Apply any generic pass manager command line options.
-  applyPassManagerCLOptions(pm);
+  if (failed(applyPassManagerCLOptions(pm)))
+    return mlir::failure();
 
   return pm.run(&module);
 }
@@ -109,7 +109,8 @@ mlir::LogicalResult optimize(mlir::Module &module) {
   pm.addPass(mlir::createCSEPass());
 
   // Apply any generic pass manager command line options.
-  applyPassManagerCLOptions(pm);
+  if (failed(applyPassManagerCLOptions(pm)))
+    return mlir::failure();
 
   return pm.run(&module);
 }
@@ -125,7 +126,8 @@ mlir::LogicalResult lowerDialect(mlir::Module &module, bool OnlyLinalg) {
     pm.addPass(mlir::createCSEPass());
   }
   // Apply any generic pass manager command line options.
-  applyPassManagerCLOptions(pm);
+  if (failed(applyPassManagerCLOptions(pm)))
+    return mlir::failure();
 
   return pm.run(&module);
 }
@@ -136,7 +138,8 @@ mlir::LogicalResult lowerLLVMModule(mlir::Module &module) {
   pm.addPass(createLateLoweringPass());
 
   // Apply any generic pass manager command line options.
-  applyPassManagerCLOptions(pm);
+  if (failed(applyPassManagerCLOptions(pm)))
+    return mlir::failure();
 
   return pm.run(&module);
 }
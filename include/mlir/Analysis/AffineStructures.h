@@ -218,7 +218,7 @@ private:
 /// coefficient (r, c) lives at the location numReservedCols * r + c in the
 /// buffer. The extra space between getNumCols() and numReservedCols exists to
 /// prevent frequent movement of data when adding columns, especially at the
-/// end.
+/// end. When it is exhausted, numReservedCols grows geometrically.
 ///
 /// The identifiers x_0, x_1, ... appear in the order: dimensional identifiers,
 /// symbolic identifiers, and local identifiers.  The local identifiers
@@ -310,13 +310,21 @@ public:
   /// intersection with no simplification of any sort attempted.
   void append(const FlatAffineConstraints &other);
 
-  // Checks for emptiness by performing variable elimination on all identifiers,
-  // running the GCD test on each equality constraint, and checking for invalid
-  // constraints.
-  // Returns true if the GCD test fails for any equality, or if any invalid
-  // constraints are discovered on any row. Returns false otherwise.
+  // Checks for integer emptiness by running the GCD test on each equality
+  // constraint, checking for invalid constraints, and searching for an integer
+  // point with a simplex and branch and bound.  If the search is inconclusive,
+  // falls back to variable elimination on all identifiers.
+  // Returns true if the GCD test fails for any equality, if any invalid
+  // constraints are discovered on any row, or if there is no integer point.
+  // Returns false otherwise.
   bool isEmpty() const;
 
+  /// Checks for emptiness by eliminating identifiers successively, which is
+  /// what isEmpty falls back to.  This is exact for rational spaces but not
+  /// integer spaces, and conservatively returns false if an explosion of
+  /// constraints is detected.
+  bool isEmptyByFourierMotzkin() const;
+
   // Runs the GCD test on all equality constraints. Returns 'true' if this test
   // fails on any equality. Returns 'false' otherwise.
   // This test can be used to disprove the existence of a solution. If it
@@ -655,7 +663,8 @@ public:
   void removeTrivialRedundancy();
 
   /// A more expensive check to detect redundant inequalities thatn
-  /// removeTrivialRedundancy.
+  /// removeTrivialRedundancy.  An inequality is redundant if it holds for all
+  /// the integer points satisfying the other constraints.
   void removeRedundantInequalities();
 
   // Removes all equalities and inequalities.
@@ -676,6 +685,10 @@ private:
   /// 'false'otherwise.
   bool hasInvalidConstraint() const;
 
+  /// Removes the redundant inequalities by checking the emptiness of their
+  /// complement with isEmptyByFourierMotzkin.
+  void removeRedundantInequalitiesByFourierMotzkin();
+
   /// Returns the constant lower bound bound if isLower is true, and the upper
   /// bound if isLower is false.
   template <bool isLower>
@@ -756,6 +769,13 @@ private:
   // don't expect an identifier to have more than 32 lower/upper/equality
   // constraints. This is conservatively set low and can be raised if needed.
   constexpr static unsigned kExplosionFactor = 32;
+
+  /// The maximal number of nodes of the branch and bound search for integer
+  /// points, past which the simplex is considered inconclusive and the
+  /// analyses fall back to Fourier-Motzkin elimination.  The constraint systems
+  /// of loop nests are mostly unimodular, in which case the rational sample
+  /// point of the simplex is usually integral or a few branches away from it.
+  constexpr static unsigned kMaxBranchAndBoundNodes = 64;
 };
 
 /// Simplify an affine expression by flattening and some amount of
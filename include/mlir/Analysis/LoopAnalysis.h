@@ -56,6 +56,14 @@ llvm::Optional<uint64_t> getConstantTripCount(AffineForOp forOp);
 /// this method is thus able to determine non-trivial divisors.
 uint64_t getLargestDivisorOfTripCount(AffineForOp forOp);
 
+/// Returns true if 'value' is defined outside of 'forOp', i.e. neither by an
+/// operation nested in 'forOp' nor as an argument of one of the blocks nested
+/// in it, which include its induction variable.
+bool isDefinedOutsideOfLoop(Value *value, AffineForOp forOp);
+
+/// Returns true if 'forOp' has no 'affine.for' operation nested in it.
+bool isInnermostLoop(AffineForOp forOp);
+
 /// Given an induction variable `iv` of type AffineForOp and an `index` of type
 /// IndexType, returns `true` if `index` is independent of `iv` and false
 /// otherwise.
@@ -0,0 +1,140 @@
+//===- MemRefDependenceAnalysis.h - Cached memref dependences ---*- C++ -*-===//
+//
+// Copyright 2019 The MLIR Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =============================================================================
+//
+// This file defines an analysis that memoizes dependence queries between the
+// memref accesses of a function.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef MLIR_ANALYSIS_MEMREFDEPENDENCEANALYSIS_H
+#define MLIR_ANALYSIS_MEMREFDEPENDENCEANALYSIS_H
+
+#include "mlir/Analysis/AffineAnalysis.h"
+#include "mlir/Analysis/AffineStructures.h"
+#include "mlir/IR/AffineMap.h"
+#include "llvm/ADT/DenseMap.h"
+#include <memory>
+
+namespace mlir {
+
+class Function;
+class MLIRContext;
+
+/// A function analysis caching the results of checkMemrefAccessDependence.
+/// Queries are keyed by their source access, destination access and loop
+/// depth. Accesses are normalized before the lookup: loads (resp. stores) of
+/// the same memref with the same composed access map, the same map operands and
+/// the same surrounding loops share their results, except for the queries that
+/// depend on the relative order of the accesses within a block.
+///
+/// The cached results refer to the operations they were computed from, so a
+/// pass that modifies memref accesses or the loops surrounding them must not
+/// preserve this analysis, and must clear() it before querying it again.
+class MemRefDependenceAnalysis {
+public:
+  /// The result of a dependence query.
+  struct Dependence {
+    /// False if the accesses were shown to never access the same element.
+    bool exists = false;
+    /// True if 'components' was computed.
+    bool hasComponents = false;
+    /// The dependence constraint system of the query.
+    FlatAffineConstraints constraints;
+    /// The direction vector of the dependence, if 'hasComponents' is set.
+    SmallVector<DependenceComponent, 2> components;
+  };
+
+  explicit MemRefDependenceAnalysis(Function *function);
+
+  /// Returns the dependence from the load or store operation 'src' to the load
+  /// or store operation 'dst' at 'loopDepth', computing it if it is not cached
+  /// yet. See checkMemrefAccessDependence for the meaning of the arguments.
+  /// The direction vector is only computed if 'computeComponents' is set.
+  const Dependence &getDependence(Operation *src, Operation *dst,
+                                  unsigned loopDepth, bool allowRAR = false,
+                                  bool computeComponents = false);
+
+  /// Returns false if it can be determined conclusively that there is no
+  /// dependence from 'src' to 'dst' at 'loopDepth'.
+  bool hasDependence(Operation *src, Operation *dst, unsigned loopDepth,
+                     bool allowRAR = false) {
+    return getDependence(src, dst, loopDepth, allowRAR).exists;
+  }
+
+  /// Computes the dependences between all pairs of the load and store
+  /// operations in 'ops', at loop depths from 1 to one more than the number of
+  /// loops they have in common. The queries that are not cached yet are
+  /// computed concurrently.
+  void computeDependences(ArrayRef<Operation *> ops, bool allowRAR = false,
+                          bool computeComponents = false);
+
+  /// Drops all the cached results.
+  void clear();
+
+private:
+  /// A normalized memref access.
+  struct NormalizedAccess {
+    Value *memref;
+    bool isStore;
+    AffineMap map;
+    SmallVector<Value *, 4> operands;
+    /// The innermost 'affine.for' operation surrounding the access, if any.
+    Operation *scope;
+    unsigned hash;
+  };
+
+  struct NormalizedAccessInfo
+      : public llvm::DenseMapInfo<const NormalizedAccess *> {
+    static unsigned getHashValue(const NormalizedAccess *access);
+    static bool isEqual(const NormalizedAccess *lhs,
+                        const NormalizedAccess *rhs);
+  };
+
+  /// A query, made of the ids of its source and destination accesses, and of
+  /// its loop depth and 'allowRAR' flag.
+  using QueryKey = std::pair<std::pair<unsigned, unsigned>, unsigned>;
+
+  /// Returns the id of the access performed by 'op'. If 'normalize' is false,
+  /// the id is unique to 'op'.
+  unsigned getAccessId(Operation *op, bool normalize);
+
+  /// Returns the key of a query, given the number of loops surrounding both
+  /// 'src' and 'dst'.
+  QueryKey getQueryKey(Operation *src, Operation *dst, unsigned loopDepth,
+                       bool allowRAR, unsigned numCommonLoops);
+
+  MLIRContext *context;
+
+  /// The normalized accesses, and the normalized access id of each operation.
+  std::vector<std::unique_ptr<NormalizedAccess>> normalizedAccesses;
+  llvm::DenseMap<const NormalizedAccess *, unsigned, NormalizedAccessInfo>
+      normalizedIds;
+  llvm::DenseMap<Operation *, unsigned> opNormalizedIds;
+
+  /// The ids of the operations whose queries cannot be normalized.
+  llvm::DenseMap<Operation *, unsigned> opUniqueIds;
+
+  /// The next access id to assign.
+  unsigned nextAccessId = 0;
+
+  /// The cached results.
+  llvm::DenseMap<QueryKey, std::unique_ptr<Dependence>> dependences;
+};
+
+} // end namespace mlir
+
+#endif // MLIR_ANALYSIS_MEMREFDEPENDENCEANALYSIS_H
@@ -0,0 +1,232 @@
+//===- Simplex.h - Rational simplex for affine constraints ------*- C++ -*-===//
+//
+// Copyright 2019 The MLIR Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =============================================================================
+//
+// A simplex tableau deciding the feasibility of systems of affine constraints
+// over the rationals, with a branch and bound search for integer points.  It
+// is used by FlatAffineConstraints in place of Fourier-Motzkin elimination,
+// whose number of constraints can grow combinatorially with the number of
+// eliminated identifiers.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef MLIR_ANALYSIS_SIMPLEX_H
+#define MLIR_ANALYSIS_SIMPLEX_H
+
+#include "mlir/Support/LLVM.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/SmallVector.h"
+
+namespace mlir {
+
+/// A rational number num / den, with a positive denominator.
+struct Fraction {
+  Fraction(int64_t num, int64_t den) : num(num), den(den) {
+    assert(den > 0 && "expected a positive denominator");
+  }
+
+  /// Returns the greatest integer less than or equal to this fraction.
+  int64_t floor() const;
+  /// Returns the least integer greater than or equal to this fraction.
+  int64_t ceil() const;
+
+  int64_t num, den;
+};
+
+/// The simplex tableau of a system of affine constraints over a number of
+/// unknowns, which are initially unconstrained.  Constraints are specified as
+/// coefficients of the unknowns followed by a constant term, in the format of
+/// the rows of FlatAffineConstraints: `coeffs` represents the affine function
+/// `coeffs[0] * x_0 + ... + coeffs[n - 1] * x_{n - 1} + coeffs[n]`.
+///
+/// Every unknown and constraint of the tableau is either in a column, in which
+/// case its value in the current sample point is zero, or in a row, in which
+/// case it is an affine function of the column unknowns.  The rows of the
+/// constraints are kept non-negative in the sample point, so the sample point
+/// is a rational point satisfying all the constraints unless the tableau is
+/// empty.
+///
+/// The tableau keeps a log of the changes made to it, and can be rolled back
+/// to a snapshot, which allows trying additional constraints cheaply.  The
+/// tableau uses 64-bit arithmetic; if an operation overflows, the tableau is
+/// marked as such and its results are meaningless.
+class Simplex {
+public:
+  enum class Direction { Up, Down };
+
+  /// The result of a search for an integer point.
+  enum class IntegerResult { Feasible, Infeasible, Unknown };
+
+  explicit Simplex(unsigned numUnknowns);
+
+  /// Add the inequality `coeffs >= 0`.
+  void addInequality(ArrayRef<int64_t> coeffs);
+
+  /// Add the equality `coeffs == 0`.
+  void addEquality(ArrayRef<int64_t> coeffs);
+
+  /// Returns the number of constraints added, each equality counting as two
+  /// constraints.
+  unsigned getNumConstraints() const { return con.size(); }
+
+  /// Returns true if the constraints have no rational solution.
+  bool isEmpty() const { return empty; }
+
+  /// Returns true if an operation overflowed, in which case the results of the
+  /// tableau are meaningless.
+  bool hasOverflowed() const { return overflowed; }
+
+  /// Returns the minimum or the maximum of the affine function `coeffs` over
+  /// the rational solutions, or None if it is unbounded.  The tableau must not
+  /// be empty.
+  Optional<Fraction> computeOptimum(Direction direction,
+                                    ArrayRef<int64_t> coeffs);
+
+  /// Search an integer solution by branch and bound on the unknowns with a
+  /// fractional value in the sample point, exploring at most `maxNodes` nodes
+  /// of the search tree.  Returns Unknown if the search was cut short.
+  IntegerResult findIntegerSample(unsigned maxNodes);
+
+  /// Returns the minimum or the maximum of the unknown at `pos` over the
+  /// integer solutions.  Returns None if the unknown is unbounded, if there
+  /// are no integer solutions, or if the search was cut short after exploring
+  /// `maxNodes` nodes in total, counting both the branch and bound nodes and
+  /// the rounded optima that were excluded.
+  Optional<int64_t> computeIntegerOptimum(Direction direction, unsigned pos,
+                                          unsigned maxNodes);
+
+  /// Mark the inequalities that are implied by the other inequalities over the
+  /// integers as redundant, in order.  An inequality is redundant if the
+  /// minimum of its affine function over the rational solutions of the
+  /// remaining constraints is greater than -1, as the function takes integer
+  /// values on integer points.  The tableau must not be empty.
+  void detectRedundant();
+
+  /// Returns true if the constraint at `index` was marked as redundant.
+  bool isMarkedRedundant(unsigned index) const { return con[index].redundant; }
+
+  /// Returns a snapshot of the tableau that it can be rolled back to.
+  unsigned getSnapshot() const { return undoLog.size(); }
+
+  /// Undo the changes made to the tableau since `snapshot` was taken.
+  void rollback(unsigned snapshot);
+
+  void print(raw_ostream &os) const;
+  void dump() const;
+
+private:
+  enum class Orientation { Row, Column };
+
+  /// An unknown or a constraint of the tableau.  Restricted unknowns, i.e. the
+  /// non-redundant inequalities, must be non-negative.
+  struct Unknown {
+    Unknown(Orientation orientation, bool restricted, unsigned pos)
+        : orientation(orientation), restricted(restricted), redundant(false),
+          pos(pos) {}
+
+    Orientation orientation;
+    bool restricted;
+    bool redundant;
+    unsigned pos;
+  };
+
+  struct Pivot {
+    unsigned row, column;
+  };
+
+  enum class UndoLogEntry { RemoveLastConstraint, UnmarkEmpty };
+
+  /// Accessors to the tableau.  Column 0 holds the denominator of the rows,
+  /// column 1 their constant term, and the remaining columns the coefficients
+  /// of the column unknowns.
+  int64_t &at(unsigned row, unsigned col) { return tableau[row * nCol + col]; }
+  int64_t at(unsigned row, unsigned col) const {
+    return tableau[row * nCol + col];
+  }
+
+  /// Returns the unknown of the given row or column.  Constraints are encoded
+  /// by their index and unknowns by the complement of their index.
+  Unknown &unknownFromIndex(int index) {
+    return index >= 0 ? con[index] : var[~index];
+  }
+  const Unknown &unknownFromIndex(int index) const {
+    return index >= 0 ? con[index] : var[~index];
+  }
+  const Unknown &unknownFromRow(unsigned row) const {
+    return unknownFromIndex(rowUnknown[row]);
+  }
+  const Unknown &unknownFromColumn(unsigned col) const {
+    return unknownFromIndex(colUnknown[col]);
+  }
+
+  /// Add a row for the affine function `coeffs` as a new constraint, and
+  /// return the index of the constraint.
+  unsigned addRow(ArrayRef<int64_t> coeffs, bool restricted);
+
+  /// Restore the non-negativity of the sample value of the row of `u`,
+  /// returning false if it cannot be restored.
+  bool restoreRow(Unknown &u);
+
+  /// Find a pivot changing the sample value of `row` in `direction` while
+  /// keeping the other restricted rows non-negative.  The pivot row is `row`
+  /// itself if the sample value of `row` is unbounded in `direction`.
+  Optional<Pivot> findPivot(unsigned row, Direction direction) const;
+
+  /// Find the restricted row, other than `skipRow`, that first becomes zero
+  /// when changing the column unknown of `col` in `direction`.
+  Optional<unsigned> findPivotRow(Optional<unsigned> skipRow,
+                                  Direction direction, unsigned col) const;
+
+  /// Swap the row unknown of `row` with the column unknown of `col`.
+  void pivot(unsigned row, unsigned col);
+  void pivot(Pivot pair) { pivot(pair.row, pair.column); }
+
+  /// Move `row` in `direction` as far as possible, returning its optimum or
+  /// None if it is unbounded.
+  Optional<Fraction> computeRowOptimum(Direction direction, unsigned row);
+
+  /// Implementation of findIntegerSample, decrementing `budget` for each node
+  /// explored.
+  IntegerResult searchIntegerSample(unsigned &budget);
+
+  /// Returns the sample value of the unknown at `pos`.
+  Fraction getSampleValue(unsigned pos) const;
+
+  void swapRows(unsigned i, unsigned j);
+  void normalizeRow(unsigned row);
+  void markEmpty();
+  void undo(UndoLogEntry entry);
+
+  /// Overflow checked arithmetic, setting `overflowed` on overflow.
+  int64_t add(int64_t lhs, int64_t rhs) const;
+  int64_t mul(int64_t lhs, int64_t rhs) const;
+
+  unsigned nRow, nCol;
+  SmallVector<int64_t, 64> tableau;
+
+  /// The unknowns of the rows and of the columns, see unknownFromIndex.
+  SmallVector<int, 8> rowUnknown, colUnknown;
+  SmallVector<Unknown, 8> var, con;
+
+  SmallVector<UndoLogEntry, 8> undoLog;
+  bool empty;
+  mutable bool overflowed;
+};
+
+} // end namespace mlir
+
+#endif // MLIR_ANALYSIS_SIMPLEX_H
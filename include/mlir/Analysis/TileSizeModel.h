@@ -0,0 +1,110 @@
+//===- TileSizeModel.h - Analytical tile size model -------------*- C++ -*-===//
+//
+// Copyright 2019 The MLIR Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =============================================================================
+//
+// This header file defines an analytical model of the cache behavior of a band
+// of loops as a function of its tile sizes, used to select tile sizes.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef MLIR_ANALYSIS_TILE_SIZE_MODEL_H
+#define MLIR_ANALYSIS_TILE_SIZE_MODEL_H
+
+#include "mlir/Support/LLVM.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/SmallVector.h"
+
+namespace mlir {
+
+class AffineForOp;
+
+/// Models the cache lines touched by the tiles of a band of perfectly nested
+/// loops with constant trip counts. For each memref accessed in the band, the
+/// extent of a tile along each memref dimension is derived from the strides of
+/// the accesses along the loops of the band, capped by the extent of the
+/// region accessed by the whole band (see MemRefRegion). A tile touches the
+/// product of the extents of the outer dimensions times the number of cache
+/// lines spanned by its innermost dimension.
+///
+/// Tiles are assumed to be executed one after the other: the lines touched by
+/// a tile are moved into a cache large enough to hold them once per tile,
+/// except for the memrefs whose accesses do not depend on the innermost loop
+/// of the band, which are reused across consecutive tiles of that loop.
+class TileSizeModel {
+public:
+  /// Returns the model of 'band' for caches with lines of 'cacheLineBytes'
+  /// bytes, or None if a trip count or the region accessed by a load or store
+  /// of the band is not constant.
+  static Optional<TileSizeModel> get(ArrayRef<AffineForOp> band,
+                                     unsigned cacheLineBytes);
+
+  /// Returns the number of bytes of the cache lines touched by a tile.
+  uint64_t getWorkingSetBytes(ArrayRef<unsigned> tileSizes) const;
+
+  /// Returns the number of cache lines moved into a cache holding the working
+  /// set of a tile, over the whole band.
+  uint64_t getTraffic(ArrayRef<unsigned> tileSizes) const;
+
+  /// Returns the number of cache lines moved into each level of a cache
+  /// hierarchy with levels of 'cacheSizes' bytes. The levels that can't hold
+  /// the working set of a tile are assumed to only exploit the reuse along the
+  /// innermost loop of the band, as if it wasn't tiled.
+  uint64_t getCost(ArrayRef<unsigned> tileSizes,
+                   ArrayRef<uint64_t> cacheSizes) const;
+
+  /// Returns in 'tileSizes' the tile sizes obtained by repeatedly doubling the
+  /// tile size that reduces the traffic the most, as long as the working set
+  /// fits in 'cacheSize' bytes.
+  void getTileSizesForCache(uint64_t cacheSize,
+                            SmallVectorImpl<unsigned> *tileSizes) const;
+
+  /// Returns in 'tileSizes' the tile sizes of lowest cost among those selected
+  /// for each level of the cache hierarchy with levels of 'cacheSizes' bytes,
+  /// innermost level first. If the whole band fits in the innermost level,
+  /// all tile sizes are 1.
+  void getTileSizes(ArrayRef<uint64_t> cacheSizes,
+                    SmallVectorImpl<unsigned> *tileSizes) const;
+
+private:
+  /// The tile footprint model of the accesses to a memref.
+  struct MemRefFootprint {
+    unsigned elementBytes;
+    /// The extent of the region accessed by the band along each dimension.
+    SmallVector<uint64_t, 4> extents;
+    /// The largest absolute stride of the accesses along each loop of the
+    /// band, for each dimension.
+    SmallVector<SmallVector<uint64_t, 4>, 4> strides;
+    /// True for the dimensions whose accesses aren't affine combinations of
+    /// the loops, which are assumed to span their whole extent in each tile.
+    SmallVector<bool, 4> isFixed;
+  };
+
+  explicit TileSizeModel(unsigned cacheLineBytes)
+      : cacheLineBytes(cacheLineBytes) {}
+
+  /// Returns the number of cache lines of 'footprint' touched by a tile.
+  uint64_t getNumLines(const MemRefFootprint &footprint,
+                       ArrayRef<unsigned> tileSizes) const;
+
+  unsigned cacheLineBytes;
+  SmallVector<uint64_t, 4> tripCounts;
+  SmallVector<MemRefFootprint, 4> footprints;
+};
+
+} // end namespace mlir
+
+#endif // MLIR_ANALYSIS_TILE_SIZE_MODEL_H
@@ -38,8 +38,10 @@ namespace mlir {
 class AffineForOp;
 class Block;
 class FlatAffineConstraints;
+class FuncBuilder;
 class Location;
 class MemRefAccess;
+class MemRefDependenceAnalysis;
 class Operation;
 class Value;
 
@@ -53,9 +55,10 @@ void getLoopIVs(Operation &op, SmallVectorImpl<AffineForOp> *loops);
 unsigned getNestingDepth(Operation &op);
 
 /// Returns in 'sequentialLoops' all sequential loops in loop nest rooted
-/// at 'forOp'.
+/// at 'forOp'. The dependences are looked up in 'dependences' if provided.
 void getSequentialLoops(AffineForOp forOp,
-                        llvm::SmallDenseSet<Value *, 8> *sequentialLoops);
+                        llvm::SmallDenseSet<Value *, 8> *sequentialLoops,
+                        MemRefDependenceAnalysis *dependences = nullptr);
 
 /// ComputationSliceState aggregates loop IVs, loop bound AffineMaps and their
 /// associated operands for a set of loops within a loop nest (typically the
@@ -216,6 +219,9 @@ struct MemRefRegion {
   FlatAffineConstraints cst;
 };
 
+/// Returns the size of an element of 'memRefType' in bytes.
+unsigned getMemRefEltSizeInBytes(MemRefType memRefType);
+
 /// Returns the size of memref data in bytes if it's statically shaped, None
 /// otherwise.
 Optional<uint64_t> getMemRefSizeInBytes(MemRefType memRefType);
@@ -230,13 +236,78 @@ LogicalResult boundCheckLoadOrStoreOp(LoadOrStoreOpPointer loadOrStoreOp,
 /// Returns the number of surrounding loops common to both A and B.
 unsigned getNumCommonSurroundingLoops(Operation &A, Operation &B);
 
+/// Recomputes the order of the operations in the blocks containing 'ops' or
+/// any of their ancestors, if it was invalidated. Operation::isBeforeInBlock
+/// recomputes this order lazily, so this must be called before querying the
+/// relative order of these operations from several threads, e.g. when
+/// checking dependences concurrently.
+void computeInstOrders(ArrayRef<Operation *> ops);
+
 /// Gets the memory footprint of all data touched in the specified memory space
 /// in bytes; if the memory space is unspecified, considers all memory spaces.
 Optional<int64_t> getMemoryFootprintBytes(AffineForOp forOp,
                                           int memorySpace = -1);
 
-/// Returns true if `forOp' is a parallel loop.
-bool isLoopParallel(AffineForOp forOp);
+/// Gets the memory footprint in bytes of all data touched by the operations in
+/// 'ops' taken together, i.e. data touched by several of them is counted once.
+/// The regions are symbolic in the IVs enclosing each operation. Returns None,
+/// without emitting a warning, if the regions accessed by different operations
+/// can't be unioned.
+Optional<int64_t> getMemoryFootprintBytes(ArrayRef<Operation *> ops,
+                                          int memorySpace = -1);
+
+/// The associative operations a reduction combines its values with. Max and
+/// Min are expressed as a 'cmpi' followed by a 'select' of its operands, and
+/// the predicate of the 'cmpi' tells whether they are signed or unsigned.
+enum class ReductionKind { Add, Mul, Max, Min };
+
+/// A reduction carried by an 'affine.for' operation through a memref location
+/// that is invariant in the loop: each iteration loads the location, combines
+/// the loaded value with 'operand', and stores the result back.
+struct LoopReduction {
+  /// Returns the memref holding the accumulator.
+  Value *getMemRef() const;
+
+  /// Returns the value of the accumulator combined with 'value', i.e. the
+  /// combiner operations cloned at the insertion point of 'b' with the loaded
+  /// value replaced by 'accumulator' and 'operand' by 'value'.
+  Value *buildCombine(FuncBuilder *b, Value *accumulator, Value *value) const;
+
+  /// Returns the identity of the reduction, created with 'b'.
+  Value *buildIdentity(FuncBuilder *b) const;
+
+  ReductionKind kind;
+  /// The load and store of the accumulator, in the body of the loop.
+  Operation *load;
+  Operation *store;
+  /// The operations combining the loaded value with 'operand' in order; the
+  /// last one defines the stored value.
+  SmallVector<Operation *, 2> combiner;
+  /// The value combined into the accumulator at each iteration.
+  Value *operand;
+};
+
+/// Populates 'reductions' with the reductions carried by 'forOp'. A reduction
+/// is recognized when the load and the store of the accumulator are the only
+/// accesses to its memref in the loop, appear in that order in the body of
+/// 'forOp', use the same indices defined outside of the loop, and the loaded
+/// value is only used to compute the stored one. Floating point additions and
+/// multiplications aren't associative, so they are only recognized as
+/// reductions if 'reassociateFloats' is set.
+void getLoopReductions(AffineForOp forOp,
+                       SmallVectorImpl<LoopReduction> *reductions,
+                       bool reassociateFloats = false);
+
+/// Returns true if `forOp' is a parallel loop. The dependences are looked up
+/// in 'dependences' if provided. If 'reductions' is provided, the dependences
+/// carried by the reductions of 'forOp' are ignored and, if the loop is
+/// parallel, the reductions are appended to it: the loop is then parallel once
+/// they are privatized. The floating point reductions are only considered if
+/// 'reassociateFloats' is set, see getLoopReductions.
+bool isLoopParallel(AffineForOp forOp,
+                    MemRefDependenceAnalysis *dependences = nullptr,
+                    SmallVectorImpl<LoopReduction> *reductions = nullptr,
+                    bool reassociateFloats = false);
 
 } // end namespace mlir
 
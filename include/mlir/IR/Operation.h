@@ -416,6 +416,36 @@ public:
     });
   }
 
+  //===--------------------------------------------------------------------===//
+  // Worklist Membership
+  //===--------------------------------------------------------------------===//
+
+  /// Returns true if this operation is marked as being in the worklist of a
+  /// worklist-driven transformation, e.g. the greedy pattern rewrite driver.
+  /// This avoids keeping a side table of the operations in the worklist and
+  /// of their positions.  The transformation is responsible for clearing the
+  /// mark of every operation before it finishes, and at most one such
+  /// transformation may run on an operation at a time.
+  bool isInWorklist() { return inWorklist; }
+
+  /// Returns the index of this operation in the worklist it is marked as being
+  /// in.
+  unsigned getWorklistIndex() {
+    assert(inWorklist && "operation is not in a worklist");
+    return worklistIndex;
+  }
+
+  /// Marks this operation as being at the given index of the worklist of a
+  /// worklist-driven transformation.
+  void setInWorklist(unsigned index) {
+    inWorklist = true;
+    worklistIndex = index;
+  }
+
+  /// Unmarks this operation as being in the worklist of a worklist-driven
+  /// transformation.
+  void removeFromWorklist() { inWorklist = false; }
+
   //===--------------------------------------------------------------------===//
   // Other
   //===--------------------------------------------------------------------===//
@@ -464,7 +494,15 @@ private:
 
   /// Relative order of this operation in its parent block. Used for
   /// O(1) local dominance checks between operations.
-  mutable unsigned orderIndex = 0;
+  mutable unsigned orderIndex : 31;
+
+  /// Whether this operation is in the worklist of a worklist-driven
+  /// transformation.  This is packed with the order index.
+  unsigned inWorklist : 1;
+
+  /// The index of this operation in the worklist of a worklist-driven
+  /// transformation, if 'inWorklist' is set.
+  unsigned worklistIndex = 0;
 
   const unsigned numResults, numSuccs, numRegions;
 
@@ -19,6 +19,8 @@
 #define MLIR_PATTERNMATCHER_H
 
 #include "mlir/IR/Builders.h"
+#include "llvm/ADT/StringMap.h"
+#include <chrono>
 
 namespace mlir {
 
@@ -313,6 +315,66 @@ private:
                                        ArrayRef<Value *> valuesToRemoveIfDead);
 };
 
+//===----------------------------------------------------------------------===//
+// Pattern Rewrite Statistics
+//===----------------------------------------------------------------------===//
+
+/// This class collects statistics about the application of rewrite patterns,
+/// e.g. how often each pattern is attempted, how often it succeeds, and the
+/// time spent matching it. Collection is opt-in: the pattern drivers only
+/// record statistics while a collector is active on the current thread.
+class PatternRewriteStatistics {
+public:
+  /// The statistics for a single pattern.
+  struct PatternEntry {
+    unsigned numMatchAttempts = 0;
+    unsigned numMatchSuccesses = 0;
+    std::chrono::nanoseconds matchTime{0};
+  };
+
+  /// Returns the collector that is active on the current thread, or null if
+  /// statistics are not being collected.
+  static PatternRewriteStatistics *getActive();
+
+  /// Set the collector that is active on the current thread, returning the
+  /// previously active collector.
+  static PatternRewriteStatistics *setActive(PatternRewriteStatistics *stats);
+
+  /// Record an attempt to match and rewrite the given pattern.
+  void recordMatchAttempt(StringRef pattern, bool succeeded,
+                          std::chrono::nanoseconds time);
+
+  /// Record an operation that was simplified via its fold hook, or folded to a
+  /// constant.
+  void recordFold() { ++numFolds; }
+  void recordConstantFold() { ++numConstantFolds; }
+
+  /// Record a single invocation of a rewrite driver that took the given number
+  /// of iterations.
+  void recordDriverRun(unsigned iterations, bool converged);
+
+  /// Merge the statistics in 'other' into this collector.
+  void merge(const PatternRewriteStatistics &other);
+
+  /// Returns true if nothing has been recorded.
+  bool empty() const { return numDriverRuns == 0 && patterns.empty(); }
+
+  /// Print the collected statistics, indenting each line by 'indent'.
+  void print(raw_ostream &os, unsigned indent = 0) const;
+
+private:
+  /// The statistics for each pattern, keyed by pattern label.
+  llvm::StringMap<PatternEntry> patterns;
+
+  /// The number of operations folded via their fold hook or to a constant.
+  unsigned numFolds = 0, numConstantFolds = 0;
+
+  /// The number of driver invocations, the total and maximum number of
+  /// iterations taken, and the number of invocations that didn't converge.
+  unsigned numDriverRuns = 0, numIterations = 0, maxIterations = 0,
+           numNonConvergedRuns = 0;
+};
+
 //===----------------------------------------------------------------------===//
 // Pattern-driven rewriters
 //===----------------------------------------------------------------------===//
@@ -345,6 +407,10 @@ private:
 
   /// The rewriter used when applying matched patterns.
   PatternRewriter &rewriter;
+
+  /// The labels used to identify each pattern when collecting statistics,
+  /// computed lazily.
+  std::vector<std::string> patternLabels;
 };
 
 /// Rewrite the specified function by repeatedly applying the highest benefit
@@ -353,6 +419,28 @@ private:
 ///
 bool applyPatternsGreedily(Function &fn, OwningRewritePatternList &&patterns);
 
+/// Rewrite the given operations, which must all be within the same function,
+/// by repeatedly applying the highest benefit patterns in a greedy work-list
+/// driven manner.  The worklist is only seeded with `ops`: the operations
+/// affected by the rewrites, i.e. the newly created operations and the users
+/// and operands of the rewritten operations, are then revisited until no more
+/// patterns apply to them.  Unlike the function variant, the function is never
+/// scanned as a whole, which makes this suitable for cleaning up after a
+/// transformation that only modified a small part of a function.
+void applyPatternsGreedily(ArrayRef<Operation *> ops,
+                           OwningRewritePatternList &&patterns);
+
+/// Rewrite the specified function like `applyPatternsGreedily`, but rewrite
+/// the operations with regions at the top level of the function, e.g. sibling
+/// loop nests, concurrently.  Each of these operations is rewritten in
+/// isolation, so only the operations at the top level of the function are
+/// rewritten serially, before and after the concurrent rewrites.
+/// `getPatterns` is invoked once for each concurrent rewrite, on the calling
+/// thread, to produce the patterns it owns.  This falls back to the serial
+/// driver if multi-threading is disabled or there is nothing to parallelize.
+void applyPatternsGreedilyInParallel(
+    Function &fn, llvm::function_ref<OwningRewritePatternList()> getPatterns);
+
 } // end namespace mlir
 
 #endif // MLIR_PATTERN_MATCH_H
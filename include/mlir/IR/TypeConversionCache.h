@@ -0,0 +1,75 @@
+//===- TypeConversionCache.h - Cache of type conversions --------*- C++ -*-===//
+//
+// Copyright 2019 The MLIR Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =============================================================================
+//
+// This file defines a utility class for caching the conversions of types
+// performed by a type converter, e.g. during dialect conversion.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef MLIR_IR_TYPECONVERSIONCACHE_H
+#define MLIR_IR_TYPECONVERSIONCACHE_H
+
+#include "mlir/IR/Types.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/RWMutex.h"
+#include <atomic>
+
+namespace mlir {
+/// This is a thread-safe cache of the conversions of types.  Converting a type
+/// may be expensive, e.g. when the converted type wraps types of an external
+/// context that must be created under a lock, and the same types are typically
+/// converted over and over.  The cache maps each original type to its
+/// conversion, which is computed once with the provided conversion function.
+/// Lookups of types that were already converted only take a reader lock, so
+/// concurrent lookups do not block each other.
+///
+/// The cache also counts the lookups that were hits and misses, which may be
+/// used to evaluate its efficiency.
+class TypeConversionCache {
+public:
+  TypeConversionCache() : numHits(0), numMisses(0) {}
+
+  /// Returns the conversion of `type`.  If `type` has not been converted yet,
+  /// `convert` is called to compute its conversion, which is then cached.  The
+  /// conversion is called without holding the lock of the cache, so it must be
+  /// thread-safe if the cache is used from multiple threads.  Failed
+  /// conversions, i.e. null types, are cached as well.
+  Type lookupOrConvert(Type type, llvm::function_ref<Type(Type)> convert);
+
+  /// Erases all of the cached conversions and resets the counters.
+  void clear();
+
+  /// Returns the number of lookups of types that were already converted.
+  unsigned getNumHits() const { return numHits; }
+
+  /// Returns the number of lookups of types that had to be converted.
+  unsigned getNumMisses() const { return numMisses; }
+
+private:
+  /// Mapping between the original types and their conversions.
+  llvm::DenseMap<Type, Type> conversions;
+
+  /// Mutex guarding `conversions`.
+  llvm::sys::SmartRWMutex<true> mutex;
+
+  /// The number of hits and misses of the lookups.
+  std::atomic<unsigned> numHits, numMisses;
+};
+} // end namespace mlir
+
+#endif // MLIR_IR_TYPECONVERSIONCACHE_H
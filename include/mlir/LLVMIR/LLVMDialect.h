@@ -27,12 +27,14 @@
 #include "mlir/IR/Function.h"
 #include "mlir/IR/OpDefinition.h"
 #include "mlir/IR/OpImplementation.h"
+#include "mlir/IR/TypeConversionCache.h"
 #include "mlir/IR/TypeSupport.h"
 #include "mlir/IR/Types.h"
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Type.h"
+#include "llvm/Support/Mutex.h"
 
 namespace llvm {
 class Type;
@@ -72,6 +74,17 @@ public:
   llvm::LLVMContext &getLLVMContext() { return llvmContext; }
   llvm::Module &getLLVMModule() { return module; }
 
+  /// Returns the mutex guarding the LLVM context and module of this dialect.
+  /// The LLVM context is not thread-safe, so this mutex must be held when
+  /// creating LLVM types while the IR may be transformed by multiple threads,
+  /// e.g. during a multi-threaded dialect conversion.
+  llvm::sys::SmartMutex<true> &getLLVMContextMutex() { return mutex; }
+
+  /// Returns the cache of the conversions of types to this dialect.  The
+  /// conversion of a type only depends on the data layout of the LLVM module,
+  /// so the cache is shared by all the conversions in this context.
+  TypeConversionCache &getTypeConversionCache() { return typeConversionCache; }
+
   /// Parse a type registered to this dialect.
   Type parseType(StringRef tyData, Location loc) const override;
 
@@ -86,6 +99,8 @@ public:
 private:
   llvm::LLVMContext llvmContext;
   llvm::Module module;
+  llvm::sys::SmartMutex<true> mutex;
+  TypeConversionCache typeConversionCache;
 };
 
 } // end namespace LLVM
@@ -81,9 +81,47 @@ private:
   SmallPtrSet<const void *, 2> preservedIDs;
 };
 
+} // namespace detail
+
+/// A utility used by analyses to declare the analyses that they are computed
+/// from. An analysis declares its dependencies via a 'Dependencies' type alias,
+/// and is invalidated whenever any of its dependencies are invalidated, even if
+/// the analysis itself was marked as preserved:
+///
+///   struct MyAnalysis {
+///     using Dependencies = AnalysisDependencies<DominanceInfo>;
+///     MyAnalysis(Function *function);
+///   };
+///
+template <typename... AnalysesT> struct AnalysisDependencies {
+  static void getIDs(SmallVectorImpl<const AnalysisID *> &ids) {
+    const AnalysisID *analysisIDs[] = {nullptr,
+                                       AnalysisID::getID<AnalysesT>()...};
+    ids.append(std::next(std::begin(analysisIDs)), std::end(analysisIDs));
+  }
+};
+
+namespace detail {
+/// Utility to detect if an analysis declares its dependencies.
+template <typename T> struct VoidType { using type = void; };
+template <typename AnalysisT, typename = void>
+struct AnalysisDependencyTraits {
+  static void getIDs(SmallVectorImpl<const AnalysisID *> &ids) {}
+};
+template <typename AnalysisT>
+struct AnalysisDependencyTraits<
+    AnalysisT, typename VoidType<typename AnalysisT::Dependencies>::type> {
+  static void getIDs(SmallVectorImpl<const AnalysisID *> &ids) {
+    AnalysisT::Dependencies::getIDs(ids);
+  }
+};
+
 /// The abstract polymorphic base class representing an analysis.
 struct AnalysisConcept {
   virtual ~AnalysisConcept() = default;
+
+  /// The analyses that this analysis is computed from.
+  SmallVector<const AnalysisID *, 2> dependencies;
 };
 
 /// A derived analysis model used to hold a specific analysis object.
@@ -128,6 +166,7 @@ public:
         pi->runBeforeAnalysis(getAnalysisName<AnalysisT>(), id, ir);
 
       it->second = llvm::make_unique<AnalysisModel<AnalysisT>>(ir);
+      AnalysisDependencyTraits<AnalysisT>::getIDs(it->second->dependencies);
 
       if (pi)
         pi->runAfterAnalysis(getAnalysisName<AnalysisT>(), id, ir);
@@ -152,14 +191,33 @@ public:
   void clear() { analyses.clear(); }
 
   /// Invalidate any cached analyses based upon the given set of preserved
-  /// analyses.
+  /// analyses. An analysis is only kept if it, and all of the analyses it
+  /// transitively depends on, are preserved.
   void invalidate(const detail::PreservedAnalyses &pa) {
-    // Remove any analyses not marked as preserved.
-    for (auto it = analyses.begin(), e = analyses.end(); it != e;) {
-      auto curIt = it++;
-      if (!pa.isPreserved(curIt->first))
-        analyses.erase(curIt);
+    // Collect the analyses that were not marked as preserved.
+    SmallPtrSet<const AnalysisID *, 4> invalidated;
+    for (auto &it : analyses)
+      if (!pa.isPreserved(it.first))
+        invalidated.insert(it.first);
+
+    // Cascade the invalidation to any analyses that depend on an invalidated
+    // analysis, until a fixed point is reached.
+    auto isInvalidated = [&](const AnalysisID *id) {
+      return !pa.isPreserved(id) || invalidated.count(id);
+    };
+    for (bool changed = true; changed;) {
+      changed = false;
+      for (auto &it : analyses) {
+        if (invalidated.count(it.first))
+          continue;
+        if (llvm::any_of(it.second->dependencies, isInvalidated))
+          changed |= invalidated.insert(it.first).second;
+      }
     }
+
+    // Remove the invalidated analyses.
+    for (const AnalysisID *id : invalidated)
+      analyses.erase(id);
   }
 
 private:
@@ -265,8 +323,14 @@ public:
   /// Create an analysis slice for the given child function.
   FunctionAnalysisManager slice(Function *function);
 
-  /// Invalidate any non preserved analyses.
-  void invalidate(const detail::PreservedAnalyses &pa);
+  /// Invalidate any non preserved analyses. If 'changedFunctions' is
+  /// provided, the analyses of functions not within the set are preserved
+  /// regardless of 'pa', except for the functions in 'erasedFunctions', whose
+  /// analyses are all dropped. The functions in these sets are not accessed,
+  /// and may no longer exist.
+  void invalidate(const detail::PreservedAnalyses &pa,
+                  const SmallPtrSetImpl<Function *> *changedFunctions = nullptr,
+                  const SmallPtrSetImpl<Function *> *erasedFunctions = nullptr);
 
   /// Returns a pass instrumentation object for the current module. This value
   /// may be null.
@@ -50,6 +50,11 @@ public:
   /// Returns the derived pass name.
   virtual StringRef getName() = 0;
 
+  /// Returns the textual options that this pass was created with, e.g.
+  /// 'fast-mem-space=2', or an empty string if the pass was not created from
+  /// a textual pass pipeline.
+  StringRef getTextualOptions() const { return textualOptions; }
+
 protected:
   Pass(const PassID *passID, Kind kind) : passIDAndKind(passID, kind) {}
 
@@ -60,6 +65,13 @@ private:
 
   /// Represents a unique identifier for the pass and its kind.
   llvm::PointerIntPair<const PassID *, 1, Kind> passIDAndKind;
+
+  /// The textual options provided when creating this pass.
+  std::string textualOptions;
+
+  /// Allow the pass registry to record the options that a pass was created
+  /// with.
+  friend class PassInfo;
 };
 
 namespace detail {
@@ -83,6 +95,20 @@ struct PassExecutionState {
   /// The set of preserved analyses for the current execution.
   detail::PreservedAnalyses preservedAnalyses;
 };
+
+/// The state for a single execution of a module pass.
+struct ModulePassExecutionState
+    : public PassExecutionState<Module, ModuleAnalysisManager> {
+  using PassExecutionState<Module, ModuleAnalysisManager>::PassExecutionState;
+
+  /// The set of functions changed by the current execution, if the pass
+  /// provided one. Only the analyses of these functions are invalidated.
+  llvm::Optional<llvm::SmallPtrSet<Function *, 4>> changedFunctions;
+
+  /// The set of functions erased by the current execution. All of the analyses
+  /// of these functions are dropped.
+  llvm::SmallPtrSet<Function *, 4> erasedFunctions;
+};
 } // namespace detail
 
 /// Pass to transform a specific function within a module. Derived passes should
@@ -140,7 +166,7 @@ private:
 /// Pass to transform a module. Derived passes should not inherit from this
 /// class directly, and instead should use the CRTP ModulePass class.
 class ModulePassBase : public Pass {
-  using PassStateT = detail::PassExecutionState<Module, ModuleAnalysisManager>;
+  using PassStateT = detail::ModulePassExecutionState;
 
 public:
   static bool classof(const Pass *pass) {
@@ -284,6 +310,36 @@ struct ModulePass : public detail::PassModel<Module, T, ModulePassBase> {
     return this->getAnalysisManager()
         .template getCachedFunctionAnalysis<AnalysisT>(f);
   }
+
+  /// Mark the given function as changed by this pass. Once any function has
+  /// been marked, the non preserved analyses are only invalidated for the
+  /// marked functions, and the analyses of all other functions are kept.
+  void markFunctionChanged(Function *f) {
+    auto &changedFunctions = this->getPassState().changedFunctions;
+    if (!changedFunctions)
+      changedFunctions.emplace();
+    changedFunctions->insert(f);
+  }
+
+  /// Mark the given function as erased by this pass, before erasing it. All of
+  /// its analyses are dropped, so that they aren't reused for a function later
+  /// allocated at the same address. As with 'markFunctionChanged', this
+  /// restricts the invalidation of analyses to the marked functions.
+  void markFunctionErased(Function *f) {
+    auto &changedFunctions = this->getPassState().changedFunctions;
+    if (!changedFunctions)
+      changedFunctions.emplace();
+    this->getPassState().erasedFunctions.insert(f);
+  }
+
+  /// Mark that this pass did not change any functions, i.e. the non preserved
+  /// analyses are only invalidated for the module itself. Functions may still
+  /// be individually marked as changed via 'markFunctionChanged'.
+  void markAllFunctionAnalysesPreserved() {
+    auto &changedFunctions = this->getPassState().changedFunctions;
+    if (!changedFunctions)
+      changedFunctions.emplace();
+  }
 };
 } // end namespace mlir
 
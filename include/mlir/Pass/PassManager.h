@@ -20,6 +20,8 @@
 
 #include "mlir/Support/LogicalResult.h"
 #include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include <string>
 
 namespace llvm {
 class Any;
@@ -51,6 +53,22 @@ enum class PassTimingDisplayMode {
   Pipeline,
 };
 
+/// A set of additional options used to configure the IR printing
+/// instrumentation.
+struct IRPrintingOptions {
+  /// If true, the IR after a pass is only printed if that pass changed the IR.
+  /// Failed passes always have their IR printed.
+  bool printAfterOnlyOnChange = false;
+
+  /// A regular expression filter on the names of the functions to print. If
+  /// empty, all functions are printed.
+  std::string functionFilter;
+
+  /// If non-empty, the IR is written asynchronously to one file per pass
+  /// within this directory instead of the output stream.
+  std::string outputDirectory;
+};
+
 /// The main pass manager and pipeline builder.
 class PassManager {
 public:
@@ -62,6 +80,20 @@ public:
   LLVM_NODISCARD
   LogicalResult run(Module *module);
 
+  /// Enable support for the pass manager to generate a reproducer on the event
+  /// of a crash or a pass failure. `outputFile` is a .mlir filename used to
+  /// write the generated reproducer. The reproducer contains the input module
+  /// as it was before the pipeline was run, along with a comment describing
+  /// the pipeline that was executed.
+  void enableCrashReproducerGeneration(llvm::StringRef outputFile);
+
+  /// Print the pipeline held by this pass manager in the textual pass
+  /// pipeline syntax accepted by 'mlir-opt -pass-pipeline', e.g.
+  /// 'func(cse,loop-fusion{fast-mem-space=2}),canonicalize'. Passes without a
+  /// registered argument are printed as their pass name within angle
+  /// brackets.
+  void printAsTextualPipeline(raw_ostream &os);
+
   //===--------------------------------------------------------------------===//
   // Pipeline Building
   //===--------------------------------------------------------------------===//
@@ -79,6 +111,11 @@ public:
   /// executor if necessary.
   void addPass(FunctionPassBase *pass);
 
+  /// Start a new function pipeline. Any function passes added after this call
+  /// are run within a new function pass executor, instead of being appended to
+  /// the executor of previously added function passes.
+  void beginFunctionPipeline();
+
   //===--------------------------------------------------------------------===//
   // Instrumentations
   //===--------------------------------------------------------------------===//
@@ -94,19 +131,30 @@ public:
   /// * 'printModuleScope' signals if the module IR should be printed, even for
   ///   non module passes.
   /// * 'out' corresponds to the stream to output the printed IR to.
-  void enableIRPrinting(std::function<bool(Pass *)> shouldPrintBeforePass,
+  /// * 'options' provides additional filtering and output configuration.
+  /// Returns failure, and emits an error, if the function filter isn't a valid
+  /// regular expression or the output directory can't be created.
+  LogicalResult enableIRPrinting(std::function<bool(Pass *)> shouldPrintBeforePass,
                         std::function<bool(Pass *)> shouldPrintAfterPass,
-                        bool printModuleScope, raw_ostream &out);
+                        bool printModuleScope, raw_ostream &out,
+                        const IRPrintingOptions &options = {});
 
   /// Add an instrumentation to time the execution of passes and the computation
   /// of analyses.
   /// Note: Timing should be enabled after all other instrumentations to avoid
   /// any potential "ghost" timing from other instrumentations being
-  /// unintentionally included in the timing results.
+  /// unintentionally included in the timing results. If
+  /// 'collectPatternStatistics' is true, statistics about the rewrite patterns
+  /// applied by each pass are collected and printed after the timing results.
   void enableTiming(
-      PassTimingDisplayMode displayMode = PassTimingDisplayMode::Pipeline);
+      PassTimingDisplayMode displayMode = PassTimingDisplayMode::Pipeline,
+      bool collectPatternStatistics = false);
 
 private:
+  /// Run the pipeline on the given module within a crash recovery context,
+  /// generating a reproducer on failure.
+  LogicalResult runWithCrashRecovery(Module *module);
+
   /// A stack of nested pass executors on sub-module IR units, e.g. function.
   llvm::SmallVector<detail::PassExecutor *, 1> nestedExecutorStack;
 
@@ -121,6 +169,9 @@ private:
 
   /// A manager for pass instrumentations.
   std::unique_ptr<PassInstrumentor> instrumentor;
+
+  /// An optional filename to use when generating a crash reproducer if valid.
+  std::string crashReproducerFileName;
 };
 
 /// Register a set of useful command-line options that can be used to configure
@@ -129,8 +180,9 @@ private:
 void registerPassManagerCLOptions();
 
 /// Apply any values provided to the pass manager options that were registered
-/// with 'registerPassManagerOptions'.
-void applyPassManagerCLOptions(PassManager &pm);
+/// with 'registerPassManagerOptions'. Returns failure, and emits an error, if
+/// the values are invalid.
+LogicalResult applyPassManagerCLOptions(PassManager &pm);
 } // end namespace mlir
 
 #endif // MLIR_PASS_PASSMANAGER_H
@@ -24,6 +24,10 @@
 #define MLIR_PASS_PASSREGISTRY_H_
 
 #include "mlir/Support/LLVM.h"
+#include "mlir/Support/LogicalResult.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Compiler.h"
@@ -33,11 +37,124 @@ namespace mlir {
 class Pass;
 class PassManager;
 
+/// This class represents the set of options provided to a specific instance of
+/// a pass within a textual pass pipeline, e.g. 'fast-mem-space=2' in
+/// 'loop-fusion{fast-mem-space=2}'. Options are provided as a space separated
+/// list of 'key=value' pairs, or just 'key' for boolean flags. Values may be
+/// quoted, e.g. 'key="a value"', with '\' escaping '"' and '\' within the
+/// quotes. Passes query their options when allocated, and any errors, e.g.
+/// unknown keys or values that fail to parse, are reported after allocation.
+class PassOptions {
+public:
+  PassOptions() = default;
+
+  /// Parse a set of options from the given string. Returns failure, and emits
+  /// an error to 'errorStream', if the options string is malformed.
+  static LogicalResult parse(StringRef options, PassOptions &result,
+                             raw_ostream &errorStream);
+
+  /// Returns true if no options were provided.
+  bool empty() const { return options.empty(); }
+
+  /// Print the provided options in the form accepted by 'parse', quoting the
+  /// values where needed. Options are sorted by key so that the output is
+  /// deterministic.
+  void print(raw_ostream &os) const;
+
+  /// Set 'value' to the value of the option with the given key if it was
+  /// provided. Supported value types are bool, integers, double, std::string,
+  /// and llvm::Optional of those.
+  template <typename T> void getOption(StringRef key, T &value) const {
+    if (const std::string *rawValue = lookup(key))
+      if (!parseValue(*rawValue, value))
+        recordError(key, *rawValue);
+  }
+  template <typename T>
+  void getOption(StringRef key, llvm::Optional<T> &value) const {
+    if (const std::string *rawValue = lookup(key)) {
+      T result;
+      if (parseValue(*rawValue, result))
+        value = result;
+      else
+        recordError(key, *rawValue);
+    }
+  }
+
+  /// Set 'value' to the enumerator that 'names' maps the value of the option
+  /// with the given key to, if it was provided, e.g. 'mode=sibling'.
+  template <typename T>
+  void getEnumOption(StringRef key, T &value,
+                     ArrayRef<std::pair<StringRef, T>> names) const {
+    const std::string *rawValue = lookup(key);
+    if (!rawValue)
+      return;
+    for (auto &name : names) {
+      if (name.first == *rawValue) {
+        value = name.second;
+        return;
+      }
+    }
+    recordError(key, *rawValue);
+  }
+
+  /// Set 'values' to the comma separated list of values of the option with
+  /// the given key if it was provided, e.g. 'tile-sizes=32,32'.
+  template <typename T>
+  void getListOption(StringRef key, SmallVectorImpl<T> &values) const {
+    const std::string *rawValue = lookup(key);
+    if (!rawValue)
+      return;
+    SmallVector<StringRef, 4> elements;
+    StringRef(*rawValue).split(elements, ',', /*MaxSplit=*/-1,
+                               /*KeepEmpty=*/false);
+    values.clear();
+    for (StringRef element : elements) {
+      T result;
+      if (!parseValue(element.trim(), result))
+        return recordError(key, *rawValue);
+      values.push_back(result);
+    }
+  }
+
+  /// Verify that all of the provided options were queried by the pass and
+  /// successfully parsed. Returns failure, and emits an error to
+  /// 'errorStream', otherwise.
+  LogicalResult verify(StringRef passArg, raw_ostream &errorStream) const;
+
+private:
+  /// Returns the raw value of the option with the given key, or null if the
+  /// option wasn't provided. This marks the option as used.
+  const std::string *lookup(StringRef key) const;
+
+  /// Record a failure to parse the value of the given option.
+  void recordError(StringRef key, StringRef value) const;
+
+  /// Utilities to parse an option value.
+  static bool parseValue(StringRef rawValue, bool &value);
+  static bool parseValue(StringRef rawValue, double &value);
+  static bool parseValue(StringRef rawValue, std::string &value);
+  template <typename T>
+  static typename std::enable_if<std::is_integral<T>::value, bool>::type
+  parseValue(StringRef rawValue, T &value) {
+    return !rawValue.getAsInteger(/*Radix=*/0, value);
+  }
+
+  /// The raw values of the provided options, and if they have been used.
+  mutable llvm::StringMap<std::pair<std::string, bool>> options;
+
+  /// The options whose values failed to parse.
+  mutable SmallVector<std::pair<std::string, std::string>, 1> invalidOptions;
+};
+
 /// A registry function that adds passes to the given pass manager.
 using PassRegistryFunction = std::function<void(PassManager &)>;
 
 using PassAllocatorFunction = std::function<Pass *()>;
 
+/// A pass allocator function that configures the allocated pass from a set of
+/// textual pass options.
+using PassOptionsAllocatorFunction = std::function<Pass *(const PassOptions &)>;
+
 /// A special type used by transformation passes to provide an address that can
 /// act as a unique identifier during pass registration.
 struct alignas(8) PassID {
@@ -95,11 +212,19 @@ public:
   /// PassInfo constructor should not be invoked directly, instead use
   /// PassRegistration or registerPass.
   PassInfo(StringRef arg, StringRef description, const PassID *passID,
-           PassAllocatorFunction allocator);
+           PassOptionsAllocatorFunction allocator);
+
+  /// Create a new instance of this pass configured with the given options.
+  /// Returns null, and emits an error to 'errorStream', if the options are
+  /// invalid for this pass.
+  Pass *createPass(const PassOptions &options, raw_ostream &errorStream) const;
 
 private:
   // Unique identifier for pass.
   const PassID *passID;
+
+  // Function to allocate a new instance of this pass.
+  PassOptionsAllocatorFunction allocator;
 };
 
 /// Register a specific dialect pipeline registry function with the system,
@@ -111,6 +236,8 @@ void registerPassPipeline(StringRef arg, StringRef description,
 /// typically used through the PassRegistration template.
 void registerPass(StringRef arg, StringRef description, const PassID *passID,
                   const PassAllocatorFunction &function);
+void registerPass(StringRef arg, StringRef description, const PassID *passID,
+                  const PassOptionsAllocatorFunction &function);
 
 /// PassRegistration provides a global initializer that registers a Pass
 /// allocation routine for a concrete pass instance.
@@ -119,11 +246,25 @@ void registerPass(StringRef arg, StringRef description, const PassID *passID,
 ///
 ///   // At namespace scope.
 ///   static PassRegistration<MyPass> Unused("unused", "Unused pass");
+///
+/// Passes that accept per-instance options within a textual pass pipeline
+/// provide an allocator that configures the pass from a PassOptions instance:
+///
+///   static PassRegistration<MyPass> Unused(
+///       "unused", "Unused pass", [](const PassOptions &options) {
+///         auto *pass = new MyPass();
+///         options.getOption("my-option", pass->myOption);
+///         return pass;
+///       });
 template <typename ConcretePass> struct PassRegistration {
   PassRegistration(StringRef arg, StringRef description) {
     registerPass(arg, description, PassID::getID<ConcretePass>(),
                  [] { return new ConcretePass(); });
   }
+  PassRegistration(StringRef arg, StringRef description,
+                   const PassOptionsAllocatorFunction &allocator) {
+    registerPass(arg, description, PassID::getID<ConcretePass>(), allocator);
+  }
 };
 
 /// PassPipelineRegistration provides a global initializer that registers a Pass
@@ -152,6 +293,24 @@ struct PassPipelineRegistration {
                            PassAllocatorFunction allocator);
 };
 
+/// Parse the given textual pass pipeline and add the passes to the given pass
+/// manager. Returns failure, and emits an error to 'errorStream', if the
+/// pipeline is malformed. The pipeline has the following grammar:
+///
+///   pipeline         ::= pipeline-element (`,` pipeline-element)*
+///   pipeline-element ::= `module` `(` pipeline `)`
+///                      | `func` `(` pipeline `)`
+///                      | pass-name (`{` pass-options `}`)?
+///   pass-options     ::= (option-key (`=` option-value)?)*
+///
+/// Passes within a `func` scope are run on each function within a single
+/// function pipeline, and must be function passes. Function passes at module
+/// scope are nested implicitly, as with PassManager::addPass. For example:
+///
+///   module(func(canonicalize,cse),loop-fusion{fast-mem-space=2})
+LogicalResult parsePassPipeline(StringRef pipeline, PassManager &pm,
+                                raw_ostream &errorStream);
+
 /// Adds command line option for each registered pass.
 struct PassNameParser : public llvm::cl::parser<const PassRegistryEntry *> {
   PassNameParser(llvm::cl::Option &opt);
@@ -23,6 +23,7 @@
 #define MLIR_TRANSFORMS_DIALECTCONVERSION_H_
 
 #include "mlir/IR/PatternMatch.h"
+#include "mlir/IR/TypeConversionCache.h"
 #include "mlir/Support/LLVM.h"
 #include "mlir/Support/LogicalResult.h"
 
@@ -39,7 +40,7 @@ class Value;
 // Private implementation class.
 namespace impl {
 class FunctionConversion;
-}
+} // end namespace impl
 
 /// Base class for the dialect op conversion patterns.  Specific conversions
 /// must derive this class and implement least one of `rewrite` and
@@ -136,22 +137,39 @@ template <typename Arg> struct ConversionListBuilder<Arg> {
 /// The module conversion proceeds as follows.
 /// 1. Call `initConverters` to obtain a set of conversions to apply, given the
 ///    current MLIR context.
-/// 2. For each function in the module do the following.
-//    a. Create a new function with the same name and convert its signature
-//    using `convertType`.
-//    b. For each block in the function, create a block in the function with
-//    its arguments converted using `convertType`.
+/// 2. For each function in the module, convert it in place as follows.
+//    a. Convert its signature using `convertFunctionSignatureType`.
+//    b. For each block whose argument types change under `convertType`, append
+//    arguments of the converted types after the original ones.
 //    c. Traverse blocks in DFS-preorder of successors starting from the entry
 //    block (if any), and convert individual operations as follows.  Pattern
 //    match against the list of conversions.  On the first match, call
 //    `rewriteTerminator` for terminator operations with successors and
-//    `rewrite` for other operations, and advance to the next iteration.  If no
-//    match is found, replicate the operation as is.  Note that if two patterns
-//    match the same operation, it is undefined which of them will be applied.
-/// 3. Update all attributes of function type to point to the new functions.
-/// 4. Replace old functions with new functions in the module.
+//    `rewrite` for other operations, inserting the new operations before the
+//    original one, and advance to the next iteration.  If no match is found,
+//    keep the operation and update its operands to the converted values.  Note
+//    that if two patterns match the same operation, it is undefined which of
+//    them will be applied.
+/// 3. Once all functions are converted, erase the replaced operations and the
+///    original block arguments.
+/// 4. Sort the functions that were added to the module by the patterns, e.g.
+///    declarations of runtime functions, by name.
 /// If any error happend during the conversion, the pass fails as soon as
-/// possible.
+/// possible and all functions are restored to their original state.
+///
+/// Only the operations matched by a pattern are rewritten, and the replaced
+/// operations are kept until the conversion is committed.  Patterns may thus
+/// inspect the original operands of the operation being converted, but must
+/// only create operations at the provided insertion point.
+///
+/// If multi-threading is enabled, the functions are converted concurrently.
+/// The conversion hooks and patterns must then be thread-safe: they may only
+/// modify the function being converted, and must synchronize any access to
+/// shared state, e.g. the module when inserting function declarations.
+///
+/// The types converted by `convertType` are cached for the duration of the
+/// conversion, so `convertType` is called at most once per type in the absence
+/// of concurrent calls.  It must thus be a pure function of its argument.
 ///
 /// If the conversion fails, the module is not modified.
 class DialectConversion {
@@ -164,6 +182,16 @@ public:
   LLVM_NODISCARD
   LogicalResult convert(Module *m);
 
+  /// Enable or disable the concurrent conversion of functions.  This has no
+  /// effect if LLVM was built without thread support.
+  void enableMultithreading(bool enable = true) { multithreaded = enable; }
+
+  /// Returns the cache of the types converted by `convertType` during the last
+  /// run of the converter.
+  const TypeConversionCache &getTypeConversionCache() const {
+    return typeCache;
+  }
+
 protected:
   /// Derived classes must implement this hook to produce a set of conversion
   /// patterns to apply.  They may use `mlirContext` to obtain registered
@@ -204,6 +232,18 @@ protected:
   virtual FunctionType convertFunctionSignatureType(
       FunctionType t, ArrayRef<NamedAttributeList> argAttrs,
       SmallVectorImpl<NamedAttributeList> &convertedArgAttrs);
+
+private:
+  /// Returns the conversion of `t` by `convertType`, looking it up in the type
+  /// conversion cache first.
+  Type lookupOrConvertType(Type t);
+
+  /// Flag that specifies if the functions are converted concurrently.
+  bool multithreaded = false;
+
+  /// Cache of the types converted by `convertType`, shared between the
+  /// functions being converted.
+  TypeConversionCache typeCache;
 };
 
 } // end namespace mlir
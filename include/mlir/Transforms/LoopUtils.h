@@ -32,6 +32,7 @@ class AffineMap;
 class AffineForOp;
 class Function;
 class FuncBuilder;
+struct LoopReduction;
 class Value;
 
 /// Unrolls this for operation completely if the trip count is known to be
@@ -91,10 +92,13 @@ LogicalResult instBodySkew(AffineForOp forOp, ArrayRef<uint64_t> shifts,
                            bool unrollPrologueEpilogue = false);
 
 /// Tiles the specified band of perfectly nested loops creating tile-space loops
-/// and intra-tile loops. A band is a contiguous set of loops.
+/// and intra-tile loops. A band is a contiguous set of loops. If 'tiledNest' is
+/// provided, it is set to the tile-space loops followed by the intra-tile
+/// loops, outermost first.
 LLVM_NODISCARD
 LogicalResult tileCodeGen(MutableArrayRef<AffineForOp> band,
-                          ArrayRef<unsigned> tileSizes);
+                          ArrayRef<unsigned> tileSizes,
+                          SmallVectorImpl<AffineForOp> *tiledNest = nullptr);
 
 /// Performs loop interchange on 'forOpA' and 'forOpB'. Requires that 'forOpA'
 /// and 'forOpB' are part of a perfectly nested sequence of loops.
@@ -121,6 +125,21 @@ SmallVector<SmallVector<AffineForOp, 8>, 8> tile(ArrayRef<AffineForOp> forOps,
 SmallVector<AffineForOp, 8> tile(ArrayRef<AffineForOp> forOps,
                                  ArrayRef<uint64_t> sizes, AffineForOp target);
 
+/// Privatizes the accumulators of 'reductions', which are carried by 'forOp',
+/// into 'numPartials' partial accumulators initialized with the identity of
+/// each reduction. 'forOp' is strip-mined by 'numPartials' and its body moved
+/// into an inner loop over the partial accumulators, which is parallel when
+/// 'forOp' is parallel but for 'reductions'. The partial results are combined
+/// into the original accumulators after the loop, and the iterations left over
+/// when the trip count isn't a multiple of 'numPartials' run in a cleanup loop
+/// after the combination. Sets 'partialLoop' to the inner loop if provided.
+/// The loads and stores of the accumulators in 'reductions' are erased. The
+/// reductions are reassociated, so the floating point ones round differently.
+LogicalResult parallelizeReductions(AffineForOp forOp,
+                                    ArrayRef<LoopReduction> reductions,
+                                    unsigned numPartials,
+                                    AffineForOp *partialLoop = nullptr);
+
 } // end namespace mlir
 
 #endif // MLIR_TRANSFORMS_LOOP_UTILS_H
@@ -39,12 +39,28 @@ class ModulePassBase;
 /// opportunties exposed by constant folding, for the general cases.
 FunctionPassBase *createTestConstantFoldPass();
 
+/// Creates a pass that signals a failure on any function with a 'test.fail'
+/// attribute. This is intended to be used for testing the handling of pass
+/// failures.
+FunctionPassBase *createTestPassFailurePass();
+
+/// Creates a pass that canonicalizes the operations with a 'test.root'
+/// attribute, and the operations affected by their rewrites, without scanning
+/// the whole function. This is intended to be used for testing the root-seeded
+/// greedy pattern rewrite driver.
+FunctionPassBase *createTestCanonicalizeRootsPass();
+
 /// Creates an instance of the Canonicalizer pass.
 FunctionPassBase *createCanonicalizerPass();
 
 /// Creates a pass to perform common sub expression elimination.
 FunctionPassBase *createCSEPass();
 
+/// Creates a pass to perform global value numbering, which eliminates the
+/// operations computing the same value modulo the order of commutative operands
+/// and the composition of affine.apply operations.
+FunctionPassBase *createGVNPass();
+
 /// Creates a pass to vectorize loops, operations and data types using a
 /// target-independent, n-D super-vector abstraction.
 FunctionPassBase *
@@ -84,12 +100,19 @@ FunctionPassBase *createLoopFusionPass(unsigned fastMemorySpace = 0,
                                        bool maximalFusion = false);
 
 /// Creates a loop invariant code motion pass that hoists loop invariant
-/// instructions out of the loop.
+/// instructions, including loads from memref's not written in the loop, out of
+/// the loop, and unswitches loops on loop invariant 'affine.if' conditions.
 FunctionPassBase *createLoopInvariantCodeMotionPass();
 
 /// Creates a pass to pipeline explicit movement of data across levels of the
-/// memory hierarchy.
-FunctionPassBase *createPipelineDataTransferPass();
+/// memory hierarchy. Each pipelined DMA cycles through 'numBuffers' buffers;
+/// if zero, the number is picked so that the buffers fit in
+/// 'fastMemCapacityBytes'. If 'pipelineComputeStages' is set, the top-level
+/// loop nests of the loop body are pipelined with respect to each other as
+/// well.
+FunctionPassBase *createPipelineDataTransferPass(
+    unsigned numBuffers = 2, bool pipelineComputeStages = false,
+    uint64_t fastMemCapacityBytes = std::numeric_limits<uint64_t>::max());
 
 /// Lowers affine control flow operations (ForStmt, IfStmt and AffineApplyOp)
 /// to equivalent lower-level constructs (flow of basic blocks and arithmetic
@@ -111,7 +134,9 @@ FunctionPassBase *createLowerVectorTransfersPass();
 
 /// Creates a pass to perform optimizations relying on memref dataflow such as
 /// store to load forwarding, elimination of dead stores, and dead allocs.
-FunctionPassBase *createMemRefDataFlowOptPass();
+/// Innermost loops reusing memref elements across iterations are unrolled by
+/// 'unrollFactor' to replace these accesses as well.
+FunctionPassBase *createMemRefDataFlowOptPass(unsigned unrollFactor = 1);
 
 /// Creates a pass to strip debug information from a function.
 FunctionPassBase *createStripDebugInfoPass();
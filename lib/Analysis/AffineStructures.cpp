@@ -21,6 +21,7 @@
 
 #include "mlir/Analysis/AffineStructures.h"
 #include "mlir/AffineOps/AffineOps.h"
+#include "mlir/Analysis/Simplex.h"
 #include "mlir/IR/AffineExprVisitor.h"
 #include "mlir/IR/AffineMap.h"
 #include "mlir/IR/IntegerSet.h"
@@ -299,12 +300,9 @@ FlatAffineConstraints::FlatAffineConstraints(
   equalities.reserve(numReservedEqualities * numReservedCols);
   inequalities.reserve(numReservedInequalities * numReservedCols);
 
-  for (unsigned r = 0, e = other.getNumInequalities(); r < e; r++) {
-    addInequality(other.getInequality(r));
-  }
-  for (unsigned r = 0, e = other.getNumEqualities(); r < e; r++) {
-    addEquality(other.getEquality(r));
-  }
+  // The buffers share the same layout; copy them wholesale.
+  equalities.append(other.equalities.begin(), other.equalities.end());
+  inequalities.append(other.inequalities.begin(), other.inequalities.end());
 }
 
 // Clones this object.
@@ -409,6 +407,25 @@ void FlatAffineConstraints::addSymbolId(unsigned pos, Value *id) {
   addId(IdKind::Symbol, pos, id);
 }
 
+/// Inserts a zero column at 'pos' in the rows stored in 'buffer' with a stride
+/// of 'oldStride', storing the result with a stride of 'newStride'. The rows
+/// are moved starting from the last one, so that the rows and the columns that
+/// haven't been moved yet are never overwritten.
+static void insertColumn(SmallVectorImpl<int64_t> &buffer, unsigned oldStride,
+                         unsigned newStride, unsigned numCols, unsigned pos) {
+  unsigned numRows = buffer.size() / oldStride;
+  if (newStride != oldStride)
+    buffer.resize(numRows * newStride);
+  for (unsigned r = numRows; r-- > 0;) {
+    int64_t *src = buffer.data() + r * oldStride;
+    int64_t *dst = buffer.data() + r * newStride;
+    std::copy_backward(src + pos, src + numCols, dst + numCols + 1);
+    dst[pos] = 0;
+    if (dst != src)
+      std::copy_backward(src, src + pos, dst + pos);
+  }
+}
+
 /// Adds a dimensional identifier. The added column is initialized to
 /// zero.
 void FlatAffineConstraints::addId(IdKind kind, unsigned pos, Value *id) {
@@ -420,15 +437,6 @@ void FlatAffineConstraints::addId(IdKind kind, unsigned pos, Value *id) {
     assert(pos <= getNumLocalIds());
   }
 
-  unsigned oldNumReservedCols = numReservedCols;
-
-  // Check if a resize is necessary.
-  if (getNumCols() + 1 > numReservedCols) {
-    equalities.resize(getNumEqualities() * (getNumCols() + 1));
-    inequalities.resize(getNumInequalities() * (getNumCols() + 1));
-    numReservedCols++;
-  }
-
   unsigned absolutePos;
 
   if (kind == IdKind::Dimension) {
@@ -440,37 +448,20 @@ void FlatAffineConstraints::addId(IdKind kind, unsigned pos, Value *id) {
   } else {
     absolutePos = pos + getNumDimIds() + getNumSymbolIds();
   }
-  numIds++;
 
-  // Note that getNumCols() now will already return the new size, which will be
-  // at least one.
-  int numInequalities = static_cast<int>(getNumInequalities());
-  int numEqualities = static_cast<int>(getNumEqualities());
-  int numCols = static_cast<int>(getNumCols());
-  for (int r = numInequalities - 1; r >= 0; r--) {
-    for (int c = numCols - 2; c >= 0; c--) {
-      if (c < absolutePos)
-        atIneq(r, c) = inequalities[r * oldNumReservedCols + c];
-      else
-        atIneq(r, c + 1) = inequalities[r * oldNumReservedCols + c];
-    }
-    atIneq(r, absolutePos) = 0;
-  }
-
-  for (int r = numEqualities - 1; r >= 0; r--) {
-    for (int c = numCols - 2; c >= 0; c--) {
-      // All values in column absolutePositions < absolutePos have the same
-      // coordinates in the 2-d view of the coefficient buffer.
-      if (c < absolutePos)
-        atEq(r, c) = equalities[r * oldNumReservedCols + c];
-      else
-        // Those at absolutePosition >= absolutePos, get a shifted
-        // absolutePosition.
-        atEq(r, c + 1) = equalities[r * oldNumReservedCols + c];
-    }
-    // Initialize added dimension to zero.
-    atEq(r, absolutePos) = 0;
-  }
+  // Insert the column in every row. The rows are only spread out when the
+  // reserved columns are exhausted; the number of reserved columns then grows
+  // geometrically so that adding ids one at a time stays cheap.
+  unsigned oldNumCols = getNumCols();
+  unsigned oldNumReservedCols = numReservedCols;
+  if (oldNumCols + 1 > numReservedCols)
+    numReservedCols = std::max(oldNumCols + 1,
+                               oldNumReservedCols + oldNumReservedCols / 2);
+  insertColumn(equalities, oldNumReservedCols, numReservedCols, oldNumCols,
+               absolutePos);
+  insertColumn(inequalities, oldNumReservedCols, numReservedCols, oldNumCols,
+               absolutePos);
+  numIds++;
 
   // If an 'id' is provided, insert it; otherwise use None.
   if (id) {
@@ -812,20 +803,16 @@ findConstraintWithNonZeroAt(const FlatAffineConstraints &constraints,
 template <bool isEq>
 static void normalizeConstraintByGCD(FlatAffineConstraints *constraints,
                                      unsigned rowIdx) {
-  auto at = [&](unsigned colIdx) -> int64_t {
-    return isEq ? constraints->atEq(rowIdx, colIdx)
-                : constraints->atIneq(rowIdx, colIdx);
-  };
-  uint64_t gcd = std::abs(at(0));
-  for (unsigned j = 1, e = constraints->getNumCols(); j < e; ++j) {
-    gcd = llvm::GreatestCommonDivisor64(gcd, std::abs(at(j)));
-  }
-  if (gcd > 0 && gcd != 1) {
-    for (unsigned j = 0, e = constraints->getNumCols(); j < e; ++j) {
-      int64_t v = at(j) / static_cast<int64_t>(gcd);
-      isEq ? constraints->atEq(rowIdx, j) = v
-           : constraints->atIneq(rowIdx, j) = v;
-    }
+  int64_t *row = isEq ? &constraints->atEq(rowIdx, 0)
+                      : &constraints->atIneq(rowIdx, 0);
+  unsigned numCols = constraints->getNumCols();
+  uint64_t gcd = 0;
+  for (unsigned j = 0; j < numCols && gcd != 1; ++j)
+    gcd = llvm::GreatestCommonDivisor64(gcd, std::abs(row[j]));
+  if (gcd > 1) {
+    int64_t divisor = static_cast<int64_t>(gcd);
+    for (unsigned j = 0; j < numCols; ++j)
+      row[j] /= divisor;
   }
 }
 
@@ -897,28 +884,31 @@ static void eliminateFromConstraint(FlatAffineConstraints *constraints,
   // Skip if equality 'rowIdx' if same as 'pivotRow'.
   if (isEq && rowIdx == pivotRow)
     return;
-  auto at = [&](unsigned i, unsigned j) -> int64_t {
-    return isEq ? constraints->atEq(i, j) : constraints->atIneq(i, j);
-  };
-  int64_t leadCoeff = at(rowIdx, pivotCol);
+  int64_t *row = isEq ? &constraints->atEq(rowIdx, 0)
+                      : &constraints->atIneq(rowIdx, 0);
+  const int64_t *pivot = &constraints->atEq(pivotRow, 0);
+  int64_t leadCoeff = row[pivotCol];
   // Skip if leading coefficient at 'rowIdx' is already zero.
   if (leadCoeff == 0)
     return;
-  int64_t pivotCoeff = constraints->atEq(pivotRow, pivotCol);
+  int64_t pivotCoeff = pivot[pivotCol];
   int64_t sign = (leadCoeff * pivotCoeff > 0) ? -1 : 1;
   int64_t lcm = mlir::lcm(pivotCoeff, leadCoeff);
   int64_t pivotMultiplier = sign * (lcm / std::abs(pivotCoeff));
   int64_t rowMultiplier = lcm / std::abs(leadCoeff);
 
+  // Update the columns on both sides of the range that was just eliminated
+  // with straight-line loops over the contiguous rows.
+  auto combine = [&](unsigned begin, unsigned end) {
+    for (unsigned j = begin; j < end; ++j)
+      row[j] = pivotMultiplier * pivot[j] + rowMultiplier * row[j];
+  };
   unsigned numCols = constraints->getNumCols();
-  for (unsigned j = 0; j < numCols; ++j) {
-    // Skip updating column 'j' if it was just eliminated.
-    if (j >= elimColStart && j < pivotCol)
-      continue;
-    int64_t v = pivotMultiplier * constraints->atEq(pivotRow, j) +
-                rowMultiplier * at(rowIdx, j);
-    isEq ? constraints->atEq(rowIdx, j) = v
-         : constraints->atIneq(rowIdx, j) = v;
+  if (elimColStart < pivotCol) {
+    combine(0, elimColStart);
+    combine(pivotCol, numCols);
+  } else {
+    combine(0, numCols);
   }
 }
 
@@ -935,15 +925,10 @@ static void shiftColumnsToLeft(FlatAffineConstraints *constraints,
   unsigned numCols = constraints->getNumCols();
   unsigned numRows = isEq ? constraints->getNumEqualities()
                           : constraints->getNumInequalities();
-  unsigned numToEliminate = colLimit - colStart;
   for (unsigned r = 0, e = numRows; r < e; ++r) {
-    for (unsigned c = colLimit; c < numCols; ++c) {
-      if (isEq) {
-        constraints->atEq(r, c - numToEliminate) = constraints->atEq(r, c);
-      } else {
-        constraints->atIneq(r, c - numToEliminate) = constraints->atIneq(r, c);
-      }
-    }
+    int64_t *row =
+        isEq ? &constraints->atEq(r, 0) : &constraints->atIneq(r, 0);
+    std::copy(row + colLimit, row + numCols, row + colStart);
   }
 }
 
@@ -1024,14 +1009,42 @@ static unsigned getBestIdToEliminate(const FlatAffineConstraints &cst,
   return minLoc;
 }
 
-// Checks for emptiness of the set by eliminating identifiers successively and
-// using the GCD test (on all equality constraints) and checking for trivially
-// invalid constraints. Returns 'true' if the constraint system is found to be
-// empty; false otherwise.
+/// Returns a simplex tableau for the constraints of `cst`.  The equalities are
+/// added first, as two constraints each, followed by the inequalities.
+static Simplex getSimplex(const FlatAffineConstraints &cst) {
+  Simplex simplex(cst.getNumIds());
+  for (unsigned r = 0, e = cst.getNumEqualities(); r < e; r++)
+    simplex.addEquality(cst.getEquality(r));
+  for (unsigned r = 0, e = cst.getNumInequalities(); r < e; r++)
+    simplex.addInequality(cst.getInequality(r));
+  return simplex;
+}
+
+// Checks for emptiness of the set by using the GCD test (on all equality
+// constraints), checking for trivially invalid constraints, and searching for
+// an integer point with a simplex. Returns 'true' if the constraint system is
+// found to be empty; false otherwise.
 bool FlatAffineConstraints::isEmpty() const {
   if (isEmptyByGCDTest() || hasInvalidConstraint())
     return true;
 
+  Simplex simplex = getSimplex(*this);
+  if (simplex.isEmpty() && !simplex.hasOverflowed())
+    return true;
+  if (!simplex.isEmpty()) {
+    auto result = simplex.findIntegerSample(kMaxBranchAndBoundNodes);
+    if (!simplex.hasOverflowed() && result != Simplex::IntegerResult::Unknown)
+      return result == Simplex::IntegerResult::Infeasible;
+  }
+  LLVM_DEBUG(llvm::dbgs() << "Simplex inconclusive, using Fourier-Motzkin\n");
+  return isEmptyByFourierMotzkin();
+}
+
+// Checks for emptiness of the set by eliminating identifiers successively and
+// using the GCD test (on all equality constraints) and checking for trivially
+// invalid constraints. Returns 'true' if the constraint system is found to be
+// empty; false otherwise.
+bool FlatAffineConstraints::isEmptyByFourierMotzkin() const {
   // First, eliminate as many identifiers as possible using Gaussian
   // elimination.
   FlatAffineConstraints tmpCst(*this);
@@ -1363,21 +1376,45 @@ bool detectAsFloorDiv(const FlatAffineConstraints &cst, unsigned pos,
 // Fills an inequality row with the value 'val'.
 static inline void fillInequality(FlatAffineConstraints *cst, unsigned r,
                                   int64_t val) {
-  for (unsigned c = 0, f = cst->getNumCols(); c < f; c++) {
-    cst->atIneq(r, c) = val;
-  }
+  int64_t *row = &cst->atIneq(r, 0);
+  std::fill(row, row + cst->getNumCols(), val);
 }
 
 // Negates an inequality.
 static inline void negateInequality(FlatAffineConstraints *cst, unsigned r) {
-  for (unsigned c = 0, f = cst->getNumCols(); c < f; c++) {
-    cst->atIneq(r, c) = -cst->atIneq(r, c);
-  }
+  int64_t *row = &cst->atIneq(r, 0);
+  for (unsigned c = 0, f = cst->getNumCols(); c < f; c++)
+    row[c] = -row[c];
 }
 
-// A more complex check to eliminate redundant inequalities. Uses FourierMotzkin
-// to check if a constraint is redundant.
+// A more complex check to eliminate redundant inequalities. Uses a simplex to
+// check if a constraint is redundant.
 void FlatAffineConstraints::removeRedundantInequalities() {
+  Simplex simplex = getSimplex(*this);
+  if (simplex.isEmpty() || simplex.hasOverflowed())
+    return removeRedundantInequalitiesByFourierMotzkin();
+  simplex.detectRedundant();
+  if (simplex.hasOverflowed())
+    return removeRedundantInequalitiesByFourierMotzkin();
+
+  // Scan to get rid of all rows marked redundant, in-place.  The inequalities
+  // follow the two constraints of each equality in the simplex.
+  unsigned offset = 2 * getNumEqualities();
+  unsigned pos = 0;
+  for (unsigned r = 0, e = getNumInequalities(); r < e; r++) {
+    if (simplex.isMarkedRedundant(offset + r))
+      continue;
+    if (r != pos)
+      for (unsigned c = 0, f = getNumCols(); c < f; c++)
+        atIneq(pos, c) = atIneq(r, c);
+    ++pos;
+  }
+  inequalities.resize(numReservedCols * pos);
+}
+
+// Eliminates the redundant inequalities using FourierMotzkin to check if a
+// constraint is redundant.
+void FlatAffineConstraints::removeRedundantInequalitiesByFourierMotzkin() {
   SmallVector<bool, 32> redun(getNumInequalities(), false);
   // To check if an inequality is redundant, we replace the inequality by its
   // complement (for eg., i - 1 >= 0 by i <= 0), and check if the resulting
@@ -2167,14 +2204,49 @@ FlatAffineConstraints::computeConstantLowerOrUpperBound(unsigned pos) {
   return minOrMaxConst;
 }
 
+/// Computes the constant bound in `direction` of the identifier at `pos` with a
+/// simplex, returning None if it is unbounded.  Sets `conclusive` to false if
+/// the simplex couldn't decide the bound, i.e. if the constraints have no
+/// integer point or if the search for one was cut short.
+static Optional<int64_t>
+computeConstantBoundBySimplex(const FlatAffineConstraints &cst, unsigned pos,
+                              Simplex::Direction direction, bool &conclusive) {
+  conclusive = false;
+  Simplex simplex = getSimplex(cst);
+  if (simplex.isEmpty() || simplex.hasOverflowed())
+    return None;
+
+  SmallVector<int64_t, 8> coeffs(cst.getNumCols(), 0);
+  coeffs[pos] = 1;
+  if (!simplex.computeOptimum(direction, coeffs)) {
+    conclusive = !simplex.hasOverflowed();
+    return None;
+  }
+  auto bound = simplex.computeIntegerOptimum(
+      direction, pos, FlatAffineConstraints::kMaxBranchAndBoundNodes);
+  conclusive = bound.hasValue();
+  return bound;
+}
+
 Optional<int64_t>
 FlatAffineConstraints::getConstantLowerBound(unsigned pos) const {
+  bool conclusive;
+  auto bound = computeConstantBoundBySimplex(*this, pos,
+                                             Simplex::Direction::Down,
+                                             conclusive);
+  if (conclusive)
+    return bound;
   FlatAffineConstraints tmpCst(*this);
   return tmpCst.computeConstantLowerOrUpperBound</*isLower=*/true>(pos);
 }
 
 Optional<int64_t>
 FlatAffineConstraints::getConstantUpperBound(unsigned pos) const {
+  bool conclusive;
+  auto bound = computeConstantBoundBySimplex(*this, pos, Simplex::Direction::Up,
+                                             conclusive);
+  if (conclusive)
+    return bound;
   FlatAffineConstraints tmpCst(*this);
   return tmpCst.computeConstantLowerOrUpperBound</*isLower=*/false>(pos);
 }
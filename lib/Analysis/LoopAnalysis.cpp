@@ -174,6 +174,25 @@ uint64_t mlir::getLargestDivisorOfTripCount(AffineForOp forOp) {
   return gcd.getValue();
 }
 
+bool mlir::isDefinedOutsideOfLoop(Value *value, AffineForOp forOp) {
+  auto *op = value->getDefiningOp();
+  if (!op)
+    op = cast<BlockArgument>(value)->getOwner()->getContainingOp();
+  for (; op; op = op->getParentOp())
+    if (op == forOp.getOperation())
+      return false;
+  return true;
+}
+
+bool mlir::isInnermostLoop(AffineForOp forOp) {
+  bool isInnermost = true;
+  forOp.getBody()->walk([&](Operation *op) {
+    if (op->isa<AffineForOp>())
+      isInnermost = false;
+  });
+  return isInnermost;
+}
+
 bool mlir::isAccessInvariant(Value *iv, Value *index) {
   assert(isForInductionVar(iv) && "iv must be a AffineForOp");
   assert(index->getType().isa<IndexType>() && "index must be of IndexType");
@@ -0,0 +1,190 @@
+//===- MemRefDependenceAnalysis.cpp - Cached memref dependences -----------===//
+//
+// Copyright 2019 The MLIR Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =============================================================================
+//
+// This file implements an analysis that memoizes dependence queries between
+// the memref accesses of a function.
+//
+//===----------------------------------------------------------------------===//
+
+#include "mlir/Analysis/MemRefDependenceAnalysis.h"
+#include "mlir/Analysis/Utils.h"
+#include "mlir/IR/Diagnostics.h"
+#include "mlir/IR/Function.h"
+#include "mlir/StandardOps/Ops.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/Support/Parallel.h"
+
+using namespace mlir;
+
+MemRefDependenceAnalysis::MemRefDependenceAnalysis(Function *function)
+    : context(function->getContext()) {}
+
+unsigned MemRefDependenceAnalysis::NormalizedAccessInfo::getHashValue(
+    const NormalizedAccess *access) {
+  return access->hash;
+}
+
+bool MemRefDependenceAnalysis::NormalizedAccessInfo::isEqual(
+    const NormalizedAccess *lhs, const NormalizedAccess *rhs) {
+  if (lhs == rhs)
+    return true;
+  if (lhs == getTombstoneKey() || lhs == getEmptyKey() ||
+      rhs == getTombstoneKey() || rhs == getEmptyKey())
+    return false;
+  return lhs->hash == rhs->hash && lhs->memref == rhs->memref &&
+         lhs->isStore == rhs->isStore && lhs->map == rhs->map &&
+         lhs->scope == rhs->scope && lhs->operands == rhs->operands;
+}
+
+unsigned MemRefDependenceAnalysis::getAccessId(Operation *op, bool normalize) {
+  if (!normalize) {
+    auto it = opUniqueIds.try_emplace(op, nextAccessId);
+    if (it.second)
+      ++nextAccessId;
+    return it.first->second;
+  }
+
+  auto it = opNormalizedIds.find(op);
+  if (it != opNormalizedIds.end())
+    return it->second;
+
+  // The access map is composed with the affine.apply operations feeding the
+  // indices and canonicalized, so that the accesses that only differ by these
+  // operations are normalized to the same access. The iteration domain of the
+  // access is identified by the innermost loop surrounding it.
+  MemRefAccess memrefAccess(op);
+  AffineValueMap accessMap;
+  memrefAccess.getAccessMap(&accessMap);
+  SmallVector<AffineForOp, 4> loops;
+  getLoopIVs(*op, &loops);
+
+  auto access = llvm::make_unique<NormalizedAccess>();
+  access->memref = memrefAccess.memref;
+  access->isStore = memrefAccess.isStore();
+  access->map = accessMap.getAffineMap();
+  access->operands.assign(accessMap.getOperands().begin(),
+                          accessMap.getOperands().end());
+  access->scope = loops.empty() ? nullptr : loops.back().getOperation();
+  access->hash = llvm::hash_combine(
+      access->memref, access->isStore, access->map, access->scope,
+      llvm::hash_combine_range(access->operands.begin(),
+                               access->operands.end()));
+
+  auto inserted = normalizedIds.try_emplace(access.get(), nextAccessId);
+  if (inserted.second) {
+    normalizedAccesses.push_back(std::move(access));
+    ++nextAccessId;
+  }
+  return opNormalizedIds[op] = inserted.first->second;
+}
+
+MemRefDependenceAnalysis::QueryKey
+MemRefDependenceAnalysis::getQueryKey(Operation *src, Operation *dst,
+                                      unsigned loopDepth, bool allowRAR,
+                                      unsigned numCommonLoops) {
+  // A query at a depth deeper than the common loops depends on the order of
+  // 'src' and 'dst' in their common block (unless read-after-read dependences
+  // are allowed), which is not captured by the normalized accesses.
+  bool normalize = allowRAR || loopDepth <= numCommonLoops;
+  return {{getAccessId(src, normalize), getAccessId(dst, normalize)},
+          loopDepth << 1 | allowRAR};
+}
+
+/// Computes the dependence from 'src' to 'dst' into 'dependence'.
+static void
+computeDependence(Operation *src, Operation *dst, unsigned loopDepth,
+                  bool allowRAR, bool computeComponents,
+                  MemRefDependenceAnalysis::Dependence &dependence) {
+  MemRefAccess srcAccess(src), dstAccess(dst);
+  dependence.components.clear();
+  dependence.exists = checkMemrefAccessDependence(
+      srcAccess, dstAccess, loopDepth, &dependence.constraints,
+      computeComponents ? &dependence.components : nullptr, allowRAR);
+  dependence.hasComponents = computeComponents;
+}
+
+const MemRefDependenceAnalysis::Dependence &
+MemRefDependenceAnalysis::getDependence(Operation *src, Operation *dst,
+                                        unsigned loopDepth, bool allowRAR,
+                                        bool computeComponents) {
+  unsigned numCommonLoops = getNumCommonSurroundingLoops(*src, *dst);
+  auto &dependence = dependences[getQueryKey(src, dst, loopDepth, allowRAR,
+                                             numCommonLoops)];
+  if (!dependence)
+    dependence = llvm::make_unique<Dependence>();
+  else if (dependence->hasComponents || !computeComponents)
+    return *dependence;
+
+  computeDependence(src, dst, loopDepth, allowRAR, computeComponents,
+                    *dependence);
+  return *dependence;
+}
+
+void MemRefDependenceAnalysis::computeDependences(ArrayRef<Operation *> ops,
+                                                  bool allowRAR,
+                                                  bool computeComponents) {
+  // Collect the queries that are not cached yet, once per key. The results
+  // are marked as having their components ahead of time so that a query
+  // isn't collected twice.
+  struct PendingQuery {
+    Operation *src, *dst;
+    unsigned loopDepth;
+    Dependence *dependence;
+  };
+  std::vector<PendingQuery> pending;
+  for (auto *src : ops) {
+    for (auto *dst : ops) {
+      unsigned numCommonLoops = getNumCommonSurroundingLoops(*src, *dst);
+      for (unsigned d = 1; d <= numCommonLoops + 1; ++d) {
+        auto &dependence =
+            dependences[getQueryKey(src, dst, d, allowRAR, numCommonLoops)];
+        if (!dependence)
+          dependence = llvm::make_unique<Dependence>();
+        else if (dependence->hasComponents || !computeComponents)
+          continue;
+        dependence->hasComponents = computeComponents;
+        pending.push_back({src, dst, d, dependence.get()});
+      }
+    }
+  }
+
+  // Compute the queries concurrently. The dependence checks compare the
+  // positions of the operations in their common block, whose order is
+  // recomputed lazily, so it is made valid upfront to keep the threads from
+  // recomputing it concurrently. Building the iteration domains may emit
+  // warnings, which are reported in the order of the queries.
+  if (pending.empty())
+    return;
+  computeInstOrders(ops);
+  ParallelDiagnosticHandler diagHandler(*context);
+  llvm::parallel::for_each_n(
+      llvm::parallel::par, size_t(0), pending.size(), [&](size_t i) {
+        diagHandler.setOrderIDForThread(i);
+        auto &query = pending[i];
+        computeDependence(query.src, query.dst, query.loopDepth, allowRAR,
+                          computeComponents, *query.dependence);
+      });
+}
+
+void MemRefDependenceAnalysis::clear() {
+  dependences.clear();
+  opNormalizedIds.clear();
+  opUniqueIds.clear();
+  normalizedIds.clear();
+  normalizedAccesses.clear();
+  nextAccessId = 0;
+}
@@ -21,6 +21,7 @@
 
 #include "mlir/Analysis/AffineAnalysis.h"
 #include "mlir/Analysis/AffineStructures.h"
+#include "mlir/Analysis/MemRefDependenceAnalysis.h"
 #include "mlir/Analysis/Passes.h"
 #include "mlir/Analysis/Utils.h"
 #include "mlir/IR/Builders.h"
@@ -79,29 +80,30 @@ getDirectionVectorStr(bool ret, unsigned numCommonLoops, unsigned loopNestDepth,
 // "source" access and all subsequent "destination" accesses in
 // 'loadsAndStores'. Emits the result of the dependence check as a note with
 // the source access.
-static void checkDependences(ArrayRef<Operation *> loadsAndStores) {
+static void checkDependences(ArrayRef<Operation *> loadsAndStores,
+                             MemRefDependenceAnalysis &dependences) {
+  // Compute all the dependences upfront, concurrently.
+  dependences.computeDependences(loadsAndStores, /*allowRAR=*/false,
+                                 /*computeComponents=*/true);
   for (unsigned i = 0, e = loadsAndStores.size(); i < e; ++i) {
     auto *srcOpInst = loadsAndStores[i];
-    MemRefAccess srcAccess(srcOpInst);
     for (unsigned j = 0; j < e; ++j) {
       auto *dstOpInst = loadsAndStores[j];
-      MemRefAccess dstAccess(dstOpInst);
 
       unsigned numCommonLoops =
           getNumCommonSurroundingLoops(*srcOpInst, *dstOpInst);
       for (unsigned d = 1; d <= numCommonLoops + 1; ++d) {
-        FlatAffineConstraints dependenceConstraints;
-        llvm::SmallVector<DependenceComponent, 2> dependenceComponents;
-        bool ret = checkMemrefAccessDependence(srcAccess, dstAccess, d,
-                                               &dependenceConstraints,
-                                               &dependenceComponents);
+        auto &dependence = dependences.getDependence(
+            srcOpInst, dstOpInst, d, /*allowRAR=*/false,
+            /*computeComponents=*/true);
         // TODO(andydavis) Print dependence type (i.e. RAW, etc) and print
         // distance vectors as: ([2, 3], [0, 10]). Also, shorten distance
         // vectors from ([1, 1], [3, 3]) to (1, 3).
         srcOpInst->emitNote(
             "dependence from " + Twine(i) + " to " + Twine(j) + " at depth " +
             Twine(d) + " = " +
-            getDirectionVectorStr(ret, numCommonLoops, d, dependenceComponents)
+            getDirectionVectorStr(dependence.exists, numCommonLoops, d,
+                                  dependence.components)
                 .c_str());
       }
     }
@@ -118,7 +120,8 @@ void MemRefDependenceCheck::runOnFunction() {
       loadsAndStores.push_back(op);
   });
 
-  checkDependences(loadsAndStores);
+  checkDependences(loadsAndStores, getAnalysis<MemRefDependenceAnalysis>());
+  markAllAnalysesPreserved();
 }
 
 static PassRegistration<MemRefDependenceCheck>
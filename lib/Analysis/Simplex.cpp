@@ -0,0 +1,483 @@
+//===- Simplex.cpp - Rational simplex for affine constraints --------------===//
+//
+// Copyright 2019 The MLIR Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =============================================================================
+//
+// The tableau follows the classical formulation of the simplex algorithm with
+// unrestricted unknowns, using Bland's rule to choose the pivots: among the
+// candidate pivots, the unknown added first is picked, which guarantees
+// termination.  Rows are stored with a common denominator, which is kept
+// small by dividing the rows by the GCD of their entries.
+//
+//===----------------------------------------------------------------------===//
+
+#include "mlir/Analysis/Simplex.h"
+#include "mlir/Support/MathExtras.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace mlir;
+
+//===----------------------------------------------------------------------===//
+// Fraction
+//===----------------------------------------------------------------------===//
+
+int64_t Fraction::floor() const { return floorDiv(num, den); }
+
+int64_t Fraction::ceil() const { return ceilDiv(num, den); }
+
+//===----------------------------------------------------------------------===//
+// Simplex
+//===----------------------------------------------------------------------===//
+
+/// Returns true if `elem` changes in `direction` when increasing the unknown it
+/// is the coefficient of.
+static bool signMatchesDirection(int64_t elem, Simplex::Direction direction) {
+  assert(elem != 0 && "elem should not be 0");
+  return direction == Simplex::Direction::Up ? elem > 0 : elem < 0;
+}
+
+static Simplex::Direction flippedDirection(Simplex::Direction direction) {
+  return direction == Simplex::Direction::Up ? Simplex::Direction::Down
+                                             : Simplex::Direction::Up;
+}
+
+Simplex::Simplex(unsigned numUnknowns)
+    : nRow(0), nCol(numUnknowns + 2), empty(false), overflowed(false) {
+  // The denominator and constant columns have no unknowns.
+  colUnknown.push_back(0);
+  colUnknown.push_back(0);
+  for (unsigned i = 0; i < numUnknowns; ++i) {
+    var.emplace_back(Orientation::Column, /*restricted=*/false,
+                     /*pos=*/nCol - numUnknowns + i);
+    colUnknown.push_back(~static_cast<int>(i));
+  }
+}
+
+int64_t Simplex::add(int64_t lhs, int64_t rhs) const {
+  int64_t result;
+  if (llvm::AddOverflow(lhs, rhs, result))
+    overflowed = true;
+  return result;
+}
+
+int64_t Simplex::mul(int64_t lhs, int64_t rhs) const {
+  int64_t result;
+  if (llvm::MulOverflow(lhs, rhs, result))
+    overflowed = true;
+  return result;
+}
+
+unsigned Simplex::addRow(ArrayRef<int64_t> coeffs, bool restricted) {
+  assert(coeffs.size() == var.size() + 1 &&
+         "incorrect number of coefficients");
+
+  ++nRow;
+  tableau.resize(nRow * nCol, 0);
+  unsigned row = nRow - 1;
+  rowUnknown.push_back(con.size());
+  con.emplace_back(Orientation::Row, restricted, row);
+
+  at(row, 0) = 1;
+  at(row, 1) = coeffs.back();
+  for (unsigned i = 0, e = var.size(); i < e; ++i) {
+    if (coeffs[i] == 0)
+      continue;
+
+    // A column unknown contributes its coefficient directly.
+    const Unknown &u = var[i];
+    if (u.orientation == Orientation::Column) {
+      at(row, u.pos) = add(at(row, u.pos), mul(coeffs[i], at(row, 0)));
+      continue;
+    }
+
+    // A row unknown contributes its row, brought to a common denominator.
+    int64_t denom = lcm(at(row, 0), at(u.pos, 0));
+    int64_t rowScale = denom / at(row, 0);
+    int64_t varScale = mul(coeffs[i], denom / at(u.pos, 0));
+    at(row, 0) = denom;
+    for (unsigned col = 1; col < nCol; ++col)
+      at(row, col) =
+          add(mul(rowScale, at(row, col)), mul(varScale, at(u.pos, col)));
+  }
+
+  normalizeRow(row);
+  undoLog.push_back(UndoLogEntry::RemoveLastConstraint);
+  return con.size() - 1;
+}
+
+void Simplex::normalizeRow(unsigned row) {
+  uint64_t gcd = 0;
+  for (unsigned col = 0; col < nCol; ++col) {
+    if (gcd == 1)
+      break;
+    gcd = llvm::GreatestCommonDivisor64(gcd, std::abs(at(row, col)));
+  }
+  if (gcd <= 1)
+    return;
+  for (unsigned col = 0; col < nCol; ++col)
+    at(row, col) /= static_cast<int64_t>(gcd);
+}
+
+void Simplex::addInequality(ArrayRef<int64_t> coeffs) {
+  unsigned conIndex = addRow(coeffs, /*restricted=*/true);
+  if (!restoreRow(con[conIndex]))
+    markEmpty();
+}
+
+void Simplex::addEquality(ArrayRef<int64_t> coeffs) {
+  addInequality(coeffs);
+  SmallVector<int64_t, 8> negated;
+  for (int64_t coeff : coeffs)
+    negated.push_back(-coeff);
+  addInequality(negated);
+}
+
+void Simplex::markEmpty() {
+  if (empty)
+    return;
+  undoLog.push_back(UndoLogEntry::UnmarkEmpty);
+  empty = true;
+}
+
+bool Simplex::restoreRow(Unknown &u) {
+  assert(u.orientation == Orientation::Row && "unknown should be in a row");
+  while (at(u.pos, 1) < 0) {
+    auto maybePivot = findPivot(u.pos, Direction::Up);
+    if (!maybePivot)
+      break;
+    pivot(*maybePivot);
+    // An unknown moved to a column has a sample value of zero.
+    if (u.orientation == Orientation::Column)
+      return true;
+  }
+  return at(u.pos, 1) >= 0;
+}
+
+Optional<Simplex::Pivot> Simplex::findPivot(unsigned row,
+                                            Direction direction) const {
+  Optional<unsigned> col;
+  for (unsigned j = 2; j < nCol; ++j) {
+    int64_t elem = at(row, j);
+    if (elem == 0)
+      continue;
+    // A restricted column unknown has a sample value of zero, so it can only
+    // increase.
+    if (unknownFromColumn(j).restricted &&
+        !signMatchesDirection(elem, direction))
+      continue;
+    if (!col || colUnknown[j] < colUnknown[*col])
+      col = j;
+  }
+  if (!col)
+    return None;
+
+  Direction colDirection = at(row, *col) < 0 ? flippedDirection(direction)
+                                             : direction;
+  auto pivotRow = findPivotRow(row, colDirection, *col);
+  return Pivot{pivotRow.hasValue() ? *pivotRow : row, *col};
+}
+
+Optional<unsigned> Simplex::findPivotRow(Optional<unsigned> skipRow,
+                                         Direction direction,
+                                         unsigned col) const {
+  Optional<unsigned> retRow;
+  int64_t retElem = 0, retConst = 0;
+  for (unsigned row = 0; row < nRow; ++row) {
+    if (skipRow && row == *skipRow)
+      continue;
+    int64_t elem = at(row, col);
+    if (elem == 0 || !unknownFromRow(row).restricted)
+      continue;
+    // Rows increasing along with the column never become negative.
+    if (signMatchesDirection(elem, direction))
+      continue;
+    int64_t constTerm = at(row, 1);
+
+    // Pick the row reaching zero first, i.e. the one with the smallest ratio
+    // of its constant term to its coefficient, breaking ties by Bland's rule.
+    if (!retRow) {
+      retRow = row;
+      retElem = elem;
+      retConst = constTerm;
+      continue;
+    }
+    int64_t diff = add(mul(retConst, elem), -mul(constTerm, retElem));
+    if ((diff == 0 && rowUnknown[row] < rowUnknown[*retRow]) ||
+        (diff != 0 && !signMatchesDirection(diff, direction))) {
+      retRow = row;
+      retElem = elem;
+      retConst = constTerm;
+    }
+  }
+  return retRow;
+}
+
+void Simplex::swapRows(unsigned i, unsigned j) {
+  if (i == j)
+    return;
+  for (unsigned col = 0; col < nCol; ++col)
+    std::swap(at(i, col), at(j, col));
+  std::swap(rowUnknown[i], rowUnknown[j]);
+  unknownFromIndex(rowUnknown[i]).pos = i;
+  unknownFromIndex(rowUnknown[j]).pos = j;
+}
+
+void Simplex::pivot(unsigned pivotRow, unsigned pivotCol) {
+  assert(pivotCol >= 2 && "refusing to pivot the denominator or constant");
+
+  // Swap the unknowns.
+  std::swap(rowUnknown[pivotRow], colUnknown[pivotCol]);
+  Unknown &rowU = unknownFromIndex(rowUnknown[pivotRow]);
+  Unknown &colU = unknownFromIndex(colUnknown[pivotCol]);
+  rowU.orientation = Orientation::Row;
+  rowU.pos = pivotRow;
+  colU.orientation = Orientation::Column;
+  colU.pos = pivotCol;
+
+  // The pivot row expressed the old row unknown r as
+  //   r = (c + a * y + sum_j b_j * z_j) / d
+  // with y the old column unknown.  Solve it for y:
+  //   y = (-c + d * r - sum_j b_j * z_j) / a
+  std::swap(at(pivotRow, 0), at(pivotRow, pivotCol));
+  if (at(pivotRow, 0) < 0) {
+    // Negate the denominator and the coefficient of r, rather than all the
+    // other entries, to keep the denominator positive.
+    at(pivotRow, 0) = -at(pivotRow, 0);
+    at(pivotRow, pivotCol) = -at(pivotRow, pivotCol);
+  } else {
+    for (unsigned col = 1; col < nCol; ++col)
+      if (col != pivotCol)
+        at(pivotRow, col) = -at(pivotRow, col);
+  }
+  normalizeRow(pivotRow);
+
+  // Substitute the new expression of y into the other rows.
+  for (unsigned row = 0; row < nRow; ++row) {
+    if (row == pivotRow || at(row, pivotCol) == 0)
+      continue;
+    int64_t elem = at(row, pivotCol);
+    at(row, 0) = mul(at(row, 0), at(pivotRow, 0));
+    for (unsigned col = 1; col < nCol; ++col) {
+      if (col == pivotCol)
+        continue;
+      at(row, col) = add(mul(at(row, col), at(pivotRow, 0)),
+                         mul(elem, at(pivotRow, col)));
+    }
+    at(row, pivotCol) = mul(elem, at(pivotRow, pivotCol));
+    normalizeRow(row);
+  }
+}
+
+Optional<Fraction> Simplex::computeRowOptimum(Direction direction,
+                                              unsigned row) {
+  while (auto maybePivot = findPivot(row, direction)) {
+    if (maybePivot->row == row)
+      return None;
+    pivot(*maybePivot);
+  }
+  return Fraction(at(row, 1), at(row, 0));
+}
+
+Optional<Fraction> Simplex::computeOptimum(Direction direction,
+                                           ArrayRef<int64_t> coeffs) {
+  assert(!empty && "the tableau should not be empty");
+  unsigned snapshot = getSnapshot();
+  unsigned conIndex = addRow(coeffs, /*restricted=*/false);
+  auto optimum = computeRowOptimum(direction, con[conIndex].pos);
+  rollback(snapshot);
+  return optimum;
+}
+
+Fraction Simplex::getSampleValue(unsigned pos) const {
+  const Unknown &u = var[pos];
+  if (u.orientation == Orientation::Column)
+    return Fraction(0, 1);
+  return Fraction(at(u.pos, 1), at(u.pos, 0));
+}
+
+Simplex::IntegerResult Simplex::findIntegerSample(unsigned maxNodes) {
+  return searchIntegerSample(maxNodes);
+}
+
+Simplex::IntegerResult Simplex::searchIntegerSample(unsigned &budget) {
+  if (empty)
+    return IntegerResult::Infeasible;
+  if (overflowed)
+    return IntegerResult::Unknown;
+
+  // Look for an unknown with a fractional sample value.  The sample values
+  // are not reduced, so check the divisibility of their numerator.
+  unsigned pos = 0, e = var.size();
+  for (; pos < e; ++pos) {
+    Fraction value = getSampleValue(pos);
+    if (value.num % value.den != 0)
+      break;
+  }
+  if (pos == e)
+    return IntegerResult::Feasible;
+  if (budget == 0)
+    return IntegerResult::Unknown;
+  --budget;
+
+  // Branch on x <= floor(value) and x >= floor(value) + 1, depth first.
+  int64_t value = getSampleValue(pos).floor();
+  SmallVector<int64_t, 8> coeffs(e + 1, 0);
+  bool unknown = false;
+  for (int64_t sign : {-1, 1}) {
+    coeffs[pos] = sign;
+    coeffs[e] = sign < 0 ? value : -(value + 1);
+    unsigned snapshot = getSnapshot();
+    addInequality(coeffs);
+    auto result = searchIntegerSample(budget);
+    rollback(snapshot);
+    if (result == IntegerResult::Feasible)
+      return result;
+    unknown |= result == IntegerResult::Unknown;
+  }
+  return unknown ? IntegerResult::Unknown : IntegerResult::Infeasible;
+}
+
+Optional<int64_t> Simplex::computeIntegerOptimum(Direction direction,
+                                                 unsigned pos,
+                                                 unsigned maxNodes) {
+  // Minimize -x to maximize x.
+  int64_t sign = direction == Direction::Down ? 1 : -1;
+  SmallVector<int64_t, 8> coeffs(var.size() + 1, 0);
+
+  unsigned snapshot = getSnapshot();
+  Optional<int64_t> result;
+  while (!empty && !overflowed && maxNodes != 0) {
+    // The optimum over the integers is at least the rounded optimum over the
+    // rationals.  It is reached if there is an integer point there, otherwise
+    // exclude the rounded optimum and try again.
+    coeffs[pos] = sign;
+    coeffs.back() = 0;
+    auto rationalOptimum = computeOptimum(Direction::Down, coeffs);
+    if (!rationalOptimum)
+      break;
+    int64_t bound = rationalOptimum->ceil();
+
+    unsigned boundSnapshot = getSnapshot();
+    coeffs[pos] = -sign;
+    coeffs.back() = bound;
+    addInequality(coeffs);
+    // The searches of all the iterations share the node budget.
+    auto feasibility = searchIntegerSample(maxNodes);
+    rollback(boundSnapshot);
+    if (feasibility == IntegerResult::Feasible) {
+      result = sign * bound;
+      break;
+    }
+    if (feasibility == IntegerResult::Unknown)
+      break;
+
+    // Excluding the rounded optimum counts as a node of the search as well.
+    if (maxNodes == 0)
+      break;
+    --maxNodes;
+    coeffs[pos] = sign;
+    coeffs.back() = -(bound + 1);
+    addInequality(coeffs);
+  }
+  rollback(snapshot);
+  return overflowed ? None : result;
+}
+
+void Simplex::detectRedundant() {
+  assert(!empty && "the tableau should not be empty");
+  for (Unknown &u : con) {
+    if (!u.restricted)
+      continue;
+
+    // A constraint in a column is at its minimum if it cannot decrease
+    // without making another constraint negative.  Otherwise move it to a
+    // row in order to minimize it.
+    if (u.orientation == Orientation::Column) {
+      unsigned col = u.pos;
+      auto pivotRow = findPivotRow(None, Direction::Down, col);
+      if (!pivotRow)
+        continue;
+      pivot(*pivotRow, col);
+    }
+
+    // Minimize the constraint while ignoring its own restriction.
+    auto minimum = computeRowOptimum(Direction::Down, u.pos);
+    if (minimum && minimum->num > -minimum->den) {
+      u.restricted = false;
+      u.redundant = true;
+      continue;
+    }
+    bool restored = restoreRow(u);
+    assert(restored && "could not restore a non-redundant constraint");
+    (void)restored;
+  }
+}
+
+void Simplex::undo(UndoLogEntry entry) {
+  if (entry == UndoLogEntry::UnmarkEmpty) {
+    empty = false;
+    return;
+  }
+
+  assert(entry == UndoLogEntry::RemoveLastConstraint);
+  Unknown &constraint = con.back();
+  if (constraint.orientation == Orientation::Column) {
+    // Move the constraint to a row, preferably without breaking the
+    // non-negativity of the other rows.  If the constraint is unbounded in
+    // both directions, any row using it is fine.
+    unsigned col = constraint.pos;
+    auto row = findPivotRow(None, Direction::Up, col);
+    if (!row)
+      row = findPivotRow(None, Direction::Down, col);
+    for (unsigned i = 0; !row && i < nRow; ++i)
+      if (at(i, col) != 0)
+        row = i;
+    assert(row && "no pivot row found");
+    pivot(*row, col);
+  }
+
+  // Move the constraint to the last row and drop it.
+  swapRows(constraint.pos, nRow - 1);
+  --nRow;
+  tableau.resize(nRow * nCol);
+  rowUnknown.pop_back();
+  con.pop_back();
+}
+
+void Simplex::rollback(unsigned snapshot) {
+  while (undoLog.size() > snapshot) {
+    undo(undoLog.back());
+    undoLog.pop_back();
+  }
+}
+
+void Simplex::print(raw_ostream &os) const {
+  os << "rows = " << nRow << ", columns = " << nCol << "\n";
+  if (empty)
+    os << "Simplex marked empty!\n";
+  if (overflowed)
+    os << "Simplex overflowed!\n";
+  for (unsigned row = 0; row < nRow; ++row) {
+    os << (rowUnknown[row] >= 0 ? "c" : "x")
+       << (rowUnknown[row] >= 0 ? rowUnknown[row] : ~rowUnknown[row]) << ":";
+    for (unsigned col = 0; col < nCol; ++col)
+      os << " " << at(row, col);
+    os << "\n";
+  }
+}
+
+void Simplex::dump() const { print(llvm::errs()); }
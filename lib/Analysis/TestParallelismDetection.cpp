@@ -20,13 +20,21 @@
 //===----------------------------------------------------------------------===//
 
 #include "mlir/AffineOps/AffineOps.h"
+#include "mlir/Analysis/MemRefDependenceAnalysis.h"
 #include "mlir/Analysis/Passes.h"
 #include "mlir/Analysis/Utils.h"
 #include "mlir/IR/Builders.h"
 #include "mlir/Pass/Pass.h"
+#include "llvm/Support/CommandLine.h"
 
 using namespace mlir;
 
+static llvm::cl::opt<bool> clReassociateFP(
+    "test-detect-parallel-reassociate-fp",
+    llvm::cl::desc("Also detect floating point addition and multiplication "
+                   "reductions"),
+    llvm::cl::init(false));
+
 namespace {
 
 struct TestParallelismDetection
@@ -40,15 +48,42 @@ FunctionPassBase *mlir::createParallelismDetectionTestPass() {
   return new TestParallelismDetection();
 }
 
+/// Returns the name of a reduction kind for diagnostics.
+static StringRef getReductionKindName(ReductionKind kind) {
+  switch (kind) {
+  case ReductionKind::Add:
+    return "add";
+  case ReductionKind::Mul:
+    return "mul";
+  case ReductionKind::Max:
+    return "max";
+  case ReductionKind::Min:
+    return "min";
+  }
+  llvm_unreachable("unknown reduction kind");
+}
+
 // Walks the function and emits a note for all 'affine.for' ops detected as
-// parallel.
+// parallel, and for those that are parallel once their reductions are
+// privatized along with a note for each of these reductions.
 void TestParallelismDetection::runOnFunction() {
   Function &f = getFunction();
   FuncBuilder b(f);
+  auto &dependences = getAnalysis<MemRefDependenceAnalysis>();
   f.walk<AffineForOp>([&](AffineForOp forOp) {
-    if (isLoopParallel(forOp))
+    SmallVector<LoopReduction, 2> reductions;
+    if (isLoopParallel(forOp, &dependences)) {
       forOp.emitNote("parallel loop");
+    } else if (isLoopParallel(forOp, &dependences, &reductions,
+                              clReassociateFP) &&
+               !reductions.empty()) {
+      forOp.emitNote("parallel loop with reductions");
+      for (auto &reduction : reductions)
+        reduction.store->emitNote(
+            Twine(getReductionKindName(reduction.kind)) + " reduction");
+    }
   });
+  markAllAnalysesPreserved();
 }
 
 static PassRegistration<TestParallelismDetection>
@@ -0,0 +1,249 @@
+//===- TileSizeModel.cpp - Analytical tile size model ---------------------===//
+//
+// Copyright 2019 The MLIR Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =============================================================================
+//
+// This file implements an analytical model of the cache behavior of a band of
+// loops as a function of its tile sizes.
+//
+//===----------------------------------------------------------------------===//
+
+#include "mlir/Analysis/TileSizeModel.h"
+#include "mlir/AffineOps/AffineOps.h"
+#include "mlir/Analysis/AffineAnalysis.h"
+#include "mlir/Analysis/AffineStructures.h"
+#include "mlir/Analysis/LoopAnalysis.h"
+#include "mlir/Analysis/Utils.h"
+#include "mlir/StandardOps/Ops.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Support/MathExtras.h"
+
+using namespace mlir;
+
+/// Returns true if the flattened affine expression 'flatExpr' of a map with
+/// 'numInputs' inputs involves local identifiers.
+static bool hasLocalIds(ArrayRef<int64_t> flatExpr, unsigned numInputs) {
+  return llvm::any_of(flatExpr.slice(numInputs).drop_back(),
+                      [](int64_t coeff) { return coeff != 0; });
+}
+
+Optional<TileSizeModel> TileSizeModel::get(ArrayRef<AffineForOp> band,
+                                           unsigned cacheLineBytes) {
+  assert(!band.empty() && "expected a non-empty band");
+  assert(cacheLineBytes > 0 && "expected a non-empty cache line");
+  TileSizeModel model(cacheLineBytes);
+  for (auto forOp : band) {
+    auto tripCount = getConstantTripCount(forOp);
+    if (!tripCount.hasValue() || tripCount.getValue() == 0)
+      return llvm::None;
+    model.tripCounts.push_back(tripCount.getValue());
+  }
+
+  SmallVector<Operation *, 8> accesses;
+  band[0].getOperation()->walk([&](Operation *op) {
+    if (op->isa<LoadOp>() || op->isa<StoreOp>())
+      accesses.push_back(op);
+  });
+  if (accesses.empty())
+    return llvm::None;
+
+  unsigned numLoops = band.size();
+  unsigned loopDepth = getNestingDepth(*band[0].getOperation());
+  llvm::DenseMap<Value *, unsigned> footprintPositions;
+  for (auto *op : accesses) {
+    // The extents of the region accessed by the whole band bound the extents
+    // of a tile.
+    MemRefRegion region(op->getLoc());
+    SmallVector<int64_t, 4> shape;
+    if (failed(region.compute(op, loopDepth)) ||
+        !region.getConstantBoundingSizeAndShape(&shape))
+      return llvm::None;
+
+    MemRefAccess access(op);
+    auto memRefType = access.memref->getType().cast<MemRefType>();
+    unsigned rank = memRefType.getRank();
+    auto it = footprintPositions.try_emplace(access.memref,
+                                             model.footprints.size());
+    if (it.second) {
+      MemRefFootprint footprint;
+      footprint.elementBytes = getMemRefEltSizeInBytes(memRefType);
+      footprint.extents.resize(rank, 0);
+      footprint.strides.resize(rank, SmallVector<uint64_t, 4>(numLoops, 0));
+      footprint.isFixed.resize(rank, false);
+      model.footprints.push_back(footprint);
+    }
+    auto &footprint = model.footprints[it.first->second];
+
+    // Get the strides of the access from its flattened access map. The inputs
+    // of the map are followed by the local identifiers introduced for mod and
+    // div expressions, and by the constant term.
+    AffineValueMap accessMap;
+    access.getAccessMap(&accessMap);
+    auto map = accessMap.getAffineMap();
+    std::vector<SmallVector<int64_t, 8>> flatExprs;
+    FlatAffineConstraints localVarCst;
+    bool isFlattened =
+        succeeded(getFlattenedAffineExprs(map, &flatExprs, &localVarCst));
+    unsigned numInputs = map.getNumInputs();
+    for (unsigned d = 0; d < rank; ++d) {
+      footprint.extents[d] =
+          std::max<uint64_t>(footprint.extents[d], shape[d]);
+      if (!isFlattened || hasLocalIds(flatExprs[d], numInputs)) {
+        footprint.isFixed[d] = true;
+        continue;
+      }
+      for (unsigned j = 0; j < numInputs; ++j) {
+        for (unsigned i = 0; i < numLoops; ++i) {
+          if (accessMap.getOperand(j) != band[i].getInductionVar())
+            continue;
+          footprint.strides[d][i] = std::max<uint64_t>(
+              footprint.strides[d][i], std::abs(flatExprs[d][j]));
+        }
+      }
+    }
+  }
+  return model;
+}
+
+uint64_t TileSizeModel::getNumLines(const MemRefFootprint &footprint,
+                                    ArrayRef<unsigned> tileSizes) const {
+  auto getExtent = [&](unsigned d) -> uint64_t {
+    if (footprint.isFixed[d])
+      return footprint.extents[d];
+    uint64_t extent = 1;
+    for (unsigned i = 0, e = tileSizes.size(); i < e; ++i)
+      extent = llvm::SaturatingAdd(
+          extent,
+          llvm::SaturatingMultiply(footprint.strides[d][i],
+                                   uint64_t(tileSizes[i] - 1)));
+    return std::min(extent, footprint.extents[d]);
+  };
+
+  unsigned rank = footprint.extents.size();
+  if (rank == 0)
+    return 1;
+  uint64_t numLines = 1;
+  for (unsigned d = 0; d + 1 < rank; ++d)
+    numLines = llvm::SaturatingMultiply(numLines, getExtent(d));
+  uint64_t innermostBytes = llvm::SaturatingMultiply(
+      getExtent(rank - 1), uint64_t(footprint.elementBytes));
+  return llvm::SaturatingMultiply(
+      numLines, llvm::divideCeil(innermostBytes, cacheLineBytes));
+}
+
+uint64_t
+TileSizeModel::getWorkingSetBytes(ArrayRef<unsigned> tileSizes) const {
+  assert(tileSizes.size() == tripCounts.size() && "invalid tile size count");
+  uint64_t numLines = 0;
+  for (auto &footprint : footprints)
+    numLines = llvm::SaturatingAdd(numLines, getNumLines(footprint, tileSizes));
+  return llvm::SaturatingMultiply(numLines, uint64_t(cacheLineBytes));
+}
+
+uint64_t TileSizeModel::getTraffic(ArrayRef<unsigned> tileSizes) const {
+  assert(tileSizes.size() == tripCounts.size() && "invalid tile size count");
+  unsigned innermost = tripCounts.size() - 1;
+  uint64_t traffic = 0;
+  for (auto &footprint : footprints) {
+    bool isReusedAcrossTiles = true;
+    for (unsigned d = 0, e = footprint.extents.size(); d < e; ++d)
+      if (!footprint.isFixed[d] && footprint.strides[d][innermost] != 0)
+        isReusedAcrossTiles = false;
+
+    uint64_t footprintTraffic = getNumLines(footprint, tileSizes);
+    for (unsigned i = 0, e = tripCounts.size(); i < e; ++i) {
+      if (i == innermost && isReusedAcrossTiles)
+        continue;
+      footprintTraffic = llvm::SaturatingMultiply(
+          footprintTraffic, llvm::divideCeil(tripCounts[i], tileSizes[i]));
+    }
+    traffic = llvm::SaturatingAdd(traffic, footprintTraffic);
+  }
+  return traffic;
+}
+
+uint64_t TileSizeModel::getCost(ArrayRef<unsigned> tileSizes,
+                                ArrayRef<uint64_t> cacheSizes) const {
+  // The levels that can't hold a tile see the traffic of the untiled band,
+  // which only reuses data along its innermost loop.
+  SmallVector<unsigned, 4> untiledSizes(tripCounts.size(), 1);
+  untiledSizes.back() = tripCounts.back();
+  uint64_t workingSet = getWorkingSetBytes(tileSizes);
+  uint64_t tiledTraffic = getTraffic(tileSizes);
+  uint64_t untiledTraffic = getTraffic(untiledSizes);
+
+  uint64_t cost = 0;
+  for (auto cacheSize : cacheSizes)
+    cost = llvm::SaturatingAdd(
+        cost, workingSet <= cacheSize ? tiledTraffic : untiledTraffic);
+  return cost;
+}
+
+void TileSizeModel::getTileSizesForCache(
+    uint64_t cacheSize, SmallVectorImpl<unsigned> *tileSizes) const {
+  unsigned numLoops = tripCounts.size();
+  tileSizes->assign(numLoops, 1);
+  SmallVector<unsigned, 4> candidate;
+  while (true) {
+    // Find the loop along which doubling the tile size reduces the traffic
+    // the most, preferring inner loops in case of a tie.
+    uint64_t bestTraffic = getTraffic(*tileSizes);
+    Optional<unsigned> bestLoop;
+    for (unsigned i = numLoops; i-- > 0;) {
+      if ((*tileSizes)[i] >= tripCounts[i])
+        continue;
+      candidate.assign(tileSizes->begin(), tileSizes->end());
+      candidate[i] = std::min<uint64_t>(2 * candidate[i], tripCounts[i]);
+      if (getWorkingSetBytes(candidate) > cacheSize)
+        continue;
+      uint64_t traffic = getTraffic(candidate);
+      if (traffic < bestTraffic) {
+        bestTraffic = traffic;
+        bestLoop = i;
+      }
+    }
+    if (!bestLoop.hasValue())
+      return;
+    unsigned pos = bestLoop.getValue();
+    (*tileSizes)[pos] =
+        std::min<uint64_t>(2 * (*tileSizes)[pos], tripCounts[pos]);
+  }
+}
+
+void TileSizeModel::getTileSizes(ArrayRef<uint64_t> cacheSizes,
+                                 SmallVectorImpl<unsigned> *tileSizes) const {
+  assert(!cacheSizes.empty() && "expected at least one cache level");
+  unsigned numLoops = tripCounts.size();
+
+  // No need to tile if the whole band fits in the innermost level.
+  SmallVector<unsigned, 4> untiledSizes(tripCounts.begin(), tripCounts.end());
+  if (getWorkingSetBytes(untiledSizes) <= cacheSizes.front()) {
+    tileSizes->assign(numLoops, 1);
+    return;
+  }
+
+  // Select the tile sizes for each level, and keep the ones of lowest cost,
+  // preferring inner levels in case of a tie.
+  Optional<uint64_t> bestCost;
+  SmallVector<unsigned, 4> candidate;
+  for (auto cacheSize : cacheSizes) {
+    getTileSizesForCache(cacheSize, &candidate);
+    uint64_t cost = getCost(candidate, cacheSizes);
+    if (bestCost.hasValue() && cost >= bestCost.getValue())
+      continue;
+    bestCost = cost;
+    tileSizes->assign(candidate.begin(), candidate.end());
+  }
+}
@@ -25,9 +25,14 @@
 #include "mlir/AffineOps/AffineOps.h"
 #include "mlir/Analysis/AffineAnalysis.h"
 #include "mlir/Analysis/AffineStructures.h"
+#include "mlir/Analysis/LoopAnalysis.h"
+#include "mlir/Analysis/MemRefDependenceAnalysis.h"
+#include "mlir/IR/BlockAndValueMapping.h"
 #include "mlir/IR/Builders.h"
 #include "mlir/StandardOps/Ops.h"
 #include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/raw_ostream.h"
 
@@ -304,7 +309,7 @@ LogicalResult MemRefRegion::compute(Operation *op, unsigned loopDepth,
 }
 
 //  TODO(mlir-team): improve/complete this when we have target data.
-static unsigned getMemRefEltSizeInBytes(MemRefType memRefType) {
+unsigned mlir::getMemRefEltSizeInBytes(MemRefType memRefType) {
   auto elementType = memRefType.getElementType();
 
   unsigned sizeInBits;
@@ -673,44 +678,56 @@ unsigned mlir::getNumCommonSurroundingLoops(Operation &A, Operation &B) {
   return numCommonLoops;
 }
 
-static Optional<int64_t> getMemoryFootprintBytes(Block &block,
-                                                 Block::iterator start,
-                                                 Block::iterator end,
-                                                 int memorySpace) {
-  SmallDenseMap<Value *, std::unique_ptr<MemRefRegion>, 4> regions;
-
-  // Walk this 'affine.for' operation to gather all memory regions.
-  bool error = false;
-  block.walk(start, end, [&](Operation *opInst) {
-    if (!opInst->isa<LoadOp>() && !opInst->isa<StoreOp>()) {
-      // Neither load nor a store op.
-      return;
+void mlir::computeInstOrders(ArrayRef<Operation *> ops) {
+  SmallPtrSet<Block *, 8> visited;
+  for (auto *op : ops) {
+    // The ancestors of a visited block have been visited as well.
+    Block *block = op->getBlock();
+    while (block && visited.insert(block).second) {
+      if (!block->isInstOrderValid())
+        block->recomputeInstOrder();
+      auto *containingOp = block->getContainingOp();
+      block = containingOp ? containingOp->getBlock() : nullptr;
     }
+  }
+}
 
-    // Compute the memref region symbolic in any IVs enclosing this block.
-    auto region = llvm::make_unique<MemRefRegion>(opInst->getLoc());
-    if (failed(
-            region->compute(opInst,
-                            /*loopDepth=*/getNestingDepth(*block.begin())))) {
-      opInst->emitError("Error obtaining memory region\n");
-      error = true;
-      return;
-    }
-    auto it = regions.find(region->memref);
-    if (it == regions.end()) {
-      regions[region->memref] = std::move(region);
-    } else if (failed(it->second->unionBoundingBox(*region))) {
+using MemRefRegionMap =
+    SmallDenseMap<Value *, std::unique_ptr<MemRefRegion>, 4>;
+
+/// Adds the memref region accessed by 'opInst', if it is a load or a store, to
+/// 'regions', taking the union with the region previously recorded for the
+/// same memref, and only warns if that fails when 'warnOnUnionFailure' is set.
+/// The region is symbolic in the 'loopDepth' outermost IVs surrounding
+/// 'opInst'.
+static LogicalResult addAccessRegion(Operation *opInst, unsigned loopDepth,
+                                     bool warnOnUnionFailure,
+                                     MemRefRegionMap &regions) {
+  if (!opInst->isa<LoadOp>() && !opInst->isa<StoreOp>()) {
+    // Neither load nor a store op.
+    return success();
+  }
+
+  auto region = llvm::make_unique<MemRefRegion>(opInst->getLoc());
+  if (failed(region->compute(opInst, loopDepth))) {
+    opInst->emitError("Error obtaining memory region\n");
+    return failure();
+  }
+  auto it = regions.find(region->memref);
+  if (it == regions.end()) {
+    regions[region->memref] = std::move(region);
+  } else if (failed(it->second->unionBoundingBox(*region))) {
+    if (warnOnUnionFailure)
       opInst->emitWarning(
           "getMemoryFootprintBytes: unable to perform a union on a memory "
           "region");
-      error = true;
-      return;
-    }
-  });
-
-  if (error)
-    return None;
+    return failure();
+  }
+  return success();
+}
 
+/// Returns the total size in bytes of 'regions'.
+static Optional<int64_t> getTotalRegionSize(const MemRefRegionMap &regions) {
   int64_t totalSizeInBytes = 0;
   for (const auto &region : regions) {
     Optional<int64_t> size = region.second->getRegionSize();
@@ -721,6 +738,28 @@ static Optional<int64_t> getMemoryFootprintBytes(Block &block,
   return totalSizeInBytes;
 }
 
+static Optional<int64_t> getMemoryFootprintBytes(Block &block,
+                                                 Block::iterator start,
+                                                 Block::iterator end,
+                                                 int memorySpace) {
+  MemRefRegionMap regions;
+
+  // Walk this 'affine.for' operation to gather all memory regions, symbolic
+  // in any IVs enclosing this block.
+  unsigned loopDepth = getNestingDepth(*block.begin());
+  bool error = false;
+  block.walk(start, end, [&](Operation *opInst) {
+    if (!error && failed(addAccessRegion(opInst, loopDepth,
+                                         /*warnOnUnionFailure=*/true,
+                                         regions)))
+      error = true;
+  });
+
+  if (error)
+    return None;
+  return getTotalRegionSize(regions);
+}
+
 Optional<int64_t> mlir::getMemoryFootprintBytes(AffineForOp forOp,
                                                 int memorySpace) {
   auto *forInst = forOp.getOperation();
@@ -729,24 +768,258 @@ Optional<int64_t> mlir::getMemoryFootprintBytes(AffineForOp forOp,
       std::next(Block::iterator(forInst)), memorySpace);
 }
 
+Optional<int64_t> mlir::getMemoryFootprintBytes(ArrayRef<Operation *> ops,
+                                                int memorySpace) {
+  MemRefRegionMap regions;
+  bool error = false;
+  for (auto *op : ops) {
+    unsigned loopDepth = getNestingDepth(*op);
+    op->walk([&](Operation *opInst) {
+      if (!error && failed(addAccessRegion(opInst, loopDepth,
+                                           /*warnOnUnionFailure=*/false,
+                                           regions)))
+        error = true;
+    });
+  }
+
+  if (error)
+    return None;
+  return getTotalRegionSize(regions);
+}
+
 /// Returns in 'sequentialLoops' all sequential loops in loop nest rooted
 /// at 'forOp'.
-void mlir::getSequentialLoops(
-    AffineForOp forOp, llvm::SmallDenseSet<Value *, 8> *sequentialLoops) {
+void mlir::getSequentialLoops(AffineForOp forOp,
+                              llvm::SmallDenseSet<Value *, 8> *sequentialLoops,
+                              MemRefDependenceAnalysis *dependences) {
   forOp.getOperation()->walk([&](Operation *op) {
     if (auto innerFor = op->dyn_cast<AffineForOp>())
-      if (!isLoopParallel(innerFor))
+      if (!isLoopParallel(innerFor, dependences))
         sequentialLoops->insert(innerFor.getInductionVar());
   });
 }
 
+Value *LoopReduction::getMemRef() const {
+  return load->cast<LoadOp>().getMemRef();
+}
+
+Value *LoopReduction::buildCombine(FuncBuilder *b, Value *accumulator,
+                                   Value *value) const {
+  BlockAndValueMapping operandMap;
+  operandMap.map(load->getResult(0), accumulator);
+  operandMap.map(operand, value);
+  Operation *result = nullptr;
+  for (auto *op : combiner)
+    result = b->clone(*op, operandMap);
+  return result->getResult(0);
+}
+
+/// Returns true if 'predicate' compares its operands as unsigned integers.
+static bool isUnsignedPredicate(CmpIPredicate predicate) {
+  return predicate == CmpIPredicate::ULT || predicate == CmpIPredicate::ULE ||
+         predicate == CmpIPredicate::UGT || predicate == CmpIPredicate::UGE;
+}
+
+Value *LoopReduction::buildIdentity(FuncBuilder *b) const {
+  // Reductions of vectors are elementwise.
+  Type type = load->getResult(0)->getType();
+  auto vectorType = type.dyn_cast<VectorType>();
+  Type eltType = vectorType ? vectorType.getElementType() : type;
+  Attribute identity;
+  if (eltType.isa<FloatType>()) {
+    assert((kind == ReductionKind::Add || kind == ReductionKind::Mul) &&
+           "only integer max and min reductions are recognized");
+    identity = b->getFloatAttr(eltType, kind == ReductionKind::Add ? 0.0 : 1.0);
+  } else {
+    unsigned width = eltType.cast<IntegerType>().getWidth();
+    bool isUnsigned =
+        combiner.front()->isa<CmpIOp>() &&
+        isUnsignedPredicate(combiner.front()->cast<CmpIOp>().getPredicate());
+    APInt value;
+    switch (kind) {
+    case ReductionKind::Add:
+      value = APInt(width, 0);
+      break;
+    case ReductionKind::Mul:
+      value = APInt(width, 1);
+      break;
+    case ReductionKind::Max:
+      value = isUnsigned ? APInt::getMinValue(width)
+                         : APInt::getSignedMinValue(width);
+      break;
+    case ReductionKind::Min:
+      value = isUnsigned ? APInt::getMaxValue(width)
+                         : APInt::getSignedMaxValue(width);
+      break;
+    }
+    identity = b->getIntegerAttr(eltType, value);
+  }
+  if (vectorType)
+    identity = b->getSplatElementsAttr(vectorType, identity);
+  return b->create<ConstantOp>(load->getLoc(), type, identity);
+}
+
+/// Returns true if 'op' is 'forOp' or is nested in it.
+static bool isInsideLoop(Operation *op, AffineForOp forOp) {
+  for (; op; op = op->getParentOp())
+    if (op == forOp.getOperation())
+      return true;
+  return false;
+}
+
+/// Matches the operations computing 'result' from 'accumulator' with an
+/// associative operation and records them in 'reduction'. Returns false if
+/// 'accumulator' is used for anything else, or if it is combined with a
+/// floating point operation and 'reassociateFloats' isn't set.
+static bool matchReductionCombiner(Value *accumulator, Value *result,
+                                   bool reassociateFloats,
+                                   LoopReduction *reduction) {
+  auto *op = result->getDefiningOp();
+  if (!op || !result->hasOneUse())
+    return false;
+
+  // Add and Mul combine the accumulator with the other operand.
+  if (op->isa<AddFOp>() || op->isa<AddIOp>() || op->isa<MulFOp>() ||
+      op->isa<MulIOp>()) {
+    // Combining partial results changes the rounding of floating point
+    // operations.
+    if ((op->isa<AddFOp>() || op->isa<MulFOp>()) && !reassociateFloats)
+      return false;
+    Value *lhs = op->getOperand(0), *rhs = op->getOperand(1);
+    if ((lhs == accumulator) == (rhs == accumulator) ||
+        !accumulator->hasOneUse())
+      return false;
+    reduction->kind = op->isa<AddFOp>() || op->isa<AddIOp>()
+                          ? ReductionKind::Add
+                          : ReductionKind::Mul;
+    reduction->combiner.push_back(op);
+    reduction->operand = lhs == accumulator ? rhs : lhs;
+    return true;
+  }
+
+  // Max and Min select one of the compared values.
+  auto select = op->dyn_cast<SelectOp>();
+  if (!select)
+    return false;
+  auto *cmpOp = select.getCondition()->getDefiningOp();
+  if (!cmpOp || !cmpOp->isa<CmpIOp>() || !select.getCondition()->hasOneUse())
+    return false;
+  Value *lhs = cmpOp->getOperand(0), *rhs = cmpOp->getOperand(1);
+  if ((lhs == accumulator) == (rhs == accumulator))
+    return false;
+  bool selectsLhs;
+  if (select.getTrueValue() == lhs && select.getFalseValue() == rhs)
+    selectsLhs = true;
+  else if (select.getTrueValue() == rhs && select.getFalseValue() == lhs)
+    selectsLhs = false;
+  else
+    return false;
+  bool isLessThan;
+  switch (cmpOp->cast<CmpIOp>().getPredicate()) {
+  case CmpIPredicate::SLT:
+  case CmpIPredicate::SLE:
+  case CmpIPredicate::ULT:
+  case CmpIPredicate::ULE:
+    isLessThan = true;
+    break;
+  case CmpIPredicate::SGT:
+  case CmpIPredicate::SGE:
+  case CmpIPredicate::UGT:
+  case CmpIPredicate::UGE:
+    isLessThan = false;
+    break;
+  default:
+    return false;
+  }
+  for (auto &use : accumulator->getUses())
+    if (use.getOwner() != cmpOp && use.getOwner() != op)
+      return false;
+  reduction->kind =
+      isLessThan == selectsLhs ? ReductionKind::Min : ReductionKind::Max;
+  reduction->combiner.push_back(cmpOp);
+  reduction->combiner.push_back(op);
+  reduction->operand = lhs == accumulator ? rhs : lhs;
+  return true;
+}
+
+void mlir::getLoopReductions(AffineForOp forOp,
+                             SmallVectorImpl<LoopReduction> *reductions,
+                             bool reassociateFloats) {
+  // Group the loads and stores in the loop nest by memref.
+  llvm::MapVector<Value *, SmallVector<Operation *, 2>> accesses;
+  forOp.getOperation()->walk([&](Operation *op) {
+    if (auto loadOp = op->dyn_cast<LoadOp>())
+      accesses[loadOp.getMemRef()].push_back(op);
+    else if (auto storeOp = op->dyn_cast<StoreOp>())
+      accesses[storeOp.getMemRef()].push_back(op);
+  });
+
+  for (auto &entry : accesses) {
+    Value *memref = entry.first;
+    if (entry.second.size() != 2)
+      continue;
+    Operation *loadOp = entry.second[0], *storeOp = entry.second[1];
+    if (loadOp->isa<StoreOp>())
+      std::swap(loadOp, storeOp);
+    if (!loadOp->isa<LoadOp>() || !storeOp->isa<StoreOp>())
+      continue;
+    if (loadOp->getBlock() != forOp.getBody() ||
+        storeOp->getBlock() != forOp.getBody() ||
+        !loadOp->isBeforeInBlock(storeOp))
+      continue;
+
+    // The accumulator must not be accessed by any other operation of the loop.
+    if (llvm::any_of(memref->getUses(), [&](OpOperand &use) {
+          Operation *user = use.getOwner();
+          return user != loadOp && user != storeOp &&
+                 isInsideLoop(user, forOp);
+        }))
+      continue;
+
+    // Both access the same location, which is invariant in the loop.
+    auto load = loadOp->cast<LoadOp>();
+    auto store = storeOp->cast<StoreOp>();
+    if (!std::equal(load.getIndices().begin(), load.getIndices().end(),
+                    store.getIndices().begin()) ||
+        llvm::any_of(load.getIndices(), [&](Value *index) {
+          return !isDefinedOutsideOfLoop(index, forOp);
+        }))
+      continue;
+
+    LoopReduction reduction;
+    reduction.load = loadOp;
+    reduction.store = storeOp;
+    if (matchReductionCombiner(load.getResult(), store.getValueToStore(),
+                               reassociateFloats, &reduction))
+      reductions->push_back(reduction);
+  }
+}
+
 /// Returns true if 'forOp' is parallel.
-bool mlir::isLoopParallel(AffineForOp forOp) {
+bool mlir::isLoopParallel(AffineForOp forOp,
+                          MemRefDependenceAnalysis *dependences,
+                          SmallVectorImpl<LoopReduction> *reductions,
+                          bool reassociateFloats) {
+  // The dependences carried through the accumulators of reductions disappear
+  // once the accumulators are privatized.
+  SmallVector<LoopReduction, 2> loopReductions;
+  llvm::SmallPtrSet<Value *, 4> accumulators;
+  if (reductions) {
+    getLoopReductions(forOp, &loopReductions, reassociateFloats);
+    for (auto &reduction : loopReductions)
+      accumulators.insert(reduction.getMemRef());
+  }
+
   // Collect all load and store ops in loop nest rooted at 'forOp'.
   SmallVector<Operation *, 8> loadAndStoreOpInsts;
   forOp.getOperation()->walk([&](Operation *opInst) {
-    if (opInst->isa<LoadOp>() || opInst->isa<StoreOp>())
-      loadAndStoreOpInsts.push_back(opInst);
+    if (auto loadOp = opInst->dyn_cast<LoadOp>()) {
+      if (!accumulators.count(loadOp.getMemRef()))
+        loadAndStoreOpInsts.push_back(opInst);
+    } else if (auto storeOp = opInst->dyn_cast<StoreOp>()) {
+      if (!accumulators.count(storeOp.getMemRef()))
+        loadAndStoreOpInsts.push_back(opInst);
+    }
   });
 
   // Dep check depth would be number of enclosing loops + 1.
@@ -756,6 +1029,11 @@ bool mlir::isLoopParallel(AffineForOp forOp) {
   for (auto *srcOpInst : loadAndStoreOpInsts) {
     MemRefAccess srcAccess(srcOpInst);
     for (auto *dstOpInst : loadAndStoreOpInsts) {
+      if (dependences) {
+        if (dependences->hasDependence(srcOpInst, dstOpInst, depth))
+          return false;
+        continue;
+      }
       MemRefAccess dstAccess(dstOpInst);
       FlatAffineConstraints dependenceConstraints;
       if (checkMemrefAccessDependence(srcAccess, dstAccess, depth,
@@ -764,5 +1042,7 @@ bool mlir::isLoopParallel(AffineForOp forOp) {
         return false;
     }
   }
+  if (reductions)
+    reductions->append(loopReductions.begin(), loopReductions.end());
   return true;
 }
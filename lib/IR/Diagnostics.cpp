@@ -0,0 +1,161 @@
+//===- Diagnostics.cpp - MLIR Diagnostic Utilities ------------------------===//
+//
+// Copyright 2019 The MLIR Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =============================================================================
+//
+// This file implements utilities for emitting diagnostics.
+//
+//===----------------------------------------------------------------------===//
+
+#include "mlir/IR/Diagnostics.h"
+#include "mlir/IR/Location.h"
+#include "mlir/IR/MLIRContext.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Support/Mutex.h"
+#include "llvm/Support/PrettyStackTrace.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace mlir;
+using namespace mlir::detail;
+
+//===----------------------------------------------------------------------===//
+// ParallelDiagnosticHandler
+//===----------------------------------------------------------------------===//
+
+namespace mlir {
+namespace detail {
+struct ParallelDiagnosticHandlerImpl : public llvm::PrettyStackTraceEntry {
+  struct ThreadDiagnostic {
+    ThreadDiagnostic(size_t id, Location loc, StringRef msg,
+                     MLIRContext::DiagnosticKind kind)
+        : id(id), loc(loc), msg(msg), kind(kind) {}
+    bool operator<(const ThreadDiagnostic &rhs) const { return id < rhs.id; }
+
+    /// The id for this diagnostic, this is used for ordering.
+    /// Note: This id corresponds to the ordered position of the current element
+    ///       being processed by a given thread.
+    size_t id;
+
+    /// Information for the diagnostic.
+    Location loc;
+    std::string msg;
+    MLIRContext::DiagnosticKind kind;
+  };
+
+  ParallelDiagnosticHandlerImpl(MLIRContext &ctx)
+      : prevHandler(ctx.getDiagnosticHandler()), context(ctx) {
+    ctx.registerDiagnosticHandler([this](Location loc, StringRef message,
+                                         MLIRContext::DiagnosticKind kind) {
+      uint64_t tid = llvm::get_threadid();
+      llvm::sys::SmartScopedLock<true> lock(mutex);
+
+      // Append a new diagnostic.
+      diagnostics.emplace_back(threadToOrderID[tid], loc, message, kind);
+    });
+  }
+
+  ~ParallelDiagnosticHandlerImpl() override {
+    // Restore the previous diagnostic handler.
+    context.registerDiagnosticHandler(prevHandler);
+
+    // Early exit if there are no diagnostics, this is the common case.
+    if (diagnostics.empty())
+      return;
+
+    // Emit the diagnostics back to the context.
+    emitDiagnostics(
+        [&](Location loc, StringRef message, MLIRContext::DiagnosticKind kind) {
+          return context.emitDiagnostic(loc, message, kind);
+        });
+  }
+
+  /// Utility method to emit any held diagnostics.
+  void emitDiagnostics(
+      std::function<void(Location, StringRef, MLIRContext::DiagnosticKind)>
+          emitFn) const {
+    // Stable sort all of the diagnostics that were emitted. This creates a
+    // deterministic ordering for the diagnostics based upon which order id they
+    // were emitted for.
+    std::stable_sort(diagnostics.begin(), diagnostics.end());
+
+    // Emit each diagnostic to the context again.
+    for (ThreadDiagnostic &diag : diagnostics)
+      emitFn(diag.loc, diag.msg, diag.kind);
+  }
+
+  /// Set the order id for the current thread.
+  void setOrderIDForThread(size_t orderID) {
+    uint64_t tid = llvm::get_threadid();
+    llvm::sys::SmartScopedLock<true> lock(mutex);
+    threadToOrderID[tid] = orderID;
+  }
+
+  /// Dump the current diagnostics that were inflight.
+  void print(raw_ostream &os) const override {
+    // Early exit if there are no diagnostics, this is the common case.
+    if (diagnostics.empty())
+      return;
+
+    os << "In-Flight Diagnostics:\n";
+    emitDiagnostics(
+        [&](Location loc, StringRef message, MLIRContext::DiagnosticKind kind) {
+          os.indent(4);
+
+          // Print each diagnostic with the format:
+          //   "<location>: <kind>: <msg>"
+          if (!loc.isa<UnknownLoc>())
+            os << loc << ": ";
+          switch (kind) {
+          case MLIRContext::DiagnosticKind::Error:
+            os << "error: ";
+            break;
+          case MLIRContext::DiagnosticKind::Warning:
+            os << "warning: ";
+            break;
+          case MLIRContext::DiagnosticKind::Note:
+            os << "note: ";
+            break;
+          }
+          os << message << '\n';
+        });
+  }
+
+  /// The previous context diagnostic handler.
+  MLIRContext::DiagnosticHandlerTy prevHandler;
+
+  /// A smart mutex to lock access to the internal state.
+  llvm::sys::SmartMutex<true> mutex;
+
+  /// A mapping between the thread id and the current order id.
+  DenseMap<uint64_t, size_t> threadToOrderID;
+
+  /// An unordered list of diagnostics that were emitted.
+  mutable std::vector<ThreadDiagnostic> diagnostics;
+
+  /// The context to emit the diagnostics to.
+  MLIRContext &context;
+};
+} // end namespace detail
+} // end namespace mlir
+
+ParallelDiagnosticHandler::ParallelDiagnosticHandler(MLIRContext &ctx)
+    : impl(new ParallelDiagnosticHandlerImpl(ctx)) {}
+ParallelDiagnosticHandler::~ParallelDiagnosticHandler() {}
+
+/// Set the order id for the current thread.
+void ParallelDiagnosticHandler::setOrderIDForThread(size_t orderID) {
+  impl->setOrderIDForThread(orderID);
+}
@@ -217,8 +217,9 @@ Operation *Operation::create(Location location, OperationName name,
 Operation::Operation(Location location, OperationName name, unsigned numResults,
                      unsigned numSuccessors, unsigned numRegions,
                      const NamedAttributeList &attributes, MLIRContext *context)
-    : location(location), numResults(numResults), numSuccs(numSuccessors),
-      numRegions(numRegions), name(name), attrs(attributes) {}
+    : location(location), orderIndex(0), inWorklist(false),
+      numResults(numResults), numSuccs(numSuccessors), numRegions(numRegions),
+      name(name), attrs(attributes) {}
 
 // Operations are deleted through the destroy() member because they are
 // allocated via malloc.
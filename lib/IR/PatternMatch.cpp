@@ -18,6 +18,9 @@
 #include "mlir/IR/PatternMatch.h"
 #include "mlir/IR/Operation.h"
 #include "mlir/IR/Value.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
 using namespace mlir;
 
 PatternBenefit::PatternBenefit(unsigned benefit) : representation(benefit) {
@@ -135,7 +138,27 @@ RewritePatternMatcher::RewritePatternMatcher(
 
 /// Try to match the given operation to a pattern and rewrite it.
 bool RewritePatternMatcher::matchAndRewrite(Operation *op) {
-  for (auto &pattern : patterns) {
+  auto *stats = PatternRewriteStatistics::getActive();
+
+  // Patterns don't have names, so label them by their root and their position
+  // amongst the patterns with the same root.
+  if (stats && patternLabels.empty()) {
+    llvm::DenseMap<OperationName, unsigned> numPatternsPerRoot;
+    for (auto &pattern : patterns)
+      ++numPatternsPerRoot[pattern->getRootKind()];
+    llvm::DenseMap<OperationName, unsigned> rootIndex;
+    for (auto &pattern : patterns) {
+      OperationName root = pattern->getRootKind();
+      std::string label = root.getStringRef().str();
+      if (numPatternsPerRoot[root] != 1)
+        label += " #" + std::to_string(rootIndex[root]++);
+      patternLabels.push_back(std::move(label));
+    }
+  }
+
+  for (unsigned i = 0, e = patterns.size(); i != e; ++i) {
+    auto &pattern = patterns[i];
+
     // Ignore patterns that are for the wrong root or are impossible to match.
     if (pattern->getRootKind() != op->getName() ||
         pattern->getBenefit().isImpossibleToMatch())
@@ -143,8 +166,105 @@ bool RewritePatternMatcher::matchAndRewrite(Operation *op) {
 
     // Try to match and rewrite this pattern. The patterns are sorted by
     // benefit, so if we match we can immediately rewrite and return.
-    if (pattern->matchAndRewrite(op, rewriter))
+    if (!stats) {
+      if (pattern->matchAndRewrite(op, rewriter))
+        return true;
+      continue;
+    }
+
+    auto startTime = std::chrono::steady_clock::now();
+    bool matched = bool(pattern->matchAndRewrite(op, rewriter));
+    stats->recordMatchAttempt(patternLabels[i], matched,
+                              std::chrono::steady_clock::now() - startTime);
+    if (matched)
       return true;
   }
   return false;
 }
+
+//===----------------------------------------------------------------------===//
+// PatternRewriteStatistics implementation
+//===----------------------------------------------------------------------===//
+
+/// The statistics collector active on the current thread.
+static LLVM_THREAD_LOCAL PatternRewriteStatistics *activeStatistics = nullptr;
+
+PatternRewriteStatistics *PatternRewriteStatistics::getActive() {
+  return activeStatistics;
+}
+
+PatternRewriteStatistics *
+PatternRewriteStatistics::setActive(PatternRewriteStatistics *stats) {
+  PatternRewriteStatistics *previous = activeStatistics;
+  activeStatistics = stats;
+  return previous;
+}
+
+void PatternRewriteStatistics::recordMatchAttempt(
+    StringRef pattern, bool succeeded, std::chrono::nanoseconds time) {
+  auto &entry = patterns[pattern];
+  ++entry.numMatchAttempts;
+  if (succeeded)
+    ++entry.numMatchSuccesses;
+  entry.matchTime += time;
+}
+
+void PatternRewriteStatistics::recordDriverRun(unsigned iterations,
+                                               bool converged) {
+  ++numDriverRuns;
+  numIterations += iterations;
+  maxIterations = std::max(maxIterations, iterations);
+  if (!converged)
+    ++numNonConvergedRuns;
+}
+
+void PatternRewriteStatistics::merge(const PatternRewriteStatistics &other) {
+  for (auto &it : other.patterns) {
+    auto &entry = patterns[it.first()];
+    entry.numMatchAttempts += it.second.numMatchAttempts;
+    entry.numMatchSuccesses += it.second.numMatchSuccesses;
+    entry.matchTime += it.second.matchTime;
+  }
+  numFolds += other.numFolds;
+  numConstantFolds += other.numConstantFolds;
+  numDriverRuns += other.numDriverRuns;
+  numIterations += other.numIterations;
+  maxIterations = std::max(maxIterations, other.maxIterations);
+  numNonConvergedRuns += other.numNonConvergedRuns;
+}
+
+void PatternRewriteStatistics::print(raw_ostream &os, unsigned indent) const {
+  os.indent(indent) << "Driver runs: " << numDriverRuns
+                    << ", iterations: " << numIterations
+                    << " (max: " << maxIterations
+                    << ", not converged: " << numNonConvergedRuns << ")\n";
+  os.indent(indent) << "Folded operations: " << numFolds
+                    << ", constant folded operations: " << numConstantFolds
+                    << "\n";
+  if (patterns.empty())
+    return;
+
+  // Sort the patterns by the time spent matching them.
+  using EntryT = std::pair<StringRef, const PatternEntry *>;
+  std::vector<EntryT> entries;
+  for (auto &it : patterns)
+    entries.emplace_back(it.first(), &it.second);
+  std::sort(entries.begin(), entries.end(),
+            [](const EntryT &lhs, const EntryT &rhs) {
+              if (lhs.second->matchTime != rhs.second->matchTime)
+                return lhs.second->matchTime > rhs.second->matchTime;
+              return lhs.first < rhs.first;
+            });
+
+  os.indent(indent) << "  ---Wall Time---  ---Attempts---  ---Successes---  "
+                       "--- Pattern ---\n";
+  for (auto &entry : entries) {
+    double seconds = std::chrono::duration_cast<std::chrono::duration<double>>(
+                         entry.second->matchTime)
+                         .count();
+    os.indent(indent) << llvm::format("  %13.4f  %14u  %15u  ", seconds,
+                                      entry.second->numMatchAttempts,
+                                      entry.second->numMatchSuccesses)
+                      << entry.first << "\n";
+  }
+}
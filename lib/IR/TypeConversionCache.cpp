@@ -0,0 +1,47 @@
+//===- TypeConversionCache.cpp - Cache of type conversions ----------------===//
+//
+// Copyright 2019 The MLIR Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =============================================================================
+
+#include "mlir/IR/TypeConversionCache.h"
+
+using namespace mlir;
+
+Type TypeConversionCache::lookupOrConvert(
+    Type type, llvm::function_ref<Type(Type)> convert) {
+  {
+    llvm::sys::SmartScopedReader<true> lock(mutex);
+    auto it = conversions.find(type);
+    if (it != conversions.end()) {
+      ++numHits;
+      return it->second;
+    }
+  }
+  ++numMisses;
+
+  // Convert the type without holding the lock, as the conversion may itself
+  // use the cache for nested types.  If another thread converted the same type
+  // in the meantime, keep the first conversion.
+  Type converted = convert(type);
+  llvm::sys::SmartScopedWriter<true> lock(mutex);
+  return conversions.insert({type, converted}).first->second;
+}
+
+void TypeConversionCache::clear() {
+  llvm::sys::SmartScopedWriter<true> lock(mutex);
+  conversions.clear();
+  numHits = 0;
+  numMisses = 0;
+}
@@ -33,33 +33,45 @@
 #include "mlir/Transforms/Passes.h"
 #include "mlir/Transforms/Utils.h"
 
+#include "llvm/ADT/Statistic.h"
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Type.h"
 
 using namespace mlir;
 
+#define DEBUG_TYPE "convert-to-llvmir"
+
+STATISTIC(NumLLVMTypeCacheHits,
+          "Number of LLVM IR dialect type conversions found in the cache");
+STATISTIC(NumLLVMTypeCacheMisses,
+          "Number of LLVM IR dialect type conversions computed");
+
 namespace {
 // Type converter for the LLVM IR dialect.  Converts MLIR standard and builtin
 // types into equivalent LLVM IR dialect types.
+//
+// The types are registered in the LLVM module of the `dialect`, which may also
+// be used to extract information specific to the data layout.  The entry points
+// below hold the LLVM context mutex of the `dialect` while creating LLVM types,
+// so that they can be called by concurrent function conversions.  The converted
+// types are memoized in the type conversion cache of the `dialect`, so that
+// converting a type again does not need to take the mutex.
 class TypeConverter {
 public:
-  // Convert one type `t ` and register it in the `llvmModule`.  The latter may
-  // be used to extract information specific to the data layout.
-  // Dispatches to the private functions below based on the actual type.
-  static Type convert(Type t, llvm::Module &llvmModule);
+  // Convert one type `t` to the LLVM IR dialect.  Dispatches to the private
+  // functions below based on the actual type.
+  static Type convert(Type t, LLVM::LLVMDialect &dialect);
 
   // Convert the element type of the memref `t` to to an LLVM type, get a
   // pointer LLVM type pointing to the converted `t`, wrap it into the MLIR LLVM
   // dialect type and return.
-  static Type getMemRefElementPtrType(MemRefType t, llvm::Module &llvmModule);
+  static Type getMemRefElementPtrType(MemRefType t, LLVM::LLVMDialect &dialect);
 
   // Convert a non-empty list of types to an LLVM IR dialect type wrapping an
   // LLVM IR structure type, elements of which are formed by converting
-  // individual types in the given list.  Register the type in the `llvmModule`.
-  // The module may be also used to query the data layout.
-  static Type pack(ArrayRef<Type> types, llvm::Module &llvmModule,
-                   MLIRContext &context);
+  // individual types in the given list.
+  static Type pack(ArrayRef<Type> types, LLVM::LLVMDialect &dialect);
 
   // Convert a function signature type to the LLVM IR dialect.  The outer
   // function type remains `mlir::FunctionType`.  Argument types are converted
@@ -67,7 +79,7 @@ public:
   // converted.  Otherwise, the types of results are packed into an LLVM IR
   // structure type.
   static FunctionType convertFunctionSignature(FunctionType t,
-                                               llvm::Module &llvmModule);
+                                               LLVM::LLVMDialect &dialect);
 
 private:
   // Construct a type converter.
@@ -306,28 +318,37 @@ Type TypeConverter::convertType(Type type) {
   return {};
 }
 
-Type TypeConverter::convert(Type t, llvm::Module &module) {
-  return TypeConverter(module, t.getContext()).convertType(t);
+Type TypeConverter::convert(Type t, LLVM::LLVMDialect &dialect) {
+  return dialect.getTypeConversionCache().lookupOrConvert(
+      t, [&dialect](Type type) {
+        llvm::sys::SmartScopedLock<true> lock(dialect.getLLVMContextMutex());
+        return TypeConverter(dialect.getLLVMModule(), type.getContext())
+            .convertType(type);
+      });
 }
 
-FunctionType TypeConverter::convertFunctionSignature(FunctionType t,
-                                                     llvm::Module &module) {
-  return TypeConverter(module, t.getContext()).convertFunctionSignatureType(t);
+FunctionType
+TypeConverter::convertFunctionSignature(FunctionType t,
+                                        LLVM::LLVMDialect &dialect) {
+  llvm::sys::SmartScopedLock<true> lock(dialect.getLLVMContextMutex());
+  return TypeConverter(dialect.getLLVMModule(), t.getContext())
+      .convertFunctionSignatureType(t);
 }
 
 Type TypeConverter::getMemRefElementPtrType(MemRefType t,
-                                            llvm::Module &module) {
-  auto elementType = t.getElementType();
-  auto converted = convert(elementType, module);
+                                            LLVM::LLVMDialect &dialect) {
+  auto converted = convert(t.getElementType(), dialect);
   if (!converted)
     return {};
+  llvm::sys::SmartScopedLock<true> lock(dialect.getLLVMContextMutex());
   llvm::Type *llvmType = converted.cast<LLVM::LLVMType>().getUnderlyingType();
   return LLVM::LLVMType::get(t.getContext(), llvmType->getPointerTo());
 }
 
-Type TypeConverter::pack(ArrayRef<Type> types, llvm::Module &module,
-                         MLIRContext &mlirContext) {
-  return TypeConverter(module, &mlirContext).getPackedResultType(types);
+Type TypeConverter::pack(ArrayRef<Type> types, LLVM::LLVMDialect &dialect) {
+  llvm::sys::SmartScopedLock<true> lock(dialect.getLLVMContextMutex());
+  return TypeConverter(dialect.getLLVMModule(), dialect.getContext())
+      .getPackedResultType(types);
 }
 
 namespace {
@@ -360,17 +381,33 @@ public:
   // Get the MLIR type wrapping the LLVM integer type whose bit width is defined
   // by the pointer size used in the LLVM module.
   LLVM::LLVMType getIndexType() const {
-    llvm::Type *llvmType = llvm::Type::getIntNTy(
-        getContext(), getModule().getDataLayout().getPointerSizeInBits());
-    return LLVM::LLVMType::get(dialect.getContext(), llvmType);
+    return TypeConverter::convert(IndexType::get(dialect.getContext()), dialect)
+        .cast<LLVM::LLVMType>();
   }
 
   // Get the MLIR type wrapping the LLVM i8* type.
   LLVM::LLVMType getVoidPtrType() const {
+    llvm::sys::SmartScopedLock<true> lock(dialect.getLLVMContextMutex());
     return LLVM::LLVMType::get(dialect.getContext(),
                                llvm::Type::getInt8PtrTy(getContext()));
   }
 
+  // Get the function named `name` in the module containing `op`, or insert a
+  // declaration of it with the type produced by `getType` if there is none.
+  // The module is shared between the functions being converted, so it is only
+  // accessed under the LLVM context mutex.
+  Function *getOrInsertFunction(Operation *op, StringRef name,
+                                llvm::function_ref<FunctionType()> getType,
+                                Location loc) const {
+    llvm::sys::SmartScopedLock<true> lock(dialect.getLLVMContextMutex());
+    Module *module = op->getFunction()->getModule();
+    if (Function *func = module->getNamedFunction(name))
+      return func;
+    auto *func = new Function(loc, name, getType());
+    module->getFunctions().push_back(func);
+    return func;
+  }
+
   // Create an LLVM IR pseudo-operation defining the given index constant.
   Value *createIndexConstant(FuncBuilder &builder, Location loc,
                              uint64_t value) const {
@@ -431,13 +468,11 @@ struct OneToOneLLVMOpLowering : public LLVMLegalizationPattern<SourceOp> {
   SmallVector<Value *, 4> rewrite(Operation *op, ArrayRef<Value *> operands,
                                   FuncBuilder &rewriter) const override {
     unsigned numResults = op->getNumResults();
-    auto *mlirContext = op->getContext();
 
     Type packedType;
     if (numResults != 0) {
       packedType =
-          TypeConverter::pack(getTypes(op->getResults()),
-                              this->dialect.getLLVMModule(), *mlirContext);
+          TypeConverter::pack(getTypes(op->getResults()), this->dialect);
       assert(packedType && "type conversion failed, such operation should not "
                            "have been matched");
     }
@@ -456,8 +491,8 @@ struct OneToOneLLVMOpLowering : public LLVMLegalizationPattern<SourceOp> {
     SmallVector<Value *, 4> results;
     results.reserve(numResults);
     for (unsigned i = 0; i < numResults; ++i) {
-      auto type = TypeConverter::convert(op->getResult(i)->getType(),
-                                         this->dialect.getLLVMModule());
+      auto type =
+          TypeConverter::convert(op->getResult(i)->getType(), this->dialect);
       results.push_back(rewriter.create<LLVM::ExtractValueOp>(
           op->getLoc(), type, newOp.getOperation()->getResult(0),
           this->getIntegerArrayAttr(rewriter, i)));
@@ -601,14 +636,12 @@ struct AllocOpLowering : public LLVMLegalizationPattern<AllocOp> {
             createIndexConstant(rewriter, op->getLoc(), elementSize)});
 
     // Insert the `malloc` declaration if it is not already present.
-    Function *mallocFunc =
-        op->getFunction()->getModule()->getNamedFunction("malloc");
-    if (!mallocFunc) {
-      auto mallocType =
-          rewriter.getFunctionType(getIndexType(), getVoidPtrType());
-      mallocFunc = new Function(rewriter.getUnknownLoc(), "malloc", mallocType);
-      op->getFunction()->getModule()->getFunctions().push_back(mallocFunc);
-    }
+    Function *mallocFunc = getOrInsertFunction(
+        op, "malloc",
+        [&] {
+          return rewriter.getFunctionType(getIndexType(), getVoidPtrType());
+        },
+        rewriter.getUnknownLoc());
 
     // Allocate the underlying buffer and store a pointer to it in the MemRef
     // descriptor.
@@ -618,11 +651,8 @@ struct AllocOpLowering : public LLVMLegalizationPattern<AllocOp> {
                                   rewriter.getFunctionAttr(mallocFunc),
                                   cumulativeSize)
             .getResult(0);
-    auto structElementType = TypeConverter::convert(elementType, getModule());
-    auto elementPtrType = LLVM::LLVMType::get(
-        op->getContext(), structElementType.cast<LLVM::LLVMType>()
-                              .getUnderlyingType()
-                              ->getPointerTo());
+    auto elementPtrType =
+        TypeConverter::getMemRefElementPtrType(type, getDialect());
     allocated = rewriter.create<LLVM::BitcastOp>(op->getLoc(), elementPtrType,
                                                  ArrayRef<Value *>(allocated));
 
@@ -632,7 +662,7 @@ struct AllocOpLowering : public LLVMLegalizationPattern<AllocOp> {
     }
 
     // Create the MemRef descriptor.
-    auto structType = TypeConverter::convert(type, getModule());
+    auto structType = TypeConverter::convert(type, getDialect());
     Value *memRefDescriptor = rewriter.create<LLVM::UndefOp>(
         op->getLoc(), structType, ArrayRef<Value *>{});
 
@@ -664,13 +694,10 @@ struct DeallocOpLowering : public LLVMLegalizationPattern<DeallocOp> {
     assert(operands.size() == 1 && "dealloc takes one operand");
 
     // Insert the `free` declaration if it is not already present.
-    Function *freeFunc =
-        op->getFunction()->getModule()->getNamedFunction("free");
-    if (!freeFunc) {
-      auto freeType = rewriter.getFunctionType(getVoidPtrType(), {});
-      freeFunc = new Function(rewriter.getUnknownLoc(), "free", freeType);
-      op->getFunction()->getModule()->getFunctions().push_back(freeFunc);
-    }
+    Function *freeFunc = getOrInsertFunction(
+        op, "free",
+        [&] { return rewriter.getFunctionType(getVoidPtrType(), {}); },
+        rewriter.getUnknownLoc());
 
     auto *type =
         operands[0]->getType().cast<LLVM::LLVMType>().getUnderlyingType();
@@ -714,7 +741,7 @@ struct MemRefCastOpLowering : public LLVMLegalizationPattern<MemRefCastOp> {
 
     // Copy the data buffer pointer.
     auto elementTypePtr =
-        TypeConverter::getMemRefElementPtrType(targetType, getModule());
+        TypeConverter::getMemRefElementPtrType(targetType, getDialect());
     Value *buffer =
         extractMemRefElementPtr(rewriter, op->getLoc(), operands[0],
                                 elementTypePtr, sourceType.hasStaticShape());
@@ -724,7 +751,7 @@ struct MemRefCastOpLowering : public LLVMLegalizationPattern<MemRefCastOp> {
     }
 
     // Create the new MemRef descriptor.
-    auto structType = TypeConverter::convert(targetType, getModule());
+    auto structType = TypeConverter::convert(targetType, getDialect());
     Value *newDescriptor = rewriter.create<LLVM::UndefOp>(
         op->getLoc(), structType, ArrayRef<Value *>{});
     // Otherwise target type is dynamic memref, so create a proper descriptor.
@@ -914,9 +941,9 @@ struct LoadStoreOpLowering : public LLVMLegalizationPattern<Derived> {
   }
 
   Value *getDataPtr(Location loc, MemRefType type, Value *dataPtr,
-                    ArrayRef<Value *> indices, FuncBuilder &rewriter,
-                    llvm::Module &module) const {
-    auto ptrType = TypeConverter::getMemRefElementPtrType(type, module);
+                    ArrayRef<Value *> indices, FuncBuilder &rewriter) const {
+    auto ptrType =
+        TypeConverter::getMemRefElementPtrType(type, this->getDialect());
     auto shape = type.getShape();
     if (type.hasStaticShape()) {
       // NB: If memref was statically-shaped, dataPtr is pointer to raw data.
@@ -938,9 +965,9 @@ struct LoadOpLowering : public LoadStoreOpLowering<LoadOp> {
     auto type = loadOp.getMemRefType();
 
     Value *dataPtr = getDataPtr(op->getLoc(), type, operands.front(),
-                                operands.drop_front(), rewriter, getModule());
+                                operands.drop_front(), rewriter);
     auto elementType =
-        TypeConverter::convert(type.getElementType(), getModule());
+        TypeConverter::convert(type.getElementType(), getDialect());
 
     SmallVector<Value *, 4> results;
     results.push_back(rewriter.create<LLVM::LoadOp>(
@@ -960,7 +987,7 @@ struct StoreOpLowering : public LoadStoreOpLowering<StoreOp> {
     auto type = storeOp.getMemRefType();
 
     Value *dataPtr = getDataPtr(op->getLoc(), type, operands[1],
-                                operands.drop_front(2), rewriter, getModule());
+                                operands.drop_front(2), rewriter);
 
     rewriter.create<LLVM::StoreOp>(op->getLoc(), operands[0], dataPtr);
     return {};
@@ -1013,9 +1040,7 @@ struct ReturnOpLowering : public LLVMLegalizationPattern<ReturnOp> {
 
     // Otherwise, we need to pack the arguments into an LLVM struct type before
     // returning.
-    auto *mlirContext = op->getContext();
-    auto packedType = TypeConverter::pack(
-        getTypes(op->getOperands()), dialect.getLLVMModule(), *mlirContext);
+    auto packedType = TypeConverter::pack(getTypes(op->getOperands()), dialect);
 
     Value *packed = rewriter.create<LLVM::UndefOp>(op->getLoc(), packedType);
     for (unsigned i = 0; i < numArguments; ++i) {
@@ -1106,7 +1131,7 @@ protected:
       return {};
     }
 
-    module = &llvmDialect->getLLVMModule();
+    dialect = llvmDialect;
 
     // FIXME: this should be tablegen'ed
     return ConversionListBuilder<
@@ -1121,12 +1146,12 @@ protected:
                                                               *llvmDialect);
   }
 
-  // Convert types using the stored LLVM IR module.
+  // Convert types using the stored LLVM IR dialect.
   Type convertType(Type t) override {
-    return TypeConverter::convert(t, *module);
+    return TypeConverter::convert(t, *dialect);
   }
 
-  // Convert function signatures using the stored LLVM IR module.
+  // Convert function signatures using the stored LLVM IR dialect.
   FunctionType convertFunctionSignatureType(
       FunctionType t, ArrayRef<NamedAttributeList> argAttrs,
       SmallVectorImpl<NamedAttributeList> &convertedArgAttrs) override {
@@ -1134,25 +1159,47 @@ protected:
     convertedArgAttrs.reserve(argAttrs.size());
     for (auto attr : argAttrs)
       convertedArgAttrs.push_back(attr);
-    return TypeConverter::convertFunctionSignature(t, *module);
+    return TypeConverter::convertFunctionSignature(t, *dialect);
   }
 
 private:
   // Storage for the conversion patterns.
   llvm::BumpPtrAllocator converterStorage;
-  // LLVM IR module used to parse/create types.
-  llvm::Module *module;
+  // LLVM IR dialect used to parse/create types.
+  LLVM::LLVMDialect *dialect;
 };
 
 /// A pass converting MLIR Standard operations into the LLVM IR dialect.
 class LLVMLoweringPass : public ModulePass<LLVMLoweringPass> {
 public:
+  // Convert the functions of the module concurrently.  The type converter and
+  // the conversion patterns synchronize on the LLVM context mutex of the
+  // dialect when accessing the LLVM context or the module.
+  LLVMLoweringPass() { impl.enableMultithreading(); }
+
   // Run the dialect converter on the module.
   void runOnModule() override {
     Module *m = &getModule();
     LLVM::ensureDistinctSuccessors(m);
+
+    // The type conversion cache of the dialect is shared by the conversions
+    // in the context, only account for the lookups of this conversion.
+    auto *llvmDialect = static_cast<LLVM::LLVMDialect *>(
+        m->getContext()->getRegisteredDialect("llvm"));
+    unsigned numHits = 0, numMisses = 0;
+    if (llvmDialect) {
+      numHits = llvmDialect->getTypeConversionCache().getNumHits();
+      numMisses = llvmDialect->getTypeConversionCache().getNumMisses();
+    }
+
     if (failed(impl.convert(m)))
       signalPassFailure();
+
+    if (llvmDialect) {
+      auto &cache = llvmDialect->getTypeConversionCache();
+      NumLLVMTypeCacheHits += cache.getNumHits() - numHits;
+      NumLLVMTypeCacheMisses += cache.getNumMisses() - numMisses;
+    }
   }
 
 private:
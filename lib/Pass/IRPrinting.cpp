@@ -18,12 +18,96 @@
 #include "PassDetail.h"
 #include "mlir/IR/Module.h"
 #include "mlir/Pass/PassManager.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Format.h"
 #include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/Mutex.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Regex.h"
+#include "llvm/Support/ThreadPool.h"
 
 using namespace mlir;
 using namespace mlir::detail;
 
+//===----------------------------------------------------------------------===//
+// IRFingerprint
+//===----------------------------------------------------------------------===//
+
+namespace {
+/// A unique fingerprint for a specific IR unit. This is used to detect whether
+/// a pass changed the IR without needing to print or clone it. The fingerprint
+/// hashes the structure of the IR along with the identity of each operation
+/// and block, so any operation being created, erased, moved, or mutated
+/// produces a different fingerprint.
+class IRFingerprint {
+public:
+  explicit IRFingerprint(const llvm::Any &ir);
+
+  bool operator==(const IRFingerprint &other) const {
+    return hash == other.hash;
+  }
+  bool operator!=(const IRFingerprint &other) const {
+    return !(*this == other);
+  }
+
+private:
+  void addFunction(Function *function);
+  void addRegion(Region &region);
+  void addOperation(Operation *op);
+
+  llvm::hash_code hash = 0;
+};
+} // end anonymous namespace
+
+IRFingerprint::IRFingerprint(const llvm::Any &ir) {
+  if (llvm::any_isa<Function *>(ir)) {
+    addFunction(llvm::any_cast<Function *>(ir));
+    return;
+  }
+
+  assert(llvm::any_isa<Module *>(ir) && "unexpected IR unit");
+  for (auto &function : *llvm::any_cast<Module *>(ir))
+    addFunction(&function);
+}
+
+void IRFingerprint::addFunction(Function *function) {
+  hash = llvm::hash_combine(hash, function, function->getName(),
+                            function->getType(), function->getLoc(),
+                            function->getAttrs());
+  for (unsigned i = 0, e = function->getNumArguments(); i != e; ++i)
+    hash = llvm::hash_combine(hash, function->getArgAttrs(i));
+  addRegion(function->getBody());
+}
+
+void IRFingerprint::addRegion(Region &region) {
+  for (auto &block : region) {
+    hash = llvm::hash_combine(hash, &block);
+    for (auto *arg : block.getArguments())
+      hash = llvm::hash_combine(hash, arg, arg->getType());
+    for (auto &op : block)
+      addOperation(&op);
+  }
+}
+
+void IRFingerprint::addOperation(Operation *op) {
+  hash = llvm::hash_combine(
+      hash, op, op->getName(), op->getLoc(), op->getAttrs(),
+      llvm::hash_combine_range(op->result_type_begin(),
+                               op->result_type_end()),
+      llvm::hash_combine_range(op->operand_begin(), op->operand_end()));
+  for (unsigned i = 0, e = op->getNumSuccessors(); i != e; ++i)
+    hash = llvm::hash_combine(hash, op->getSuccessor(i));
+  for (auto &region : op->getRegions())
+    addRegion(region);
+}
+
+//===----------------------------------------------------------------------===//
+// IRPrinterInstrumentation
+//===----------------------------------------------------------------------===//
+
 namespace {
 class IRPrinterInstrumentation : public PassInstrumentation {
 public:
@@ -33,12 +117,19 @@ public:
 
   IRPrinterInstrumentation(ShouldPrintFn &&shouldPrintBeforePass,
                            ShouldPrintFn &&shouldPrintAfterPass,
-                           bool printModuleScope, raw_ostream &out)
+                           bool printModuleScope, raw_ostream &out,
+                           const IRPrintingOptions &options)
       : shouldPrintBeforePass(shouldPrintBeforePass),
         shouldPrintAfterPass(shouldPrintAfterPass),
-        printModuleScope(printModuleScope), out(out) {
+        printModuleScope(printModuleScope),
+        printAfterOnlyOnChange(options.printAfterOnlyOnChange),
+        outputDirectory(options.outputDirectory), out(out) {
     assert((shouldPrintBeforePass || shouldPrintAfterPass) &&
            "expected atleast one valid filter function");
+    if (!options.functionFilter.empty())
+      functionFilter.emplace(options.functionFilter);
+    if (!outputDirectory.empty())
+      fileWriter.reset(new AsyncFileWriter(outputDirectory));
   }
 
 private:
@@ -47,26 +138,108 @@ private:
   void runAfterPass(Pass *pass, const llvm::Any &ir) override;
   void runAfterPassFailed(Pass *pass, const llvm::Any &ir) override;
 
+  /// Returns true if the given function passes the function filter.
+  bool shouldPrintFunction(Function *function) const {
+    return !functionFilter ||
+           functionFilter->match(function->getName().strref());
+  }
+
+  /// Returns true if any of the IR within the given unit passes the function
+  /// filter.
+  bool shouldPrintIR(const llvm::Any &ir) const;
+
+  /// Print the given header and IR unit to either the output stream, or the
+  /// per-pass output file for the given pass.
+  void print(Pass *pass, const Twine &header, const llvm::Any &ir);
+
+  /// A utility class that writes printed IR to per-pass files on a separate
+  /// thread, so that file output doesn't stall the pass pipeline.
+  class AsyncFileWriter {
+  public:
+    explicit AsyncFileWriter(StringRef directory) : directory(directory), pool(1) {}
+
+    /// Flush any pending writes before destruction.
+    ~AsyncFileWriter() { pool.wait(); }
+
+    /// Append the given contents to the file for the pass with the given
+    /// name.
+    void write(StringRef passName, std::string &&contents);
+
+  private:
+    /// The directory that all of the files are written within.
+    std::string directory;
+
+    /// The open output streams for each pass name. This is only ever accessed
+    /// from within the writer thread.
+    llvm::StringMap<std::unique_ptr<llvm::raw_fd_ostream>> streams;
+
+    /// A single thread pool to process the writes in order.
+    llvm::ThreadPool pool;
+  };
+
   /// Filter functions for before and after pass execution.
   ShouldPrintFn shouldPrintBeforePass, shouldPrintAfterPass;
 
   /// Flag to toggle if the printer should always print at module scope.
   bool printModuleScope;
 
-  /// The stream to output to.
+  /// Flag to toggle if the printer should only print after a pass if that
+  /// pass changed the IR.
+  bool printAfterOnlyOnChange;
+
+  /// An optional filter on the names of the functions that should be printed.
+  llvm::Optional<llvm::Regex> functionFilter;
+
+  /// The fingerprints of the IR units before a pass was run. This is only
+  /// populated if 'printAfterOnlyOnChange' is set. Function passes may be run
+  /// on multiple threads, so accesses are guarded by 'beforePassPrintsMutex'.
+  DenseMap<std::pair<Pass *, const void *>, IRFingerprint> beforePassPrints;
+  llvm::sys::SmartMutex<true> beforePassPrintsMutex;
+
+  /// An optional directory to write per-pass IR files to.
+  std::string outputDirectory;
+  std::unique_ptr<AsyncFileWriter> fileWriter;
+
+  /// The stream to output to if 'outputDirectory' is empty.
   raw_ostream &out;
 };
 } // end anonymous namespace
 
+/// Returns the opaque pointer of the given IR unit.
+static const void *getIRUnitPointer(const llvm::Any &ir) {
+  if (llvm::any_isa<Function *>(ir))
+    return llvm::any_cast<Function *>(ir);
+  assert(llvm::any_isa<Module *>(ir) && "unexpected IR unit");
+  return llvm::any_cast<Module *>(ir);
+}
+
+/// Print the given IR unit to the provided stream. If 'functionFilter' is
+/// non-null, only the functions of a module that pass the filter are printed.
 static void printIR(const llvm::Any &ir, bool printModuleScope,
+                    const std::function<bool(Function *)> &functionFilter,
                     raw_ostream &out) {
+  auto printModule = [&](Module *module) {
+    if (!functionFilter) {
+      module->print(out);
+      return;
+    }
+
+    // Only print the functions that pass the filter.
+    for (auto &function : *module) {
+      if (functionFilter(&function)) {
+        function.print(out);
+        out << "\n";
+      }
+    }
+  };
+
   // Check for printing at module scope.
   if (printModuleScope && llvm::any_isa<Function *>(ir)) {
     Function *function = llvm::any_cast<Function *>(ir);
 
     // Print the function name and a newline before the Module.
     out << " (function: " << function->getName() << ")\n";
-    function->getModule()->print(out);
+    printModule(function->getModule());
     return;
   }
 
@@ -81,36 +254,141 @@ static void printIR(const llvm::Any &ir, bool printModuleScope,
 
   // Print the given module.
   assert(llvm::any_isa<Module *>(ir) && "unexpected IR unit");
-  llvm::any_cast<Module *>(ir)->print(out);
+  printModule(llvm::any_cast<Module *>(ir));
+}
+
+bool IRPrinterInstrumentation::shouldPrintIR(const llvm::Any &ir) const {
+  if (!functionFilter)
+    return true;
+  if (llvm::any_isa<Function *>(ir))
+    return shouldPrintFunction(llvm::any_cast<Function *>(ir));
+  for (auto &function : *llvm::any_cast<Module *>(ir))
+    if (shouldPrintFunction(&function))
+      return true;
+  return false;
+}
+
+void IRPrinterInstrumentation::print(Pass *pass, const Twine &header,
+                                     const llvm::Any &ir) {
+  std::function<bool(Function *)> filterFn;
+  if (functionFilter)
+    filterFn = [this](Function *function) {
+      return shouldPrintFunction(function);
+    };
+
+  // If there is no output directory, print directly to the output stream.
+  if (!fileWriter) {
+    out << header;
+    printIR(ir, printModuleScope, filterFn, out);
+    return;
+  }
+
+  // Otherwise, the IR must be printed now as it may be modified by subsequent
+  // passes, but the write to the file itself is deferred to the writer thread.
+  std::string contents;
+  {
+    llvm::raw_string_ostream os(contents);
+    os << header;
+    printIR(ir, printModuleScope, filterFn, os);
+    os << "\n";
+  }
+  fileWriter->write(pass->getName(), std::move(contents));
 }
 
 /// Instrumentation hooks.
 void IRPrinterInstrumentation::runBeforePass(Pass *pass, const llvm::Any &ir) {
-  // Skip adaptor passes and passes that the user filtered out.
-  if (!shouldPrintBeforePass || isAdaptorPass(pass) ||
-      !shouldPrintBeforePass(pass))
+  // Skip adaptor passes and IR units that the user filtered out.
+  if (isAdaptorPass(pass) || !shouldPrintIR(ir))
     return;
-  out << formatv("*** IR Dump Before {0} ***", pass->getName());
-  printIR(ir, printModuleScope, out);
+
+  // If we are only printing after a change, record the fingerprint of the IR
+  // before the pass executes.
+  if (printAfterOnlyOnChange && shouldPrintAfterPass &&
+      shouldPrintAfterPass(pass)) {
+    auto key = std::make_pair(pass, getIRUnitPointer(ir));
+    IRFingerprint fingerprint(ir);
+    llvm::sys::SmartScopedLock<true> lock(beforePassPrintsMutex);
+    beforePassPrints.erase(key);
+    beforePassPrints.try_emplace(key, fingerprint);
+  }
+
+  // Skip passes that the user filtered out.
+  if (!shouldPrintBeforePass || !shouldPrintBeforePass(pass))
+    return;
+  print(pass, formatv("*** IR Dump Before {0} ***", pass->getName()), ir);
 }
 
 void IRPrinterInstrumentation::runAfterPass(Pass *pass, const llvm::Any &ir) {
   // Skip adaptor passes and passes that the user filtered out.
   if (!shouldPrintAfterPass || isAdaptorPass(pass) ||
-      !shouldPrintAfterPass(pass))
+      !shouldPrintAfterPass(pass) || !shouldPrintIR(ir))
     return;
-  out << formatv("*** IR Dump After {0} ***", pass->getName());
-  printIR(ir, printModuleScope, out);
+
+  // Check to see if the pass changed the IR, and skip printing if it didn't.
+  if (printAfterOnlyOnChange) {
+    llvm::Optional<IRFingerprint> beforeFingerprint;
+    {
+      llvm::sys::SmartScopedLock<true> lock(beforePassPrintsMutex);
+      auto it = beforePassPrints.find({pass, getIRUnitPointer(ir)});
+      if (it != beforePassPrints.end()) {
+        beforeFingerprint = it->second;
+        beforePassPrints.erase(it);
+      }
+    }
+    if (beforeFingerprint && *beforeFingerprint == IRFingerprint(ir))
+      return;
+  }
+  print(pass, formatv("*** IR Dump After {0} ***", pass->getName()), ir);
 }
 
 void IRPrinterInstrumentation::runAfterPassFailed(Pass *pass,
                                                   const llvm::Any &ir) {
   // Skip adaptor passes and passes that the user filtered out.
   if (!shouldPrintAfterPass || isAdaptorPass(pass) ||
-      !shouldPrintAfterPass(pass))
+      !shouldPrintAfterPass(pass) || !shouldPrintIR(ir))
     return;
-  out << formatv("*** IR Dump After {0} Failed ***", pass->getName());
-  printIR(ir, printModuleScope, out);
+
+  // Always print the IR on failure, regardless of if it changed.
+  if (printAfterOnlyOnChange) {
+    llvm::sys::SmartScopedLock<true> lock(beforePassPrintsMutex);
+    beforePassPrints.erase({pass, getIRUnitPointer(ir)});
+  }
+  print(pass, formatv("*** IR Dump After {0} Failed ***", pass->getName()), ir);
+}
+
+//===----------------------------------------------------------------------===//
+// AsyncFileWriter
+//===----------------------------------------------------------------------===//
+
+void IRPrinterInstrumentation::AsyncFileWriter::write(
+    StringRef passName, std::string &&contents) {
+  // Sanitize the pass name so that it can be used as a file name.
+  std::string fileName = passName;
+  for (char &c : fileName)
+    if (!llvm::isAlnum(c) && c != '-' && c != '_')
+      c = '_';
+
+  // Note: std::function requires a copyable callable, so the contents are
+  // moved into a shared buffer.
+  auto buffer = std::make_shared<std::string>(std::move(contents));
+  pool.async([this, fileName, buffer] {
+    auto &stream = streams[fileName];
+    if (!stream) {
+      SmallString<128> path(directory);
+      llvm::sys::path::append(path, fileName + ".mlir");
+
+      std::error_code error;
+      stream = llvm::make_unique<llvm::raw_fd_ostream>(path, error,
+                                                       llvm::sys::fs::F_Text);
+      if (error) {
+        llvm::errs() << "error: could not open IR dump file '" << path
+                     << "': " << error.message() << "\n";
+        stream.reset();
+        return;
+      }
+    }
+    *stream << *buffer;
+  });
 }
 
 //===----------------------------------------------------------------------===//
@@ -118,11 +396,32 @@ void IRPrinterInstrumentation::runAfterPassFailed(Pass *pass,
 //===----------------------------------------------------------------------===//
 
 /// Add an instrumentation to print the IR before and after pass execution.
-void PassManager::enableIRPrinting(
+LogicalResult PassManager::enableIRPrinting(
     std::function<bool(Pass *)> shouldPrintBeforePass,
     std::function<bool(Pass *)> shouldPrintAfterPass, bool printModuleScope,
-    raw_ostream &out) {
+    raw_ostream &out, const IRPrintingOptions &options) {
+  // Check that the function filter is a valid regular expression.
+  std::string regexError;
+  if (!options.functionFilter.empty() &&
+      !llvm::Regex(options.functionFilter).isValid(regexError)) {
+    llvm::errs() << "error: invalid IR printing function filter '"
+                 << options.functionFilter << "': " << regexError << "\n";
+    return failure();
+  }
+
+  // If an output directory was provided, make sure that it exists.
+  if (!options.outputDirectory.empty()) {
+    if (auto error =
+            llvm::sys::fs::create_directories(options.outputDirectory)) {
+      llvm::errs() << "error: could not create IR dump directory '"
+                   << options.outputDirectory << "': " << error.message()
+                   << "\n";
+      return failure();
+    }
+  }
+
   addInstrumentation(new IRPrinterInstrumentation(
       std::move(shouldPrintBeforePass), std::move(shouldPrintAfterPass),
-      printModuleScope, out));
+      printModuleScope, out, options));
+  return success();
 }
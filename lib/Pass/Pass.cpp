@@ -21,13 +21,17 @@
 
 #include "mlir/Pass/Pass.h"
 #include "PassDetail.h"
+#include "mlir/IR/Diagnostics.h"
 #include "mlir/IR/Module.h"
 #include "mlir/Pass/PassManager.h"
+#include "mlir/Support/FileUtilities.h"
+#include "mlir/Support/STLExtras.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/CrashRecoveryContext.h"
 #include "llvm/Support/Mutex.h"
 #include "llvm/Support/Parallel.h"
-#include "llvm/Support/PrettyStackTrace.h"
 #include "llvm/Support/Threading.h"
+#include "llvm/Support/ToolOutputFile.h"
 
 using namespace mlir;
 using namespace mlir::detail;
@@ -89,7 +93,10 @@ LogicalResult ModulePassBase::run(Module *module, ModuleAnalysisManager &mam) {
   runOnModule();
 
   // Invalidate any non preserved analyses.
-  mam.invalidate(passState->preservedAnalyses);
+  auto &changedFunctions = passState->changedFunctions;
+  mam.invalidate(passState->preservedAnalyses,
+                 changedFunctions ? &*changedFunctions : nullptr,
+                 &passState->erasedFunctions);
 
   // Instrument after the pass has run.
   bool passFailed = passState->irAndPassFailed.getInt();
@@ -176,134 +183,6 @@ void ModuleToFunctionPassAdaptor::runOnModule() {
   }
 }
 
-namespace {
-/// A utility class to ensure that diagnostics are emitted in a deterministic
-/// order when executing a pipeline asynchronously with
-/// ModuleToFunctionPassAdaptorParallel.
-struct ParallelDiagnosticHandler {
-  struct ThreadDiagnostic {
-    ThreadDiagnostic(size_t id, Location loc, StringRef msg,
-                     MLIRContext::DiagnosticKind kind)
-        : id(id), loc(loc), msg(msg), kind(kind) {}
-    bool operator<(const ThreadDiagnostic &rhs) const { return id < rhs.id; }
-
-    /// The function id for this diagnostic, this is used for ordering.
-    /// Note: This id corresponds to the ordered position of the current
-    ///       function within its parent module.
-    size_t id;
-
-    /// Information for the diagnostic.
-    Location loc;
-    std::string msg;
-    MLIRContext::DiagnosticKind kind;
-  };
-
-  ParallelDiagnosticHandler(MLIRContext &ctx)
-      : prevHandler(ctx.getDiagnosticHandler()), context(ctx) {
-    ctx.registerDiagnosticHandler([this](Location loc, StringRef message,
-                                         MLIRContext::DiagnosticKind kind) {
-      uint64_t tid = llvm::get_threadid();
-      llvm::sys::SmartScopedLock<true> lock(mutex);
-
-      // Append a new diagnostic.
-      diagnostics.emplace_back(threadToFuncID[tid], loc, message, kind);
-    });
-  }
-
-  ~ParallelDiagnosticHandler() {
-    // Restore the previous diagnostic handler.
-    context.registerDiagnosticHandler(prevHandler);
-
-    // Early exit if there are no diagnostics, this is the common case.
-    if (diagnostics.empty())
-      return;
-
-    // Emit the diagnostics back to the context.
-    emitDiagnostics(
-        [&](Location loc, StringRef message, MLIRContext::DiagnosticKind kind) {
-          return context.emitDiagnostic(loc, message, kind);
-        });
-  }
-
-  /// Utility method to emit any held diagnostics.
-  void emitDiagnostics(
-      std::function<void(Location, StringRef, MLIRContext::DiagnosticKind)>
-          emitFn) {
-    // Stable sort all of the diagnostics that were emitted. This creates a
-    // deterministic ordering for the diagnostics based upon which function they
-    // were emitted for.
-    std::stable_sort(diagnostics.begin(), diagnostics.end());
-
-    // Emit each diagnostic to the context again.
-    for (ThreadDiagnostic &diag : diagnostics)
-      emitFn(diag.loc, diag.msg, diag.kind);
-  }
-
-  /// Set the function id for the current thread.
-  void setFuncIDForThread(size_t funcID) {
-    uint64_t tid = llvm::get_threadid();
-    llvm::sys::SmartScopedLock<true> lock(mutex);
-    threadToFuncID[tid] = funcID;
-  }
-
-  /// The previous context diagnostic handler.
-  MLIRContext::DiagnosticHandlerTy prevHandler;
-
-  /// A smart mutex to lock access to the internal state.
-  llvm::sys::SmartMutex<true> mutex;
-
-  /// A mapping between the thread id and the current function id.
-  DenseMap<uint64_t, size_t> threadToFuncID;
-
-  /// An unordered list of diagnostics that were emitted.
-  std::vector<ThreadDiagnostic> diagnostics;
-
-  /// The context to emit the diagnostics to.
-  MLIRContext &context;
-};
-
-/// A utility stack trace entry that dumps any dangling diagnostics held by a
-/// ParallelDiagnosticHandler in the event of a crash.
-struct PrettyStackTraceParallelDiagnosticEntry
-    : public llvm::PrettyStackTraceEntry {
-  PrettyStackTraceParallelDiagnosticEntry(
-      ParallelDiagnosticHandler &parallelHandler)
-      : parallelHandler(parallelHandler) {}
-
-  void print(raw_ostream &os) const override {
-    // Early exit if there are no diagnostics, this is the common case.
-    if (parallelHandler.diagnostics.empty())
-      return;
-
-    os << "In-Flight Diagnostics:\n";
-    parallelHandler.emitDiagnostics(
-        [&](Location loc, StringRef message, MLIRContext::DiagnosticKind kind) {
-          os.indent(4);
-
-          // Print each diagnostic with the format:
-          //   "<location>: <kind>: <msg>"
-          if (!loc.isa<UnknownLoc>())
-            os << loc << ": ";
-          switch (kind) {
-          case MLIRContext::DiagnosticKind::Error:
-            os << "error: ";
-            break;
-          case MLIRContext::DiagnosticKind::Warning:
-            os << "warning: ";
-            break;
-          case MLIRContext::DiagnosticKind::Note:
-            os << "note: ";
-            break;
-          }
-          os << message << '\n';
-        });
-  }
-
-  // A reference to the parallel handler to dump on the event of a crash.
-  ParallelDiagnosticHandler &parallelHandler;
-};
-} // end anonymous namespace
-
 // Run the held function pipeline synchronously across the functions within
 // the module.
 void ModuleToFunctionPassAdaptorParallel::runOnModule() {
@@ -323,13 +202,9 @@ void ModuleToFunctionPassAdaptorParallel::runOnModule() {
       funcAMPairs.emplace_back(&func, mam.slice(&func));
 
   // A parallel diagnostic handler that provides deterministic diagnostic
-  // ordering.
+  // ordering, and dumps any dangling diagnostics in the event of a crash.
   ParallelDiagnosticHandler diagHandler(getContext());
 
-  // A pretty stack entry to print any dangling diagnostics in the event of a
-  // crash.
-  PrettyStackTraceParallelDiagnosticEntry diagCrashEntry(diagHandler);
-
   // An index for the current function/analysis manager pair.
   std::atomic<unsigned> funcIt(0);
 
@@ -347,7 +222,7 @@ void ModuleToFunctionPassAdaptorParallel::runOnModule() {
             break;
 
           // Set the function id for this thread in the diagnostic handler.
-          diagHandler.setFuncIDForThread(nextID);
+          diagHandler.setOrderIDForThread(nextID);
 
           // Run the executor over the current function.
           auto &it = funcAMPairs[nextID];
@@ -395,10 +270,138 @@ PassManager::~PassManager() {}
 
 /// Run the passes within this manager on the provided module.
 LogicalResult PassManager::run(Module *module) {
+  // If reproducer generation is enabled, run the pipeline with crash recovery
+  // enabled.
+  if (!crashReproducerFileName.empty())
+    return runWithCrashRecovery(module);
+
   ModuleAnalysisManager mam(module, instrumentor.get());
   return mpe->run(module, mam);
 }
 
+/// Enable support for the pass manager to generate a reproducer on the event
+/// of a crash or a pass failure.
+void PassManager::enableCrashReproducerGeneration(StringRef outputFile) {
+  crashReproducerFileName = outputFile;
+}
+
+/// Run the pipeline on the given module within a crash recovery context,
+/// generating a reproducer on failure.
+LogicalResult PassManager::runWithCrashRecovery(Module *module) {
+  // Snapshot the input module before running the pipeline. The IR may be in an
+  // invalid state after a failure, so the reproducer can't be generated from
+  // the module after the fact.
+  std::string moduleSnapshot;
+  {
+    llvm::raw_string_ostream os(moduleSnapshot);
+    module->print(os);
+  }
+
+  // Safely invoke the pipeline within a recovery context.
+  // Note: Crashes on threads spawned by the parallel function adaptor are not
+  // recovered.
+  LogicalResult result = failure();
+  llvm::CrashRecoveryContext::Enable();
+  llvm::CrashRecoveryContext recoveryContext;
+  recoveryContext.RunSafelyOnThread([&] {
+    ModuleAnalysisManager mam(module, instrumentor.get());
+    result = mpe->run(module, mam);
+  });
+  llvm::CrashRecoveryContext::Disable();
+  if (succeeded(result))
+    return success();
+
+  // Generate the reproducer.
+  MLIRContext *context = module->getContext();
+  std::string error;
+  auto outputFile = openOutputFile(crashReproducerFileName, &error);
+  if (!outputFile) {
+    context->emitError(UnknownLoc::get(context),
+                       "failed to create reproducer: " + error);
+    return failure();
+  }
+
+  // The pipeline is quoted as a shell argument, so single quotes within it are
+  // escaped. Settings provided to passes through command line flags, rather
+  // than as pass options, aren't known to the pass manager.
+  std::string pipeline;
+  {
+    llvm::raw_string_ostream pipelineOS(pipeline);
+    printAsTextualPipeline(pipelineOS);
+  }
+  auto &os = outputFile->os();
+  os << "// configuration: -pass-pipeline='";
+  for (char c : pipeline) {
+    if (c == '\'')
+      os << "'\\''";
+    else
+      os << c;
+  }
+  os << "'";
+  if (!verifyPasses)
+    os << " -verify-each=false";
+  os << "\n// note: pass settings provided through command line flags rather "
+        "than pass options are not part of the configuration\n\n"
+     << moduleSnapshot;
+  outputFile->keep();
+
+  context->emitError(UnknownLoc::get(context),
+                     "A failure has been detected while processing the MLIR "
+                     "module, a reproducer has been generated in '" +
+                         crashReproducerFileName + "'");
+  return failure();
+}
+
+/// Print the given pass as an element of a textual pass pipeline.
+static void printPipelineElement(Pass *pass, raw_ostream &os) {
+  const PassInfo *info = pass->lookupPassInfo();
+  if (!info) {
+    os << '<' << pass->getName() << '>';
+    return;
+  }
+  os << info->getPassArgument();
+  if (!pass->getTextualOptions().empty())
+    os << '{' << pass->getTextualOptions() << '}';
+}
+
+/// Print the pipeline held by this pass manager in the textual pass pipeline
+/// syntax.
+void PassManager::printAsTextualPipeline(raw_ostream &os) {
+  bool first = true;
+  auto printSeparator = [&] {
+    if (!first)
+      os << ',';
+    first = false;
+  };
+  for (auto &pass : mpe->getPasses()) {
+    // The verifier passes are implicitly added by the pass manager.
+    if (isa<ModuleVerifier>(pass.get()))
+      continue;
+    if (!isModuleToFunctionAdaptorPass(pass.get())) {
+      printSeparator();
+      printPipelineElement(pass.get(), os);
+      continue;
+    }
+
+    // Each function pass adaptor is printed as a 'func' scope.
+    SmallVector<Pass *, 8> functionPasses;
+    auto &fpe = getAdaptorFunctionExecutor(pass.get());
+    for (auto &functionPass : fpe.getPasses())
+      if (!isa<FunctionVerifier>(functionPass.get()))
+        functionPasses.push_back(functionPass.get());
+    if (functionPasses.empty())
+      continue;
+    printSeparator();
+    os << "func(";
+    interleave(functionPasses,
+               [&](Pass *functionPass) {
+                 printPipelineElement(functionPass, os);
+               },
+               [&] { os << ','; });
+    os << ')';
+  }
+}
+
 /// Add an opaque pass pointer to the current manager. This takes ownership
 /// over the provided pass pointer.
 void PassManager::addPass(Pass *pass) {
@@ -453,6 +456,10 @@ void PassManager::addPass(FunctionPassBase *pass) {
     fpe->addPass(new FunctionVerifier());
 }
 
+/// Start a new function pipeline, so that subsequently added function passes
+/// are grouped within a new function pass executor.
+void PassManager::beginFunctionPipeline() { nestedExecutorStack.clear(); }
+
 /// Add the provided instrumentation to the pass manager. This takes ownership
 /// over the given pointer.
 void PassManager::addInstrumentation(PassInstrumentation *pi) {
@@ -480,7 +487,16 @@ FunctionAnalysisManager ModuleAnalysisManager::slice(Function *function) {
 }
 
 /// Invalidate any non preserved analyses.
-void ModuleAnalysisManager::invalidate(const detail::PreservedAnalyses &pa) {
+void ModuleAnalysisManager::invalidate(
+    const detail::PreservedAnalyses &pa,
+    const SmallPtrSetImpl<Function *> *changedFunctions,
+    const SmallPtrSetImpl<Function *> *erasedFunctions) {
+  // The analyses of erased functions are dropped regardless of 'pa', to avoid
+  // reusing them for a new function allocated at the same address.
+  if (erasedFunctions)
+    for (Function *func : *erasedFunctions)
+      functionAnalyses.erase(func);
+
   // If all analyses were preserved, then there is nothing to do here.
   if (pa.isAll())
     return;
@@ -488,6 +504,21 @@ void ModuleAnalysisManager::invalidate(const detail::PreservedAnalyses &pa) {
   // Invalidate the module analyses directly.
   moduleAnalyses.invalidate(pa);
 
+  // If the set of changed functions is known, only invalidate the analyses of
+  // those functions.
+  if (changedFunctions) {
+    for (Function *func : *changedFunctions) {
+      auto it = functionAnalyses.find(func);
+      if (it == functionAnalyses.end())
+        continue;
+      if (pa.isNone())
+        functionAnalyses.erase(it);
+      else
+        it->second.invalidate(pa);
+    }
+    return;
+  }
+
   // If no analyses were preserved, then just simply clear out the function
   // analysis results.
   if (pa.isNone()) {
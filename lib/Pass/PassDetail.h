@@ -57,6 +57,11 @@ public:
   /// Returns the number of passes held by this executor.
   size_t size() const { return passes.size(); }
 
+  /// Returns the passes held by this executor.
+  MutableArrayRef<std::unique_ptr<FunctionPassBase>> getPasses() {
+    return passes;
+  }
+
   static bool classof(const PassExecutor *pe) {
     return pe->getKind() == Kind::FunctionExecutor;
   }
@@ -82,6 +87,11 @@ public:
   /// pass pointer.
   void addPass(ModulePassBase *pass) { passes.emplace_back(pass); }
 
+  /// Returns the passes held by this executor.
+  MutableArrayRef<std::unique_ptr<ModulePassBase>> getPasses() {
+    return passes;
+  }
+
   static bool classof(const PassExecutor *pe) {
     return pe->getKind() == Kind::ModuleExecutor;
   }
@@ -139,6 +149,14 @@ inline bool isModuleToFunctionAdaptorPass(Pass *pass) {
          isa<ModuleToFunctionPassAdaptor>(pass);
 }
 
+/// Utility function to return the function pass executor held by the given
+/// ModuleToFunctionPassAdaptor instance.
+inline FunctionPassExecutor &getAdaptorFunctionExecutor(Pass *pass) {
+  if (auto *adaptor = dyn_cast<ModuleToFunctionPassAdaptorParallel>(pass))
+    return adaptor->getFunctionExecutor();
+  return cast<ModuleToFunctionPassAdaptor>(pass)->getFunctionExecutor();
+}
+
 /// Utility function to return if a pass refers to an adaptor pass. Adaptor
 /// passes are those that internally execute a pipeline, such as the
 /// ModuleToFunctionPassAdaptor.
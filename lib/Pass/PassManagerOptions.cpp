@@ -30,6 +30,11 @@ struct PassManagerOptions {
 
   PassManagerOptions();
 
+  //===--------------------------------------------------------------------===//
+  // Crash Reproducer Generator
+  //===--------------------------------------------------------------------===//
+  llvm::cl::opt<std::string> reproducerFile;
+
   //===--------------------------------------------------------------------===//
   // IR Printing
   //===--------------------------------------------------------------------===//
@@ -38,15 +43,19 @@ struct PassManagerOptions {
   llvm::cl::opt<bool> printBeforeAll;
   llvm::cl::opt<bool> printAfterAll;
   llvm::cl::opt<bool> printModuleScope;
+  llvm::cl::opt<bool> printAfterChange;
+  llvm::cl::opt<std::string> printFunctionFilter;
+  llvm::cl::opt<std::string> printOutputDirectory;
 
   /// Add an IR printing instrumentation if enabled by any 'print-ir' flags.
-  void addPrinterInstrumentation(PassManager &pm);
+  LogicalResult addPrinterInstrumentation(PassManager &pm);
 
   //===--------------------------------------------------------------------===//
   // Pass Timing
   //===--------------------------------------------------------------------===//
   llvm::cl::opt<bool> passTiming;
   llvm::cl::opt<PassTimingDisplayMode> passTimingDisplayMode;
+  llvm::cl::opt<bool> passTimingPatternStatistics;
 
   /// Add a pass timing instrumentation if enabled by 'pass-timing' flags.
   void addTimingInstrumentation(PassManager &pm);
@@ -57,9 +66,18 @@ static llvm::ManagedStatic<llvm::Optional<PassManagerOptions>> options;
 
 PassManagerOptions::PassManagerOptions()
     //===------------------------------------------------------------------===//
-    // IR Printing
+    // Crash Reproducer Generator
     //===------------------------------------------------------------------===//
-    : printBefore("print-ir-before",
+    : reproducerFile(
+          "pass-pipeline-crash-reproducer",
+          llvm::cl::desc("Generate a .mlir reproducer file at the given output "
+                         "path if the pass manager crashes or fails"),
+          llvm::cl::value_desc("filename")),
+
+      //===----------------------------------------------------------------===//
+      // IR Printing
+      //===----------------------------------------------------------------===//
+      printBefore("print-ir-before",
                   llvm::cl::desc("Print IR before specified passes")),
       printAfter("print-ir-after",
                  llvm::cl::desc("Print IR after specified passes")),
@@ -75,6 +93,23 @@ PassManagerOptions::PassManagerOptions()
                          "always print "
                          "a module IR"),
           llvm::cl::init(false)),
+      printAfterChange(
+          "print-ir-after-change",
+          llvm::cl::desc("When printing the IR after a pass, only print if "
+                         "the pass changed the IR"),
+          llvm::cl::init(false)),
+      printFunctionFilter(
+          "print-ir-function-filter",
+          llvm::cl::desc("When printing IR for print-ir-[before|after]{-all} "
+                         "only print functions with names matching the given "
+                         "regex"),
+          llvm::cl::value_desc("regex")),
+      printOutputDirectory(
+          "print-ir-output-dir",
+          llvm::cl::desc("When printing IR for print-ir-[before|after]{-all} "
+                         "asynchronously write the IR to a file per pass "
+                         "within the given directory"),
+          llvm::cl::value_desc("directory")),
 
       //===----------------------------------------------------------------===//
       // Pass Timing
@@ -89,10 +124,15 @@ PassManagerOptions::PassManagerOptions()
               clEnumValN(PassTimingDisplayMode::List, "list",
                          "display the results in a list sorted by total time"),
               clEnumValN(PassTimingDisplayMode::Pipeline, "pipeline",
-                         "display the results with a nested pipeline view"))) {}
+                         "display the results with a nested pipeline view"))),
+      passTimingPatternStatistics(
+          "pass-timing-pattern-statistics",
+          llvm::cl::desc("Collect statistics about the rewrite patterns "
+                         "applied by each pass, and display them with the "
+                         "pass timing data")) {}
 
 /// Add an IR printing instrumentation if enabled by any 'print-ir' flags.
-void PassManagerOptions::addPrinterInstrumentation(PassManager &pm) {
+LogicalResult PassManagerOptions::addPrinterInstrumentation(PassManager &pm) {
   std::function<bool(Pass *)> shouldPrintBeforePass, shouldPrintAfterPass;
 
   // Handle print-before.
@@ -123,17 +163,21 @@ void PassManagerOptions::addPrinterInstrumentation(PassManager &pm) {
 
   // If there are no valid printing filters, then just return.
   if (!shouldPrintBeforePass && !shouldPrintAfterPass)
-    return;
+    return success();
 
   // Otherwise, add the IR printing instrumentation.
-  pm.enableIRPrinting(shouldPrintBeforePass, shouldPrintAfterPass,
-                      printModuleScope, llvm::errs());
+  IRPrintingOptions printingOptions;
+  printingOptions.printAfterOnlyOnChange = printAfterChange;
+  printingOptions.functionFilter = printFunctionFilter;
+  printingOptions.outputDirectory = printOutputDirectory;
+  return pm.enableIRPrinting(shouldPrintBeforePass, shouldPrintAfterPass,
+                             printModuleScope, llvm::errs(), printingOptions);
 }
 
 /// Add a pass timing instrumentation if enabled by 'pass-timing' flags.
 void PassManagerOptions::addTimingInstrumentation(PassManager &pm) {
   if (passTiming)
-    pm.enableTiming(passTimingDisplayMode);
+    pm.enableTiming(passTimingDisplayMode, passTimingPatternStatistics);
 }
 
 void mlir::registerPassManagerCLOptions() {
@@ -142,12 +186,18 @@ void mlir::registerPassManagerCLOptions() {
     options->emplace();
 }
 
-void mlir::applyPassManagerCLOptions(PassManager &pm) {
+LogicalResult mlir::applyPassManagerCLOptions(PassManager &pm) {
+  // Generate a reproducer on crash/failure.
+  if ((*options)->reproducerFile.getNumOccurrences())
+    pm.enableCrashReproducerGeneration((*options)->reproducerFile);
+
   // Add the IR printing instrumentation.
-  (*options)->addPrinterInstrumentation(pm);
+  if (failed((*options)->addPrinterInstrumentation(pm)))
+    return failure();
 
   // Note: The pass timing instrumentation should be added last to avoid any
   // potential "ghost" timing from other instrumentations being unintentionally
   // included in the timing results.
   (*options)->addTimingInstrumentation(pm);
+  return success();
 }
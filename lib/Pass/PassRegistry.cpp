@@ -20,6 +20,8 @@
 #include "mlir/Pass/PassManager.h"
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
 
 using namespace mlir;
 
@@ -37,6 +39,139 @@ buildDefaultRegistryFn(PassAllocatorFunction allocator) {
   return [=](PassManager &pm) { pm.addPass(allocator()); };
 }
 
+//===----------------------------------------------------------------------===//
+// PassOptions
+//===----------------------------------------------------------------------===//
+
+/// Parse a set of options from the given string. Values may be quoted with
+/// '"' to contain spaces or '}', with '\' escaping '"' and '\' within the
+/// quotes.
+LogicalResult PassOptions::parse(StringRef options, PassOptions &result,
+                                 raw_ostream &errorStream) {
+  const char *curPtr = options.begin(), *end = options.end();
+  while (true) {
+    while (curPtr != end && isspace(*curPtr))
+      ++curPtr;
+    if (curPtr == end)
+      break;
+
+    const char *keyStart = curPtr;
+    while (curPtr != end && !isspace(*curPtr) && *curPtr != '=')
+      ++curPtr;
+    StringRef key(keyStart, curPtr - keyStart);
+    if (key.empty()) {
+      errorStream << "expected option key before '='";
+      return failure();
+    }
+
+    // Options without an explicit value are treated as boolean flags.
+    std::string rawValue = "true";
+    if (curPtr != end && *curPtr == '=') {
+      rawValue.clear();
+      if (++curPtr != end && *curPtr == '"') {
+        for (++curPtr; curPtr != end && *curPtr != '"'; ++curPtr) {
+          if (*curPtr == '\\' && curPtr + 1 != end)
+            ++curPtr;
+          rawValue += *curPtr;
+        }
+        if (curPtr == end) {
+          errorStream << "expected '\"' to end the value of option '" << key
+                      << "'";
+          return failure();
+        }
+        ++curPtr;
+      } else {
+        for (; curPtr != end && !isspace(*curPtr); ++curPtr)
+          rawValue += *curPtr;
+      }
+    }
+    if (!result.options.try_emplace(key, rawValue, false).second) {
+      errorStream << "option '" << key << "' was provided multiple times";
+      return failure();
+    }
+  }
+  return success();
+}
+
+/// Verify that all of the provided options were queried by the pass and
+/// successfully parsed.
+LogicalResult PassOptions::verify(StringRef passArg,
+                                  raw_ostream &errorStream) const {
+  if (!invalidOptions.empty()) {
+    auto &invalid = invalidOptions.front();
+    errorStream << "invalid value '" << invalid.second << "' for option '"
+                << invalid.first << "' of pass '" << passArg << "'";
+    return failure();
+  }
+  for (auto &it : options) {
+    if (it.second.second)
+      continue;
+    errorStream << "pass '" << passArg << "' does not support option '"
+                << it.first() << "'";
+    return failure();
+  }
+  return success();
+}
+
+void PassOptions::print(raw_ostream &os) const {
+  SmallVector<StringRef, 4> keys;
+  for (auto &it : options)
+    keys.push_back(it.first());
+  std::sort(keys.begin(), keys.end());
+  for (unsigned i = 0, e = keys.size(); i != e; ++i) {
+    if (i != 0)
+      os << ' ';
+    os << keys[i] << '=';
+
+    // Quote the values that would otherwise not parse back to the same value.
+    StringRef value = options.find(keys[i])->second.first;
+    if (value.find_first_of(" \t\n\r\v\f\"\\}") == StringRef::npos) {
+      os << value;
+      continue;
+    }
+    os << '"';
+    for (char c : value) {
+      if (c == '"' || c == '\\')
+        os << '\\';
+      os << c;
+    }
+    os << '"';
+  }
+}
+
+const std::string *PassOptions::lookup(StringRef key) const {
+  auto it = options.find(key);
+  if (it == options.end())
+    return nullptr;
+  it->second.second = true;
+  return &it->second.first;
+}
+
+void PassOptions::recordError(StringRef key, StringRef value) const {
+  invalidOptions.emplace_back(key.str(), value.str());
+}
+
+bool PassOptions::parseValue(StringRef rawValue, bool &value) {
+  if (rawValue == "true" || rawValue == "1") {
+    value = true;
+    return true;
+  }
+  if (rawValue == "false" || rawValue == "0") {
+    value = false;
+    return true;
+  }
+  return false;
+}
+
+bool PassOptions::parseValue(StringRef rawValue, double &value) {
+  return !rawValue.getAsDouble(value);
+}
+
+bool PassOptions::parseValue(StringRef rawValue, std::string &value) {
+  value = rawValue.str();
+  return true;
+}
+
 //===----------------------------------------------------------------------===//
 // PassPipelineInfo
 //===----------------------------------------------------------------------===//
@@ -62,13 +197,37 @@ void mlir::registerPassPipeline(StringRef arg, StringRef description,
 //===----------------------------------------------------------------------===//
 
 PassInfo::PassInfo(StringRef arg, StringRef description, const PassID *passID,
-                   PassAllocatorFunction allocator)
-    : PassRegistryEntry(arg, description, buildDefaultRegistryFn(allocator)),
-      passID(passID) {}
+                   PassOptionsAllocatorFunction allocator)
+    : PassRegistryEntry(
+          arg, description,
+          [=](PassManager &pm) { pm.addPass(allocator(PassOptions())); }),
+      passID(passID), allocator(allocator) {}
+
+/// Create a new instance of this pass configured with the given options.
+Pass *PassInfo::createPass(const PassOptions &options,
+                           raw_ostream &errorStream) const {
+  std::unique_ptr<Pass> pass(allocator(options));
+  if (failed(options.verify(getPassArgument(), errorStream)))
+    return nullptr;
+
+  // Record the options so that the pass can be printed back as part of a
+  // textual pipeline, e.g. within a crash reproducer.
+  llvm::raw_string_ostream os(pass->textualOptions);
+  options.print(os);
+  os.flush();
+  return pass.release();
+}
 
 void mlir::registerPass(StringRef arg, StringRef description,
                         const PassID *passID,
                         const PassAllocatorFunction &function) {
+  registerPass(arg, description, passID,
+               [=](const PassOptions &) { return function(); });
+}
+
+void mlir::registerPass(StringRef arg, StringRef description,
+                        const PassID *passID,
+                        const PassOptionsAllocatorFunction &function) {
   PassInfo passInfo(arg, description, passID, function);
   bool inserted = passRegistry->try_emplace(passID, passInfo).second;
   assert(inserted && "Pass registered multiple times");
@@ -83,6 +242,192 @@ const PassInfo *mlir::Pass::lookupPassInfo(const PassID *passID) {
   return &it->getSecond();
 }
 
+//===----------------------------------------------------------------------===//
+// Textual Pass Pipeline Parsing
+//===----------------------------------------------------------------------===//
+
+namespace {
+/// This class implements a recursive descent parser for textual pass
+/// pipelines, see 'parsePassPipeline' for the grammar.
+class PassPipelineParser {
+public:
+  PassPipelineParser(StringRef pipeline, PassManager &pm,
+                     raw_ostream &errorStream)
+      : pipeline(pipeline), curPtr(pipeline.begin()), pm(pm),
+        errorStream(errorStream) {}
+
+  /// Parse the full pipeline.
+  LogicalResult parse() {
+    if (failed(parsePipeline(/*inFunctionScope=*/false)))
+      return failure();
+    if (curPtr != pipeline.end())
+      return emitError(curPtr, "expected ',' or end of pipeline");
+    return success();
+  }
+
+private:
+  /// Parse a comma separated list of pipeline elements.
+  LogicalResult parsePipeline(bool inFunctionScope);
+
+  /// Parse a single pipeline element, i.e. a nested scope or a pass.
+  LogicalResult parseElement(bool inFunctionScope);
+
+  /// Parse the name of a pass or scope.
+  StringRef parseName();
+
+  /// Skip any whitespace at the current position.
+  void skipWhitespace() {
+    while (curPtr != pipeline.end() && isspace(*curPtr))
+      ++curPtr;
+  }
+
+  /// Consume the given character if it is next in the pipeline.
+  bool consumeIf(char c) {
+    skipWhitespace();
+    if (curPtr == pipeline.end() || *curPtr != c)
+      return false;
+    ++curPtr;
+    return true;
+  }
+
+  /// Emit an error at the given location, displaying the pipeline with a
+  /// caret pointing to the location.
+  LogicalResult emitError(const char *loc, const Twine &message) {
+    errorStream << "error: " << message << "\n";
+    errorStream << "  " << pipeline << "\n";
+    errorStream.indent(2 + (loc - pipeline.begin())) << "^\n";
+    return failure();
+  }
+
+  /// Returns the registry entry for the pass with the given argument, or null
+  /// if no such pass exists.
+  static const PassInfo *lookupPass(StringRef arg) {
+    for (auto &it : *passRegistry)
+      if (it.second.getPassArgument() == arg)
+        return &it.second;
+    return nullptr;
+  }
+
+  /// The full pipeline, and the current position within it.
+  StringRef pipeline;
+  const char *curPtr;
+
+  /// The pass manager to populate.
+  PassManager &pm;
+
+  /// The stream to emit errors to.
+  raw_ostream &errorStream;
+};
+} // end anonymous namespace
+
+LogicalResult PassPipelineParser::parsePipeline(bool inFunctionScope) {
+  do {
+    if (failed(parseElement(inFunctionScope)))
+      return failure();
+  } while (consumeIf(','));
+  return success();
+}
+
+StringRef PassPipelineParser::parseName() {
+  skipWhitespace();
+  const char *start = curPtr;
+  while (curPtr != pipeline.end() &&
+         (isalnum(*curPtr) || *curPtr == '-' || *curPtr == '_' ||
+          *curPtr == '.'))
+    ++curPtr;
+  return StringRef(start, curPtr - start);
+}
+
+LogicalResult PassPipelineParser::parseElement(bool inFunctionScope) {
+  skipWhitespace();
+  const char *nameLoc = curPtr;
+  StringRef name = parseName();
+  if (name.empty())
+    return emitError(nameLoc, "expected pass or pipeline scope name");
+
+  // Check for a nested pipeline scope.
+  if (consumeIf('(')) {
+    bool isFunctionScope = name == "func";
+    if (!isFunctionScope && name != "module")
+      return emitError(nameLoc, "unknown pipeline scope '" + name +
+                                    "', expected 'module' or 'func'");
+    if (inFunctionScope)
+      return emitError(nameLoc, "'" + name +
+                                    "' scope cannot be nested within a "
+                                    "'func' scope");
+
+    // Each scope begins and ends a distinct function pipeline.
+    pm.beginFunctionPipeline();
+    if (failed(parsePipeline(isFunctionScope)))
+      return failure();
+    if (!consumeIf(')'))
+      return emitError(curPtr, "expected ',' or ')' to end '" + name +
+                                   "' scope");
+    pm.beginFunctionPipeline();
+    return success();
+  }
+
+  // Otherwise, this is a pass with an optional set of options.
+  PassOptions options;
+  if (consumeIf('{')) {
+    // Skip over quoted option values, which may contain '}'.
+    const char *optionsLoc = curPtr;
+    for (bool inQuotes = false;
+         curPtr != pipeline.end() && (inQuotes || *curPtr != '}'); ++curPtr) {
+      if (*curPtr == '"')
+        inQuotes = !inQuotes;
+      else if (inQuotes && *curPtr == '\\' && curPtr + 1 != pipeline.end())
+        ++curPtr;
+    }
+    if (curPtr == pipeline.end())
+      return emitError(optionsLoc, "expected '}' to end pass options");
+
+    std::string errorMsg;
+    llvm::raw_string_ostream errorOS(errorMsg);
+    StringRef optionsStr(optionsLoc, curPtr++ - optionsLoc);
+    if (failed(PassOptions::parse(optionsStr, options, errorOS)))
+      return emitError(optionsLoc, errorOS.str());
+  }
+
+  // Check for a registered pass.
+  if (const PassInfo *passInfo = lookupPass(name)) {
+    std::string errorMsg;
+    llvm::raw_string_ostream errorOS(errorMsg);
+    Pass *pass = passInfo->createPass(options, errorOS);
+    if (!pass)
+      return emitError(nameLoc, errorOS.str());
+    if (inFunctionScope && !isa<FunctionPassBase>(pass)) {
+      delete pass;
+      return emitError(nameLoc, "'" + name +
+                                    "' is not a function pass and cannot be "
+                                    "nested within a 'func' scope");
+    }
+    pm.addPass(pass);
+    return success();
+  }
+
+  // Otherwise, check for a registered pass pipeline.
+  auto pipelineIt = passPipelineRegistry->find(name);
+  if (pipelineIt == passPipelineRegistry->end())
+    return emitError(nameLoc, "'" + name + "' does not refer to a "
+                                           "registered pass or pass pipeline");
+  if (!options.empty())
+    return emitError(nameLoc, "pass pipeline '" + name +
+                                  "' does not support options");
+  if (inFunctionScope)
+    return emitError(nameLoc, "pass pipeline '" + name +
+                                  "' cannot be nested within a 'func' scope");
+  pipelineIt->second.addToPipeline(pm);
+  return success();
+}
+
+/// Parse the given textual pass pipeline and add the passes to the given pass
+/// manager.
+LogicalResult mlir::parsePassPipeline(StringRef pipeline, PassManager &pm,
+                                      raw_ostream &errorStream) {
+  return PassPipelineParser(pipeline, pm, errorStream).parse();
+}
+
 //===----------------------------------------------------------------------===//
 // PassNameParser
 //===----------------------------------------------------------------------===//
@@ -16,12 +16,14 @@
 // =============================================================================
 
 #include "PassDetail.h"
+#include "mlir/IR/PatternMatch.h"
 #include "mlir/Pass/PassManager.h"
 #include "llvm/ADT/MapVector.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/Support/Format.h"
 #include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/Mutex.h"
 #include "llvm/Support/Threading.h"
 #include <chrono>
 
@@ -30,6 +32,8 @@ using namespace mlir::detail;
 
 constexpr llvm::StringLiteral kPassTimingDescription =
     "... Pass execution timing report ...";
+constexpr llvm::StringLiteral kPatternStatisticsDescription =
+    "... Pattern rewrite statistics ...";
 
 namespace {
 /// Simple record class to record timing information.
@@ -150,12 +154,16 @@ struct Timer {
 };
 
 struct PassTiming : public PassInstrumentation {
-  PassTiming(PassTimingDisplayMode displayMode) : displayMode(displayMode) {}
+  PassTiming(PassTimingDisplayMode displayMode, bool collectPatternStatistics)
+      : displayMode(displayMode),
+        collectPatternStatistics(collectPatternStatistics) {}
   ~PassTiming() { print(); }
 
   /// Setup the instrumentation hooks.
   void runBeforePass(Pass *pass, const llvm::Any &) override {
     startPassTimer(pass);
+    if (collectPatternStatistics && !isAdaptorPass(pass))
+      startPatternStatistics();
   }
   void runAfterPass(Pass *pass, const llvm::Any &) override;
   void runAfterPassFailed(Pass *pass, const llvm::Any &ir) override {
@@ -171,6 +179,16 @@ struct PassTiming : public PassInstrumentation {
   /// Print and clear the timing results.
   void print();
 
+  /// Start collecting pattern statistics for a pass on the current thread.
+  void startPatternStatistics();
+
+  /// Stop collecting pattern statistics for the given pass on the current
+  /// thread, and merge the results into the statistics for the pass.
+  void stopPatternStatistics(Pass *pass);
+
+  /// Print the collected pattern statistics.
+  void printPatternStatistics(raw_ostream &os);
+
   /// Start a new timer for the given pass.
   void startPassTimer(Pass *pass);
 
@@ -219,6 +237,27 @@ struct PassTiming : public PassInstrumentation {
 
   /// The display mode to use when printing the timing results.
   PassTimingDisplayMode displayMode;
+
+  /// A pattern statistics collector for an executing pass, along with the
+  /// collector that was active before it.
+  using ActivePatternStatistics =
+      std::pair<std::unique_ptr<PatternRewriteStatistics>,
+                PatternRewriteStatistics *>;
+
+  /// A stack of the currently active pattern statistics per thread.
+  DenseMap<uint64_t, SmallVector<ActivePatternStatistics, 2>>
+      activeThreadPatternStatistics;
+
+  /// The pattern statistics collected for each pass, merged by pass name.
+  llvm::MapVector<StringRef, PatternRewriteStatistics> patternStatistics;
+
+  /// Function passes may be run on multiple threads, so accesses to
+  /// 'activeThreadPatternStatistics' and 'patternStatistics' are guarded by
+  /// this mutex.
+  llvm::sys::SmartMutex<true> patternStatisticsMutex;
+
+  /// Flag that specifies if pattern statistics should be collected.
+  bool collectPatternStatistics;
 };
 } // end anonymous namespace
 
@@ -242,8 +281,32 @@ void PassTiming::startAnalysisTimer(llvm::StringRef name, AnalysisID *id) {
   timer->start();
 }
 
+/// Start collecting pattern statistics for a pass on the current thread.
+void PassTiming::startPatternStatistics() {
+  llvm::sys::SmartScopedLock<true> lock(patternStatisticsMutex);
+  auto &activeStats = activeThreadPatternStatistics[llvm::get_threadid()];
+  auto *stats = new PatternRewriteStatistics();
+  activeStats.emplace_back(std::unique_ptr<PatternRewriteStatistics>(stats),
+                           PatternRewriteStatistics::setActive(stats));
+}
+
+/// Stop collecting pattern statistics for the given pass on the current
+/// thread.
+void PassTiming::stopPatternStatistics(Pass *pass) {
+  llvm::sys::SmartScopedLock<true> lock(patternStatisticsMutex);
+  auto &activeStats = activeThreadPatternStatistics[llvm::get_threadid()];
+  assert(!activeStats.empty() && "expected active pattern statistics");
+  ActivePatternStatistics stats = activeStats.pop_back_val();
+  PatternRewriteStatistics::setActive(stats.second);
+  if (!stats.first->empty())
+    patternStatistics[pass->getName()].merge(*stats.first);
+}
+
 /// Stop a pass timer.
 void PassTiming::runAfterPass(Pass *pass, const llvm::Any &) {
+  if (collectPatternStatistics && !isAdaptorPass(pass))
+    stopPatternStatistics(pass);
+
   auto tid = llvm::get_threadid();
   auto &activeTimers = activeThreadTimers[tid];
   assert(!activeTimers.empty() && "expected active timer");
@@ -332,11 +395,29 @@ void PassTiming::print() {
     break;
   }
   printTimeEntry(*os, 0, "Total", totalTime, totalTime);
+
+  // Print any collected pattern statistics.
+  if (!patternStatistics.empty())
+    printPatternStatistics(*os);
   os->flush();
 
   // Reset root timers.
   rootTimers.clear();
   activeThreadTimers.clear();
+  patternStatistics.clear();
+}
+
+/// Print the collected pattern statistics.
+void PassTiming::printPatternStatistics(raw_ostream &os) {
+  os << "\n===" << std::string(73, '-') << "===\n";
+  unsigned padding = (80 - kPatternStatisticsDescription.size()) / 2;
+  os.indent(padding) << kPatternStatisticsDescription << '\n';
+  os << "===" << std::string(73, '-') << "===\n";
+
+  for (auto &it : patternStatistics) {
+    os << it.first << "\n";
+    it.second.print(os, /*indent=*/2);
+  }
 }
 
 /// Print the timing result in list mode.
@@ -393,10 +474,11 @@ void PassTiming::printResultsAsPipeline(raw_ostream &os, Timer *root,
 
 /// Add an instrumentation to time the execution of passes and the computation
 /// of analyses.
-void PassManager::enableTiming(PassTimingDisplayMode displayMode) {
+void PassManager::enableTiming(PassTimingDisplayMode displayMode,
+                               bool collectPatternStatistics) {
   // Check if pass timing is already enabled.
   if (passTiming)
     return;
-  addInstrumentation(new PassTiming(displayMode));
+  addInstrumentation(new PassTiming(displayMode, collectPatternStatistics));
   passTiming = true;
 }
@@ -20,7 +20,7 @@
 //
 //===----------------------------------------------------------------------===//
 
-#include "mlir/Analysis/Dominance.h"
+#include "CSEDriver.h"
 #include "mlir/IR/Attributes.h"
 #include "mlir/IR/Builders.h"
 #include "mlir/IR/Function.h"
@@ -30,53 +30,63 @@
 #include "mlir/Transforms/Utils.h"
 #include "llvm/ADT/DenseMapInfo.h"
 #include "llvm/ADT/Hashing.h"
-#include "llvm/ADT/ScopedHashTable.h"
 #include "llvm/Support/Allocator.h"
-#include "llvm/Support/RecyclingAllocator.h"
-#include <deque>
 using namespace mlir;
 
 namespace {
-// TODO(riverriddle) Handle commutative operations.
-struct SimpleOperationInfo : public llvm::DenseMapInfo<Operation *> {
-  static unsigned getHashValue(const Operation *opC) {
-    auto *op = const_cast<Operation *>(opC);
+/// The key identifying an operation in the table of known values.  The
+/// structural hash of the operation is computed once, when the operation is
+/// visited, and kept for the duration of the pass along with the properties
+/// that cheaply reject most of the unequal operations.
+struct OperationKey {
+  explicit OperationKey(Operation *op)
+      : op(op), name(op->getName()), numOperands(op->getNumOperands()),
+        numResults(op->getNumResults()) {
     // Hash the operations based upon their:
     //   - Operation Name
     //   - Attributes
     //   - Result Types
     //   - Operands
-    return hash_combine(
-        op->getName(), op->getAttrs(),
+    // Attribute lists are uniqued, so they are hashed by identity.
+    hash = hash_combine(
+        name, op->getAttrs().data(),
         hash_combine_range(op->result_type_begin(), op->result_type_end()),
         hash_combine_range(op->operand_begin(), op->operand_end()));
   }
-  static bool isEqual(const Operation *lhsC, const Operation *rhsC) {
-    auto *lhs = const_cast<Operation *>(lhsC);
-    auto *rhs = const_cast<Operation *>(rhsC);
+
+  Operation *op;
+  OperationName name;
+  unsigned numOperands, numResults;
+  unsigned hash;
+};
+
+// TODO(riverriddle) Handle commutative operations.
+struct SimpleOperationInfo : public llvm::DenseMapInfo<const OperationKey *> {
+  static unsigned getHashValue(const OperationKey *key) { return key->hash; }
+  static bool isEqual(const OperationKey *lhs, const OperationKey *rhs) {
     if (lhs == rhs)
       return true;
     if (lhs == getTombstoneKey() || lhs == getEmptyKey() ||
         rhs == getTombstoneKey() || rhs == getEmptyKey())
       return false;
 
-    // Compare the operation name.
-    if (lhs->getName() != rhs->getName())
-      return false;
-    // Check operand and result type counts.
-    if (lhs->getNumOperands() != rhs->getNumOperands() ||
-        lhs->getNumResults() != rhs->getNumResults())
+    // Compare the hash, the operation name, and the operand and result counts
+    // before looking at the operations themselves.
+    if (lhs->hash != rhs->hash || lhs->name != rhs->name ||
+        lhs->numOperands != rhs->numOperands ||
+        lhs->numResults != rhs->numResults)
       return false;
-    // Compare attributes.
-    if (lhs->getAttrs() != rhs->getAttrs())
+    auto *lhsOp = lhs->op, *rhsOp = rhs->op;
+    // Compare attributes, the attribute lists are uniqued.
+    if (lhsOp->getAttrs().data() != rhsOp->getAttrs().data())
       return false;
     // Compare operands.
-    if (!std::equal(lhs->operand_begin(), lhs->operand_end(),
-                    rhs->operand_begin()))
+    if (!std::equal(lhsOp->operand_begin(), lhsOp->operand_end(),
+                    rhsOp->operand_begin()))
       return false;
     // Compare result types.
-    return std::equal(lhs->result_type_begin(), lhs->result_type_end(),
-                      rhs->result_type_begin());
+    return std::equal(lhsOp->result_type_begin(), lhsOp->result_type_end(),
+                      rhsOp->result_type_begin());
   }
 };
 } // end anonymous namespace
@@ -87,161 +97,30 @@ struct CSE : public FunctionPass<CSE> {
   CSE() = default;
   CSE(const CSE &) {}
 
-  /// Shared implementation of operation elimination and scoped map definitions.
-  using AllocatorTy = llvm::RecyclingAllocator<
-      llvm::BumpPtrAllocator,
-      llvm::ScopedHashTableVal<Operation *, Operation *>>;
-  using ScopedMapTy = llvm::ScopedHashTable<Operation *, Operation *,
-                                            SimpleOperationInfo, AllocatorTy>;
-
-  /// Represents a single entry in the depth first traversal of a CFG.
-  struct CFGStackNode {
-    CFGStackNode(ScopedMapTy &knownValues, DominanceInfoNode *node)
-        : scope(knownValues), node(node), childIterator(node->begin()),
-          processed(false) {}
-
-    /// Scope for the known values.
-    ScopedMapTy::ScopeTy scope;
-
-    DominanceInfoNode *node;
-    DominanceInfoNode::iterator childIterator;
-
-    /// If this node has been fully processed yet or not.
-    bool processed;
-  };
-
-  /// Attempt to eliminate a redundant operation. Returns true if the operation
-  /// was marked for removal, false otherwise.
-  bool simplifyOperation(Operation *op);
-
-  void simplifyBlock(DominanceInfo &domInfo, Block *bb);
-  void simplifyRegion(DominanceInfo &domInfo, Region &region);
-
   void runOnFunction() override;
 
 private:
-  /// A scoped hash table of defining operations within a function.
-  ScopedMapTy knownValues;
-
-  /// Operations marked as dead and to be erased.
-  std::vector<Operation *> opsToErase;
+  /// The allocator for the keys of the known values, reset after each
+  /// function.
+  llvm::SpecificBumpPtrAllocator<OperationKey> keyAllocator;
 };
 } // end anonymous namespace
 
-/// Attempt to eliminate a redundant operation.
-bool CSE::simplifyOperation(Operation *op) {
-  // Don't simplify operations with nested blocks. We don't currently model
-  // equality comparisons correctly among other things. It is also unclear
-  // whether we would want to CSE such operations.
-  if (op->getNumRegions() != 0)
-    return false;
-
-  // TODO(riverriddle) We currently only eliminate non side-effecting
-  // operations.
-  if (!op->hasNoSideEffect())
-    return false;
-
-  // If the operation is already trivially dead just add it to the erase list.
-  if (op->use_empty()) {
-    opsToErase.push_back(op);
-    return true;
-  }
-
-  // Look for an existing definition for the operation.
-  if (auto *existing = knownValues.lookup(op)) {
-    // If we find one then replace all uses of the current operation with the
-    // existing one and mark it for deletion.
-    for (unsigned i = 0, e = existing->getNumResults(); i != e; ++i)
-      op->getResult(i)->replaceAllUsesWith(existing->getResult(i));
-    opsToErase.push_back(op);
-
-    // If the existing operation has an unknown location and the current
-    // operation doesn't, then set the existing op's location to that of the
-    // current op.
-    if (existing->getLoc().isa<UnknownLoc>() &&
-        !op->getLoc().isa<UnknownLoc>()) {
-      existing->setLoc(op->getLoc());
-    }
-    return true;
-  }
-
-  // Otherwise, we add this operation to the known values map.
-  knownValues.insert(op, op);
-  return false;
-}
-
-void CSE::simplifyBlock(DominanceInfo &domInfo, Block *bb) {
-  for (auto &i : *bb) {
-    // If the operation is simplified, we don't process any held regions.
-    if (simplifyOperation(&i))
-      continue;
-
-    // Simplify any held blocks.
-    for (auto &region : i.getRegions())
-      simplifyRegion(domInfo, region);
-  }
-}
-
-void CSE::simplifyRegion(DominanceInfo &domInfo, Region &region) {
-  // If the region is empty there is nothing to do.
-  if (region.empty())
-    return;
-
-  // If the region only contains one block, then simplify it directly.
-  if (std::next(region.begin()) == region.end()) {
-    ScopedMapTy::ScopeTy scope(knownValues);
-    simplifyBlock(domInfo, &region.front());
-    return;
-  }
-
-  // Note, deque is being used here because there was significant performance
-  // gains over vector when the container becomes very large due to the
-  // specific access patterns. If/when these performance issues are no
-  // longer a problem we can change this to vector. For more information see
-  // the llvm mailing list discussion on this:
-  // http://lists.llvm.org/pipermail/llvm-commits/Week-of-Mon-20120116/135228.html
-  std::deque<std::unique_ptr<CFGStackNode>> stack;
-
-  // Process the nodes of the dom tree for this region.
-  stack.emplace_back(llvm::make_unique<CFGStackNode>(
-      knownValues, domInfo.getRootNode(&region)));
-
-  while (!stack.empty()) {
-    auto &currentNode = stack.back();
-
-    // Check to see if we need to process this node.
-    if (!currentNode->processed) {
-      currentNode->processed = true;
-      simplifyBlock(domInfo, currentNode->node->getBlock());
-    }
-
-    // Otherwise, check to see if we need to process a child node.
-    if (currentNode->childIterator != currentNode->node->end()) {
-      auto *childNode = *(currentNode->childIterator++);
-      stack.emplace_back(
-          llvm::make_unique<CFGStackNode>(knownValues, childNode));
-    } else {
-      // Finally, if the node and all of its children have been processed
-      // then we delete the node.
-      stack.pop_back();
-    }
-  }
-}
-
 void CSE::runOnFunction() {
-  simplifyRegion(getAnalysis<DominanceInfo>(), getFunction().getBody());
+  auto getKey = [&](Operation *op) {
+    return new (keyAllocator.Allocate()) OperationKey(op);
+  };
+  detail::CSEDriver<OperationKey, SimpleOperationInfo> driver(
+      getAnalysis<DominanceInfo>(), getKey);
+  bool changed = driver.simplify(getFunction().getBody());
+  keyAllocator.DestroyAll();
 
   // If no operations were erased, then we mark all analyses as preserved.
-  if (opsToErase.empty()) {
+  if (!changed) {
     markAllAnalysesPreserved();
     return;
   }
 
-  /// Erase any operations that were marked as dead during simplification.
-  for (auto *op : opsToErase)
-    op->erase();
-  opsToErase.clear();
-
   // We currently don't remove region operations, so mark dominance as
   // preserved.
   markAnalysesPreserved<DominanceInfo, PostDominanceInfo>();
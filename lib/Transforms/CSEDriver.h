@@ -0,0 +1,215 @@
+//===- CSEDriver.h - Dominator-scoped redundancy elimination ----*- C++ -*-===//
+//
+// Copyright 2019 The MLIR Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =============================================================================
+//
+// This file implements the driver shared by the CSE and GVN passes: a walk of
+// the dominance tree of a region that keeps the operations computing the known
+// values in a scoped hash table, and replaces the side-effect free operations
+// whose key is already known.  The passes only differ in how they normalize an
+// operation into the key identifying the value it computes.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef MLIR_TRANSFORMS_CSEDRIVER_H_
+#define MLIR_TRANSFORMS_CSEDRIVER_H_
+
+#include "mlir/Analysis/Dominance.h"
+#include "mlir/IR/Operation.h"
+#include "llvm/ADT/ScopedHashTable.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/RecyclingAllocator.h"
+#include <deque>
+
+namespace mlir {
+namespace detail {
+
+/// Eliminates the redundant side-effect free operations of a region.  `KeyT` is
+/// the key identifying the value computed by an operation, and `KeyInfoT` the
+/// DenseMapInfo used to hash and compare pointers to such keys.
+template <typename KeyT, typename KeyInfoT> class CSEDriver {
+public:
+  /// The hook normalizing an operation into its key.  The returned key must
+  /// live as long as the driver.
+  using GetKeyFn = llvm::function_ref<const KeyT *(Operation *)>;
+
+  CSEDriver(DominanceInfo &domInfo, GetKeyFn getKey)
+      : domInfo(domInfo), getKey(getKey) {}
+
+  /// Simplify the given region and erase the eliminated operations. Returns
+  /// true if any operation was erased.
+  bool simplify(Region &region) {
+    simplifyRegion(region);
+    if (opsToErase.empty())
+      return false;
+
+    /// Erase any operations that were marked as dead during simplification.
+    for (auto *op : opsToErase)
+      op->erase();
+    opsToErase.clear();
+    return true;
+  }
+
+private:
+  using AllocatorTy = llvm::RecyclingAllocator<
+      llvm::BumpPtrAllocator,
+      llvm::ScopedHashTableVal<const KeyT *, Operation *>>;
+  using ScopedMapTy =
+      llvm::ScopedHashTable<const KeyT *, Operation *, KeyInfoT, AllocatorTy>;
+
+  /// Represents a single entry in the depth first traversal of a CFG.
+  struct CFGStackNode {
+    CFGStackNode(ScopedMapTy &knownValues, DominanceInfoNode *node)
+        : scope(knownValues), node(node), childIterator(node->begin()),
+          processed(false) {}
+
+    /// Scope for the known values.
+    typename ScopedMapTy::ScopeTy scope;
+
+    DominanceInfoNode *node;
+    DominanceInfoNode::iterator childIterator;
+
+    /// If this node has been fully processed yet or not.
+    bool processed;
+  };
+
+  /// Attempt to eliminate a redundant operation. Returns true if the operation
+  /// was marked for removal, false otherwise.
+  bool simplifyOperation(Operation *op);
+
+  void simplifyBlock(Block *bb);
+  void simplifyRegion(Region &region);
+
+  DominanceInfo &domInfo;
+  GetKeyFn getKey;
+
+  /// A scoped hash table of the operations computing the known values.  The
+  /// scopes follow the dominance tree, and the nested regions of an operation
+  /// are simplified within the scope of the operation, so the values known
+  /// outside of a region are reused within.
+  ScopedMapTy knownValues;
+
+  /// Operations marked as dead and to be erased.
+  std::vector<Operation *> opsToErase;
+};
+
+template <typename KeyT, typename KeyInfoT>
+bool CSEDriver<KeyT, KeyInfoT>::simplifyOperation(Operation *op) {
+  // Don't simplify operations with nested blocks. We don't currently model
+  // equality comparisons correctly among other things. It is also unclear
+  // whether we would want to CSE such operations.
+  if (op->getNumRegions() != 0)
+    return false;
+
+  // TODO(riverriddle) We currently only eliminate non side-effecting
+  // operations.
+  if (!op->hasNoSideEffect())
+    return false;
+
+  // If the operation is already trivially dead just add it to the erase list.
+  if (op->use_empty()) {
+    opsToErase.push_back(op);
+    return true;
+  }
+
+  // Look for an existing definition for the operation.
+  auto *key = getKey(op);
+  if (auto *existing = knownValues.lookup(key)) {
+    // If we find one then replace all uses of the current operation with the
+    // existing one and mark it for deletion.
+    for (unsigned i = 0, e = existing->getNumResults(); i != e; ++i)
+      op->getResult(i)->replaceAllUsesWith(existing->getResult(i));
+    opsToErase.push_back(op);
+
+    // If the existing operation has an unknown location and the current
+    // operation doesn't, then set the existing op's location to that of the
+    // current op.
+    if (existing->getLoc().isa<UnknownLoc>() &&
+        !op->getLoc().isa<UnknownLoc>()) {
+      existing->setLoc(op->getLoc());
+    }
+    return true;
+  }
+
+  // Otherwise, we add this operation to the known values map.
+  knownValues.insert(key, op);
+  return false;
+}
+
+template <typename KeyT, typename KeyInfoT>
+void CSEDriver<KeyT, KeyInfoT>::simplifyBlock(Block *bb) {
+  for (auto &i : *bb) {
+    // If the operation is simplified, we don't process any held regions.
+    if (simplifyOperation(&i))
+      continue;
+
+    // Simplify any held blocks.
+    for (auto &region : i.getRegions())
+      simplifyRegion(region);
+  }
+}
+
+template <typename KeyT, typename KeyInfoT>
+void CSEDriver<KeyT, KeyInfoT>::simplifyRegion(Region &region) {
+  // If the region is empty there is nothing to do.
+  if (region.empty())
+    return;
+
+  // If the region only contains one block, then simplify it directly.
+  if (std::next(region.begin()) == region.end()) {
+    typename ScopedMapTy::ScopeTy scope(knownValues);
+    simplifyBlock(&region.front());
+    return;
+  }
+
+  // Note, deque is being used here because there was significant performance
+  // gains over vector when the container becomes very large due to the
+  // specific access patterns. If/when these performance issues are no
+  // longer a problem we can change this to vector. For more information see
+  // the llvm mailing list discussion on this:
+  // http://lists.llvm.org/pipermail/llvm-commits/Week-of-Mon-20120116/135228.html
+  std::deque<std::unique_ptr<CFGStackNode>> stack;
+
+  // Process the nodes of the dom tree for this region.
+  stack.emplace_back(llvm::make_unique<CFGStackNode>(
+      knownValues, domInfo.getRootNode(&region)));
+
+  while (!stack.empty()) {
+    auto &currentNode = stack.back();
+
+    // Check to see if we need to process this node.
+    if (!currentNode->processed) {
+      currentNode->processed = true;
+      simplifyBlock(currentNode->node->getBlock());
+    }
+
+    // Otherwise, check to see if we need to process a child node.
+    if (currentNode->childIterator != currentNode->node->end()) {
+      auto *childNode = *(currentNode->childIterator++);
+      stack.emplace_back(
+          llvm::make_unique<CFGStackNode>(knownValues, childNode));
+    } else {
+      // Finally, if the node and all of its children have been processed
+      // then we delete the node.
+      stack.pop_back();
+    }
+  }
+}
+
+} // end namespace detail
+} // end namespace mlir
+
+#endif // MLIR_TRANSFORMS_CSEDRIVER_H_
@@ -34,22 +34,35 @@ namespace {
 
 /// Canonicalize operations in functions.
 struct Canonicalizer : public FunctionPass<Canonicalizer> {
+  explicit Canonicalizer(bool parallelRegions = false)
+      : parallelRegions(parallelRegions) {}
+
   void runOnFunction() override;
+
+  /// Whether the operations with regions at the top level of the function are
+  /// canonicalized concurrently.
+  bool parallelRegions;
 };
 } // end anonymous namespace
 
 void Canonicalizer::runOnFunction() {
-  OwningRewritePatternList patterns;
   auto &func = getFunction();
 
   // TODO: Instead of adding all known patterns from the whole system lazily add
   // and cache the canonicalization patterns for ops we see in practice when
   // building the worklist.  For now, we just grab everything.
   auto *context = &getContext();
-  for (auto *op : context->getRegisteredOperations())
-    op->getCanonicalizationPatterns(patterns, context);
+  auto getPatterns = [context]() -> OwningRewritePatternList {
+    OwningRewritePatternList patterns;
+    for (auto *op : context->getRegisteredOperations())
+      op->getCanonicalizationPatterns(patterns, context);
+    return patterns;
+  };
 
-  applyPatternsGreedily(func, std::move(patterns));
+  if (parallelRegions)
+    applyPatternsGreedilyInParallel(func, getPatterns);
+  else
+    applyPatternsGreedily(func, getPatterns());
 }
 
 /// Create a Canonicalizer pass.
@@ -57,5 +70,14 @@ FunctionPassBase *mlir::createCanonicalizerPass() {
   return new Canonicalizer();
 }
 
-static PassRegistration<Canonicalizer> pass("canonicalize",
-                                            "Canonicalize operations");
+/// Allocate a Canonicalizer pass configured from the options of a textual pass
+/// pipeline, e.g. 'canonicalize{parallel-regions=true}'.
+static Pass *createRegisteredCanonicalizerPass(const PassOptions &options) {
+  bool parallelRegions = false;
+  options.getOption("parallel-regions", parallelRegions);
+  return new Canonicalizer(parallelRegions);
+}
+
+static PassRegistration<Canonicalizer>
+    pass("canonicalize", "Canonicalize operations",
+         createRegisteredCanonicalizerPass);
@@ -22,85 +22,161 @@
 #include "mlir/Transforms/DialectConversion.h"
 #include "mlir/IR/BlockAndValueMapping.h"
 #include "mlir/IR/Builders.h"
+#include "mlir/IR/Diagnostics.h"
 #include "mlir/IR/Function.h"
 #include "mlir/IR/Module.h"
-#include "mlir/Transforms/Utils.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Support/Parallel.h"
+#include "llvm/Support/Threading.h"
+#include <atomic>
 
 using namespace mlir;
 
+#define DEBUG_TYPE "dialect-conversion"
+
+STATISTIC(NumTypeConversionCacheHits,
+          "Number of type conversions found in the cache");
+STATISTIC(NumTypeConversionCacheMisses,
+          "Number of type conversions computed by the converter");
+
 namespace mlir {
 namespace impl {
-// Implementation detail class of the DialectConversion pass.  Performs
-// function-by-function conversions by creating new functions, filling them in
-// with converted blocks, updating the function attributes, and replacing the
-// old functions with the new ones in the module.
+// Implementation detail class of the DialectConversion pass.  Converts a single
+// function in place: operations matched by a conversion pattern are rewritten,
+// the operands of the remaining operations are updated to use the converted
+// values, and blocks get new arguments of the converted types.  Every
+// modification is recorded, so that the conversion can later be either
+// committed, by erasing the replaced operations and block arguments, or rolled
+// back, by restoring the original function.  The replaced operations and
+// arguments are kept until then, so that patterns can still inspect the
+// original types of the operands.  The conversion of a function only modifies
+// that function, so functions can be converted independently of each other.
 class FunctionConversion {
 public:
   // Entry point.  Uses hooks defined in `conversion` to obtain the list of
   // conversion patterns and to convert function and block argument types.
-  // Converts the `module` in-place by replacing all existing functions with the
-  // converted ones.
+  // Converts each function of the `module` in-place.  If any function fails to
+  // convert, all functions are rolled back and the module is left unmodified.
   static LogicalResult convert(DialectConversion *conversion, Module *module);
 
 private:
-  // Constructs a FunctionConversion by storing the hooks.
-  explicit FunctionConversion(DialectConversion *conversion)
-      : dialectConversion(conversion) {}
+  // Constructs a FunctionConversion of `function` with the given hooks and
+  // conversion patterns.
+  FunctionConversion(DialectConversion *conversion,
+                     const llvm::DenseSet<DialectOpConversion *> &conversions,
+                     Function *function)
+      : dialectConversion(conversion), conversions(conversions),
+        function(function) {}
+
+  // Converts the function signature and body in place.  On failure, the
+  // function may be partially converted and must be rolled back.
+  LogicalResult run();
+
+  // Finalizes a successful conversion by erasing the replaced operations and
+  // block arguments.
+  void commit();
+
+  // Restores the function to its state before the conversion.
+  void rollback();
+
+  // Emits an error on the function being converted.
+  LogicalResult emitError(const llvm::Twine &message) {
+    MLIRContext *context = function->getContext();
+    context->emitError(UnknownLoc::get(context), message);
+    return failure();
+  }
 
-  // Utility that looks up a list of value in the value remapping table. Returns
-  // an empty vector if one of the values is not mapped yet.
+  // Utility that looks up a list of values in the value remapping table.
+  // Values that were not remapped are returned as is.
   SmallVector<Value *, 4> lookupValues(Operation::operand_range operands);
 
-  // Converts the given function to the dialect using hooks defined in
-  // `dialectConversion`.  Returns the converted function or `nullptr` on error.
-  Function *convertFunction(Function *f);
-
-  // Converts the given region starting from the entry block and following the
-  // block successors.  Returns the converted region or `nullptr` on error.
-  template <typename RegionParent>
-  std::unique_ptr<Region> convertRegion(MLIRContext *context, Region *region,
-                                        RegionParent *parent);
+  // Returns the first conversion pattern that matches `op`, or null if there
+  // is none.
+  DialectOpConversion *findConversion(Operation *op);
 
   // Converts an operation with successors.  Extracts the converted operands
-  // from `valueRemapping` and the converted blocks from `blockRemapping`, and
-  // passes them to `converter->rewriteTerminator` function defined in the
-  // pattern, together with `builder`.
+  // from `mapping`, and passes them to `converter->rewriteTerminator` function
+  // defined in the pattern, together with `builder`.
   LogicalResult convertOpWithSuccessors(DialectOpConversion *converter,
                                         Operation *op, FuncBuilder &builder);
 
   // Converts an operation without successors.  Extracts the converted operands
-  // from `valueRemapping` and passes them to the `converter->rewrite` function
-  // defined in the pattern, together with `builder`.
+  // from `mapping` and passes them to the `converter->rewrite` function defined
+  // in the pattern, together with `builder`.
   LogicalResult convertOp(DialectOpConversion *converter, Operation *op,
                           FuncBuilder &builder);
 
+  // Rewrites `op` with `converter`, inserting the new operations before `op`.
+  // The original operation is kept until the conversion is committed.
+  LogicalResult rewriteOp(DialectOpConversion *converter, Operation *op,
+                          FuncBuilder &builder);
+
+  // Updates the operands of an operation that is not converted to use the
+  // converted values.
+  void updateOperands(Operation *op);
+
   // Converts a block by traversing its operations sequentially, looking for
   // the first pattern match and dispatching the operation conversion to
-  // either `convertOp` or `convertOpWithSuccessors` depending on the presence
-  // of successors.  If there is no match, clones the operation.
+  // `rewriteOp`.  If there is no match, updates the operands of the operation
+  // in place and converts its regions, if any.
   //
   // After converting operations, traverses the successor blocks unless they
   // have been visited already as indicated in `visitedBlocks`.
   LogicalResult convertBlock(Block *block, FuncBuilder &builder,
                              llvm::DenseSet<Block *> &visitedBlocks);
 
-  // Converts the module as follows.
-  // 1. Call `convertFunction` on each function of the module and collect the
-  // mapping between old and new functions.
-  // 2. Remap all function attributes in the new functions to point to the new
-  // functions instead of the old ones.
-  // 3. Replace old functions with the new in the module.
-  LogicalResult run(Module *m);
+  // Converts the argument types of the given block in place.
+  LogicalResult convertBlockArguments(Block *block);
+
+  // Converts the given region starting from the entry block and following the
+  // block successors.
+  LogicalResult convertRegion(Region &region);
+
+  // Converts the function signature in place.
+  LogicalResult convertSignature();
 
   // Pointer to a specific dialect pass.
   DialectConversion *dialectConversion;
 
   // Set of known conversion patterns.
-  llvm::DenseSet<DialectOpConversion *> conversions;
+  const llvm::DenseSet<DialectOpConversion *> &conversions;
 
-  // Mapping between values(blocks) in the original function and in the new
-  // function.
+  // The function being converted.
+  Function *function;
+
+  // Mapping between the results of the replaced operations, or the replaced
+  // block arguments, and the values that replace them.
   BlockAndValueMapping mapping;
+
+  //===--------------------------------------------------------------------===//
+  // Rollback log.
+  //===--------------------------------------------------------------------===//
+
+  // The operations that were rewritten, in the order of their conversion.
+  // These are erased when the conversion is committed.
+  SmallVector<Operation *, 16> replacedOps;
+
+  // The operations created by the conversion patterns.  These are erased when
+  // the conversion is rolled back.
+  SmallVector<Operation *, 16> createdOps;
+
+  // The operands of unconverted operations that were updated to use converted
+  // values, along with their original values.
+  struct OperandUpdate {
+    Operation *op;
+    unsigned index;
+    Value *originalValue;
+  };
+  SmallVector<OperandUpdate, 16> operandUpdates;
+
+  // The blocks whose arguments were converted, along with their original
+  // number of arguments.  The converted arguments are appended after the
+  // original ones.
+  SmallVector<std::pair<Block *, unsigned>, 8> convertedBlocks;
+
+  // The original signature of the function.
+  FunctionType originalType;
+  SmallVector<NamedAttributeList, 4> originalArgAttrs;
 };
 } // end namespace impl
 } // end namespace mlir
@@ -109,22 +185,28 @@ SmallVector<Value *, 4>
 impl::FunctionConversion::lookupValues(Operation::operand_range operands) {
   SmallVector<Value *, 4> remapped;
   remapped.reserve(llvm::size(operands));
-  for (Value *operand : operands) {
-    Value *value = mapping.lookupOrNull(operand);
-    if (!value)
-      return {};
-    remapped.push_back(value);
-  }
+  for (Value *operand : operands)
+    remapped.push_back(mapping.lookupOrDefault(operand));
   return remapped;
 }
 
+DialectOpConversion *impl::FunctionConversion::findConversion(Operation *op) {
+  for (auto *conversion : conversions) {
+    // Ignore patterns that are for the wrong root or are impossible to match.
+    if (conversion->getRootKind() != op->getName() ||
+        conversion->getBenefit().isImpossibleToMatch())
+      continue;
+    if (conversion->match(op))
+      return conversion;
+  }
+  return nullptr;
+}
+
 LogicalResult impl::FunctionConversion::convertOpWithSuccessors(
     DialectOpConversion *converter, Operation *op, FuncBuilder &builder) {
   SmallVector<Block *, 2> destinations;
   destinations.reserve(op->getNumSuccessors());
   SmallVector<Value *, 4> operands = lookupValues(op->getOperands());
-  assert((!operands.empty() || op->getNumOperands() == 0) &&
-         "converting op before ops defining its operands");
 
   SmallVector<ArrayRef<Value *>, 2> operandsPerDestination;
   unsigned numSuccessorOperands = 0;
@@ -133,9 +215,8 @@ LogicalResult impl::FunctionConversion::convertOpWithSuccessors(
   unsigned seen = 0;
   unsigned firstSuccessorOperand = op->getNumOperands() - numSuccessorOperands;
   for (unsigned i = 0, e = op->getNumSuccessors(); i < e; ++i) {
-    Block *successor = mapping.lookupOrNull(op->getSuccessor(i));
-    assert(successor && "block was not remapped");
-    destinations.push_back(successor);
+    // Blocks are converted in place, so the successors are left unchanged.
+    destinations.push_back(op->getSuccessor(i));
     unsigned n = op->getNumSuccessorOperands(i);
     operandsPerDestination.push_back(
         llvm::makeArrayRef(operands.data() + firstSuccessorOperand + seen, n));
@@ -153,9 +234,6 @@ LogicalResult
 impl::FunctionConversion::convertOp(DialectOpConversion *converter,
                                     Operation *op, FuncBuilder &builder) {
   auto operands = lookupValues(op->getOperands());
-  assert((!operands.empty() || op->getNumOperands() == 0) &&
-         "converting op before ops defining its operands");
-
   auto results = converter->rewrite(op, operands, builder);
   if (results.size() != op->getNumResults())
     return (op->emitError("rewriting produced a different number of results"),
@@ -166,45 +244,61 @@ impl::FunctionConversion::convertOp(DialectOpConversion *converter,
   return success();
 }
 
+LogicalResult
+impl::FunctionConversion::rewriteOp(DialectOpConversion *converter,
+                                    Operation *op, FuncBuilder &builder) {
+  // Remember the operation preceding `op`, so that the operations created by
+  // the pattern can be identified.
+  Operation *prevOp = op->getPrevNode();
+  builder.setInsertionPoint(op);
+
+  LogicalResult result = op->getNumSuccessors() != 0
+                             ? convertOpWithSuccessors(converter, op, builder)
+                             : convertOp(converter, op, builder);
+
+  // Record the operations inserted between `prevOp` and `op` by the pattern,
+  // even on failure, so that they are erased on rollback.
+  auto it =
+      prevOp ? std::next(Block::iterator(prevOp)) : op->getBlock()->begin();
+  for (; &*it != op; ++it)
+    createdOps.push_back(&*it);
+  replacedOps.push_back(op);
+  return result;
+}
+
+void impl::FunctionConversion::updateOperands(Operation *op) {
+  for (unsigned i = 0, e = op->getNumOperands(); i != e; ++i) {
+    Value *operand = op->getOperand(i);
+    Value *newValue = mapping.lookupOrNull(operand);
+    if (!newValue || newValue == operand)
+      continue;
+    operandUpdates.push_back({op, i, operand});
+    op->setOperand(i, newValue);
+  }
+}
+
 LogicalResult
 impl::FunctionConversion::convertBlock(Block *block, FuncBuilder &builder,
                                        llvm::DenseSet<Block *> &visitedBlocks) {
   // First, add the current block to the list of visited blocks.
   visitedBlocks.insert(block);
-  // Setup the builder to the insert to the converted block.
-  builder.setInsertionPointToStart(mapping.lookupOrNull(block));
 
-  // Iterate over ops and convert them.
-  for (Operation &op : *block) {
+  // Iterate over ops and convert them.  The new operations are inserted before
+  // the converted operation, so they are not visited.
+  for (Operation &op : llvm::make_early_inc_range(*block)) {
     // Find the first matching conversion and apply it.
-    bool converted = false;
-    for (auto *conversion : conversions) {
-      // Ignore patterns that are for the wrong root or are impossible to match.
-      if (conversion->getRootKind() != op.getName() ||
-          conversion->getBenefit().isImpossibleToMatch())
-        continue;
-
-      if (!conversion->match(&op))
-        continue;
-
-      if (op.getNumSuccessors() != 0) {
-        if (failed(convertOpWithSuccessors(conversion, &op, builder)))
-          return failure();
-      } else if (failed(convertOp(conversion, &op, builder))) {
+    if (auto *conversion = findConversion(&op)) {
+      if (failed(rewriteOp(conversion, &op, builder)))
         return failure();
-      }
-      converted = true;
-      break;
-    }
-    // If there is no conversion provided for the op, clone the op and convert
-    // its regions, if any.
-    if (!converted) {
-      auto *newOp = builder.cloneWithoutRegions(op, mapping);
-      for (int i = 0, e = op.getNumRegions(); i < e; ++i) {
-        auto newRegion = convertRegion(op.getContext(), &op.getRegion(i), &op);
-        newOp->getRegion(i).takeBody(*newRegion);
-      }
+      continue;
     }
+
+    // If there is no conversion provided for the op, keep the op and convert
+    // its operands and regions, if any.
+    updateOperands(&op);
+    for (auto &region : op.getRegions())
+      if (failed(convertRegion(region)))
+        return failure();
   }
 
   // Recurse to children unless they have been already visited.
@@ -217,126 +311,231 @@ impl::FunctionConversion::convertBlock(Block *block, FuncBuilder &builder,
   return success();
 }
 
-template <typename RegionParent>
-std::unique_ptr<Region>
-impl::FunctionConversion::convertRegion(MLIRContext *context, Region *region,
-                                        RegionParent *parent) {
-  assert(region && "expected a region");
-  auto newRegion = llvm::make_unique<Region>(parent);
-  if (region->empty())
-    return newRegion;
-
-  auto emitError = [context](llvm::Twine f) -> std::unique_ptr<Region> {
-    context->emitError(UnknownLoc::get(context), f.str());
-    return nullptr;
-  };
-
-  // Create new blocks and convert their arguments.
-  for (Block &block : *region) {
-    auto *newBlock = new Block;
-    newRegion->push_back(newBlock);
-    mapping.map(&block, newBlock);
-    for (auto *arg : block.getArguments()) {
-      auto convertedType = dialectConversion->convertType(arg->getType());
-      if (!convertedType)
-        return emitError("could not convert block argument type");
-      newBlock->addArgument(convertedType);
-      mapping.map(arg, *newBlock->args_rbegin());
-    }
+LogicalResult impl::FunctionConversion::convertBlockArguments(Block *block) {
+  SmallVector<Type, 4> convertedTypes;
+  bool changed = false;
+  for (auto *arg : block->getArguments()) {
+    auto convertedType = dialectConversion->lookupOrConvertType(arg->getType());
+    if (!convertedType)
+      return emitError("could not convert block argument type");
+    convertedTypes.push_back(convertedType);
+    changed |= convertedType != arg->getType();
   }
 
+  // Leave the block untouched if none of the argument types change.
+  if (!changed)
+    return success();
+
+  // Otherwise, append the converted arguments after the original ones.
+  unsigned numArgs = block->getNumArguments();
+  convertedBlocks.emplace_back(block, numArgs);
+  for (unsigned i = 0; i != numArgs; ++i)
+    mapping.map(block->getArgument(i), block->addArgument(convertedTypes[i]));
+  return success();
+}
+
+LogicalResult impl::FunctionConversion::convertRegion(Region &region) {
+  if (region.empty())
+    return success();
+
+  // Convert the block arguments.
+  for (Block &block : region)
+    if (failed(convertBlockArguments(&block)))
+      return failure();
+
   // Start a DFS-order traversal of the CFG to make sure defs are converted
   // before uses in dominated blocks.
   llvm::DenseSet<Block *> visitedBlocks;
-  FuncBuilder builder(&newRegion->front());
-  if (failed(convertBlock(&region->front(), builder, visitedBlocks)))
-    return nullptr;
+  FuncBuilder builder(function);
+  if (failed(convertBlock(&region.front(), builder, visitedBlocks)))
+    return failure();
 
   // If some blocks are not reachable through successor chains, they should have
   // been removed by the DCE before this.
-
-  if (visitedBlocks.size() != std::distance(region->begin(), region->end()))
+  if (visitedBlocks.size() != std::distance(region.begin(), region.end()))
     return emitError("unreachable blocks were not converted");
-  return newRegion;
+  return success();
 }
 
-Function *impl::FunctionConversion::convertFunction(Function *f) {
-  assert(f && "expected function");
-  MLIRContext *context = f->getContext();
-  auto emitError = [context](llvm::Twine f) -> Function * {
-    context->emitError(UnknownLoc::get(context), f.str());
-    return nullptr;
-  };
-
-  // Create a new function with argument types and result types converted. Wrap
-  // it into a unique_ptr to make sure it is cleaned up in case of error.
+LogicalResult impl::FunctionConversion::convertSignature() {
   SmallVector<NamedAttributeList, 4> newFunctionArgAttrs;
-  Type newFunctionType = dialectConversion->convertFunctionSignatureType(
-      f->getType(), f->getAllArgAttrs(), newFunctionArgAttrs);
+  FunctionType newFunctionType =
+      dialectConversion->convertFunctionSignatureType(
+          function->getType(), function->getAllArgAttrs(),
+          newFunctionArgAttrs);
   if (!newFunctionType)
     return emitError("could not convert function type");
-  auto newFunction = llvm::make_unique<Function>(
-      f->getLoc(), f->getName().strref(), newFunctionType.cast<FunctionType>(),
-      f->getAttrs(), newFunctionArgAttrs);
+
+  // Record the original signature before updating it.
+  originalType = function->getType();
+  auto argAttrs = function->getAllArgAttrs();
+  originalArgAttrs.assign(argAttrs.begin(), argAttrs.end());
+
+  function->setType(newFunctionType);
+  argAttrs = function->getAllArgAttrs();
+  for (unsigned i = 0,
+                e = std::min(argAttrs.size(), newFunctionArgAttrs.size());
+       i != e; ++i)
+    argAttrs[i] = newFunctionArgAttrs[i];
+  return success();
+}
+
+LogicalResult impl::FunctionConversion::run() {
+  if (failed(convertSignature()))
+    return failure();
 
   // Return early if the function has no blocks.
-  if (f->getBlocks().empty())
-    return newFunction.release();
+  if (function->getBlocks().empty())
+    return success();
 
-  auto newBody = convertRegion(context, &f->getBody(), f);
-  if (!newBody)
+  if (failed(convertRegion(function->getBody())))
     return emitError("could not convert function body");
-  newFunction->getBody().takeBody(*newBody);
+  return success();
+}
 
-  return newFunction.release();
+void impl::FunctionConversion::commit() {
+  // The replaced operations may use the results of each other, so drop all of
+  // their references before erasing them.
+  for (auto *op : replacedOps)
+    op->dropAllReferences();
+  for (auto *op : llvm::reverse(replacedOps)) {
+    // Any remaining uses of the results are replaced with the converted values.
+    for (auto *result : op->getResults())
+      if (auto *newValue = mapping.lookupOrNull(result))
+        result->replaceAllUsesWith(newValue);
+    op->erase();
+  }
+
+  // Erase the original arguments of the converted blocks.  The terminators of
+  // the predecessors already forward the converted arguments only.
+  for (auto &block : convertedBlocks) {
+    for (unsigned i = 0; i != block.second; ++i) {
+      auto *arg = block.first->getArgument(0);
+      arg->replaceAllUsesWith(mapping.lookupOrNull(arg));
+      block.first->eraseArgument(0, /*updatePredTerms=*/false);
+    }
+  }
 }
 
-LogicalResult impl::FunctionConversion::convert(DialectConversion *conversion,
-                                                Module *module) {
-  return impl::FunctionConversion(conversion).run(module);
+void impl::FunctionConversion::rollback() {
+  // Restore the operands of the operations that were kept.
+  for (auto &update : llvm::reverse(operandUpdates))
+    update.op->setOperand(update.index, update.originalValue);
+
+  // Erase the operations created by the conversion patterns.
+  for (auto *op : createdOps)
+    op->dropAllReferences();
+  for (auto *op : llvm::reverse(createdOps))
+    op->erase();
+
+  // Erase the converted block arguments, and restore the function signature.
+  for (auto &block : convertedBlocks)
+    while (block.first->getNumArguments() != block.second)
+      block.first->eraseArgument(block.first->getNumArguments() - 1,
+                                 /*updatePredTerms=*/false);
+  if (originalType) {
+    function->setType(originalType);
+    std::copy(originalArgAttrs.begin(), originalArgAttrs.end(),
+              function->getAllArgAttrs().begin());
+  }
+}
+
+// Moves the functions that were appended to `module` after `lastFunction` to
+// the end of the module, sorted by name.
+static void sortAddedFunctions(Module *module, Function *lastFunction) {
+  auto &functions = module->getFunctions();
+  auto firstAdded = lastFunction ? std::next(Module::iterator(lastFunction))
+                                 : functions.begin();
+  std::vector<Function *> addedFunctions;
+  for (auto &func : llvm::make_range(firstAdded, functions.end()))
+    addedFunctions.push_back(&func);
+  std::stable_sort(addedFunctions.begin(), addedFunctions.end(),
+                   [](Function *lhs, Function *rhs) {
+                     return lhs->getName().strref() < rhs->getName().strref();
+                   });
+  for (auto *func : addedFunctions)
+    functions.splice(functions.end(), functions, Module::iterator(func));
 }
 
-LogicalResult impl::FunctionConversion::run(Module *module) {
+LogicalResult impl::FunctionConversion::convert(DialectConversion *conversion,
+                                                Module *module) {
   if (!module)
     return failure();
 
-  MLIRContext *context = module->getContext();
-  conversions = dialectConversion->initConverters(context);
+  auto conversions = conversion->initConverters(module->getContext());
+  conversion->typeCache.clear();
 
-  // Convert the functions but don't add them to the module yet to avoid
-  // converted functions to be converted again.
-  SmallVector<Function *, 0> originalFuncs, convertedFuncs;
-  DenseMap<Attribute, FunctionAttr> functionAttrRemapping;
-  originalFuncs.reserve(module->getFunctions().size());
+  // Collect the functions to convert up front, so that functions added to the
+  // module by the conversion patterns, e.g. declarations of runtime functions,
+  // are not converted.
+  std::vector<std::unique_ptr<FunctionConversion>> functionConversions;
+  functionConversions.reserve(module->getFunctions().size());
   for (auto &func : *module)
-    originalFuncs.push_back(&func);
-  convertedFuncs.reserve(module->getFunctions().size());
-  for (auto *func : originalFuncs) {
-    Function *converted = convertFunction(func);
-    if (!converted)
-      return failure();
-
-    auto origFuncAttr = FunctionAttr::get(func, context);
-    auto convertedFuncAttr = FunctionAttr::get(converted, context);
-    convertedFuncs.push_back(converted);
-    functionAttrRemapping.insert({origFuncAttr, convertedFuncAttr});
+    functionConversions.emplace_back(
+        new FunctionConversion(conversion, conversions, &func));
+  Function *lastFunction = functionConversions.empty()
+                               ? nullptr
+                               : functionConversions.back()->function;
+
+  // Convert the functions in place, concurrently if multi-threading is
+  // enabled.  The conversion of each function only modifies that function, so
+  // they can be converted independently.
+  bool multithreaded = conversion->multithreaded &&
+                       llvm::llvm_is_multithreaded() &&
+                       functionConversions.size() > 1;
+  bool conversionFailed = false;
+  if (multithreaded) {
+    // A parallel diagnostic handler that provides deterministic diagnostic
+    // ordering.
+    ParallelDiagnosticHandler diagHandler(*module->getContext());
+
+    std::atomic<bool> anyFailed(false);
+    llvm::parallel::for_each_n(
+        llvm::parallel::par, size_t(0), functionConversions.size(),
+        [&](size_t i) {
+          // Skip the remaining functions once a conversion failed.
+          if (anyFailed)
+            return;
+          diagHandler.setOrderIDForThread(i);
+          if (failed(functionConversions[i]->run()))
+            anyFailed = true;
+        });
+    conversionFailed = anyFailed;
+  } else {
+    for (auto &functionConversion : functionConversions) {
+      if (failed(functionConversion->run())) {
+        conversionFailed = true;
+        break;
+      }
+    }
   }
 
-  // Remap function attributes in the converted functions (they are not yet in
-  // the module).  Original functions will disappear anyway so there is no
-  // need to remap attributes in them.
-  for (const auto &funcPair : functionAttrRemapping) {
-    remapFunctionAttrs(*funcPair.getSecond().getValue(), functionAttrRemapping);
+  // If any function failed to convert, roll back all of them.  Rolling back a
+  // function that was not converted is a no-op.  Otherwise, commit the
+  // conversion of each function.
+  if (conversionFailed) {
+    for (auto &functionConversion : llvm::reverse(functionConversions))
+      functionConversion->rollback();
+  } else if (multithreaded) {
+    llvm::parallel::for_each(
+        llvm::parallel::par, functionConversions.begin(),
+        functionConversions.end(),
+        [](std::unique_ptr<FunctionConversion> &functionConversion) {
+          functionConversion->commit();
+        });
+  } else {
+    for (auto &functionConversion : functionConversions)
+      functionConversion->commit();
   }
 
-  // Remove original functions from the module, then insert converted
-  // functions.  The order is important to avoid name collisions.
-  for (auto &func : originalFuncs)
-    func->erase();
-  for (auto *func : convertedFuncs)
-    module->getFunctions().push_back(func);
+  // The functions added by the patterns are appended to the module in an order
+  // that depends on the scheduling of the threads.  Sort them by name, as a
+  // post-pass, so that the resulting module is deterministic.
+  sortAddedFunctions(module, lastFunction);
 
-  return success();
+  NumTypeConversionCacheHits += conversion->typeCache.getNumHits();
+  NumTypeConversionCacheMisses += conversion->typeCache.getNumMisses();
+  return failure(conversionFailed);
 }
 
 // Create a function type with arguments and results converted, and argument
@@ -349,11 +548,11 @@ FunctionType DialectConversion::convertFunctionSignatureType(
 
   arguments.reserve(type.getNumInputs());
   for (auto t : type.getInputs())
-    arguments.push_back(convertType(t));
+    arguments.push_back(lookupOrConvertType(t));
 
   results.reserve(type.getNumResults());
   for (auto t : type.getResults())
-    results.push_back(convertType(t));
+    results.push_back(lookupOrConvertType(t));
 
   // Note this will cause an extra allocation only if we need
   // to grow the caller-provided resulting attribute vector.
@@ -364,6 +563,11 @@ FunctionType DialectConversion::convertFunctionSignatureType(
   return FunctionType::get(arguments, results, type.getContext());
 }
 
+Type DialectConversion::lookupOrConvertType(Type t) {
+  return typeCache.lookupOrConvert(
+      t, [this](Type type) { return convertType(type); });
+}
+
 LogicalResult DialectConversion::convert(Module *m) {
   return impl::FunctionConversion::convert(this, m);
 }
@@ -0,0 +1,152 @@
+//===- GVN.cpp - Global value numbering -----------------------------------===//
+//
+// Copyright 2019 The MLIR Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =============================================================================
+//
+// This transformation pass performs a dominator-based global value numbering
+// of the side-effect free operations in a function.  Unlike CSE, which only
+// eliminates structurally identical operations, operations are numbered by a
+// normalized form of the value they compute: the operands of commutative
+// operations are ordered, and `affine.apply` operations are numbered by the
+// composition of their chain of `affine.apply` operands.
+//
+//===----------------------------------------------------------------------===//
+
+#include "CSEDriver.h"
+#include "mlir/AffineOps/AffineOps.h"
+#include "mlir/IR/Function.h"
+#include "mlir/Pass/Pass.h"
+#include "mlir/Transforms/Passes.h"
+#include "llvm/ADT/DenseMapInfo.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/Support/Allocator.h"
+using namespace mlir;
+
+namespace {
+/// The normalized expression computed by a side-effect free operation.
+/// Operations with equal expressions compute the same values.
+struct ValueExpr {
+  ValueExpr(Operation *op, const NamedAttribute *attrs, AffineMap map,
+            ArrayRef<Value *> operands)
+      : op(op), name(op->getName()), attrs(attrs), map(map),
+        operands(operands) {
+    hash = hash_combine(
+        name, attrs, map, hash_combine_range(operands.begin(), operands.end()),
+        hash_combine_range(op->result_type_begin(), op->result_type_end()));
+  }
+
+  /// The operation computing the expression.
+  Operation *op;
+
+  OperationName name;
+
+  /// The uniqued attribute list of the operation.  This is null for
+  /// `affine.apply` operations, which are identified by `map` instead.
+  const NamedAttribute *attrs;
+  AffineMap map;
+
+  /// The normalized operands of the operation.
+  ArrayRef<Value *> operands;
+
+  unsigned hash;
+};
+
+struct ValueExprInfo : public llvm::DenseMapInfo<const ValueExpr *> {
+  static unsigned getHashValue(const ValueExpr *expr) { return expr->hash; }
+  static bool isEqual(const ValueExpr *lhs, const ValueExpr *rhs) {
+    if (lhs == rhs)
+      return true;
+    if (lhs == getTombstoneKey() || lhs == getEmptyKey() ||
+        rhs == getTombstoneKey() || rhs == getEmptyKey())
+      return false;
+
+    if (lhs->hash != rhs->hash || lhs->name != rhs->name ||
+        lhs->attrs != rhs->attrs || lhs->map != rhs->map ||
+        !lhs->operands.equals(rhs->operands))
+      return false;
+
+    // Compare result types.
+    auto *lhsOp = lhs->op, *rhsOp = rhs->op;
+    return lhsOp->getNumResults() == rhsOp->getNumResults() &&
+           std::equal(lhsOp->result_type_begin(), lhsOp->result_type_end(),
+                      rhsOp->result_type_begin());
+  }
+};
+} // end anonymous namespace
+
+namespace {
+/// Global value numbering.
+struct GVN : public FunctionPass<GVN> {
+  GVN() = default;
+  GVN(const GVN &) {}
+
+  /// Compute the normalized expression of the given operation.
+  const ValueExpr *getValueExpr(Operation *op);
+
+  void runOnFunction() override;
+
+private:
+  /// The allocator for the expressions of the known values and their operands,
+  /// reset after each function.
+  llvm::BumpPtrAllocator exprAllocator;
+};
+} // end anonymous namespace
+
+const ValueExpr *GVN::getValueExpr(Operation *op) {
+  SmallVector<Value *, 8> operands(op->operand_begin(), op->operand_end());
+  auto *attrs = op->getAttrs().data();
+  AffineMap map;
+  if (auto apply = op->dyn_cast<AffineApplyOp>()) {
+    // Number the apply operations by the composition of their chain of apply
+    // operands, so that the chains composing to the same map are equivalent.
+    map = apply.getAffineMap();
+    fullyComposeAffineMapAndOperands(&map, &operands);
+    canonicalizeMapAndOperands(&map, &operands);
+    map = simplifyAffineMap(map);
+    attrs = nullptr;
+  } else if (op->isCommutative()) {
+    // The order of the operands of commutative operations doesn't matter, so
+    // order them by address.
+    std::sort(operands.begin(), operands.end());
+  }
+
+  auto *storage = exprAllocator.Allocate<Value *>(operands.size());
+  std::uninitialized_copy(operands.begin(), operands.end(), storage);
+  return new (exprAllocator.Allocate<ValueExpr>())
+      ValueExpr(op, attrs, map, llvm::makeArrayRef(storage, operands.size()));
+}
+
+void GVN::runOnFunction() {
+  // The operations are numbered by the CSE driver, keyed on their normalized
+  // expression rather than on their structure.
+  auto getKey = [&](Operation *op) { return getValueExpr(op); };
+  detail::CSEDriver<ValueExpr, ValueExprInfo> driver(
+      getAnalysis<DominanceInfo>(), getKey);
+  bool changed = driver.simplify(getFunction().getBody());
+  exprAllocator.Reset();
+
+  // If no operations were erased, then we mark all analyses as preserved.
+  if (!changed) {
+    markAllAnalysesPreserved();
+    return;
+  }
+
+  // We don't remove region operations, so mark dominance as preserved.
+  markAnalysesPreserved<DominanceInfo, PostDominanceInfo>();
+}
+
+FunctionPassBase *mlir::createGVNPass() { return new GVN(); }
+
+static PassRegistration<GVN> pass("gvn", "Global value numbering");
@@ -27,6 +27,7 @@
 #include "mlir/IR/AffineExpr.h"
 #include "mlir/IR/AffineMap.h"
 #include "mlir/IR/Builders.h"
+#include "mlir/IR/Diagnostics.h"
 #include "mlir/Pass/Pass.h"
 #include "mlir/StandardOps/Ops.h"
 #include "mlir/Transforms/LoopUtils.h"
@@ -37,6 +38,7 @@
 #include "llvm/ADT/SetVector.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/Parallel.h"
 #include "llvm/Support/raw_ostream.h"
 #include <iomanip>
 #include <sstream>
@@ -47,6 +49,20 @@ using llvm::SetVector;
 
 using namespace mlir;
 
+namespace {
+/// The kinds of loop nests fused by the pass.
+enum class FusionMode {
+  /// Fuse producer-consumer pairs, then sibling nests, then the remaining
+  /// producers into all their consumers.
+  Greedy,
+  /// Only fuse producer-consumer pairs.
+  ProducerConsumer,
+  /// Only fuse sibling nests which read a common memref, when this saves
+  /// memory traffic.
+  Sibling,
+};
+} // end anonymous namespace
+
 static llvm::cl::OptionCategory clOptionsCategory(DEBUG_TYPE " options");
 
 /// Disables fusion profitability check and fuses if valid. Ignore any
@@ -77,6 +93,40 @@ static llvm::cl::opt<unsigned long long> clFusionLocalBufThreshold(
                    "memory space"),
     llvm::cl::cat(clOptionsCategory));
 
+static llvm::cl::opt<FusionMode> clFusionMode(
+    "fusion-mode", llvm::cl::desc("The kinds of loop nests to fuse"),
+    llvm::cl::values(
+        clEnumValN(FusionMode::Greedy, "greedy",
+                   "Producer-consumer and sibling fusion (default)"),
+        clEnumValN(FusionMode::ProducerConsumer, "producer-consumer",
+                   "Only producer-consumer fusion"),
+        clEnumValN(FusionMode::Sibling, "sibling",
+                   "Only fusion of sibling loop nests sharing an input")),
+    llvm::cl::init(FusionMode::Greedy), llvm::cl::cat(clOptionsCategory));
+
+// The fraction of the bytes accessed by two sibling loop nests which fusing
+// them must save for sibling fusion to be profitable.
+static llvm::cl::opt<double> clFusionSiblingMinSavings(
+    "fusion-sibling-min-savings",
+    llvm::cl::desc("Minimum fraction of the memory footprint of two sibling "
+                   "loop nests saved by fusing them"),
+    llvm::cl::cat(clOptionsCategory));
+
+// Caps the profitability analysis of each fusion candidate to the given number
+// of destination loop depths, starting at the deepest one.
+static llvm::cl::opt<unsigned> clFusionDepthBudget(
+    "fusion-depth-budget",
+    llvm::cl::desc("Maximum number of destination loop depths evaluated per "
+                   "fusion candidate (0 for no limit)"),
+    llvm::cl::cat(clOptionsCategory));
+
+// Evaluates the destination loop depths of each fusion candidate concurrently.
+static llvm::cl::opt<bool> clFusionParallelDepths(
+    "fusion-parallel-depths",
+    llvm::cl::desc("Evaluate the destination loop depths of each fusion "
+                   "candidate concurrently"),
+    llvm::cl::init(false), llvm::cl::cat(clOptionsCategory));
+
 namespace {
 
 /// Loop fusion pass. This pass currently supports a greedy fusion policy,
@@ -90,9 +140,7 @@ namespace {
 
 struct LoopFusion : public FunctionPass<LoopFusion> {
   LoopFusion(unsigned fastMemorySpace = 0, uint64_t localBufSizeThreshold = 0,
-             bool maximalFusion = false)
-      : localBufSizeThreshold(localBufSizeThreshold),
-        fastMemorySpace(fastMemorySpace), maximalFusion(maximalFusion) {}
+             bool maximalFusion = false);
 
   void runOnFunction() override;
 
@@ -103,14 +151,52 @@ struct LoopFusion : public FunctionPass<LoopFusion> {
   // If true, ignore any additional (redundant) computation tolerance threshold
   // that would have prevented fusion.
   bool maximalFusion;
-
   // The amount of additional computation that is tolerated while fusing
   // pair-wise as a fraction of the total computation.
+  double computeToleranceThreshold = kComputeToleranceThreshold;
+  // The maximum number of destination loop depths at which the profitability
+  // of each fusion candidate is evaluated, or zero for no limit.
+  unsigned depthBudget = 0;
+  // If true, the destination loop depths of each fusion candidate are
+  // evaluated concurrently.
+  bool parallelDepths = false;
+  // The kinds of loop nests to fuse.
+  FusionMode mode = FusionMode::Greedy;
+  // The minimum fraction of the memory footprint of two sibling loop nests
+  // which must be saved by fusing them, if provided. The sibling mode requires
+  // some savings otherwise, and the greedy mode doesn't check them.
+  Optional<double> minSiblingSavings;
+
+  // The default amount of additional computation that is tolerated while
+  // fusing pair-wise as a fraction of the total computation.
   constexpr static double kComputeToleranceThreshold = 0.30f;
 };
 
 } // end anonymous namespace
 
+LoopFusion::LoopFusion(unsigned fastMemorySpace, uint64_t localBufSizeThreshold,
+                       bool maximalFusion)
+    : localBufSizeThreshold(localBufSizeThreshold),
+      fastMemorySpace(fastMemorySpace), maximalFusion(maximalFusion) {
+  // Override if a command line argument was provided.
+  if (clFusionFastMemorySpace.getNumOccurrences() > 0)
+    this->fastMemorySpace = clFusionFastMemorySpace.getValue();
+  if (clFusionLocalBufThreshold.getNumOccurrences() > 0)
+    this->localBufSizeThreshold = clFusionLocalBufThreshold * 1024;
+  if (clMaximalLoopFusion.getNumOccurrences() > 0)
+    this->maximalFusion = clMaximalLoopFusion;
+  if (clFusionAddlComputeTolerance.getNumOccurrences() > 0)
+    computeToleranceThreshold = clFusionAddlComputeTolerance;
+  if (clFusionDepthBudget.getNumOccurrences() > 0)
+    depthBudget = clFusionDepthBudget;
+  if (clFusionParallelDepths.getNumOccurrences() > 0)
+    parallelDepths = clFusionParallelDepths;
+  if (clFusionMode.getNumOccurrences() > 0)
+    mode = clFusionMode;
+  if (clFusionSiblingMinSavings.getNumOccurrences() > 0)
+    minSiblingSavings = clFusionSiblingMinSavings.getValue();
+}
+
 FunctionPassBase *mlir::createLoopFusionPass(unsigned fastMemorySpace,
                                              uint64_t localBufSizeThreshold,
                                              bool maximalFusion) {
@@ -141,6 +227,55 @@ struct LoopNestStateCollector {
   }
 };
 
+// LoopNestStats aggregates various per-loop statistics (eg. loop trip count
+// and operation count) for a loop nest up until the innermost loop body.
+struct LoopNestStats {
+  // Map from AffineForOp to immediate child AffineForOps in its loop body.
+  DenseMap<Operation *, SmallVector<AffineForOp, 2>> loopMap;
+  // Map from AffineForOp to count of operations in its loop body.
+  DenseMap<Operation *, uint64_t> opCountMap;
+  // Map from AffineForOp to its constant trip count.
+  DenseMap<Operation *, uint64_t> tripCountMap;
+};
+
+// LoopNestStatsCollector walks a single loop nest and gathers per-loop
+// trip count and operation count statistics and records them in 'stats'.
+struct LoopNestStatsCollector {
+  LoopNestStats *stats;
+  bool hasLoopWithNonConstTripCount = false;
+
+  LoopNestStatsCollector(LoopNestStats *stats) : stats(stats) {}
+
+  void collect(Operation *op) {
+    op->walk<AffineForOp>([&](AffineForOp forOp) {
+      auto *forInst = forOp.getOperation();
+      auto *parentInst = forOp.getOperation()->getParentOp();
+      if (parentInst != nullptr) {
+        assert(parentInst->isa<AffineForOp>() && "Expected parent AffineForOp");
+        // Add mapping to 'forOp' from its parent AffineForOp.
+        stats->loopMap[parentInst].push_back(forOp);
+      }
+
+      // Record the number of op operations in the body of 'forOp'.
+      unsigned count = 0;
+      stats->opCountMap[forInst] = 0;
+      for (auto &op : *forOp.getBody()) {
+        if (!op.isa<AffineForOp>() && !op.isa<AffineIfOp>())
+          ++count;
+      }
+      stats->opCountMap[forInst] = count;
+      // Record trip count for 'forOp'. Set flag if trip count is not
+      // constant.
+      Optional<uint64_t> maybeConstTripCount = getConstantTripCount(forOp);
+      if (!maybeConstTripCount.hasValue()) {
+        hasLoopWithNonConstTripCount = true;
+        return;
+      }
+      stats->tripCountMap[forInst] = maybeConstTripCount.getValue();
+    });
+  }
+};
+
 // TODO(b/117228571) Replace when this is modeled through side-effects/op traits
 static bool isMemRefDereferencingOp(Operation &op) {
   if (op.isa<LoadOp>() || op.isa<StoreOp>() || op.isa<DmaStartOp>() ||
@@ -168,6 +303,9 @@ public:
     SmallVector<Operation *, 4> loads;
     // List of store op insts.
     SmallVector<Operation *, 4> stores;
+    // Incremented each time the operation rooted at 'op' is modified, so that
+    // state derived from an earlier version of the node can be detected.
+    unsigned version = 0;
     Node(unsigned id, Operation *op) : id(id), op(op) {}
 
     // Returns the load op count for 'memref'.
@@ -241,12 +379,41 @@ public:
     Value *value;
   };
 
+  // Analysis state of the loop nest of a node which is expensive to compute
+  // and is queried for each fusion candidate involving the node. It is
+  // computed on demand and dropped whenever the node is modified.
+  struct NodeAnalysis {
+    // Statistics of the loop nest, if 'statsComputed' is true. Only valid if
+    // all loops of the nest have a constant trip count.
+    bool statsComputed = false;
+    bool hasConstTripCounts = false;
+    LoopNestStats stats;
+    // Memory footprint of the loop nest in bytes, if 'footprintComputed'.
+    bool footprintComputed = false;
+    Optional<int64_t> footprintBytes;
+    // Map from a store op of the node to the size in bytes of the region it
+    // writes at loop depth zero.
+    DenseMap<Operation *, Optional<int64_t>> writeRegionSizeBytes;
+  };
+
+  // Key identifying the edge from a source node to a destination node for a
+  // value.
+  using EdgeKey = std::pair<std::pair<unsigned, unsigned>, Value *>;
+
   // Map from node id to Node.
   DenseMap<unsigned, Node> nodes;
+  // Map from the operation of a node to the node id.
+  DenseMap<Operation *, unsigned> opToNodeId;
   // Map from node id to list of input edges.
   DenseMap<unsigned, SmallVector<Edge, 2>> inEdges;
   // Map from node id to list of output edges.
   DenseMap<unsigned, SmallVector<Edge, 2>> outEdges;
+  // Set of all edges in the graph, for constant time edge queries.
+  DenseSet<EdgeKey> edgeSet;
+  // Map from node id to its cached analysis state. The state is allocated
+  // separately so that references to it remain valid while other entries are
+  // inserted.
+  DenseMap<unsigned, std::unique_ptr<NodeAnalysis>> nodeAnalyses;
   // Map from memref to a count on the dependence edges associated with that
   // memref.
   DenseMap<Value *, unsigned> memrefEdgeCount;
@@ -268,19 +435,84 @@ public:
 
   // Returns the graph node for 'forOp'.
   Node *getForOpNode(AffineForOp forOp) {
-    for (auto &idAndNode : nodes)
-      if (idAndNode.second.op == forOp.getOperation())
-        return &idAndNode.second;
-    return nullptr;
+    auto it = opToNodeId.find(forOp.getOperation());
+    if (it == opToNodeId.end())
+      return nullptr;
+    return getNode(it->second);
   }
 
   // Adds a node with 'op' to the graph and returns its unique identifier.
   unsigned addNode(Operation *op) {
     Node node(nextNodeId++, op);
     nodes.insert({node.id, node});
+    opToNodeId[op] = node.id;
     return node.id;
   }
 
+  // Replaces the operation of node 'id' with 'op', e.g. after its loop nest
+  // has been permuted such that another loop is at the root.
+  void setNodeOp(unsigned id, Operation *op) {
+    Node *node = getNode(id);
+    opToNodeId.erase(node->op);
+    node->op = op;
+    opToNodeId[op] = id;
+  }
+
+  // Drops the cached analysis state of node 'id' and bumps its version. Must
+  // be called whenever the operation of the node is modified.
+  void invalidateNode(unsigned id) {
+    nodeAnalyses.erase(id);
+    ++getNode(id)->version;
+  }
+
+  // Returns the cached analysis state of node 'id', allocating it if needed.
+  NodeAnalysis &getNodeAnalysis(unsigned id) {
+    auto &analysis = nodeAnalyses[id];
+    if (!analysis)
+      analysis = llvm::make_unique<NodeAnalysis>();
+    return *analysis;
+  }
+
+  // Returns the statistics of the loop nest of node 'id', or nullptr if the
+  // nest has a loop with a non-constant trip count.
+  const LoopNestStats *getLoopNestStats(unsigned id) {
+    NodeAnalysis &analysis = getNodeAnalysis(id);
+    if (!analysis.statsComputed) {
+      LoopNestStatsCollector collector(&analysis.stats);
+      collector.collect(getNode(id)->op);
+      analysis.hasConstTripCounts = !collector.hasLoopWithNonConstTripCount;
+      analysis.statsComputed = true;
+    }
+    return analysis.hasConstTripCounts ? &analysis.stats : nullptr;
+  }
+
+  // Returns the memory footprint in bytes of the loop nest of node 'id'.
+  Optional<int64_t> getMemoryFootprintBytes(unsigned id) {
+    NodeAnalysis &analysis = getNodeAnalysis(id);
+    if (!analysis.footprintComputed) {
+      analysis.footprintBytes =
+          mlir::getMemoryFootprintBytes(getNode(id)->op->cast<AffineForOp>());
+      analysis.footprintComputed = true;
+    }
+    return analysis.footprintBytes;
+  }
+
+  // Returns the size in bytes of the memref region written by 'storeOpInst'
+  // of node 'id' at loop depth zero, or None if it can't be computed.
+  Optional<int64_t> getWriteRegionSizeBytes(unsigned id,
+                                            Operation *storeOpInst) {
+    NodeAnalysis &analysis = getNodeAnalysis(id);
+    auto it = analysis.writeRegionSizeBytes.find(storeOpInst);
+    if (it != analysis.writeRegionSizeBytes.end())
+      return it->second;
+    Optional<int64_t> sizeBytes;
+    MemRefRegion region(storeOpInst->getLoc());
+    if (succeeded(region.compute(storeOpInst, /*loopDepth=*/0)))
+      sizeBytes = region.getRegionSize();
+    analysis.writeRegionSizeBytes[storeOpInst] = sizeBytes;
+    return sizeBytes;
+  }
+
   // Remove node 'id' (and its associated edges) from graph.
   void removeNode(unsigned id) {
     // Remove each edge in 'inEdges[id]'.
@@ -300,6 +532,8 @@ public:
     // Erase remaining node state.
     inEdges.erase(id);
     outEdges.erase(id);
+    nodeAnalyses.erase(id);
+    opToNodeId.erase(getNode(id)->op);
     nodes.erase(id);
   }
 
@@ -343,21 +577,21 @@ public:
   // is for 'value' if non-null, or for any value otherwise. Returns false
   // otherwise.
   bool hasEdge(unsigned srcId, unsigned dstId, Value *value = nullptr) {
-    if (outEdges.count(srcId) == 0 || inEdges.count(dstId) == 0) {
-      return false;
+    if (value) {
+      EdgeKey key = {{srcId, dstId}, value};
+      return edgeSet.count(key) > 0;
     }
-    bool hasOutEdge = llvm::any_of(outEdges[srcId], [=](Edge &edge) {
-      return edge.id == dstId && (!value || edge.value == value);
-    });
-    bool hasInEdge = llvm::any_of(inEdges[dstId], [=](Edge &edge) {
-      return edge.id == srcId && (!value || edge.value == value);
-    });
-    return hasOutEdge && hasInEdge;
+    auto it = outEdges.find(srcId);
+    if (it == outEdges.end())
+      return false;
+    return llvm::any_of(it->second,
+                        [=](const Edge &edge) { return edge.id == dstId; });
   }
 
   // Adds an edge from node 'srcId' to node 'dstId' for 'value'.
   void addEdge(unsigned srcId, unsigned dstId, Value *value) {
-    if (!hasEdge(srcId, dstId, value)) {
+    EdgeKey key = {{srcId, dstId}, value};
+    if (edgeSet.insert(key).second) {
       outEdges[srcId].push_back({dstId, value});
       inEdges[dstId].push_back({srcId, value});
       if (value->getType().isa<MemRefType>())
@@ -369,6 +603,9 @@ public:
   void removeEdge(unsigned srcId, unsigned dstId, Value *value) {
     assert(inEdges.count(dstId) > 0);
     assert(outEdges.count(srcId) > 0);
+    EdgeKey key = {{srcId, dstId}, value};
+    if (!edgeSet.erase(key))
+      return;
     if (value->getType().isa<MemRefType>()) {
       assert(memrefEdgeCount.count(value) > 0);
       memrefEdgeCount[value]--;
@@ -395,6 +632,10 @@ public:
     // Worklist state is: <node-id, next-output-edge-index-to-visit>
     SmallVector<std::pair<unsigned, unsigned>, 4> worklist;
     worklist.push_back({srcId, 0});
+    // Nodes already pushed on the worklist. Each node is visited at most once
+    // so that the traversal is linear in the size of the graph.
+    llvm::SmallDenseSet<unsigned, 16> visited;
+    visited.insert(srcId);
     // Run DFS traversal to see if 'dstId' is reachable from 'srcId'.
     while (!worklist.empty()) {
       auto &idAndIndex = worklist.back();
@@ -412,8 +653,9 @@ public:
       Edge edge = outEdges[idAndIndex.first][idAndIndex.second];
       // Increment next output edge index for 'idAndIndex'.
       ++idAndIndex.second;
-      // Add node at 'edge.id' to worklist.
-      worklist.push_back({edge.id, 0});
+      // Add node at 'edge.id' to worklist if it has not been visited yet.
+      if (visited.insert(edge.id).second)
+        worklist.push_back({edge.id, 0});
     }
     return false;
   }
@@ -574,7 +816,10 @@ public:
       node->stores.push_back(storeOpInst);
   }
 
+  // Clears the load and store ops of node 'id'. This is done when the loop
+  // nest of the node was modified, so its cached analysis state is dropped.
   void clearNodeLoadAndStores(unsigned id) {
+    invalidateNode(id);
     Node *node = getNode(id);
     node->loads.clear();
     node->stores.clear();
@@ -644,7 +889,6 @@ bool MemRefDependenceGraph::init(Function &f) {
   if (f.getBlocks().size() != 1)
     return false;
 
-  DenseMap<Operation *, unsigned> forToNodeMap;
   for (auto &op : f.front()) {
     if (auto forOp = op.dyn_cast<AffineForOp>()) {
       // Create graph node 'id' to represent top-level 'forOp' and record
@@ -666,8 +910,8 @@ bool MemRefDependenceGraph::init(Function &f) {
         auto *memref = opInst->cast<StoreOp>().getMemRef();
         memrefAccesses[memref].insert(node.id);
       }
-      forToNodeMap[&op] = node.id;
       nodes.insert({node.id, node});
+      opToNodeId[&op] = node.id;
     } else if (auto loadOp = op.dyn_cast<LoadOp>()) {
       // Create graph node for top-level load op.
       Node node(nextNodeId++, &op);
@@ -675,6 +919,7 @@ bool MemRefDependenceGraph::init(Function &f) {
       auto *memref = op.cast<LoadOp>().getMemRef();
       memrefAccesses[memref].insert(node.id);
       nodes.insert({node.id, node});
+      opToNodeId[&op] = node.id;
     } else if (auto storeOp = op.dyn_cast<StoreOp>()) {
       // Create graph node for top-level store op.
       Node node(nextNodeId++, &op);
@@ -682,6 +927,7 @@ bool MemRefDependenceGraph::init(Function &f) {
       auto *memref = op.cast<StoreOp>().getMemRef();
       memrefAccesses[memref].insert(node.id);
       nodes.insert({node.id, node});
+      opToNodeId[&op] = node.id;
     } else if (op.getNumRegions() != 0) {
       // Return false if another region is found (not currently supported).
       return false;
@@ -690,6 +936,7 @@ bool MemRefDependenceGraph::init(Function &f) {
       // could be used by loop nest nodes.
       Node node(nextNodeId++, &op);
       nodes.insert({node.id, node});
+      opToNodeId[&op] = node.id;
     }
   }
 
@@ -706,8 +953,8 @@ bool MemRefDependenceGraph::init(Function &f) {
         getLoopIVs(*use.getOwner(), &loops);
         if (loops.empty())
           continue;
-        assert(forToNodeMap.count(loops[0].getOperation()) > 0);
-        unsigned userLoopNestId = forToNodeMap[loops[0].getOperation()];
+        assert(opToNodeId.count(loops[0].getOperation()) > 0);
+        unsigned userLoopNestId = opToNodeId[loops[0].getOperation()];
         addEdge(node.id, userLoopNestId, value);
       }
     }
@@ -734,55 +981,6 @@ bool MemRefDependenceGraph::init(Function &f) {
 
 namespace {
 
-// LoopNestStats aggregates various per-loop statistics (eg. loop trip count
-// and operation count) for a loop nest up until the innermost loop body.
-struct LoopNestStats {
-  // Map from AffineForOp to immediate child AffineForOps in its loop body.
-  DenseMap<Operation *, SmallVector<AffineForOp, 2>> loopMap;
-  // Map from AffineForOp to count of operations in its loop body.
-  DenseMap<Operation *, uint64_t> opCountMap;
-  // Map from AffineForOp to its constant trip count.
-  DenseMap<Operation *, uint64_t> tripCountMap;
-};
-
-// LoopNestStatsCollector walks a single loop nest and gathers per-loop
-// trip count and operation count statistics and records them in 'stats'.
-struct LoopNestStatsCollector {
-  LoopNestStats *stats;
-  bool hasLoopWithNonConstTripCount = false;
-
-  LoopNestStatsCollector(LoopNestStats *stats) : stats(stats) {}
-
-  void collect(Operation *op) {
-    op->walk<AffineForOp>([&](AffineForOp forOp) {
-      auto *forInst = forOp.getOperation();
-      auto *parentInst = forOp.getOperation()->getParentOp();
-      if (parentInst != nullptr) {
-        assert(parentInst->isa<AffineForOp>() && "Expected parent AffineForOp");
-        // Add mapping to 'forOp' from its parent AffineForOp.
-        stats->loopMap[parentInst].push_back(forOp);
-      }
-
-      // Record the number of op operations in the body of 'forOp'.
-      unsigned count = 0;
-      stats->opCountMap[forInst] = 0;
-      for (auto &op : *forOp.getBody()) {
-        if (!op.isa<AffineForOp>() && !op.isa<AffineIfOp>())
-          ++count;
-      }
-      stats->opCountMap[forInst] = count;
-      // Record trip count for 'forOp'. Set flag if trip count is not
-      // constant.
-      Optional<uint64_t> maybeConstTripCount = getConstantTripCount(forOp);
-      if (!maybeConstTripCount.hasValue()) {
-        hasLoopWithNonConstTripCount = true;
-        return;
-      }
-      stats->tripCountMap[forInst] = maybeConstTripCount.getValue();
-    });
-  }
-};
-
 // Computes the total cost of the loop nest rooted at 'forOp'.
 // Currently, the total cost is computed by counting the total operation
 // instance count (i.e. total number of operations in the loop bodyloop
@@ -799,13 +997,14 @@ struct LoopNestStatsCollector {
 // 2) This is also used to compute the cost of fusing a slice of some loop nest
 // within another loop.
 static int64_t getComputeCost(
-    Operation *forInst, LoopNestStats *stats,
+    Operation *forInst, const LoopNestStats *stats,
     llvm::SmallDenseMap<Operation *, uint64_t, 8> *tripCountOverrideMap,
     DenseMap<Operation *, int64_t> *computeCostMap) {
   // 'opCount' is the total number operations in one iteration of 'forOp' body
-  int64_t opCount = stats->opCountMap[forInst];
-  if (stats->loopMap.count(forInst) > 0) {
-    for (auto childForOp : stats->loopMap[forInst]) {
+  int64_t opCount = stats->opCountMap.lookup(forInst);
+  auto loopIt = stats->loopMap.find(forInst);
+  if (loopIt != stats->loopMap.end()) {
+    for (auto childForOp : loopIt->second) {
       opCount += getComputeCost(childForOp.getOperation(), stats,
                                 tripCountOverrideMap, computeCostMap);
     }
@@ -818,7 +1017,7 @@ static int64_t getComputeCost(
     }
   }
   // Override trip count (if specified in map).
-  int64_t tripCount = stats->tripCountMap[forInst];
+  int64_t tripCount = stats->tripCountMap.lookup(forInst);
   if (tripCountOverrideMap != nullptr) {
     auto it = tripCountOverrideMap->find(forInst);
     if (it != tripCountOverrideMap->end()) {
@@ -1050,7 +1249,8 @@ computeLoopInterchangePermutation(ArrayRef<AffineForOp> loops,
 // outermost (while again preserving relative order among them).
 // This can increase the loop depth at which we can fuse a slice, since we are
 // pushing loop carried dependence to a greater depth in the loop nest.
-static void sinkSequentialLoops(MemRefDependenceGraph::Node *node) {
+static void sinkSequentialLoops(MemRefDependenceGraph *mdg, unsigned id) {
+  auto *node = mdg->getNode(id);
   assert(node->op->isa<AffineForOp>());
   SmallVector<AffineForOp, 4> loops;
   AffineForOp curr = node->op->cast<AffineForOp>();
@@ -1064,6 +1264,7 @@ static void sinkSequentialLoops(MemRefDependenceGraph::Node *node) {
     return;
 
   int loopNestRootIndex = -1;
+  bool permuted = false;
   for (int i = loops.size() - 1; i >= 0; --i) {
     int permIndex = static_cast<int>(loopPermMap[i]);
     // Store the index of the for loop which will be the new loop nest root.
@@ -1072,25 +1273,14 @@ static void sinkSequentialLoops(MemRefDependenceGraph::Node *node) {
     if (permIndex > i) {
       // Sink loop 'i' by 'permIndex - i' levels deeper into the loop nest.
       sinkLoop(loops[i], permIndex - i);
+      permuted = true;
     }
   }
   assert(loopNestRootIndex != -1 && "invalid root index");
-  node->op = loops[loopNestRootIndex].getOperation();
-}
-
-//  TODO(mlir-team): improve/complete this when we have target data.
-unsigned getMemRefEltSizeInBytes(MemRefType memRefType) {
-  auto elementType = memRefType.getElementType();
-
-  unsigned sizeInBits;
-  if (elementType.isIntOrFloat()) {
-    sizeInBits = elementType.getIntOrFloatBitWidth();
-  } else {
-    auto vectorType = elementType.cast<VectorType>();
-    sizeInBits =
-        vectorType.getElementTypeBitWidth() * vectorType.getNumElements();
-  }
-  return llvm::divideCeil(sizeInBits, 8);
+  if (!permuted)
+    return;
+  mdg->setNodeOp(id, loops[loopNestRootIndex].getOperation());
+  mdg->invalidateNode(id);
 }
 
 // Creates and returns a private (single-user) memref for fused loop rooted
@@ -1367,6 +1557,24 @@ static bool getSliceUnion(Operation *srcOpInst,
   return true;
 }
 
+namespace {
+// The result of evaluating the fusion of a src loop nest slice into a dst loop
+// nest at one dst loop depth.
+struct FusionDepthEvaluation {
+  // True if the slice and its costs could be computed at this depth.
+  bool valid = false;
+  // The reason the depth could not be evaluated, if not valid.
+  StringRef failure;
+  // The slice of the src loop nest at this depth.
+  ComputationSliceState sliceState;
+  int64_t sliceIterationCount = 0;
+  int64_t fusedLoopNestComputeCost = 0;
+  double additionalComputeFraction = 0.0;
+  int64_t sliceWriteRegionSizeBytes = 0;
+  double storageReduction = 0.0;
+};
+} // end anonymous namespace
+
 // Checks the profitability of fusing a backwards slice of the loop nest
 // surrounding 'srcOpInst' into the loop nest surrounding 'dstLoadOpInsts'.
 // The argument 'srcStoreOpInst' is used to calculate the storage reduction on
@@ -1405,11 +1613,20 @@ static bool getSliceUnion(Operation *srcOpInst,
 // *) Compares the total cost of the unfused loop nests to the min cost fused
 //    loop nest computed in the previous step, and returns true if the latter
 //    is lower.
-static bool isFusionProfitable(Operation *srcOpInst, Operation *srcStoreOpInst,
+// Loop nest statistics, memory footprints and the src write region size only
+// depend on one of the loop nests, and are looked up in the per-node analysis
+// cache of 'mdg'.
+// The depths are evaluated concurrently if 'parallelDepths' is true, and the
+// best one is then selected in the order of a serial search from the deepest
+// one. If 'depthBudget' is non-zero, at most that many depths are evaluated.
+static bool isFusionProfitable(MemRefDependenceGraph *mdg,
+                               Operation *srcOpInst, Operation *srcStoreOpInst,
                                ArrayRef<Operation *> dstLoadOpInsts,
                                ArrayRef<Operation *> dstStoreOpInsts,
                                ComputationSliceState *sliceState,
-                               unsigned *dstLoopDepth, bool maximalFusion) {
+                               unsigned *dstLoopDepth, bool maximalFusion,
+                               double computeToleranceThreshold,
+                               unsigned depthBudget, bool parallelDepths) {
   LLVM_DEBUG({
     llvm::dbgs() << "Checking whether fusion is profitable between:\n";
     llvm::dbgs() << " " << *srcOpInst << " and \n";
@@ -1422,25 +1639,25 @@ static bool isFusionProfitable(Operation *srcOpInst, Operation *srcStoreOpInst,
   SmallVector<AffineForOp, 4> srcLoopIVs;
   getLoopIVs(*srcOpInst, &srcLoopIVs);
   unsigned numSrcLoopIVs = srcLoopIVs.size();
+  auto *srcNode = mdg->getForOpNode(srcLoopIVs[0]);
+  assert(srcNode && "expected src loop nest to be a graph node");
 
-  // Walk src loop nest and collect stats.
-  LoopNestStats srcLoopNestStats;
-  LoopNestStatsCollector srcStatsCollector(&srcLoopNestStats);
-  srcStatsCollector.collect(srcLoopIVs[0].getOperation());
+  // Look up the stats of the src loop nest.
+  const LoopNestStats *srcLoopNestStats = mdg->getLoopNestStats(srcNode->id);
   // Currently only constant trip count loop nests are supported.
-  if (srcStatsCollector.hasLoopWithNonConstTripCount) {
+  if (!srcLoopNestStats) {
     LLVM_DEBUG(llvm::dbgs() << "Non-constant trip count loops unsupported.\n");
     return false;
   }
   // Compute cost of dst loop nest.
   SmallVector<AffineForOp, 4> dstLoopIVs;
   getLoopIVs(*dstLoadOpInsts[0], &dstLoopIVs);
+  auto *dstNode = mdg->getForOpNode(dstLoopIVs[0]);
+  assert(dstNode && "expected dst loop nest to be a graph node");
 
-  LoopNestStats dstLoopNestStats;
-  LoopNestStatsCollector dstStatsCollector(&dstLoopNestStats);
-  dstStatsCollector.collect(dstLoopIVs[0].getOperation());
+  const LoopNestStats *dstLoopNestStats = mdg->getLoopNestStats(dstNode->id);
   // Currently only constant trip count loop nests are supported.
-  if (dstStatsCollector.hasLoopWithNonConstTripCount) {
+  if (!dstLoopNestStats) {
     LLVM_DEBUG(llvm::dbgs() << "Non-constant trip count loops unsupported.\n");
     return false;
   }
@@ -1461,62 +1678,60 @@ static bool isFusionProfitable(Operation *srcOpInst, Operation *srcStoreOpInst,
   // bounds between 'srcOpInst' and each op in 'dstOpinsts' (taking the union
   // of these bounds). Next the union slice bounds are used to calculate
   // the cost of the slice and the cost of the slice inserted into the dst
-  // loop nest at 'dstLoopDepth'.
+  // loop nest at 'dstLoopDepth'. If 'depthBudget' is non-zero, only the
+  // 'depthBudget' deepest values of 'dstLoopDepth' are evaluated.
+  unsigned minDstLoopDepth = 1;
+  if (depthBudget != 0 && depthBudget < maxDstLoopDepth)
+    minDstLoopDepth = maxDstLoopDepth - depthBudget + 1;
   uint64_t minFusedLoopNestComputeCost = std::numeric_limits<uint64_t>::max();
   double maxStorageReduction = 0.0;
   Optional<uint64_t> sliceMemEstimate = None;
 
-  SmallVector<ComputationSliceState, 4> sliceStates;
-  sliceStates.resize(maxDstLoopDepth);
   // The best loop depth at which to materialize the slice.
   Optional<unsigned> bestDstLoopDepth = None;
 
   // Compute op instance count for the src loop nest without iteration slicing.
   uint64_t srcLoopNestCost =
-      getComputeCost(srcLoopIVs[0].getOperation(), &srcLoopNestStats,
+      getComputeCost(srcLoopIVs[0].getOperation(), srcLoopNestStats,
                      /*tripCountOverrideMap=*/nullptr,
                      /*computeCostMap=*/nullptr);
 
   // Compute src loop nest write region size.
-  MemRefRegion srcWriteRegion(srcStoreOpInst->getLoc());
-  if (failed(srcWriteRegion.compute(srcStoreOpInst, /*loopDepth=*/0))) {
+  Optional<int64_t> maybeSrcWriteRegionSizeBytes =
+      mdg->getWriteRegionSizeBytes(srcNode->id, srcStoreOpInst);
+  if (!maybeSrcWriteRegionSizeBytes.hasValue()) {
     LLVM_DEBUG(llvm::dbgs()
                << "Unable to compute MemRefRegion for source operation\n.");
     return false;
   }
-
-  Optional<int64_t> maybeSrcWriteRegionSizeBytes =
-      srcWriteRegion.getRegionSize();
-  if (!maybeSrcWriteRegionSizeBytes.hasValue())
-    return false;
   int64_t srcWriteRegionSizeBytes = maybeSrcWriteRegionSizeBytes.getValue();
 
   // Compute op instance count for the src loop nest.
   uint64_t dstLoopNestCost =
-      getComputeCost(dstLoopIVs[0].getOperation(), &dstLoopNestStats,
+      getComputeCost(dstLoopIVs[0].getOperation(), dstLoopNestStats,
                      /*tripCountOverrideMap=*/nullptr,
                      /*computeCostMap=*/nullptr);
 
-  // Evaluate all depth choices for materializing the slice in the destination
-  // loop nest.
-  llvm::SmallDenseMap<Operation *, uint64_t, 8> sliceTripCountMap;
-  DenseMap<Operation *, int64_t> computeCostMap;
-  for (unsigned i = maxDstLoopDepth; i >= 1; --i) {
+  // Evaluates the fusion of the src slice at dst loop depth 'i' into
+  // 'evaluation'. This only reads the IR and the cached loop nest stats, so
+  // different depths can be evaluated concurrently once the operation orders
+  // of the blocks it queries are valid.
+  SmallVector<FusionDepthEvaluation, 4> evaluations(maxDstLoopDepth);
+  auto evaluateDepth = [&](unsigned i, FusionDepthEvaluation &evaluation) {
     // Compute the union of slice bounds of all ops in 'dstLoadOpInsts'.
     if (!getSliceUnion(srcOpInst, dstLoadOpInsts, numSrcLoopIVs, i,
-                       &sliceStates[i - 1])) {
-      LLVM_DEBUG(llvm::dbgs()
-                 << "getSliceUnion failed for loopDepth: " << i << "\n");
-      continue;
+                       &evaluation.sliceState)) {
+      evaluation.failure = "getSliceUnion failed";
+      return;
     }
 
     // Build trip count map for computation slice. We'll skip cases where the
     // trip count was non-constant.
-    sliceTripCountMap.clear();
-    if (!buildSliceTripCountMap(srcOpInst, &sliceStates[i - 1],
+    llvm::SmallDenseMap<Operation *, uint64_t, 8> sliceTripCountMap;
+    if (!buildSliceTripCountMap(srcOpInst, &evaluation.sliceState,
                                 &sliceTripCountMap)) {
-      LLVM_DEBUG(llvm::dbgs() << "Unable to build slice trip count map.\n.");
-      continue;
+      evaluation.failure = "Unable to build slice trip count map";
+      return;
     }
 
     // Checks whether a store to load forwarding will happen.
@@ -1526,7 +1741,7 @@ static bool isFusionProfitable(Operation *srcOpInst, Operation *srcStoreOpInst,
 
     // Compute cost of fusion for this dest loop depth.
 
-    computeCostMap.clear();
+    DenseMap<Operation *, int64_t> computeCostMap;
 
     // The store and loads to this memref will disappear.
     // TODO(andydavis) Add load coalescing to memref data flow opt pass.
@@ -1540,7 +1755,7 @@ static bool isFusionProfitable(Operation *srcOpInst, Operation *srcStoreOpInst,
 
     // Compute op instance count for the src loop nest with iteration slicing.
     int64_t sliceComputeCost =
-        getComputeCost(srcLoopIVs[0].getOperation(), &srcLoopNestStats,
+        getComputeCost(srcLoopIVs[0].getOperation(), srcLoopNestStats,
                        /*tripCountOverrideMap=*/&sliceTripCountMap,
                        /*computeCostMap=*/&computeCostMap);
 
@@ -1548,7 +1763,7 @@ static bool isFusionProfitable(Operation *srcOpInst, Operation *srcStoreOpInst,
     computeCostMap[dstLoopIVs[i - 1].getOperation()] = sliceComputeCost;
 
     int64_t fusedLoopNestComputeCost =
-        getComputeCost(dstLoopIVs[0].getOperation(), &dstLoopNestStats,
+        getComputeCost(dstLoopIVs[0].getOperation(), dstLoopNestStats,
                        /*tripCountOverrideMap=*/nullptr, &computeCostMap);
 
     double additionalComputeFraction =
@@ -1557,25 +1772,21 @@ static bool isFusionProfitable(Operation *srcOpInst, Operation *srcStoreOpInst,
         1;
 
     // Determine what the slice write MemRefRegion would be, if the src loop
-    // nest slice 'sliceStates[i - 1]' were to be inserted into the dst loop
-    // nest at loop depth 'i'
+    // nest slice 'evaluation.sliceState' were to be inserted into the dst
+    // loop nest at loop depth 'i'
     MemRefRegion sliceWriteRegion(srcStoreOpInst->getLoc());
     if (failed(sliceWriteRegion.compute(srcStoreOpInst, /*loopDepth=*/0,
-                                        &sliceStates[i - 1]))) {
-      LLVM_DEBUG(llvm::dbgs()
-                 << "Failed to compute slice write region at loopDepth: " << i
-                 << "\n");
-      continue;
+                                        &evaluation.sliceState))) {
+      evaluation.failure = "Failed to compute slice write region";
+      return;
     }
 
     Optional<int64_t> maybeSliceWriteRegionSizeBytes =
         sliceWriteRegion.getRegionSize();
     if (!maybeSliceWriteRegionSizeBytes.hasValue() ||
         maybeSliceWriteRegionSizeBytes.getValue() == 0) {
-      LLVM_DEBUG(llvm::dbgs()
-                 << "Failed to get slice write region size at loopDepth: " << i
-                 << "\n");
-      continue;
+      evaluation.failure = "Failed to get slice write region size";
+      return;
     }
     int64_t sliceWriteRegionSizeBytes =
         maybeSliceWriteRegionSizeBytes.getValue();
@@ -1585,43 +1796,86 @@ static bool isFusionProfitable(Operation *srcOpInst, Operation *srcStoreOpInst,
     // each dimension, so that we are sure they are covering the same memref
     // region. Also, move this out to a isMemRefRegionSuperSet helper function.
     if (srcOpInst != srcStoreOpInst &&
-        sliceWriteRegionSizeBytes != srcWriteRegionSizeBytes)
-      continue;
+        sliceWriteRegionSizeBytes != srcWriteRegionSizeBytes) {
+      evaluation.failure = "Slice changes the src write region";
+      return;
+    }
+
+    evaluation.valid = true;
+    evaluation.sliceIterationCount = sliceIterationCount;
+    evaluation.fusedLoopNestComputeCost = fusedLoopNestComputeCost;
+    evaluation.additionalComputeFraction = additionalComputeFraction;
+    evaluation.sliceWriteRegionSizeBytes = sliceWriteRegionSizeBytes;
+    evaluation.storageReduction =
+        static_cast<double>(srcWriteRegionSizeBytes) /
+        static_cast<double>(sliceWriteRegionSizeBytes);
+  };
+
+  // Evaluate all depth choices for materializing the slice in the destination
+  // loop nest, concurrently if 'parallelDepths' is set. Diagnostics emitted by
+  // the analyses are reported in the order of the depths.
+  size_t numEvaluations = maxDstLoopDepth - minDstLoopDepth + 1;
+  if (parallelDepths && numEvaluations > 1) {
+    // The dependence checks of the slice computation order the accesses with
+    // Operation::isBeforeInBlock, which recomputes the order of a block if it
+    // was invalidated. Compute the orders of the blocks surrounding the
+    // accesses first, so that the evaluations don't write to the IR.
+    SmallVector<Operation *, 8> accessOps = {srcOpInst, srcStoreOpInst};
+    accessOps.append(dstLoadOpInsts.begin(), dstLoadOpInsts.end());
+    accessOps.append(dstStoreOpInsts.begin(), dstStoreOpInsts.end());
+    computeInstOrders(accessOps);
+
+    ParallelDiagnosticHandler diagHandler(*srcOpInst->getContext());
+    llvm::parallel::for_each_n(
+        llvm::parallel::par, size_t(0), numEvaluations, [&](size_t n) {
+          diagHandler.setOrderIDForThread(n);
+          unsigned i = maxDstLoopDepth - n;
+          evaluateDepth(i, evaluations[i - 1]);
+        });
+  } else {
+    for (unsigned i = maxDstLoopDepth; i >= minDstLoopDepth; --i)
+      evaluateDepth(i, evaluations[i - 1]);
+  }
 
-    double storageReduction = static_cast<double>(srcWriteRegionSizeBytes) /
-                              static_cast<double>(sliceWriteRegionSizeBytes);
+  // Pick the best depth, visiting the depths in the same order as a serial
+  // search so that ties are broken the same way.
+  for (unsigned i = maxDstLoopDepth; i >= minDstLoopDepth; --i) {
+    const FusionDepthEvaluation &evaluation = evaluations[i - 1];
+    if (!evaluation.valid) {
+      LLVM_DEBUG(llvm::dbgs() << evaluation.failure
+                              << " at loopDepth: " << i << "\n");
+      continue;
+    }
 
     LLVM_DEBUG({
       std::stringstream msg;
       msg << "  evaluating fusion profitability at depth : " << i << "\n"
           << std::fixed << std::setprecision(2)
           << "   additional compute fraction: "
-          << 100.0 * additionalComputeFraction << "%\n"
-          << "   storage reduction factor: " << storageReduction << "x\n"
-          << "   fused nest cost: " << fusedLoopNestComputeCost << "\n"
-          << "   slice iteration count: " << sliceIterationCount << "\n"
+          << 100.0 * evaluation.additionalComputeFraction << "%\n"
+          << "   storage reduction factor: " << evaluation.storageReduction
+          << "x\n"
+          << "   fused nest cost: " << evaluation.fusedLoopNestComputeCost
+          << "\n"
+          << "   slice iteration count: " << evaluation.sliceIterationCount
+          << "\n"
           << "   src write region size: " << srcWriteRegionSizeBytes << "\n"
-          << "   slice write region size: " << sliceWriteRegionSizeBytes
-          << "\n";
+          << "   slice write region size: "
+          << evaluation.sliceWriteRegionSizeBytes << "\n";
       llvm::dbgs() << msg.str();
     });
 
-    double computeToleranceThreshold =
-        clFusionAddlComputeTolerance.getNumOccurrences() > 0
-            ? clFusionAddlComputeTolerance
-            : LoopFusion::kComputeToleranceThreshold;
-
     // TODO(b/123247369): This is a placeholder cost model.
     // Among all choices that add an acceptable amount of redundant computation
     // (as per computeToleranceThreshold), we will simply pick the one that
     // reduces the intermediary size the most.
-    if ((storageReduction > maxStorageReduction) &&
+    if ((evaluation.storageReduction > maxStorageReduction) &&
         (maximalFusion ||
-         (additionalComputeFraction < computeToleranceThreshold))) {
-      maxStorageReduction = storageReduction;
+         (evaluation.additionalComputeFraction < computeToleranceThreshold))) {
+      maxStorageReduction = evaluation.storageReduction;
       bestDstLoopDepth = i;
-      minFusedLoopNestComputeCost = fusedLoopNestComputeCost;
-      sliceMemEstimate = sliceWriteRegionSizeBytes;
+      minFusedLoopNestComputeCost = evaluation.fusedLoopNestComputeCost;
+      sliceMemEstimate = evaluation.sliceWriteRegionSizeBytes;
     }
   }
 
@@ -1652,8 +1906,8 @@ static bool isFusionProfitable(Operation *srcOpInst, Operation *srcStoreOpInst,
                    << "\n  fused loop nest compute cost: "
                    << minFusedLoopNestComputeCost << "\n");
 
-  auto dstMemSize = getMemoryFootprintBytes(dstLoopIVs[0]);
-  auto srcMemSize = getMemoryFootprintBytes(srcLoopIVs[0]);
+  auto dstMemSize = mdg->getMemoryFootprintBytes(dstNode->id);
+  auto srcMemSize = mdg->getMemoryFootprintBytes(srcNode->id);
 
   Optional<double> storageReduction = None;
 
@@ -1703,7 +1957,8 @@ static bool isFusionProfitable(Operation *srcOpInst, Operation *srcStoreOpInst,
   });
 
   // Update return parameter 'sliceState' with 'bestSliceState'.
-  ComputationSliceState *bestSliceState = &sliceStates[*dstLoopDepth - 1];
+  ComputationSliceState *bestSliceState =
+      &evaluations[*dstLoopDepth - 1].sliceState;
   sliceState->lbs = bestSliceState->lbs;
   sliceState->ubs = bestSliceState->ubs;
   sliceState->lbOperands = bestSliceState->lbOperands;
@@ -1783,13 +2038,34 @@ public:
   // If true, ignore any additional (redundant) computation tolerance threshold
   // that would have prevented fusion.
   bool maximalFusion;
+  // The amount of additional computation that is tolerated while fusing
+  // pair-wise as a fraction of the total computation.
+  double computeToleranceThreshold;
+  // The maximum number of dst loop depths evaluated per fusion candidate.
+  unsigned depthBudget;
+  // If true, the dst loop depths of a fusion candidate are evaluated
+  // concurrently.
+  bool parallelDepths;
+  // If set, sibling nests are only fused if this saves at least this fraction
+  // of the bytes accessed by the two unfused nests.
+  Optional<double> minSiblingSavings;
+  // Producer-consumer candidates <srcId, dstId, memref> found unprofitable,
+  // mapped to the versions of the src and dst nodes at the time of the query.
+  // A candidate is only evaluated again once one of its nodes was modified.
+  DenseMap<MemRefDependenceGraph::EdgeKey, std::pair<unsigned, unsigned>>
+      unprofitableCandidates;
 
   using Node = MemRefDependenceGraph::Node;
 
   GreedyFusion(MemRefDependenceGraph *mdg, unsigned localBufSizeThreshold,
-               Optional<unsigned> fastMemorySpace, bool maximalFusion)
+               Optional<unsigned> fastMemorySpace, bool maximalFusion,
+               double computeToleranceThreshold, unsigned depthBudget,
+               bool parallelDepths, Optional<double> minSiblingSavings = None)
       : mdg(mdg), localBufSizeThreshold(localBufSizeThreshold),
-        fastMemorySpace(fastMemorySpace), maximalFusion(maximalFusion) {}
+        fastMemorySpace(fastMemorySpace), maximalFusion(maximalFusion),
+        computeToleranceThreshold(computeToleranceThreshold),
+        depthBudget(depthBudget), parallelDepths(parallelDepths),
+        minSiblingSavings(minSiblingSavings) {}
 
   // Initializes 'worklist' with nodes from 'mdg'
   void init() {
@@ -1818,6 +2094,20 @@ public:
     eraseUnusedMemRefAllocations();
   }
 
+  // Run only the producer-consumer passes of the GreedyFusion pass.
+  void runProducerConsumerFusionOnly() {
+    fuseProducerConsumerNodes(/*maxSrcUserCount=*/1);
+    fuseProducerConsumerNodes(
+        /*maxSrcUserCount=*/std::numeric_limits<unsigned>::max());
+    eraseUnusedMemRefAllocations();
+  }
+
+  // Run only the sibling pass of the GreedyFusion pass.
+  void runSiblingFusionOnly() {
+    fuseSiblingNodes();
+    eraseUnusedMemRefAllocations();
+  }
+
   void fuseProducerConsumerNodes(unsigned maxSrcUserCount) {
     init();
     while (!worklist.empty()) {
@@ -1837,7 +2127,7 @@ public:
       // while preserving relative order. This can increase the maximum loop
       // depth at which we can fuse a slice of a producer loop nest into a
       // consumer loop nest.
-      sinkSequentialLoops(dstNode);
+      sinkSequentialLoops(mdg, dstId);
 
       SmallVector<Operation *, 4> loads = dstNode->loads;
       SmallVector<Operation *, 4> dstLoadOpInsts;
@@ -1903,13 +2193,27 @@ public:
             if (storeOpInst->cast<StoreOp>().getMemRef() == memref)
               dstStoreOpInsts.push_back(storeOpInst);
 
+          // Skip if fusion was found unprofitable by an earlier query and
+          // neither node was modified since.
+          MemRefDependenceGraph::EdgeKey candidate = {{srcId, dstId}, memref};
+          std::pair<unsigned, unsigned> versions = {srcNode->version,
+                                                    dstNode->version};
+          auto unprofitableIt = unprofitableCandidates.find(candidate);
+          if (unprofitableIt != unprofitableCandidates.end() &&
+              unprofitableIt->second == versions)
+            continue;
+
           unsigned bestDstLoopDepth;
           mlir::ComputationSliceState sliceState;
           // Check if fusion would be profitable.
-          if (!isFusionProfitable(srcStoreOpInst, srcStoreOpInst,
+          if (!isFusionProfitable(mdg, srcStoreOpInst, srcStoreOpInst,
                                   dstLoadOpInsts, dstStoreOpInsts, &sliceState,
-                                  &bestDstLoopDepth, maximalFusion))
+                                  &bestDstLoopDepth, maximalFusion,
+                                  computeToleranceThreshold, depthBudget,
+                                  parallelDepths)) {
+            unprofitableCandidates[candidate] = versions;
             continue;
+          }
 
           // Fuse computation slice of 'srcLoopNest' into 'dstLoopNest'.
           auto sliceLoopNest = mlir::insertBackwardComputationSlice(
@@ -1949,6 +2253,10 @@ public:
                   mdg->addNode(newMemRef->getDefiningOp());
               // Add edge from 'newMemRef' node to dstNode.
               mdg->addEdge(newMemRefNodeId, dstId, newMemRef);
+              // Adding a node may have reallocated the node storage, refresh
+              // the pointers into it.
+              srcNode = mdg->getNode(srcId);
+              dstNode = mdg->getNode(dstId);
             }
 
             // Collect dst loop stats after memref privatizaton transformation.
@@ -2041,6 +2349,11 @@ public:
       if (insertPointInst == nullptr)
         continue;
 
+      // Skip if fusing the nests does not save enough memory traffic.
+      if (minSiblingSavings.hasValue() &&
+          !isSiblingFusionProfitable(sibNode, dstNode))
+        continue;
+
       // Check if fusion would be profitable and at what depth.
 
       // Get unique 'sibNode' load op to 'memref'.
@@ -2065,9 +2378,11 @@ public:
       mlir::ComputationSliceState sliceState;
 
       // Check if fusion would be profitable.
-      if (!isFusionProfitable(sibLoadOpInst, sibStoreOpInst, dstLoadOpInsts,
-                              dstStoreOpInsts, &sliceState, &bestDstLoopDepth,
-                              maximalFusion))
+      if (!isFusionProfitable(mdg, sibLoadOpInst, sibStoreOpInst,
+                              dstLoadOpInsts, dstStoreOpInsts, &sliceState,
+                              &bestDstLoopDepth, maximalFusion,
+                              computeToleranceThreshold, depthBudget,
+                              parallelDepths))
         continue;
 
       // Fuse computation slice of 'sibLoopNest' into 'dstLoopNest'.
@@ -2085,6 +2400,33 @@ public:
     }
   }
 
+  // Returns true if fusing 'sibNode' into 'dstNode' saves at least a fraction
+  // 'minSiblingSavings' of the bytes accessed by the two unfused loop nests.
+  // The savings are the bytes of the memrefs accessed by both nests, which
+  // are counted once in the memory footprint of the nests taken together.
+  bool isSiblingFusionProfitable(Node *sibNode, Node *dstNode) {
+    Optional<int64_t> sibBytes = mdg->getMemoryFootprintBytes(sibNode->id);
+    Optional<int64_t> dstBytes = mdg->getMemoryFootprintBytes(dstNode->id);
+    Optional<int64_t> fusedBytes =
+        getMemoryFootprintBytes({sibNode->op, dstNode->op});
+    if (!sibBytes.hasValue() || !dstBytes.hasValue() ||
+        !fusedBytes.hasValue()) {
+      LLVM_DEBUG(llvm::dbgs() << "Sibling fusion savings cannot be evaluated; "
+                                 "NOT fusing.\n");
+      return false;
+    }
+
+    int64_t unfusedBytes = sibBytes.getValue() + dstBytes.getValue();
+    int64_t savedBytes = unfusedBytes - fusedBytes.getValue();
+    double savings =
+        unfusedBytes > 0 ? savedBytes / static_cast<double>(unfusedBytes) : 0;
+    LLVM_DEBUG(llvm::dbgs() << "   sibling mem: " << sibBytes << "\n"
+                            << "   dst mem: " << dstBytes << "\n"
+                            << "   fused mem: " << fusedBytes << "\n"
+                            << "   saved bytes: " << savedBytes << "\n");
+    return savedBytes > 0 && savings >= minSiblingSavings.getValue();
+  }
+
   // Searches function argument uses and the graph from 'dstNode' looking for a
   // fusion candidate sibling node which shares no dependences with 'dstNode'
   // but which loads from the same memref. Returns true and sets
@@ -2252,23 +2594,54 @@ public:
 } // end anonymous namespace
 
 void LoopFusion::runOnFunction() {
-  // Override if a command line argument was provided.
-  if (clFusionFastMemorySpace.getNumOccurrences() > 0) {
-    fastMemorySpace = clFusionFastMemorySpace.getValue();
-  }
+  MemRefDependenceGraph g;
+  if (!g.init(getFunction()))
+    return;
 
-  // Override if a command line argument was provided.
-  if (clFusionLocalBufThreshold.getNumOccurrences() > 0) {
-    localBufSizeThreshold = clFusionLocalBufThreshold * 1024;
+  Optional<double> siblingSavings = minSiblingSavings;
+  if (mode == FusionMode::Sibling && !siblingSavings)
+    siblingSavings = 0.0;
+  GreedyFusion fusion(&g, localBufSizeThreshold, fastMemorySpace,
+                      maximalFusion, computeToleranceThreshold, depthBudget,
+                      parallelDepths, siblingSavings);
+  switch (mode) {
+  case FusionMode::Greedy:
+    fusion.run();
+    break;
+  case FusionMode::ProducerConsumer:
+    fusion.runProducerConsumerFusionOnly();
+    break;
+  case FusionMode::Sibling:
+    fusion.runSiblingFusionOnly();
+    break;
   }
+}
 
-  if (clMaximalLoopFusion.getNumOccurrences() > 0)
-    maximalFusion = clMaximalLoopFusion;
-
-  MemRefDependenceGraph g;
-  if (g.init(getFunction()))
-    GreedyFusion(&g, localBufSizeThreshold, fastMemorySpace, maximalFusion)
-        .run();
+/// The names of the fusion modes in textual pass pipelines.
+static const std::pair<StringRef, FusionMode> fusionModeNames[] = {
+    {"greedy", FusionMode::Greedy},
+    {"producer-consumer", FusionMode::ProducerConsumer},
+    {"sibling", FusionMode::Sibling}};
+
+/// Allocate a loop fusion pass for the pass registry. The constructor applies
+/// any command line arguments, and the options of a textual pass pipeline
+/// override them, e.g. 'loop-fusion{fast-mem-space=2 local-buf-threshold=16}'.
+static Pass *createRegisteredLoopFusionPass(const PassOptions &options) {
+  auto *pass = new LoopFusion();
+  options.getOption("fast-mem-space", pass->fastMemorySpace);
+  Optional<uint64_t> localBufThresholdKiB;
+  options.getOption("local-buf-threshold", localBufThresholdKiB);
+  if (localBufThresholdKiB)
+    pass->localBufSizeThreshold = *localBufThresholdKiB * 1024;
+  options.getOption("maximal", pass->maximalFusion);
+  options.getOption("compute-tolerance", pass->computeToleranceThreshold);
+  options.getOption("depth-budget", pass->depthBudget);
+  options.getOption("parallel-depths", pass->parallelDepths);
+  options.getEnumOption("mode", pass->mode,
+                        llvm::makeArrayRef(fusionModeNames));
+  options.getOption("sibling-min-savings", pass->minSiblingSavings);
+  return pass;
 }
 
-static PassRegistration<LoopFusion> pass("loop-fusion", "Fuse loop nests");
+static PassRegistration<LoopFusion> pass("loop-fusion", "Fuse loop nests",
+                                         createRegisteredLoopFusionPass);
@@ -26,7 +26,6 @@
 #include "mlir/Analysis/AffineAnalysis.h"
 #include "mlir/Analysis/AffineStructures.h"
 #include "mlir/Analysis/LoopAnalysis.h"
-#include "mlir/Analysis/SliceAnalysis.h"
 #include "mlir/Analysis/Utils.h"
 #include "mlir/IR/AffineExpr.h"
 #include "mlir/IR/AffineMap.h"
@@ -38,6 +37,7 @@
 #include "mlir/Transforms/Utils.h"
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/SetVector.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
@@ -49,50 +49,284 @@ using llvm::SetVector;
 
 using namespace mlir;
 
+static llvm::cl::OptionCategory clOptionsCategory(DEBUG_TYPE " options");
+
+// Each unswitching duplicates the loop; these bound the resulting code growth.
+static llvm::cl::opt<unsigned> clUnswitchSizeThreshold(
+    "licm-unswitch-size-threshold",
+    llvm::cl::desc("Maximum number of operations nested in a loop for it to "
+                   "be unswitched"),
+    llvm::cl::cat(clOptionsCategory));
+
+static llvm::cl::opt<unsigned> clUnswitchLimit(
+    "licm-unswitch-limit",
+    llvm::cl::desc("Maximum number of times each loop, including its copies, "
+                   "is unswitched"),
+    llvm::cl::cat(clOptionsCategory));
+
 namespace {
 
-/// Loop invariant code motion (LICM) pass.
-/// TODO(asabne) : The pass is missing zero-trip tests.
-/// TODO(asabne) : Check for the presence of side effects before hoisting.
+/// Loop invariant code motion (LICM) pass. Operations without side effects,
+/// loads from memref's that aren't written in the loop, and stores to memref's
+/// not otherwise accessed in the loop are hoisted when their operands are loop
+/// invariant. Loads and stores are only hoisted out of loops known to run at
+/// least once, or else the loop is guarded by a check of its trip count. Loops
+/// are unswitched on loop invariant 'affine.if' conditions.
 struct LoopInvariantCodeMotion : public FunctionPass<LoopInvariantCodeMotion> {
+  LoopInvariantCodeMotion();
+
   void runOnFunction() override;
   void runOnAffineForOp(AffineForOp forOp);
   std::vector<AffineForOp> forOps;
+
+  constexpr static unsigned kDefaultUnswitchSizeThreshold = 256;
+  constexpr static unsigned kDefaultUnswitchLimit = 8;
+
+  // Maximum number of operations nested in a loop for it to be unswitched.
+  unsigned unswitchSizeThreshold = kDefaultUnswitchSizeThreshold;
+  // Maximum number of times each loop of the function, including its copies,
+  // is unswitched.
+  unsigned unswitchLimit = kDefaultUnswitchLimit;
+  // Number of times the loop being processed has been unswitched so far.
+  unsigned numUnswitched = 0;
+};
+
+/// Memory side effects of the operations nested in a loop. As with the
+/// dependence analysis, distinct memref values are assumed not to alias.
+struct LoopMemoryEffects {
+  explicit LoopMemoryEffects(AffineForOp forOp);
+
+  /// Returns true if 'memref' isn't written in the loop.
+  bool isReadOnly(Value *memref) const;
+
+  /// Returns true if 'op' is the only operation of the loop using 'memref'.
+  bool isOnlyUser(Operation *op, Value *memref) const;
+
+  // True if the loop has operations with unknown side effects, which may
+  // write any memref.
+  bool hasUnknownEffects = false;
+  // Operations of the loop using each memref.
+  DenseMap<Value *, SmallVector<Operation *, 4>> memrefUsers;
 };
+
 } // end anonymous namespace
 
+LoopInvariantCodeMotion::LoopInvariantCodeMotion() {
+  // Override if a command line argument was provided.
+  if (clUnswitchSizeThreshold.getNumOccurrences() > 0)
+    unswitchSizeThreshold = clUnswitchSizeThreshold;
+  if (clUnswitchLimit.getNumOccurrences() > 0)
+    unswitchLimit = clUnswitchLimit;
+}
+
 FunctionPassBase *mlir::createLoopInvariantCodeMotionPass() {
   return new LoopInvariantCodeMotion();
 }
 
+LoopMemoryEffects::LoopMemoryEffects(AffineForOp forOp) {
+  for (auto &bodyOp : *forOp.getBody()) {
+    bodyOp.walk([&](Operation *op) {
+      for (auto *operand : op->getOperands())
+        if (operand->getType().isa<MemRefType>())
+          memrefUsers[operand].push_back(op);
+      // The effects of these on memory are those on their memref operands.
+      if (op->hasNoSideEffect() || op->isa<LoadOp>() || op->isa<StoreOp>() ||
+          op->isa<AllocOp>() || op->isa<DeallocOp>() ||
+          op->isa<DmaStartOp>() || op->isa<DmaWaitOp>() ||
+          op->isa<AffineForOp>() || op->isa<AffineIfOp>() ||
+          op->isa<AffineTerminatorOp>())
+        return;
+      hasUnknownEffects = true;
+    });
+  }
+}
+
+bool LoopMemoryEffects::isReadOnly(Value *memref) const {
+  if (hasUnknownEffects)
+    return false;
+  auto it = memrefUsers.find(memref);
+  if (it == memrefUsers.end())
+    return true;
+  return llvm::all_of(it->second, [](Operation *op) {
+    return op->isa<LoadOp>() || op->hasNoSideEffect();
+  });
+}
+
+bool LoopMemoryEffects::isOnlyUser(Operation *op, Value *memref) const {
+  if (hasUnknownEffects)
+    return false;
+  auto it = memrefUsers.find(memref);
+  return it != memrefUsers.end() &&
+         llvm::all_of(it->second, [&](Operation *user) { return user == op; });
+}
+
+/// Returns true if 'op' from the body of a loop with the memory side effects
+/// 'effects' can be executed once before the loop instead of in every
+/// iteration, provided that its operands are loop invariant. Loads and stores
+/// additionally require the loop to run at least once.
+static bool isHoistable(Operation &op, const LoopMemoryEffects &effects) {
+  if (op.getNumRegions() != 0 || op.isKnownTerminator())
+    return false;
+  if (auto loadOp = op.dyn_cast<LoadOp>())
+    return effects.isReadOnly(loadOp.getMemRef());
+  if (auto storeOp = op.dyn_cast<StoreOp>())
+    return effects.isOnlyUser(&op, storeOp.getMemRef());
+  return op.hasNoSideEffect();
+}
+
+/// Creates an empty block terminated by an 'affine.terminator' in 'region'.
+static Block *createTerminatedBlock(Region &region, Location loc) {
+  auto *block = new Block();
+  region.push_back(block);
+  FuncBuilder b(block, block->end());
+  b.create<AffineTerminatorOp>(loc);
+  return block;
+}
+
+/// Moves 'forOp' into an 'affine.if' checking that the loop runs at least one
+/// iteration, i.e., that each of its upper bounds exceeds each of its lower
+/// bounds. Returns the 'then' block of the new operation.
+static Block *guardAgainstZeroTrip(AffineForOp forOp) {
+  auto lbMap = forOp.getLowerBoundMap();
+  auto ubMap = forOp.getUpperBoundMap();
+  SmallVector<Value *, 4> lbOperands(forOp.getLowerBoundOperands());
+  SmallVector<Value *, 4> ubOperands(forOp.getUpperBoundOperands());
+  unsigned numLbDims = lbMap.getNumDims(), numUbDims = ubMap.getNumDims();
+  unsigned numLbSymbols = lbMap.getNumSymbols();
+  unsigned numUbSymbols = ubMap.getNumSymbols();
+
+  // The set has the dimensions of the lower bound followed by those of the
+  // upper bound, and likewise for symbols.
+  FuncBuilder b(forOp.getOperation());
+  SmallVector<AffineExpr, 4> dimReplacements, symReplacements;
+  for (unsigned i = 0; i < numUbDims; ++i)
+    dimReplacements.push_back(b.getAffineDimExpr(numLbDims + i));
+  for (unsigned i = 0; i < numUbSymbols; ++i)
+    symReplacements.push_back(b.getAffineSymbolExpr(numLbSymbols + i));
+  SmallVector<AffineExpr, 4> constraints;
+  for (auto ubExpr : ubMap.getResults()) {
+    ubExpr = ubExpr.replaceDimsAndSymbols(dimReplacements, symReplacements);
+    for (auto lbExpr : lbMap.getResults())
+      constraints.push_back(ubExpr - lbExpr - 1);
+  }
+  SmallVector<bool, 4> isEq(constraints.size(), false);
+  auto set = b.getIntegerSet(numLbDims + numUbDims,
+                             numLbSymbols + numUbSymbols, constraints, isEq);
+
+  SmallVector<Value *, 8> operands(lbOperands.begin(),
+                                   lbOperands.begin() + numLbDims);
+  operands.append(ubOperands.begin(), ubOperands.begin() + numUbDims);
+  operands.append(lbOperands.begin() + numLbDims, lbOperands.end());
+  operands.append(ubOperands.begin() + numUbDims, ubOperands.end());
+
+  auto ifOp = b.create<AffineIfOp>(forOp.getLoc(), set, operands);
+  auto *thenBlock = createTerminatedBlock(ifOp.getThenBlocks(), forOp.getLoc());
+  forOp.getOperation()->moveBefore(&thenBlock->back());
+  return thenBlock;
+}
+
+/// Returns the first 'affine.if' operation of the body of 'forOp' whose
+/// condition is loop invariant, or a null operation if there is none.
+static AffineIfOp getInvariantIf(AffineForOp forOp) {
+  for (auto &op : *forOp.getBody()) {
+    auto ifOp = op.dyn_cast<AffineIfOp>();
+    if (ifOp && llvm::all_of(op.getOperands(), [&](Value *operand) {
+          return isDefinedOutsideOfLoop(operand, forOp);
+        }))
+      return ifOp;
+  }
+  return AffineIfOp();
+}
+
+/// Returns the number of operations nested in 'forOp'.
+static unsigned getNumNestedOps(AffineForOp forOp) {
+  unsigned numOps = 0;
+  for (auto &op : *forOp.getBody())
+    op.walk([&](Operation *) { ++numOps; });
+  return numOps;
+}
+
+/// Replaces 'ifOp' by the operations of its 'then' or 'else' block.
+static void inlineIfBranch(AffineIfOp ifOp, bool thenBranch) {
+  auto &region = thenBranch ? ifOp.getThenBlocks() : ifOp.getElseBlocks();
+  if (!region.empty()) {
+    for (auto &op : llvm::make_early_inc_range(region.front()))
+      if (!op.isKnownTerminator())
+        op.moveBefore(ifOp.getOperation());
+  }
+  ifOp.erase();
+}
+
+/// Unswitches 'forOp' on the loop invariant condition of 'ifOp': the loop is
+/// replaced by an 'affine.if' on that condition holding a copy of the loop in
+/// each branch, with 'ifOp' replaced by its 'then' and 'else' blocks
+/// respectively. Returns the new 'affine.if' operation; the copy of the loop
+/// in its 'then' block is returned in 'thenLoop', and 'forOp' itself ends up
+/// in its 'else' block.
+static AffineIfOp unswitchLoop(AffineForOp forOp, AffineIfOp ifOp,
+                               AffineForOp *thenLoop) {
+  auto *forInst = forOp.getOperation();
+  auto loc = forOp.getLoc();
+  FuncBuilder b(forInst);
+  SmallVector<Value *, 4> operands(ifOp.getOperation()->getOperands());
+  auto newIfOp = b.create<AffineIfOp>(ifOp.getLoc(), ifOp.getIntegerSet(),
+                                      operands);
+  auto *thenBlock = createTerminatedBlock(newIfOp.getThenBlocks(), loc);
+  auto *elseBlock = createTerminatedBlock(newIfOp.getElseBlocks(), loc);
+
+  // Find the copy of 'ifOp' in the copy of the loop through its position.
+  auto *forBody = forOp.getBody();
+  auto ifPos =
+      std::distance(forBody->begin(), Block::iterator(ifOp.getOperation()));
+  FuncBuilder thenBuilder(thenBlock, thenBlock->begin());
+  *thenLoop = thenBuilder.clone(*forInst)->cast<AffineForOp>();
+  auto &thenIfInst = *std::next(thenLoop->getBody()->begin(), ifPos);
+  inlineIfBranch(thenIfInst.cast<AffineIfOp>(), /*thenBranch=*/true);
+
+  forInst->moveBefore(&elseBlock->back());
+  inlineIfBranch(ifOp, /*thenBranch=*/false);
+  return newIfOp;
+}
+
 void LoopInvariantCodeMotion::runOnAffineForOp(AffineForOp forOp) {
   auto *loopBody = forOp.getBody();
+  LoopMemoryEffects effects(forOp);
 
-  // This is the place where hoisted instructions would reside.
-  FuncBuilder b(forOp.getOperation());
+  // Loads and stores can't be hoisted out of a loop that never runs, and need
+  // a guard if it isn't known to run.
+  auto mayBeConstTripCount = getConstantTripCount(forOp);
+  bool neverRuns =
+      mayBeConstTripCount.hasValue() && mayBeConstTripCount.getValue() == 0;
+  bool mayNotRun = !mayBeConstTripCount.hasValue();
 
   // This vector is used to place loop invariant operations.
   SmallVector<Operation *, 8> opsToMove;
-
-  SetVector<Operation *> loopDefinedOps;
-  // Generate forward slice which contains ops that fall under the transitive
-  // definition closure following the loop induction variable.
-  getForwardSlice(forOp, &loopDefinedOps);
-
-  LLVM_DEBUG(for (auto i
-                  : loopDefinedOps) {
-    (i->print(llvm::dbgs() << "\nLoop-dependent op\n"));
-  });
+  SmallPtrSet<Operation *, 8> opsToMoveSet;
+  bool needsGuard = false;
 
   for (auto &op : *loopBody) {
-    // If the operation is loop invariant, insert it into opsToMove.
-    if (!op.isa<AffineForOp>() && !op.isa<AffineTerminatorOp>() &&
-        loopDefinedOps.count(&op) != 1) {
-      LLVM_DEBUG(op.print(llvm::dbgs() << "\nLICM'ing op\n"));
-      opsToMove.push_back(&op);
+    // An operation is loop invariant if its operands are defined outside of
+    // the loop or by loop invariant operations.
+    if (!isHoistable(op, effects) ||
+        !llvm::all_of(op.getOperands(), [&](Value *operand) {
+          auto *defOp = operand->getDefiningOp();
+          return isDefinedOutsideOfLoop(operand, forOp) ||
+                 (defOp && opsToMoveSet.count(defOp));
+        }))
+      continue;
+    if (op.isa<LoadOp>() || op.isa<StoreOp>()) {
+      if (neverRuns)
+        continue;
+      needsGuard |= mayNotRun;
     }
+    LLVM_DEBUG(op.print(llvm::dbgs() << "\nLICM'ing op\n"));
+    opsToMove.push_back(&op);
+    opsToMoveSet.insert(&op);
   }
 
+  if (needsGuard)
+    guardAgainstZeroTrip(forOp);
+
   // For all instructions that we found to be invariant, place them sequentially
   // right before the for loop.
   for (auto *op : opsToMove) {
@@ -105,7 +339,34 @@ void LoopInvariantCodeMotion::runOnAffineForOp(AffineForOp forOp) {
   if (forOp.getBody()->getOperations().size() == 1) {
     assert(forOp.getBody()->getOperations().front().isa<AffineTerminatorOp>());
     forOp.erase();
+    return;
   }
+
+  // Unswitch the loop on a loop invariant condition, and process the loops in
+  // both branches, which may be unswitched further. Each unswitching removes
+  // an 'affine.if' from both copies of the loop, which bounds the growth; it is
+  // further bounded by the size of the loop and the number of unswitchings.
+  if (numUnswitched >= unswitchLimit ||
+      getNumNestedOps(forOp) > unswitchSizeThreshold)
+    return;
+  auto ifOp = getInvariantIf(forOp);
+  if (!ifOp)
+    return;
+  ++numUnswitched;
+  LLVM_DEBUG(ifOp.getOperation()->print(llvm::dbgs() << "\nUnswitching on\n"));
+  AffineForOp thenLoop;
+  auto newIfOp = unswitchLoop(forOp, ifOp, &thenLoop);
+  runOnAffineForOp(thenLoop);
+  runOnAffineForOp(forOp);
+
+  // Drop the branches whose loops turned out to be empty.
+  auto isEmpty = [](Region &region) {
+    return region.empty() || region.front().getOperations().size() == 1;
+  };
+  if (isEmpty(newIfOp.getElseBlocks()))
+    newIfOp.getElseBlocks().getBlocks().clear();
+  if (isEmpty(newIfOp.getThenBlocks()) && newIfOp.getElseBlocks().empty())
+    newIfOp.erase();
 }
 
 void LoopInvariantCodeMotion::runOnFunction() {
@@ -121,10 +382,22 @@ void LoopInvariantCodeMotion::runOnFunction() {
   // mess the iterators up.
   for (auto op : forOps) {
     LLVM_DEBUG(op.getOperation()->print(llvm::dbgs() << "\nOriginal loop\n"));
+    numUnswitched = 0;
     runOnAffineForOp(op);
   }
 }
 
+/// Allocate a loop invariant code motion pass configured from the options of a
+/// textual pass pipeline, e.g. 'loop-invariant-code-motion{unswitch-limit=2}'.
+static Pass *
+createRegisteredLoopInvariantCodeMotionPass(const PassOptions &options) {
+  auto *pass = new LoopInvariantCodeMotion();
+  options.getOption("unswitch-size-threshold", pass->unswitchSizeThreshold);
+  options.getOption("unswitch-limit", pass->unswitchLimit);
+  return pass;
+}
+
 static PassRegistration<LoopInvariantCodeMotion>
     pass("loop-invariant-code-motion",
-         "Hoist loop invariant instructions outside of the loop");
+         "Hoist loop invariant instructions outside of the loop",
+         createRegisteredLoopInvariantCodeMotionPass);
@@ -23,6 +23,7 @@
 #include "mlir/Analysis/AffineAnalysis.h"
 #include "mlir/Analysis/AffineStructures.h"
 #include "mlir/Analysis/LoopAnalysis.h"
+#include "mlir/Analysis/TileSizeModel.h"
 #include "mlir/Analysis/Utils.h"
 #include "mlir/IR/Builders.h"
 #include "mlir/Pass/Pass.h"
@@ -45,6 +46,35 @@ static llvm::cl::opt<unsigned long long>
                    llvm::cl::desc("Set size of cache to tile for in KiB"),
                    llvm::cl::cat(clOptionsCategory));
 
+// Sizes of the levels of the cache hierarchy to tile for, innermost first. If
+// provided, tile sizes are selected with TileSizeModel.
+static llvm::cl::list<unsigned long long> clCacheSizesKiB(
+    "tile-cache-sizes",
+    llvm::cl::desc("Set sizes of the cache levels to tile for in KiB, "
+                   "innermost first, and select tile sizes from their reuse"),
+    llvm::cl::CommaSeparated, llvm::cl::cat(clOptionsCategory));
+
+static llvm::cl::opt<unsigned> clCacheLineSize(
+    "tile-cache-line-size",
+    llvm::cl::desc("Set size of a cache line in bytes for -tile-cache-sizes"),
+    llvm::cl::init(64), llvm::cl::cat(clOptionsCategory));
+
+// Tile once for each level of -tile-cache-sizes instead of once for the level
+// of lowest cost.
+static llvm::cl::opt<bool> clMultiLevel(
+    "tile-multi-level",
+    llvm::cl::desc("Tile the intra-tile loops again for each inner level of "
+                   "-tile-cache-sizes"),
+    llvm::cl::init(false), llvm::cl::cat(clOptionsCategory));
+
+// Unroll-and-jam factors of the innermost intra-tile loops. If any of them
+// aren't provided, they are 1.
+static llvm::cl::list<unsigned> clRegisterTileSizes(
+    "tile-register-sizes",
+    llvm::cl::desc("List of factors to unroll-and-jam the innermost intra-tile "
+                   "loops by"),
+    llvm::cl::CommaSeparated, llvm::cl::cat(clOptionsCategory));
+
 // Tile size to use for all loops (overrides -tile-sizes if provided).
 static llvm::cl::opt<unsigned>
     clTileSize("tile-size", llvm::cl::desc("Use this tile size for all loops"),
@@ -63,12 +93,14 @@ namespace {
 /// A pass to perform loop tiling on all suitable loop nests of a Function.
 struct LoopTiling : public FunctionPass<LoopTiling> {
   explicit LoopTiling(uint64_t cacheSizeBytes = kDefaultCacheMemCapacity,
-                      bool avoidMaxMinBounds = true)
-      : cacheSizeBytes(cacheSizeBytes), avoidMaxMinBounds(avoidMaxMinBounds) {}
+                      bool avoidMaxMinBounds = true);
 
   void runOnFunction() override;
   void getTileSizes(ArrayRef<AffineForOp> band,
                     SmallVectorImpl<unsigned> *tileSizes);
+  LogicalResult getMultiLevelTileSizes(
+      ArrayRef<AffineForOp> band,
+      SmallVectorImpl<SmallVector<unsigned, 6>> *levelTileSizes);
 
   // Default tile size if nothing is provided.
   constexpr static unsigned kDefaultTileSize = 4;
@@ -76,12 +108,36 @@ struct LoopTiling : public FunctionPass<LoopTiling> {
 
   // Capacity of the cache to tile for.
   uint64_t cacheSizeBytes;
+  // Capacities of the cache levels to tile for with TileSizeModel, innermost
+  // first, if any.
+  SmallVector<uint64_t, 3> cacheLevelSizesBytes;
   // If true, tile sizes are set to avoid max/min in bounds if possible.
   bool avoidMaxMinBounds;
+  // If true, tile once for each level of cacheLevelSizesBytes.
+  bool multiLevel = false;
+  // Unroll-and-jam factors of the innermost intra-tile loops, outermost first.
+  SmallVector<unsigned, 6> registerTileSizes;
+  // Tile size for all loops and list of tile sizes provided with the options of
+  // a textual pass pipeline, which take precedence over the command line ones.
+  Optional<unsigned> tileSize;
+  SmallVector<unsigned, 6> tileSizeList;
 };
 
 } // end anonymous namespace
 
+LoopTiling::LoopTiling(uint64_t cacheSizeBytes, bool avoidMaxMinBounds)
+    : cacheSizeBytes(cacheSizeBytes), avoidMaxMinBounds(avoidMaxMinBounds) {
+  // Override cache sizes if provided on command line.
+  if (clCacheSizeKiB.getNumOccurrences() > 0)
+    this->cacheSizeBytes = clCacheSizeKiB * 1024;
+  for (auto sizeKiB : clCacheSizesKiB)
+    cacheLevelSizesBytes.push_back(sizeKiB * 1024);
+  if (clMultiLevel.getNumOccurrences() > 0)
+    multiLevel = clMultiLevel;
+  registerTileSizes.assign(clRegisterTileSizes.begin(),
+                           clRegisterTileSizes.end());
+}
+
 /// Creates a pass to perform loop tiling on all suitable loop nests of a
 /// Function.
 FunctionPassBase *mlir::createLoopTilingPass(uint64_t cacheSizeBytes) {
@@ -186,7 +242,8 @@ constructTiledIndexSetHyperRect(MutableArrayRef<AffineForOp> origLoops,
 /// and intra-tile loops. A band is a contiguous set of loops.
 //  TODO(bondhugula): handle non hyper-rectangular spaces.
 LogicalResult mlir::tileCodeGen(MutableArrayRef<AffineForOp> band,
-                                ArrayRef<unsigned> tileSizes) {
+                                ArrayRef<unsigned> tileSizes,
+                                SmallVectorImpl<AffineForOp> *tiledNest) {
   assert(!band.empty());
   assert(band.size() == tileSizes.size() && "Incorrect number of tile sizes");
 
@@ -258,6 +315,8 @@ LogicalResult mlir::tileCodeGen(MutableArrayRef<AffineForOp> band,
   // Erase the old loop nest.
   rootAffineForOp.erase();
 
+  if (tiledNest)
+    tiledNest->assign(newLoops.begin(), newLoops.end());
   return success();
 }
 
@@ -294,16 +353,17 @@ static void adjustToDivisorsOfTripCounts(ArrayRef<AffineForOp> band,
     // tSize.
     uint64_t constTripCount = mayConst.getValue();
     if (tSizeAdjusted > constTripCount / 2)
-      tSizeAdjusted = constTripCount / 2;
+      tSizeAdjusted = std::max<uint64_t>(1, constTripCount / 2);
     while (constTripCount % tSizeAdjusted != 0)
       tSizeAdjusted--;
   }
 }
 
 // Returns tile sizes to use. Checks CL options; if none are specified, sets it
-// based on a simple model that looks at the memory footprint and determines
-// tile sizes assuming identity accesses / 1:1 tile size proportional footprint
-// along each of the dimensions being tiled.
+// with TileSizeModel if cache levels were provided and the band can be
+// modeled, and otherwise based on a simple model that looks at the memory
+// footprint and determines tile sizes assuming identity accesses / 1:1 tile
+// size proportional footprint along each of the dimensions being tiled.
 // TODO(mlir-team): evolve this model. Tile size determination is a large area
 // to play with in general.
 void LoopTiling::getTileSizes(ArrayRef<AffineForOp> band,
@@ -313,18 +373,26 @@ void LoopTiling::getTileSizes(ArrayRef<AffineForOp> band,
 
   tileSizes->resize(band.size());
 
-  // Use clTileSize for all loops if specified.
-  if (clTileSize.getNumOccurrences() > 0) {
-    std::fill(tileSizes->begin(), tileSizes->end(), clTileSize);
+  // Use tileSize or clTileSize for all loops if specified.
+  Optional<unsigned> uniformTileSize = tileSize;
+  if (!uniformTileSize && clTileSize.getNumOccurrences() > 0)
+    uniformTileSize = clTileSize;
+  if (uniformTileSize) {
+    std::fill(tileSizes->begin(), tileSizes->end(), *uniformTileSize);
     return;
   }
 
-  // Use clTileSizes and fill them with default tile size if it's short.
-  if (!clTileSizes.empty()) {
+  // Use tileSizeList or clTileSizes and fill them with default tile size if
+  // it's short.
+  SmallVector<unsigned, 6> providedTileSizes(tileSizeList);
+  if (providedTileSizes.empty())
+    providedTileSizes.assign(clTileSizes.begin(), clTileSizes.end());
+  if (!providedTileSizes.empty()) {
     std::fill(tileSizes->begin(), tileSizes->end(),
               LoopTiling::kDefaultTileSize);
-    std::copy(clTileSizes.begin(),
-              clTileSizes.begin() + std::min(clTileSizes.size(), band.size()),
+    std::copy(providedTileSizes.begin(),
+              providedTileSizes.begin() +
+                  std::min(providedTileSizes.size(), band.size()),
               tileSizes->begin());
     return;
   }
@@ -333,6 +401,20 @@ void LoopTiling::getTileSizes(ArrayRef<AffineForOp> band,
   auto rootForOp = band[0];
   (void)rootForOp;
 
+  // Select the tile sizes from the reuse along each loop if a cache hierarchy
+  // was provided.
+  if (!cacheLevelSizesBytes.empty()) {
+    if (auto model = TileSizeModel::get(band, clCacheLineSize)) {
+      model->getTileSizes(cacheLevelSizesBytes, tileSizes);
+      if (avoidMaxMinBounds)
+        adjustToDivisorsOfTripCounts(band, tileSizes);
+      return;
+    }
+    LLVM_DEBUG(rootForOp.emitWarning(
+        "trip counts or accessed regions not constant: using the memory "
+        "footprint to select tile sizes"));
+  }
+
   // Obtain memory footprint and set tile sizes so that a tile fits in
   // the cache size. This is an approximation with the assumption that the
   // footprint increases with the tile size linearly in that dimension (i.e.,
@@ -382,35 +464,142 @@ void LoopTiling::getTileSizes(ArrayRef<AffineForOp> band,
     adjustToDivisorsOfTripCounts(band, tileSizes);
 }
 
-void LoopTiling::runOnFunction() {
-  // Override cache size if provided on command line.
-  if (clCacheSizeKiB.getNumOccurrences() > 0)
-    cacheSizeBytes = clCacheSizeKiB * 1024;
+// Returns in 'levelTileSizes' the tile sizes to tile 'band' with once for each
+// level of the cache hierarchy, outermost level first, selected with
+// TileSizeModel. The tile sizes of a level are capped by and divide those of
+// the enclosing level, so that each tiling applies to intra-tile loops with
+// constant trip counts. The levels whose tiles would be those of the enclosing
+// level are skipped. Returns failure if the band can't be modeled.
+LogicalResult LoopTiling::getMultiLevelTileSizes(
+    ArrayRef<AffineForOp> band,
+    SmallVectorImpl<SmallVector<unsigned, 6>> *levelTileSizes) {
+  auto model = TileSizeModel::get(band, clCacheLineSize);
+  if (!model)
+    return failure();
+
+  // The model only exists for constant trip counts.
+  SmallVector<unsigned, 6> outerTileSizes;
+  for (auto forOp : band)
+    outerTileSizes.push_back(getConstantTripCount(forOp).getValue());
+
+  for (auto cacheSize : llvm::reverse(cacheLevelSizesBytes)) {
+    SmallVector<unsigned, 6> tileSizes;
+    model->getTileSizesForCache(cacheSize, &tileSizes);
+    for (unsigned i = 0, e = band.size(); i < e; i++) {
+      unsigned &tSize = tileSizes[i];
+      tSize = std::max(1U, std::min(tSize, outerTileSizes[i]));
+      while (outerTileSizes[i] % tSize != 0)
+        tSize--;
+    }
+    if (tileSizes == outerTileSizes)
+      continue;
+    levelTileSizes->push_back(tileSizes);
+    outerTileSizes = tileSizes;
+  }
+  return success();
+}
 
+// Unroll-and-jams the loops of 'band' by 'factors', outermost loop first, so
+// that the body of the innermost loop holds a register tile. Each factor is
+// reduced to the largest divisor of the trip count of its loop if the latter is
+// known.
+static void unrollJamRegisterTile(ArrayRef<AffineForOp> band,
+                                  ArrayRef<unsigned> factors) {
+  unsigned numFactors = std::min(band.size(), factors.size());
+  for (unsigned i = 0; i < numFactors; i++) {
+    uint64_t factor = factors[i];
+    if (auto mayConst = getConstantTripCount(band[i])) {
+      uint64_t constTripCount = mayConst.getValue();
+      factor = std::min(factor, constTripCount);
+      while (factor > 1 && constTripCount % factor != 0)
+        factor--;
+    }
+    if (factor <= 1)
+      continue;
+    if (failed(loopUnrollJamByFactor(band[i], factor)))
+      LLVM_DEBUG(band[i].emitWarning("register tile not unroll-and-jammed"));
+  }
+}
+
+void LoopTiling::runOnFunction() {
   // Bands of loops to tile.
   std::vector<SmallVector<AffineForOp, 6>> bands;
   getTileableBands(getFunction(), &bands);
 
   for (auto &band : bands) {
-    // Set up tile sizes; fill missing tile sizes at the end with default tile
-    // size or clTileSize if one was provided.
-    SmallVector<unsigned, 6> tileSizes;
-    getTileSizes(band, &tileSizes);
+    // Set up tile sizes for each tiling, outermost first; fill missing tile
+    // sizes at the end with default tile size or clTileSize if one was
+    // provided.
+    SmallVector<SmallVector<unsigned, 6>, 3> levelTileSizes;
+    if (!multiLevel || cacheLevelSizesBytes.empty() ||
+        failed(getMultiLevelTileSizes(band, &levelTileSizes))) {
+      levelTileSizes.clear();
+      levelTileSizes.emplace_back();
+      getTileSizes(band, &levelTileSizes.back());
+    }
     if (llvm::DebugFlag) {
       std::stringstream msg;
-      msg << "using tile sizes [";
-      for (auto tSize : tileSizes)
-        msg << tSize << " ";
-      msg << "]\n";
+      msg << "using tile sizes";
+      for (auto &tileSizes : levelTileSizes) {
+        msg << " [";
+        for (auto tSize : tileSizes)
+          msg << tSize << " ";
+        msg << "]";
+      }
+      msg << "\n";
       auto rootForOp = band[0];
       rootForOp.emitNote(msg.str());
     }
-    if (failed(tileCodeGen(band, tileSizes)))
-      return signalPassFailure();
+
+    // Each tiling after the first one tiles the intra-tile loops of the
+    // previous one.
+    SmallVector<AffineForOp, 6> pointLoops(band.begin(), band.end());
+    for (unsigned l = 0, e = levelTileSizes.size(); l < e; l++) {
+      SmallVector<AffineForOp, 12> tiledNest;
+      if (failed(tileCodeGen(pointLoops, levelTileSizes[l], &tiledNest)))
+        return signalPassFailure();
+      unsigned width = pointLoops.size();
+      pointLoops.assign(tiledNest.begin() + width, tiledNest.end());
+      // Tile-space loops of intra-tile loops that aren't tiled further have a
+      // single iteration.
+      if (l > 0)
+        for (unsigned i = 0; i < width; i++)
+          (void)promoteIfSingleIteration(tiledNest[i]);
+    }
+
+    if (!registerTileSizes.empty())
+      unrollJamRegisterTile(pointLoops, registerTileSizes);
   }
 }
 
 constexpr unsigned LoopTiling::kDefaultTileSize;
 constexpr uint64_t LoopTiling::kDefaultCacheMemCapacity;
 
-static PassRegistration<LoopTiling> pass("loop-tile", "Tile loop nests");
+/// Allocate a loop tiling pass configured from the options of a textual pass
+/// pipeline, e.g. 'loop-tile{tile-sizes=32,32}'. Cache sizes are provided in
+/// KiB, as on the command line, e.g. 'loop-tile{cache-sizes=32,1024}', and
+/// 'multi-level' and 'register-sizes' correspond to -tile-multi-level and
+/// -tile-register-sizes, e.g. 'loop-tile{multi-level register-sizes=4,4}'.
+static Pass *createRegisteredLoopTilingPass(const PassOptions &options) {
+  auto *pass = new LoopTiling();
+  options.getOption("tile-size", pass->tileSize);
+  options.getListOption("tile-sizes", pass->tileSizeList);
+
+  Optional<uint64_t> cacheSizeKiB;
+  options.getOption("cache-size", cacheSizeKiB);
+  if (cacheSizeKiB)
+    pass->cacheSizeBytes = *cacheSizeKiB * 1024;
+  SmallVector<uint64_t, 3> cacheSizesKiB;
+  options.getListOption("cache-sizes", cacheSizesKiB);
+  if (!cacheSizesKiB.empty()) {
+    pass->cacheLevelSizesBytes.clear();
+    for (auto sizeKiB : cacheSizesKiB)
+      pass->cacheLevelSizesBytes.push_back(sizeKiB * 1024);
+  }
+  options.getOption("multi-level", pass->multiLevel);
+  options.getListOption("register-sizes", pass->registerTileSizes);
+  return pass;
+}
+
+static PassRegistration<LoopTiling> pass("loop-tile", "Tile loop nests",
+                                         createRegisteredLoopTilingPass);
@@ -188,4 +188,15 @@ FunctionPassBase *mlir::createLoopUnrollPass(
       unrollFull == -1 ? None : Optional<bool>(unrollFull), getUnrollFactor);
 }
 
-static PassRegistration<LoopUnroll> pass("loop-unroll", "Unroll loops");
+/// Allocate a loop unroll pass configured from the options of a textual pass
+/// pipeline, e.g. 'loop-unroll{unroll-factor=2}'.
+static Pass *createRegisteredLoopUnrollPass(const PassOptions &options) {
+  Optional<unsigned> unrollFactor;
+  Optional<bool> unrollFull;
+  options.getOption("unroll-factor", unrollFactor);
+  options.getOption("unroll-full", unrollFull);
+  return new LoopUnroll(unrollFactor, unrollFull);
+}
+
+static PassRegistration<LoopUnroll> pass("loop-unroll", "Unroll loops",
+                                         createRegisteredLoopUnrollPass);
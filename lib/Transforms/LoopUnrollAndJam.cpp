@@ -240,5 +240,14 @@ LogicalResult mlir::loopUnrollJamByFactor(AffineForOp forOp,
   return success();
 }
 
-static PassRegistration<LoopUnrollAndJam> pass("loop-unroll-jam",
-                                               "Unroll and jam loops");
+/// Allocate an unroll and jam pass configured from the options of a textual
+/// pass pipeline, e.g. 'loop-unroll-jam{unroll-jam-factor=2}'.
+static Pass *createRegisteredLoopUnrollAndJamPass(const PassOptions &options) {
+  Optional<unsigned> unrollJamFactor;
+  options.getOption("unroll-jam-factor", unrollJamFactor);
+  return new LoopUnrollAndJam(unrollJamFactor);
+}
+
+static PassRegistration<LoopUnrollAndJam>
+    pass("loop-unroll-jam", "Unroll and jam loops",
+         createRegisteredLoopUnrollAndJamPass);
@@ -16,25 +16,43 @@
 // =============================================================================
 //
 // This file implements a pass to forward memref stores to loads, thereby
-// potentially getting rid of intermediate memref's entirely.
-// TODO(mlir-team): In the future, similar techniques could be used to eliminate
-// dead memref store's and perform more complex forwarding when support for
+// potentially getting rid of intermediate memref's entirely. Within a block,
+// redundant loads are replaced by the values previously loaded or stored, and
+// stores overwritten before being read are eliminated. Values reused across the
+// iterations of innermost loops are replaced after unrolling these loops.
+// TODO(mlir-team): more complex forwarding can be performed when support for
 // SSA scalars live out of 'affine.for'/'affine.if' statements is available.
 //===----------------------------------------------------------------------===//
 
+#include "mlir/AffineOps/AffineOps.h"
 #include "mlir/Analysis/AffineAnalysis.h"
+#include "mlir/Analysis/AffineStructures.h"
 #include "mlir/Analysis/Dominance.h"
+#include "mlir/Analysis/LoopAnalysis.h"
+#include "mlir/Analysis/MemRefDependenceAnalysis.h"
 #include "mlir/Analysis/Utils.h"
 #include "mlir/Pass/Pass.h"
 #include "mlir/StandardOps/Ops.h"
+#include "mlir/Transforms/LoopUtils.h"
 #include "mlir/Transforms/Passes.h"
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/Support/CommandLine.h"
 #include <algorithm>
 
 #define DEBUG_TYPE "memref-dataflow-opt"
 
 using namespace mlir;
 
+static llvm::cl::OptionCategory clOptionsCategory(DEBUG_TYPE " options");
+
+static llvm::cl::opt<unsigned> clUnrollFactor(
+    "memref-dataflow-unroll-factor",
+    llvm::cl::desc("Unroll factor of the innermost loops whose iterations "
+                   "access memref elements accessed by the previous "
+                   "iterations; 1 disables unrolling"),
+    llvm::cl::init(1), llvm::cl::cat(clOptionsCategory));
+
 namespace {
 
 // The store to load forwarding relies on three conditions:
@@ -63,16 +81,35 @@ namespace {
 // condition (2) is a sufficient one but not necessary (since it doesn't reason
 // about loops that are guaranteed to execute at least once).
 //
+// Once the loads are forwarded, each block is scanned in order to replace the
+// loads of an element that was loaded or stored earlier in the block, with no
+// other access to the memref in between that may write it, and to erase the
+// stores of an element that is stored again later in the block, with no other
+// access to the memref in between that may read it. The elements are compared
+// with their access maps composed with the affine.apply ops feeding them.
+//
+// Values reused across iterations are not carried in SSA form since
+// 'affine.for' has no loop-carried values; instead, the innermost loops where
+// an access reuses an element accessed by one of the previous 'unrollFactor'
+// iterations are unrolled by 'unrollFactor' first, so that the reuse happens
+// within the unrolled body for most iterations.
+//
 // TODO(mlir-team): more forwarding can be done when support for
 // loop/conditional live-out SSA values is available.
-// TODO(mlir-team): do general dead store elimination for memref's. This pass
-// currently only eliminates the stores only if no other loads/uses (other
-// than dealloc) remain.
 //
 struct MemRefDataFlowOpt : public FunctionPass<MemRefDataFlowOpt> {
+  explicit MemRefDataFlowOpt(unsigned unrollFactor = 1)
+      : unrollFactor(unrollFactor) {}
+
   void runOnFunction() override;
 
+  void unrollForReuse(Function &f);
   void forwardStoreToLoad(LoadOp loadOp);
+  void replaceAccessesInBlock(Block &block);
+
+  // The unroll factor of the innermost loops reusing elements across their
+  // iterations.
+  unsigned unrollFactor;
 
   // A list of memref's that are potentially dead / could be eliminated.
   SmallPtrSet<Value *, 4> memrefsToErase;
@@ -81,14 +118,68 @@ struct MemRefDataFlowOpt : public FunctionPass<MemRefDataFlowOpt> {
 
   DominanceInfo *domInfo = nullptr;
   PostDominanceInfo *postDomInfo = nullptr;
+  MemRefDependenceAnalysis *dependences = nullptr;
 };
 
 } // end anonymous namespace
 
 /// Creates a pass to perform optimizations relying on memref dataflow such as
 /// store to load forwarding, elimination of dead stores, and dead allocs.
-FunctionPassBase *mlir::createMemRefDataFlowOptPass() {
-  return new MemRefDataFlowOpt();
+FunctionPassBase *mlir::createMemRefDataFlowOptPass(unsigned unrollFactor) {
+  return new MemRefDataFlowOpt(unrollFactor);
+}
+
+/// Returns true if a load in the body of 'forOp' accesses an element already
+/// accessed by one of the 'maxDistance' previous iterations of 'forOp'.
+static bool hasReuseAcrossIterations(AffineForOp forOp, unsigned maxDistance,
+                                     MemRefDependenceAnalysis *dependences) {
+  SmallVector<Operation *, 8> loadOps;
+  SmallVector<Operation *, 8> accessOps;
+  for (auto &op : *forOp.getBody()) {
+    if (op.isa<LoadOp>())
+      loadOps.push_back(&op);
+    if (op.isa<LoadOp>() || op.isa<StoreOp>())
+      accessOps.push_back(&op);
+  }
+
+  unsigned loopDepth = getNestingDepth(*forOp.getOperation()) + 1;
+  int64_t step = forOp.getStep();
+  for (auto *loadOp : loadOps) {
+    Value *memref = loadOp->cast<LoadOp>().getMemRef();
+    for (auto *srcOp : accessOps) {
+      if (MemRefAccess(srcOp).memref != memref)
+        continue;
+      // The dependence is carried by 'forOp'; its minimal distance is the
+      // number of iterations the element has to be kept for.
+      const auto &dependence = dependences->getDependence(
+          srcOp, loadOp, loopDepth, /*allowRAR=*/srcOp->isa<LoadOp>(),
+          /*computeComponents=*/true);
+      if (!dependence.exists || !dependence.hasComponents ||
+          dependence.components.size() != loopDepth)
+        continue;
+      const auto &distance = dependence.components.back().lb;
+      if (distance.hasValue() && distance.getValue() >= step &&
+          distance.getValue() / step < maxDistance)
+        return true;
+    }
+  }
+  return false;
+}
+
+/// Unrolls the innermost loops of 'f' that reuse elements across iterations.
+void MemRefDataFlowOpt::unrollForReuse(Function &f) {
+  // Collect the loops first since unrolling modifies the function.
+  SmallVector<AffineForOp, 8> loops;
+  f.walk<AffineForOp>([&](AffineForOp forOp) {
+    if (isInnermostLoop(forOp) &&
+        hasReuseAcrossIterations(forOp, unrollFactor, dependences))
+      loops.push_back(forOp);
+  });
+  for (auto forOp : loops)
+    (void)loopUnrollByFactor(forOp, unrollFactor);
+  // The cached dependences refer to the iteration domains before unrolling.
+  if (!loops.empty())
+    dependences->clear();
 }
 
 // This is a straightforward implementation not optimized for speed. Optimize
@@ -125,15 +216,10 @@ void MemRefDataFlowOpt::forwardStoreToLoad(LoadOp loadOp) {
   // post-dominance on these. 'fwdingCandidates' are a subset of depSrcStores.
   SmallVector<Operation *, 8> depSrcStores;
   for (auto *storeOpInst : storeOps) {
-    MemRefAccess srcAccess(storeOpInst);
-    MemRefAccess destAccess(loadOpInst);
-    FlatAffineConstraints dependenceConstraints;
     unsigned nsLoops = getNumCommonSurroundingLoops(*loadOpInst, *storeOpInst);
     // Dependences at loop depth <= minSurroundingLoops do NOT matter.
     for (unsigned d = nsLoops + 1; d > minSurroundingLoops; d--) {
-      if (!checkMemrefAccessDependence(srcAccess, destAccess, d,
-                                       &dependenceConstraints,
-                                       /*dependenceComponents=*/nullptr))
+      if (!dependences->hasDependence(storeOpInst, loadOpInst, d))
         continue;
       depSrcStores.push_back(storeOpInst);
       // Check if this store is a candidate for forwarding; we only forward if
@@ -209,6 +295,126 @@ void MemRefDataFlowOpt::forwardStoreToLoad(LoadOp loadOp) {
   loadOpsToErase.push_back(loadOpInst);
 }
 
+// Returns the memref that 'memref' is cast from, looking through a chain of
+// memref_cast ops, or 'memref' itself if it isn't the result of a cast. The
+// accesses to a memref and to its casts access the same elements.
+static Value *lookThroughCasts(Value *memref) {
+  while (auto *defOp = memref->getDefiningOp()) {
+    auto castOp = defOp->dyn_cast<MemRefCastOp>();
+    if (!castOp)
+      break;
+    memref = castOp.getOperand();
+  }
+  return memref;
+}
+
+namespace {
+/// A memref element, identified by the memref accessed, looking through memref
+/// casts, and the access map of a load or store composed with the affine.apply
+/// ops feeding its indices.
+struct AccessedElement {
+  explicit AccessedElement(Operation *op) {
+    MemRefAccess access(op);
+    AffineValueMap accessMap;
+    access.getAccessMap(&accessMap);
+    memref = lookThroughCasts(access.memref);
+    map = accessMap.getAffineMap();
+    operands.assign(accessMap.getOperands().begin(),
+                    accessMap.getOperands().end());
+  }
+
+  bool operator==(const AccessedElement &other) const {
+    return memref == other.memref && map == other.map &&
+           operands == other.operands;
+  }
+
+  Value *memref;
+  AffineMap map;
+  SmallVector<Value *, 4> operands;
+};
+} // end anonymous namespace
+
+// Replaces the loads of 'block' that access an element loaded or stored
+// earlier in 'block', and erases the stores overwritten later in 'block'
+// before being read. Operations other than loads, stores and memref casts,
+// including those nested in the regions of the operations of 'block', are
+// conservatively assumed to both read and write the memref's they use.
+void MemRefDataFlowOpt::replaceAccessesInBlock(Block &block) {
+  // The values held by the elements loaded or stored in the block so far.
+  SmallVector<std::pair<AccessedElement, Value *>, 8> availableValues;
+  // The stores whose value hasn't been read yet.
+  SmallVector<std::pair<AccessedElement, Operation *>, 8> pendingStores;
+
+  auto forgetAvailableValues = [&](Value *memref) {
+    availableValues.erase(
+        std::remove_if(availableValues.begin(), availableValues.end(),
+                       [&](const std::pair<AccessedElement, Value *> &entry) {
+                         return entry.first.memref == memref;
+                       }),
+        availableValues.end());
+  };
+  auto forgetPendingStores = [&](Value *memref) {
+    pendingStores.erase(
+        std::remove_if(
+            pendingStores.begin(), pendingStores.end(),
+            [&](const std::pair<AccessedElement, Operation *> &entry) {
+              return entry.first.memref == memref;
+            }),
+        pendingStores.end());
+  };
+
+  for (auto &op : llvm::make_early_inc_range(block)) {
+    if (auto loadOp = op.dyn_cast<LoadOp>()) {
+      AccessedElement element(&op);
+      auto it = llvm::find_if(
+          availableValues, [&](const std::pair<AccessedElement, Value *> &e) {
+            return e.first == element;
+          });
+      if (it != availableValues.end()) {
+        loadOp.getResult()->replaceAllUsesWith(it->second);
+        memrefsToErase.insert(element.memref);
+        op.erase();
+        continue;
+      }
+      // The stores to the memref may have been read.
+      forgetPendingStores(element.memref);
+      availableValues.emplace_back(element, loadOp.getResult());
+      continue;
+    }
+
+    if (auto storeOp = op.dyn_cast<StoreOp>()) {
+      AccessedElement element(&op);
+      // A pending store to the same element is dead. There is at most one
+      // since each store erases the previous one.
+      auto pending = llvm::find_if(
+          pendingStores,
+          [&](const std::pair<AccessedElement, Operation *> &entry) {
+            return entry.first == element;
+          });
+      if (pending != pendingStores.end()) {
+        pending->second->erase();
+        pendingStores.erase(pending);
+      }
+      // The store may write any other element of the memref.
+      forgetAvailableValues(element.memref);
+      availableValues.emplace_back(element, storeOp.getValueToStore());
+      pendingStores.emplace_back(element, &op);
+      continue;
+    }
+
+    op.walk([&](Operation *nestedOp) {
+      if (nestedOp->isa<MemRefCastOp>())
+        return;
+      for (auto *operand : nestedOp->getOperands()) {
+        if (!operand->getType().isa<MemRefType>())
+          continue;
+        forgetAvailableValues(lookThroughCasts(operand));
+        forgetPendingStores(lookThroughCasts(operand));
+      }
+    });
+  }
+}
+
 void MemRefDataFlowOpt::runOnFunction() {
   // Only supports single block functions at the moment.
   Function &f = getFunction();
@@ -217,6 +423,10 @@ void MemRefDataFlowOpt::runOnFunction() {
     return;
   }
 
+  dependences = &getAnalysis<MemRefDependenceAnalysis>();
+  if (unrollFactor > 1)
+    unrollForReuse(f);
+
   domInfo = &getAnalysis<DominanceInfo>();
   postDomInfo = &getAnalysis<PostDominanceInfo>();
 
@@ -231,6 +441,17 @@ void MemRefDataFlowOpt::runOnFunction() {
     loadOp->erase();
   }
 
+  // Replace the redundant loads and erase the dead stores of each block.
+  SmallVector<Block *, 8> blocks;
+  f.walk([&](Operation *op) {
+    for (auto &region : op->getRegions())
+      for (auto &block : region)
+        blocks.push_back(&block);
+  });
+  blocks.push_back(&f.front());
+  for (auto *block : blocks)
+    replaceAccessesInBlock(*block);
+
   // Check if the store fwd'ed memrefs are now left with only stores and can
   // thus be completely deleted. Note: the canononicalize pass should be able
   // to do this as well, but we'll do it here since we collected these anyway.
@@ -256,5 +477,16 @@ void MemRefDataFlowOpt::runOnFunction() {
   }
 }
 
+/// Allocate a memref dataflow optimization pass configured from the options of
+/// a textual pass pipeline, e.g. 'memref-dataflow-opt{unroll-factor=4}'.
+static Pass *createRegisteredMemRefDataFlowOptPass(const PassOptions &options) {
+  auto *pass = new MemRefDataFlowOpt();
+  if (clUnrollFactor.getNumOccurrences() > 0)
+    pass->unrollFactor = clUnrollFactor;
+  options.getOption("unroll-factor", pass->unrollFactor);
+  return pass;
+}
+
 static PassRegistration<MemRefDataFlowOpt>
-    pass("memref-dataflow-opt", "Perform store/load forwarding for memrefs");
+    pass("memref-dataflow-opt", "Perform store/load forwarding for memrefs",
+         createRegisteredMemRefDataFlowOptPass);
@@ -31,26 +31,97 @@
 #include "mlir/Transforms/LoopUtils.h"
 #include "mlir/Transforms/Utils.h"
 #include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #define DEBUG_TYPE "pipeline-data-transfer"
 
 using namespace mlir;
 
+static llvm::cl::OptionCategory clOptionsCategory(DEBUG_TYPE " options");
+
+static llvm::cl::opt<unsigned> clNumBuffers(
+    "pipeline-data-transfer-num-buffers",
+    llvm::cl::desc("Number of buffers to cycle through for each pipelined DMA; "
+                   "0 picks it from the fast memory capacity (default: 2)"),
+    llvm::cl::cat(clOptionsCategory));
+
+static llvm::cl::opt<unsigned> clMaxBuffers(
+    "pipeline-data-transfer-max-buffers",
+    llvm::cl::desc("Maximum number of buffers the fast memory capacity based "
+                   "choice can pick (default: 4)"),
+    llvm::cl::cat(clOptionsCategory));
+
+static llvm::cl::opt<unsigned long long> clFastMemoryCapacity(
+    "pipeline-data-transfer-fast-mem-capacity",
+    llvm::cl::desc("Set fast memory space capacity in KiB available to the "
+                   "pipelined buffers (default: unlimited)"),
+    llvm::cl::cat(clOptionsCategory));
+
+static llvm::cl::opt<bool> clComputeStages(
+    "pipeline-data-transfer-compute-stages",
+    llvm::cl::desc("Also pipeline the top-level loop nests of the loop body "
+                   "with respect to each other"),
+    llvm::cl::cat(clOptionsCategory));
+
 namespace {
 
 struct PipelineDataTransfer : public FunctionPass<PipelineDataTransfer> {
+  explicit PipelineDataTransfer(
+      unsigned numBuffers = 2, bool pipelineComputeStages = false,
+      uint64_t fastMemCapacityBytes = std::numeric_limits<uint64_t>::max(),
+      unsigned maxBuffers = 4)
+      : numBuffers(numBuffers), maxBuffers(maxBuffers),
+        pipelineComputeStages(pipelineComputeStages),
+        fastMemCapacityBytes(fastMemCapacityBytes) {}
+
   void runOnFunction() override;
   void runOnAffineForOp(AffineForOp forOp);
 
   std::vector<AffineForOp> forOps;
+
+  // Number of buffers each pipelined DMA cycles through, i.e., DMAs are
+  // started 'numBuffers - 1' iterations ahead of their use. If zero, the
+  // largest number up to 'maxBuffers' that fits in 'fastMemCapacityBytes' is
+  // used.
+  unsigned numBuffers;
+  unsigned maxBuffers;
+  // Pipeline the top-level loop nests of the body as separate stages.
+  bool pipelineComputeStages;
+  // Capacity of the faster memory space.
+  uint64_t fastMemCapacityBytes;
+};
+
+/// A memref replaced by a multi-buffer with one buffer for each iteration in
+/// flight, along with the range of compute stages accessing it.
+struct PipelinedBuffer {
+  // Returns the number of buffers needed when DMAs are started
+  // 'numBuffers - 1' iterations ahead of the first compute stage.
+  unsigned getDepth(unsigned numBuffers) const {
+    if (writtenByDmaStart)
+      return numBuffers + maxStage;
+    return maxStage - minStage + 1;
+  }
+
+  Value *memref;
+  // True for the buffers and tags of pipelined DMAs, which are accessed by
+  // the DMA start ahead of all compute stages.
+  bool writtenByDmaStart;
+  bool isTag;
+  unsigned minStage;
+  unsigned maxStage;
 };
 
 } // end anonymous namespace
 
 /// Creates a pass to pipeline explicit movement of data across levels of the
 /// memory hierarchy.
-FunctionPassBase *mlir::createPipelineDataTransferPass() {
-  return new PipelineDataTransfer();
+FunctionPassBase *
+mlir::createPipelineDataTransferPass(unsigned numBuffers,
+                                     bool pipelineComputeStages,
+                                     uint64_t fastMemCapacityBytes) {
+  return new PipelineDataTransfer(numBuffers, pipelineComputeStages,
+                                  fastMemCapacityBytes);
 }
 
 // Returns the position of the tag memref operand given a DMA operation.
@@ -66,22 +137,24 @@ static unsigned getTagMemRefPos(Operation &dmaInst) {
   return 0;
 }
 
-/// Doubles the buffer of the supplied memref on the specified 'affine.for'
-/// operation by adding a leading dimension of size two to the memref.
+/// Multiplies the buffer of the supplied memref on the specified 'affine.for'
+/// operation by adding a leading dimension of size 'numBuffers' to the memref.
 /// Replaces all uses of the old memref by the new one while indexing the newly
 /// added dimension by the loop IV of the specified 'affine.for' operation
-/// modulo 2. Returns false if such a replacement cannot be performed.
-static bool doubleBuffer(Value *oldMemRef, AffineForOp forOp) {
+/// modulo 'numBuffers'. Returns false if such a replacement cannot be
+/// performed.
+static bool multiBuffer(Value *oldMemRef, AffineForOp forOp,
+                        unsigned numBuffers) {
   auto *forBody = forOp.getBody();
   FuncBuilder bInner(forBody, forBody->begin());
   bInner.setInsertionPoint(forBody, forBody->begin());
 
-  // Doubles the shape with a leading dimension extent of 2.
-  auto doubleShape = [&](MemRefType oldMemRefType) -> MemRefType {
-    // Add the leading dimension in the shape for the double buffer.
+  // Multiplies the shape with a leading dimension extent of 'numBuffers'.
+  auto multiplyShape = [&](MemRefType oldMemRefType) -> MemRefType {
+    // Add the leading dimension in the shape for the multi-buffer.
     ArrayRef<int64_t> oldShape = oldMemRefType.getShape();
     SmallVector<int64_t, 4> newShape(1 + oldMemRefType.getRank());
-    newShape[0] = 2;
+    newShape[0] = numBuffers;
     std::copy(oldShape.begin(), oldShape.end(), newShape.begin() + 1);
     auto newMemRefType =
         bInner.getMemRefType(newShape, oldMemRefType.getElementType(), {},
@@ -90,9 +163,9 @@ static bool doubleBuffer(Value *oldMemRef, AffineForOp forOp) {
   };
 
   auto oldMemRefType = oldMemRef->getType().cast<MemRefType>();
-  auto newMemRefType = doubleShape(oldMemRefType);
+  auto newMemRefType = multiplyShape(oldMemRefType);
 
-  // The double buffer is allocated right before 'forInst'.
+  // The multi-buffer is allocated right before 'forInst'.
   auto *forInst = forOp.getOperation();
   FuncBuilder bOuter(forInst);
   // Put together alloc operands for any dynamic dimensions of the memref.
@@ -108,24 +181,24 @@ static bool doubleBuffer(Value *oldMemRef, AffineForOp forOp) {
   Value *newMemRef =
       bOuter.create<AllocOp>(forInst->getLoc(), newMemRefType, allocOperands);
 
-  // Create 'iv mod 2' value to index the leading dimension.
+  // Create 'iv mod numBuffers' value to index the leading dimension.
   auto d0 = bInner.getAffineDimExpr(0);
   int64_t step = forOp.getStep();
-  auto modTwoMap = bInner.getAffineMap(/*dimCount=*/1, /*symbolCount=*/0,
-                                       {d0.floorDiv(step) % 2}, {});
-  auto ivModTwoOp = bInner.create<AffineApplyOp>(forOp.getLoc(), modTwoMap,
-                                                 forOp.getInductionVar());
+  auto modMap = bInner.getAffineMap(/*dimCount=*/1, /*symbolCount=*/0,
+                                    {d0.floorDiv(step) % numBuffers}, {});
+  auto ivModOp = bInner.create<AffineApplyOp>(forOp.getLoc(), modMap,
+                                              forOp.getInductionVar());
 
   // replaceAllMemRefUsesWith will always succeed unless the forOp body has
   // non-deferencing uses of the memref (dealloc's are fine though).
   if (!replaceAllMemRefUsesWith(oldMemRef, newMemRef,
-                                /*extraIndices=*/{ivModTwoOp},
+                                /*extraIndices=*/{ivModOp},
                                 /*indexRemap=*/AffineMap(),
                                 /*extraOperands=*/{},
                                 /*domInstFilter=*/&*forOp.getBody()->begin())) {
     LLVM_DEBUG(
-        forOp.emitError("memref replacement for double buffering failed"));
-    ivModTwoOp.erase();
+        forOp.emitError("memref replacement for multi-buffering failed"));
+    ivModOp.erase();
     return false;
   }
   // Insert the dealloc op right after the for loop.
@@ -173,6 +246,22 @@ static bool checkTagMatch(DmaStartOp startOp, DmaWaitOp waitOp) {
   return true;
 }
 
+/// Returns true if 'memref' has uses outside of 'forOp' other than dealloc's,
+/// i.e., if it is live out of the loop.
+static bool isLiveOutOfLoop(Value *memref, AffineForOp forOp) {
+  for (const auto &use : memref->getUses()) {
+    // We can multi-buffer regardless of dealloc's outside the loop.
+    if (use.getOwner()->isa<DeallocOp>())
+      continue;
+    if (!forOp.getBody()->findAncestorInstInBlock(*use.getOwner())) {
+      LLVM_DEBUG(llvm::dbgs()
+                     << "can't pipeline: buffer is live out of loop\n";);
+      return true;
+    }
+  }
+  return false;
+}
+
 // Identify matching DMA start/finish operations to overlap computation with.
 static void findMatchingStartFinishInsts(
     AffineForOp forOp,
@@ -213,21 +302,9 @@ static void findMatchingStartFinishInsts(
     if (it != outgoingDmaOps.end())
       continue;
 
-    // We only double buffer if the buffer is not live out of loop.
+    // We only multi-buffer if the buffer is not live out of loop.
     auto *memref = dmaStartOp.getOperand(dmaStartOp.getFasterMemPos());
-    bool escapingUses = false;
-    for (const auto &use : memref->getUses()) {
-      // We can double buffer regardless of dealloc's outside the loop.
-      if (use.getOwner()->isa<DeallocOp>())
-        continue;
-      if (!forOp.getBody()->findAncestorInstInBlock(*use.getOwner())) {
-        LLVM_DEBUG(llvm::dbgs()
-                       << "can't pipeline: buffer is live out of loop\n";);
-        escapingUses = true;
-        break;
-      }
-    }
-    if (!escapingUses)
+    if (!isLiveOutOfLoop(memref, forOp))
       dmaStartInsts.push_back(&op);
   }
 
@@ -243,6 +320,274 @@ static void findMatchingStartFinishInsts(
   }
 }
 
+/// Partitions the operations in the body of 'forOp' into compute stages and
+/// returns the number of stages. Each top-level loop nest of the body forms a
+/// stage with the operations preceding it, and operations following the last
+/// loop nest join the last stage. All operations are in a single stage if
+/// 'splitStages' is false.
+static unsigned getComputeStages(AffineForOp forOp, bool splitStages,
+                                 DenseMap<Operation *, unsigned> &stages) {
+  stages.clear();
+  unsigned numLoops = 0;
+  for (auto &op : *forOp.getBody()) {
+    stages[&op] = numLoops;
+    if (splitStages && op.isa<AffineForOp>())
+      ++numLoops;
+  }
+  unsigned numStages = std::max(numLoops, 1u);
+  for (auto &entry : stages)
+    entry.second = std::min(entry.second, numStages - 1);
+  return numStages;
+}
+
+/// Computes the range of compute stages accessing 'memref' in the body of
+/// 'forOp', ignoring the pipelined DMA starts in 'dmaStartInsts'.
+static void
+getAccessStageRange(Value *memref, AffineForOp forOp,
+                    const DenseMap<Operation *, unsigned> &stages,
+                    const SmallPtrSetImpl<Operation *> &dmaStartInsts,
+                    unsigned *minStage, unsigned *maxStage) {
+  *minStage = std::numeric_limits<unsigned>::max();
+  *maxStage = 0;
+  for (auto &use : memref->getUses()) {
+    auto *op = forOp.getBody()->findAncestorInstInBlock(*use.getOwner());
+    if (!op || dmaStartInsts.count(op))
+      continue;
+    *minStage = std::min(*minStage, stages.lookup(op));
+    *maxStage = std::max(*maxStage, stages.lookup(op));
+  }
+  if (*minStage > *maxStage)
+    *minStage = *maxStage = 0;
+}
+
+/// Returns true if 'storeOp', nested in the body of 'forOp', writes to all the
+/// elements read by 'loadOp' in each iteration of 'forOp'. This holds if the
+/// store is only nested in loops with constant trip counts, writes to a
+/// different element in each of its executions in an iteration, and the
+/// bounding box of these elements, whose size is their number, contains the
+/// region read by 'loadOp'.
+static bool writesRegionReadBy(Operation *storeOp, Operation *loadOp,
+                               AffineForOp forOp) {
+  // The number of executions of the store in an iteration of 'forOp'.
+  int64_t numWrites = 1;
+  for (auto *op = storeOp->getParentOp(); op != forOp.getOperation();
+       op = op->getParentOp()) {
+    auto innerForOp = op->dyn_cast<AffineForOp>();
+    if (!innerForOp)
+      return false;
+    auto tripCount = getConstantTripCount(innerForOp);
+    if (!tripCount.hasValue())
+      return false;
+    numWrites *= tripCount.getValue();
+  }
+
+  // The store writes to a different element in each execution if it has no
+  // output dependence on itself carried by the loops nested in 'forOp'.
+  unsigned loopDepth = getNestingDepth(*forOp.getOperation()) + 1;
+  MemRefAccess storeAccess(storeOp);
+  for (unsigned d = loopDepth + 1, e = getNestingDepth(*storeOp); d <= e; ++d) {
+    FlatAffineConstraints dependenceConstraints;
+    if (checkMemrefAccessDependence(storeAccess, storeAccess, d,
+                                    &dependenceConstraints,
+                                    /*dependenceComponents=*/nullptr))
+      return false;
+  }
+
+  // The regions are symbolic in the IV of 'forOp' and those of the loops
+  // surrounding it.
+  MemRefRegion writeRegion(storeOp->getLoc());
+  MemRefRegion readRegion(loadOp->getLoc());
+  if (failed(writeRegion.compute(storeOp, loopDepth)) ||
+      failed(readRegion.compute(loadOp, loopDepth)) ||
+      writeRegion.getConstraints()->getNumLocalIds() != 0 ||
+      readRegion.getConstraints()->getNumLocalIds() != 0)
+    return false;
+  auto writeSize = writeRegion.getConstantBoundingSizeAndShape();
+  if (!writeSize.hasValue() || writeSize.getValue() != numWrites ||
+      failed(writeRegion.unionBoundingBox(readRegion)))
+    return false;
+  auto unionSize = writeRegion.getConstantBoundingSizeAndShape();
+  return unionSize.hasValue() && unionSize.getValue() == numWrites;
+}
+
+/// Returns true if a load of 'memref' in the body of 'forOp' may read a value
+/// stored in an earlier iteration of 'forOp', i.e., if there is a dependence
+/// carried by 'forOp' from a store to the load, unless a store of an earlier
+/// compute stage writes to all the elements read by the load first.
+static bool
+mayReadValueOfEarlierIteration(Value *memref, AffineForOp forOp,
+                               const DenseMap<Operation *, unsigned> &stages) {
+  auto *forBody = forOp.getBody();
+  SmallVector<Operation *, 4> loadOps, storeOps;
+  for (auto &use : memref->getUses()) {
+    auto *owner = use.getOwner();
+    if (!forBody->findAncestorInstInBlock(*owner))
+      continue;
+    if (owner->isa<LoadOp>())
+      loadOps.push_back(owner);
+    else if (owner->isa<StoreOp>())
+      storeOps.push_back(owner);
+  }
+
+  auto getStage = [&](Operation *op) {
+    return stages.lookup(forBody->findAncestorInstInBlock(*op));
+  };
+  unsigned loopDepth = getNestingDepth(*forOp.getOperation()) + 1;
+  for (auto *loadOp : loadOps) {
+    MemRefAccess loadAccess(loadOp);
+    bool isCarried = llvm::any_of(storeOps, [&](Operation *storeOp) {
+      FlatAffineConstraints dependenceConstraints;
+      return checkMemrefAccessDependence(MemRefAccess(storeOp), loadAccess,
+                                         loopDepth, &dependenceConstraints,
+                                         /*dependenceComponents=*/nullptr);
+    });
+    if (!isCarried)
+      continue;
+    bool isOverwritten = llvm::any_of(storeOps, [&](Operation *storeOp) {
+      return getStage(storeOp) < getStage(loadOp) &&
+             writesRegionReadBy(storeOp, loadOp, forOp);
+    });
+    if (!isOverwritten)
+      return true;
+  }
+  return false;
+}
+
+/// Collects the memref's through which compute stages of the body of 'forOp'
+/// pass values to later stages. These need one buffer per iteration in flight
+/// between the stages, and all the values read from them must be written in
+/// the same iteration. Returns false if a memref written in one stage and
+/// accessed in another can't be multi-buffered, i.e., if the stages can't be
+/// shifted with respect to each other.
+static bool
+getInterStageBuffers(AffineForOp forOp,
+                     const DenseMap<Operation *, unsigned> &stages,
+                     const SmallPtrSetImpl<Operation *> &dmaStartInsts,
+                     const SmallPtrSetImpl<Value *> &dmaMemRefs,
+                     SmallVectorImpl<PipelinedBuffer> &buffers) {
+  auto *forBody = forOp.getBody();
+  llvm::SetVector<Value *> memrefs;
+  for (auto &op : *forBody) {
+    if (dmaStartInsts.count(&op))
+      continue;
+    op.walk([&](Operation *nestedOp) {
+      for (auto *operand : nestedOp->getOperands())
+        if (operand->getType().isa<MemRefType>() && !dmaMemRefs.count(operand))
+          memrefs.insert(operand);
+    });
+  }
+
+  for (auto *memref : memrefs) {
+    unsigned minStage, maxStage;
+    getAccessStageRange(memref, forOp, stages, dmaStartInsts, &minStage,
+                        &maxStage);
+    // Accesses within a single stage keep their relative order.
+    if (minStage == maxStage)
+      continue;
+
+    bool isWritten = false, isMultiBufferable = true;
+    for (auto &use : memref->getUses()) {
+      auto *owner = use.getOwner();
+      auto *op = forBody->findAncestorInstInBlock(*owner);
+      if (!op)
+        continue;
+      if (owner->isa<LoadOp>())
+        continue;
+      isWritten = true;
+      // Values may only flow from the first stage accessing the memref to
+      // later ones.
+      if (!owner->isa<StoreOp>() || stages.lookup(op) != minStage)
+        isMultiBufferable = false;
+    }
+    // Memref's that are only read can be accessed in any order.
+    if (!isWritten)
+      continue;
+
+    auto *allocInst = memref->getDefiningOp();
+    if (!isMultiBufferable || !allocInst || !allocInst->isa<AllocOp>() ||
+        !memref->getType().cast<MemRefType>().hasStaticShape() ||
+        isLiveOutOfLoop(memref, forOp) ||
+        mayReadValueOfEarlierIteration(memref, forOp, stages)) {
+      LLVM_DEBUG(llvm::dbgs() << "can't pipeline compute stages: memref "
+                                 "accessed across stages\n";);
+      return false;
+    }
+    buffers.push_back({memref, /*writtenByDmaStart=*/false, /*isTag=*/false,
+                       minStage, maxStage});
+  }
+  return true;
+}
+
+/// Returns the largest number of buffers up to 'maxBuffers' for which all the
+/// (non-tag) pipelined buffers fit in 'capacityBytes'. Returns zero if not even
+/// double buffering fits or if a buffer size isn't known statically.
+static unsigned getNumBuffersForCapacity(ArrayRef<PipelinedBuffer> buffers,
+                                         unsigned maxBuffers,
+                                         uint64_t capacityBytes) {
+  for (unsigned numBuffers = maxBuffers; numBuffers >= 2; --numBuffers) {
+    uint64_t sizeInBytes = 0;
+    for (const auto &buffer : buffers) {
+      if (buffer.isTag)
+        continue;
+      auto bufferSize =
+          getMemRefSizeInBytes(buffer.memref->getType().cast<MemRefType>());
+      if (!bufferSize.hasValue())
+        return 0;
+      sizeInBytes += bufferSize.getValue() * buffer.getDepth(numBuffers);
+    }
+    if (sizeInBytes <= capacityBytes)
+      return numBuffers;
+  }
+  return 0;
+}
+
+/// Rematerializes the affine.apply and constant operations of the body of
+/// 'forOp' in each later compute stage that uses them, so that no SSA value
+/// flows between stages, which get shifted differently. Uses by the pipelined
+/// DMA starts are left alone; those get their own computation slices.
+static void cloneIndexComputationsIntoStages(
+    AffineForOp forOp, DenseMap<Operation *, unsigned> &stages,
+    const SmallPtrSetImpl<Operation *> &dmaStarts) {
+  auto *forBody = forOp.getBody();
+  // The first operation of each stage; clones are inserted before it.
+  SmallVector<Operation *, 4> stageBegins;
+  SmallVector<Operation *, 16> ops;
+  for (auto &op : *forBody) {
+    if (stages[&op] == stageBegins.size())
+      stageBegins.push_back(&op);
+    ops.push_back(&op);
+  }
+
+  // Walk backwards so that the users of an operation are cloned before the
+  // operation itself is looked at.
+  for (auto *op : llvm::reverse(ops)) {
+    if (!op->isa<AffineApplyOp>() && !op->isa<ConstantOp>())
+      continue;
+    unsigned stage = stages[op];
+    DenseMap<unsigned, Operation *> stageClones;
+    for (auto &use : llvm::make_early_inc_range(op->getResult(0)->getUses())) {
+      auto *user = forBody->findAncestorInstInBlock(*use.getOwner());
+      if (!user || dmaStarts.count(user) || stages[user] == stage)
+        continue;
+      unsigned userStage = stages[user];
+      auto *&clone = stageClones[userStage];
+      if (!clone) {
+        FuncBuilder b(stageBegins[userStage]);
+        clone = b.clone(*op);
+        stages[clone] = userStage;
+        stageBegins[userStage] = clone;
+      }
+      use.set(clone->getResult(0));
+    }
+    if (!op->use_empty())
+      continue;
+    if (stageBegins[stage] == op)
+      stageBegins[stage] = op->getNextNode();
+    stages.erase(op);
+    op->erase();
+  }
+}
+
 /// Overlap DMA transfers with computation in this loop. If successful,
 /// 'forOp' is deleted, and a prologue, a new pipelined loop, and epilogue are
 /// inserted right before where it was.
@@ -261,36 +606,100 @@ void PipelineDataTransfer::runOnAffineForOp(AffineForOp forOp) {
     return;
   }
 
-  // Double the buffers for the higher memory space memref's.
+  SmallPtrSet<Operation *, 4> dmaStartInsts;
+  SmallPtrSet<Value *, 8> dmaMemRefs;
+  for (auto &pair : startWaitPairs) {
+    auto *dmaStartInst = pair.first;
+    dmaStartInsts.insert(dmaStartInst);
+    dmaMemRefs.insert(dmaStartInst->getOperand(
+        dmaStartInst->cast<DmaStartOp>().getFasterMemPos()));
+    dmaMemRefs.insert(pair.second->getOperand(getTagMemRefPos(*pair.second)));
+  }
+
+  // Split the computation into stages that are pipelined with respect to each
+  // other if requested, falling back to a single compute stage if values
+  // can't be buffered between them.
+  DenseMap<Operation *, unsigned> stages;
+  SmallVector<PipelinedBuffer, 4> interStageBuffers;
+  unsigned numStages =
+      getComputeStages(forOp, pipelineComputeStages, stages);
+  if (numStages > 1 && !getInterStageBuffers(forOp, stages, dmaStartInsts,
+                                             dmaMemRefs, interStageBuffers)) {
+    interStageBuffers.clear();
+    numStages = getComputeStages(forOp, /*splitStages=*/false, stages);
+  }
+
+  // Multiply the buffers for the higher memory space memref's.
   // Identify memref's to replace by scanning through all DMA start
   // operations. A DMA start operation has two memref's - the one from the
-  // higher level of memory hierarchy is the one to double buffer.
-  // TODO(bondhugula): check whether double-buffering is even necessary.
+  // higher level of memory hierarchy is the one to multi-buffer. The tag
+  // memref's and the memref's carrying values between compute stages are
+  // multi-buffered as well.
+  // TODO(bondhugula): check whether multi-buffering is even necessary.
   // TODO(bondhugula): make this work with different layouts: assuming here that
-  // the dimension we are adding here for the double buffering is the outermost
+  // the dimension we are adding here for the multi-buffering is the outermost
   // dimension.
+  SmallVector<PipelinedBuffer, 8> buffers;
   for (auto &pair : startWaitPairs) {
     auto *dmaStartInst = pair.first;
-    Value *oldMemRef = dmaStartInst->getOperand(
+    Value *memref = dmaStartInst->getOperand(
         dmaStartInst->cast<DmaStartOp>().getFasterMemPos());
-    if (!doubleBuffer(oldMemRef, forOp)) {
-      // Normally, double buffering should not fail because we already checked
+    buffers.push_back({memref, /*writtenByDmaStart=*/true, /*isTag=*/false,
+                       0, 0});
+  }
+  for (auto &pair : startWaitPairs) {
+    auto *dmaFinishInst = pair.second;
+    Value *tagMemRef =
+        dmaFinishInst->getOperand(getTagMemRefPos(*dmaFinishInst));
+    buffers.push_back({tagMemRef, /*writtenByDmaStart=*/true, /*isTag=*/true,
+                       0, 0});
+  }
+  for (auto &buffer : buffers)
+    getAccessStageRange(buffer.memref, forOp, stages, dmaStartInsts,
+                        &buffer.minStage, &buffer.maxStage);
+  buffers.append(interStageBuffers.begin(), interStageBuffers.end());
+
+  // DMA starts are shifted by 'depth - 1' iterations with respect to the first
+  // compute stage, and each later stage by one more. Shifts beyond the trip
+  // count don't overlap anything more, and op body skewing doesn't shift by
+  // more than the number of operations in the body.
+  uint64_t maxDepth =
+      std::min<uint64_t>(mayBeConstTripCount.getValue(),
+                         forOp.getBody()->getOperations().size() - numStages +
+                             1);
+  unsigned depth;
+  if (numBuffers == 0) {
+    depth = getNumBuffersForCapacity(
+        buffers, std::min<uint64_t>(maxBuffers, maxDepth),
+        fastMemCapacityBytes);
+    if (depth == 0) {
+      LLVM_DEBUG(forOp.emitNote("pipelined buffers don't fit in fast memory"));
+      return;
+    }
+  } else {
+    depth = std::max<uint64_t>(2, std::min<uint64_t>(numBuffers, maxDepth));
+  }
+
+  for (auto &buffer : buffers) {
+    Value *oldMemRef = buffer.memref;
+    if (!multiBuffer(oldMemRef, forOp, buffer.getDepth(depth))) {
+      // Normally, multi-buffering should not fail because we already checked
       // that there are no uses outside.
-      LLVM_DEBUG(llvm::dbgs() << "double buffering failed for: \n";);
-      LLVM_DEBUG(dmaStartInst->dump());
+      LLVM_DEBUG(llvm::dbgs() << "multi-buffering failed for: \n";);
+      LLVM_DEBUG(oldMemRef->dump());
       // IR still in a valid state.
       return;
     }
     // If the old memref has no more uses, remove its 'dead' alloc if it was
     // alloc'ed. (note: DMA buffers are rarely function live-in; but a 'dim'
     // operation could have been used on it if it was dynamically shaped in
-    // order to create the double buffer above.)
+    // order to create the multi-buffer above.)
     // '-canonicalize' does this in a more general way, but we'll anyway do the
     // simple/common case so that the output / test cases looks clear.
     if (auto *allocInst = oldMemRef->getDefiningOp()) {
       if (oldMemRef->use_empty()) {
         allocInst->erase();
-      } else if (oldMemRef->hasOneUse()) {
+      } else if (!buffer.isTag && oldMemRef->hasOneUse()) {
         auto *singleUse = oldMemRef->use_begin()->getOwner();
         if (singleUse->isa<DeallocOp>()) {
           singleUse->erase();
@@ -300,25 +709,18 @@ void PipelineDataTransfer::runOnAffineForOp(AffineForOp forOp) {
     }
   }
 
-  // Double the buffers for tag memrefs.
-  for (auto &pair : startWaitPairs) {
-    auto *dmaFinishInst = pair.second;
-    Value *oldTagMemRef =
-        dmaFinishInst->getOperand(getTagMemRefPos(*dmaFinishInst));
-    if (!doubleBuffer(oldTagMemRef, forOp)) {
-      LLVM_DEBUG(llvm::dbgs() << "tag double buffering failed\n";);
-      return;
-    }
-    // If the old tag has no more uses, remove its 'dead' alloc if it was
-    // alloc'ed.
-    if (oldTagMemRef->use_empty())
-      if (auto *allocInst = oldTagMemRef->getDefiningOp())
-        allocInst->erase();
-  }
-
-  // Double buffering would have invalidated all the old DMA start/wait insts.
+  // Multi-buffering would have invalidated all the old DMA start/wait insts.
   startWaitPairs.clear();
   findMatchingStartFinishInsts(forOp, startWaitPairs);
+  dmaStartInsts.clear();
+  for (auto &pair : startWaitPairs)
+    dmaStartInsts.insert(pair.first);
+
+  // The stages have to be recomputed for the new operations, which are all in
+  // place with respect to the loop nests delimiting the stages.
+  getComputeStages(forOp, numStages > 1, stages);
+  if (numStages > 1)
+    cloneIndexComputationsIntoStages(forOp, stages, dmaStartInsts);
 
   // Store shift for operation for later lookup for AffineApplyOp's.
   DenseMap<Operation *, unsigned> instShiftMap;
@@ -344,32 +746,40 @@ void PipelineDataTransfer::runOnAffineForOp(AffineForOp forOp) {
       }
     }
   }
-  // Everything else (including compute ops and dma finish) are shifted by one.
-  for (auto &op : *forOp.getBody()) {
-    if (instShiftMap.find(&op) == instShiftMap.end()) {
-      instShiftMap[&op] = 1;
-    }
-  }
 
-  // Get shifts stored in map.
+  // Everything else (including compute ops and dma finish) is shifted by
+  // 'depth - 1' plus the index of its compute stage. If the stages can't be
+  // shifted with respect to each other, all of them are shifted alike; the
+  // buffers allocated above are then deeper than needed but still correct.
   std::vector<uint64_t> shifts(forOp.getBody()->getOperations().size());
-  unsigned s = 0;
-  for (auto &op : *forOp.getBody()) {
-    assert(instShiftMap.find(&op) != instShiftMap.end());
-    shifts[s++] = instShiftMap[&op];
-
-    // Tagging operations with shifts for debugging purposes.
-    LLVM_DEBUG({
-      FuncBuilder b(&op);
-      op.setAttr("shift", b.getI64IntegerAttr(shifts[s - 1]));
-    });
+  for (bool splitStages : {numStages > 1, false}) {
+    unsigned s = 0;
+    for (auto &op : *forOp.getBody()) {
+      auto it = instShiftMap.find(&op);
+      if (it != instShiftMap.end())
+        shifts[s++] = it->second;
+      else
+        shifts[s++] = depth - 1 + (splitStages ? stages.lookup(&op) : 0);
+    }
+    if (isInstwiseShiftValid(forOp, shifts))
+      break;
+    if (!splitStages) {
+      // Violates dependences.
+      LLVM_DEBUG(llvm::dbgs() << "Shifts invalid - unexpected\n";);
+      return;
+    }
+    LLVM_DEBUG(llvm::dbgs() << "can't pipeline compute stages: values flow "
+                               "across stages\n";);
   }
 
-  if (!isInstwiseShiftValid(forOp, shifts)) {
-    // Violates dependences.
-    LLVM_DEBUG(llvm::dbgs() << "Shifts invalid - unexpected\n";);
-    return;
-  }
+  // Tagging operations with shifts for debugging purposes.
+  LLVM_DEBUG({
+    unsigned s = 0;
+    for (auto &op : *forOp.getBody()) {
+      FuncBuilder b(&op);
+      op.setAttr("shift", b.getI64IntegerAttr(shifts[s++]));
+    }
+  });
 
   if (failed(instBodySkew(forOp, shifts))) {
     LLVM_DEBUG(llvm::dbgs() << "op body skewing failed - unexpected\n";);
@@ -377,7 +787,31 @@ void PipelineDataTransfer::runOnAffineForOp(AffineForOp forOp) {
   }
 }
 
+/// Allocate a data transfer pipelining pass configured from the options of a
+/// textual pass pipeline, e.g. 'pipeline-data-transfer{num-buffers=3}'.
+static Pass *
+createRegisteredPipelineDataTransferPass(const PassOptions &options) {
+  auto *pass = new PipelineDataTransfer();
+  if (clNumBuffers.getNumOccurrences() > 0)
+    pass->numBuffers = clNumBuffers;
+  if (clMaxBuffers.getNumOccurrences() > 0)
+    pass->maxBuffers = clMaxBuffers;
+  if (clFastMemoryCapacity.getNumOccurrences() > 0)
+    pass->fastMemCapacityBytes = clFastMemoryCapacity * 1024;
+  if (clComputeStages.getNumOccurrences() > 0)
+    pass->pipelineComputeStages = clComputeStages;
+  options.getOption("num-buffers", pass->numBuffers);
+  options.getOption("max-buffers", pass->maxBuffers);
+  options.getOption("compute-stages", pass->pipelineComputeStages);
+  Optional<uint64_t> fastMemCapacityKiB;
+  options.getOption("fast-mem-capacity", fastMemCapacityKiB);
+  if (fastMemCapacityKiB)
+    pass->fastMemCapacityBytes = *fastMemCapacityKiB * 1024;
+  return pass;
+}
+
 static PassRegistration<PipelineDataTransfer> pass(
     "pipeline-data-transfer",
     "Pipeline non-blocking data transfers between explicitly managed levels of "
-    "the memory hierarchy");
+    "the memory hierarchy",
+    createRegisteredPipelineDataTransferPass);
@@ -0,0 +1,59 @@
+//===- TestCanonicalizeRoots.cpp - Test root-seeded canonicalization ------===//
+//
+// Copyright 2019 The MLIR Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =============================================================================
+//
+// This file implements a test pass that canonicalizes the operations with a
+// 'test.root' attribute, and the operations affected by their rewrites, using
+// the root-seeded greedy pattern rewrite driver.
+//
+//===----------------------------------------------------------------------===//
+
+#include "mlir/IR/Function.h"
+#include "mlir/IR/MLIRContext.h"
+#include "mlir/IR/PatternMatch.h"
+#include "mlir/Pass/Pass.h"
+#include "mlir/Transforms/Passes.h"
+
+using namespace mlir;
+
+namespace {
+struct TestCanonicalizeRoots : public FunctionPass<TestCanonicalizeRoots> {
+  void runOnFunction() override {
+    SmallVector<Operation *, 8> roots;
+    getFunction().walk([&](Operation *op) {
+      if (op->getAttr("test.root"))
+        roots.push_back(op);
+    });
+
+    OwningRewritePatternList patterns;
+    auto *context = &getContext();
+    for (auto *op : context->getRegisteredOperations())
+      op->getCanonicalizationPatterns(patterns, context);
+    applyPatternsGreedily(roots, std::move(patterns));
+  }
+};
+} // end anonymous namespace
+
+/// Creates a pass that canonicalizes from the operations with a 'test.root'
+/// attribute.
+FunctionPassBase *mlir::createTestCanonicalizeRootsPass() {
+  return new TestCanonicalizeRoots();
+}
+
+static PassRegistration<TestCanonicalizeRoots>
+    pass("test-canonicalize-roots",
+         "Canonicalize starting from the operations with a 'test.root' "
+         "attribute");
@@ -0,0 +1,50 @@
+//===- TestPassFailure.cpp - Test pass failure handling -------------------===//
+//
+// Copyright 2019 The MLIR Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =============================================================================
+//
+// This file implements a test pass that signals a failure on functions with a
+// 'test.fail' attribute. This is used to test the handling of pass failures
+// within the pass manager and related tooling, e.g. crash reproducers.
+//
+//===----------------------------------------------------------------------===//
+
+#include "mlir/IR/Function.h"
+#include "mlir/Pass/Pass.h"
+#include "mlir/Transforms/Passes.h"
+
+using namespace mlir;
+
+namespace {
+struct TestPassFailure : public FunctionPass<TestPassFailure> {
+  void runOnFunction() override {
+    auto &f = getFunction();
+    markAllAnalysesPreserved();
+    if (f.getAttr("test.fail")) {
+      f.emitError("test pass failure");
+      signalPassFailure();
+    }
+  }
+};
+} // end anonymous namespace
+
+/// Creates a pass that fails on functions with a 'test.fail' attribute.
+FunctionPassBase *mlir::createTestPassFailurePass() {
+  return new TestPassFailure();
+}
+
+static PassRegistration<TestPassFailure>
+    pass("test-pass-failure",
+         "Signal a pass failure on functions with a 'test.fail' attribute");
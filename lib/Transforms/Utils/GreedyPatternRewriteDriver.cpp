@@ -20,12 +20,14 @@
 //===----------------------------------------------------------------------===//
 
 #include "mlir/IR/Builders.h"
+#include "mlir/IR/Diagnostics.h"
 #include "mlir/IR/PatternMatch.h"
 #include "mlir/StandardOps/Ops.h"
 #include "mlir/Transforms/ConstantFoldUtils.h"
-#include "llvm/ADT/DenseMap.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/Parallel.h"
+#include "llvm/Support/Threading.h"
 #include "llvm/Support/raw_ostream.h"
 
 using namespace mlir;
@@ -55,12 +57,17 @@ public:
   /// `maxIterations`.
   bool simplifyFunction(unsigned maxIterations);
 
+  /// Perform the rewrites starting from the given root operations only.  The
+  /// function is never scanned as a whole, the rewrites only propagate to the
+  /// operations affected by previous rewrites.
+  void simplifyFrom(ArrayRef<Operation *> roots);
+
   void addToWorklist(Operation *op) {
     // Check to see if the worklist already contains this op.
-    if (worklistMap.count(op))
+    if (op->isInWorklist())
       return;
 
-    worklistMap[op] = worklist.size();
+    op->setInWorklist(worklist.size());
     worklist.push_back(op);
   }
 
@@ -68,20 +75,23 @@ public:
     auto *op = worklist.back();
     worklist.pop_back();
 
-    // This operation is no longer in the worklist, keep worklistMap up to date.
+    // This operation is no longer in the worklist, keep its mark up to date.
     if (op)
-      worklistMap.erase(op);
+      op->removeFromWorklist();
     return op;
   }
 
   /// If the specified operation is in the worklist, remove it.  If not, this is
   /// a no-op.
   void removeFromWorklist(Operation *op) {
-    auto it = worklistMap.find(op);
-    if (it != worklistMap.end()) {
-      assert(worklist[it->second] == op && "malformed worklist data structure");
-      worklist[it->second] = nullptr;
-    }
+    if (!op->isInWorklist())
+      return;
+
+    unsigned index = op->getWorklistIndex();
+    assert(index < worklist.size() && worklist[index] == op &&
+           "malformed worklist data structure");
+    worklist[index] = nullptr;
+    op->removeFromWorklist();
   }
 
   // These are hooks implemented for PatternRewriter.
@@ -94,11 +104,12 @@ protected:
     return result;
   }
 
-  // If an operation is about to be removed, make sure it is not in our
-  // worklist anymore because we'd get dangling references to it.
+  // If an operation is about to be removed, make sure neither it nor the
+  // operations nested in its regions are in our worklist anymore because we'd
+  // get dangling references to them.
   void notifyOperationRemoved(Operation *op) override {
     addToWorklist(op->getOperands());
-    removeFromWorklist(op);
+    op->walk([this](Operation *nested) { removeFromWorklist(nested); });
   }
 
   // When the root of a pattern is about to be replaced, it can trigger
@@ -136,119 +147,156 @@ private:
   /// This builder is used to create new operations.
   FuncBuilder builder;
 
+  /// Process the operations in the worklist until it is empty.  Return true if
+  /// any operation was changed.
+  bool processWorklist(ConstantFoldHelper &helper);
+
   /// The worklist for this transformation keeps track of the operations that
-  /// need to be revisited, plus their index in the worklist.  This allows us to
-  /// efficiently remove operations from the worklist when they are erased from
-  /// the function, even if they aren't the root of a pattern.
+  /// need to be revisited.  The operations in the worklist are marked as such
+  /// along with their index in the worklist, which allows us to check for
+  /// membership and to replace erased operations by null entries without a
+  /// side table.
   std::vector<Operation *> worklist;
-  DenseMap<Operation *, unsigned> worklistMap;
 };
 }; // end anonymous namespace
 
-/// Perform the rewrites.
-bool GreedyPatternRewriteDriver::simplifyFunction(unsigned maxIterations) {
-  Function *fn = builder.getFunction();
-  ConstantFoldHelper helper(fn);
-
-  bool changed = false;
-  int i = 0;
-  do {
-    // Add all operations to the worklist.
-    fn->walk([&](Operation *op) { addToWorklist(op); });
-
-    // These are scratch vectors used in the folding loop below.
-    SmallVector<Value *, 8> originalOperands, resultValues;
+/// Process the operations in the worklist until it is empty.
+bool GreedyPatternRewriteDriver::processWorklist(ConstantFoldHelper &helper) {
+  // Statistics are only collected if a collector is active on this thread.
+  auto *stats = PatternRewriteStatistics::getActive();
 
-    changed = false;
-    while (!worklist.empty()) {
-      auto *op = popFromWorklist();
+  // These are scratch vectors used in the folding loop below.
+  SmallVector<Value *, 8> originalOperands, resultValues;
 
-      // Nulls get added to the worklist when operations are removed, ignore
-      // them.
-      if (op == nullptr)
-        continue;
+  bool changed = false;
+  while (!worklist.empty()) {
+    auto *op = popFromWorklist();
+
+    // Nulls get added to the worklist when operations are removed, ignore
+    // them.
+    if (op == nullptr)
+      continue;
+
+    // If the operation has no side effects, and no users, then it is
+    // trivially dead - remove it.
+    if (op->hasNoSideEffect() && op->use_empty()) {
+      // Be careful to update bookkeeping in ConstantHelper to keep
+      // consistency if this is a constant op.
+      if (op->isa<ConstantOp>())
+        helper.notifyRemoval(op);
+      notifyOperationRemoved(op);
+      op->erase();
+      continue;
+    }
 
-      // If the operation has no side effects, and no users, then it is
-      // trivially dead - remove it.
-      if (op->hasNoSideEffect() && op->use_empty()) {
-        // Be careful to update bookkeeping in ConstantHelper to keep
-        // consistency if this is a constant op.
-        if (op->isa<ConstantOp>())
-          helper.notifyRemoval(op);
-        op->erase();
-        continue;
+    // Collects all the operands and result uses of the given `op` into work
+    // list.
+    auto collectOperandsAndUses = [this](Operation *op) {
+      // Add the operands to the worklist for visitation.
+      addToWorklist(op->getOperands());
+      // Add all the users of the result to the worklist so we make sure
+      // to revisit them.
+      //
+      // TODO: Add a result->getUsers() iterator.
+      for (unsigned i = 0, e = op->getNumResults(); i != e; ++i) {
+        for (auto &operand : op->getResult(i)->getUses())
+          addToWorklist(operand.getOwner());
       }
+    };
+
+    // Try to constant fold this op.
+    if (helper.tryToConstantFold(op, collectOperandsAndUses)) {
+      assert(op->hasNoSideEffect() && "Constant folded op with side effects?");
+      op->erase();
+      changed |= true;
+      if (stats)
+        stats->recordConstantFold();
+      continue;
+    }
 
-      // Collects all the operands and result uses of the given `op` into work
-      // list.
-      auto collectOperandsAndUses = [this](Operation *op) {
-        // Add the operands to the worklist for visitation.
-        addToWorklist(op->getOperands());
-        // Add all the users of the result to the worklist so we make sure
-        // to revisit them.
-        //
-        // TODO: Add a result->getUsers() iterator.
-        for (unsigned i = 0, e = op->getNumResults(); i != e; ++i) {
-          for (auto &operand : op->getResult(i)->getUses())
-            addToWorklist(operand.getOwner());
+    // Otherwise see if we can use the generic folder API to simplify the
+    // operation.
+    originalOperands.assign(op->operand_begin(), op->operand_end());
+    resultValues.clear();
+    if (succeeded(op->fold(resultValues))) {
+      // If the result was an in-place simplification (e.g. max(x,x,y) ->
+      // max(x,y)) then add the original operands to the worklist so we can
+      // make sure to revisit them.
+      if (resultValues.empty()) {
+        // Add the operands back to the worklist as there may be more
+        // canonicalization opportunities now.
+        addToWorklist(originalOperands);
+      } else {
+        // Otherwise, the operation is simplified away completely.
+        assert(resultValues.size() == op->getNumResults());
+
+        // Notify that we are replacing this operation.
+        notifyRootReplaced(op);
+
+        // Replace the result values and erase the operation.
+        for (unsigned i = 0, e = resultValues.size(); i != e; ++i) {
+          auto *res = op->getResult(i);
+          if (!res->use_empty())
+            res->replaceAllUsesWith(resultValues[i]);
         }
-      };
 
-      // Try to constant fold this op.
-      if (helper.tryToConstantFold(op, collectOperandsAndUses)) {
-        assert(op->hasNoSideEffect() &&
-               "Constant folded op with side effects?");
+        notifyOperationRemoved(op);
         op->erase();
-        changed |= true;
-        continue;
       }
+      changed |= true;
+      if (stats)
+        stats->recordFold();
+      continue;
+    }
 
-      // Otherwise see if we can use the generic folder API to simplify the
-      // operation.
-      originalOperands.assign(op->operand_begin(), op->operand_end());
-      resultValues.clear();
-      if (succeeded(op->fold(resultValues))) {
-        // If the result was an in-place simplification (e.g. max(x,x,y) ->
-        // max(x,y)) then add the original operands to the worklist so we can
-        // make sure to revisit them.
-        if (resultValues.empty()) {
-          // Add the operands back to the worklist as there may be more
-          // canonicalization opportunities now.
-          addToWorklist(originalOperands);
-        } else {
-          // Otherwise, the operation is simplified away completely.
-          assert(resultValues.size() == op->getNumResults());
-
-          // Notify that we are replacing this operation.
-          notifyRootReplaced(op);
+    // Make sure that any new operations are inserted at this point.
+    builder.setInsertionPoint(op);
 
-          // Replace the result values and erase the operation.
-          for (unsigned i = 0, e = resultValues.size(); i != e; ++i) {
-            auto *res = op->getResult(i);
-            if (!res->use_empty())
-              res->replaceAllUsesWith(resultValues[i]);
-          }
+    // Try to match one of the canonicalization patterns. The rewriter is
+    // automatically notified of any necessary changes, so there is nothing
+    // else to do here.
+    changed |= matcher.matchAndRewrite(op);
+  }
+  return changed;
+}
 
-          notifyOperationRemoved(op);
-          op->erase();
-        }
-        changed |= true;
-        continue;
-      }
+/// Perform the rewrites.
+bool GreedyPatternRewriteDriver::simplifyFunction(unsigned maxIterations) {
+  Function *fn = builder.getFunction();
+  ConstantFoldHelper helper(fn);
 
-      // Make sure that any new operations are inserted at this point.
-      builder.setInsertionPoint(op);
+  bool changed = false;
+  unsigned i = 0;
+  do {
+    // Add all operations to the worklist.
+    fn->walk([&](Operation *op) { addToWorklist(op); });
 
-      // Try to match one of the canonicalization patterns. The rewriter is
-      // automatically notified of any necessary changes, so there is nothing
-      // else to do here.
-      changed |= matcher.matchAndRewrite(op);
-    }
+    changed = processWorklist(helper);
   } while (changed && ++i < maxIterations);
+
+  // Record the number of iterations taken, i.e. the number of scans of the
+  // function.
+  if (auto *stats = PatternRewriteStatistics::getActive())
+    stats->recordDriverRun(changed ? i : i + 1, !changed);
+
   // Whether the rewrite converges, i.e. wasn't changed in the last iteration.
   return !changed;
 }
 
+/// Perform the rewrites starting from the given root operations.
+void GreedyPatternRewriteDriver::simplifyFrom(ArrayRef<Operation *> roots) {
+  ConstantFoldHelper helper(builder.getFunction());
+  for (auto *op : roots)
+    addToWorklist(op);
+
+  // The worklist only contains the roots and the operations affected by the
+  // rewrites, so a single drain of the worklist reaches a fixed point for
+  // them.
+  processWorklist(helper);
+  if (auto *stats = PatternRewriteStatistics::getActive())
+    stats->recordDriverRun(/*iterations=*/1, /*converged=*/true);
+}
+
 /// Rewrite the specified function by repeatedly applying the highest benefit
 /// patterns in a greedy work-list driven manner. Return true if no more
 /// patterns can be matched in the result function.
@@ -264,3 +312,197 @@ bool mlir::applyPatternsGreedily(Function &fn,
   });
   return converged;
 }
+
+/// Rewrite the given operations, and the operations affected by their rewrites,
+/// by repeatedly applying the highest benefit patterns in a greedy work-list
+/// driven manner.
+///
+void mlir::applyPatternsGreedily(ArrayRef<Operation *> ops,
+                                 OwningRewritePatternList &&patterns) {
+  if (ops.empty())
+    return;
+  Function *fn = ops.front()->getFunction();
+  assert(fn && "expected operations within a function");
+  assert(llvm::all_of(
+             ops, [fn](Operation *op) { return op->getFunction() == fn; }) &&
+         "expected all operations to be within the same function");
+  GreedyPatternRewriteDriver driver(*fn, std::move(patterns));
+  driver.simplifyFrom(ops);
+}
+
+//===----------------------------------------------------------------------===//
+// Parallel region rewriting
+//===----------------------------------------------------------------------===//
+
+namespace {
+/// An operation with regions at the top level of a function, e.g. a loop nest,
+/// that is rewritten in isolation.  The operation must not have results: the
+/// users of its results would be outside of the partition, and rewriting it
+/// could then modify use-lists shared with other partitions, or with the
+/// enclosing function.  Values defined within the regions of the operation are
+/// only used within those regions.  The operation is moved into a temporary
+/// function for the duration of the rewrite: the values it uses from the
+/// enclosing function are replaced by arguments of the temporary function, or
+/// by clones if they are constants, so that no use-list is shared with the
+/// operations rewritten on other threads.
+struct RegionPartition {
+  /// Move `root` into a temporary function.
+  explicit RegionPartition(Operation *root);
+
+  /// Move the operations of the temporary function, i.e. the root operation
+  /// and the constants hoisted out of it, back to the original position of the
+  /// root and restore the uses of the captured values.
+  void inlineBack();
+
+  /// The temporary function holding the root operation.
+  std::unique_ptr<Function> fn;
+
+  /// The block that contained the root operation, and the operation that
+  /// preceded it, or null if the root was at the start of the block.
+  Block *block;
+  Operation *prev;
+
+  /// The values of the enclosing function used by the root operation, indexed
+  /// by the number of the corresponding temporary function argument.
+  SmallVector<Value *, 4> capturedValues;
+};
+} // end anonymous namespace
+
+RegionPartition::RegionPartition(Operation *root)
+    : block(root->getBlock()), prev(root->getPrevNode()) {
+  auto *context = root->getContext();
+  fn = llvm::make_unique<Function>(root->getLoc(), "__region_partition",
+                                   FunctionType::get({}, {}, context));
+  fn->addEntryBlock();
+  Block *entry = &fn->front();
+  entry->getOperations().splice(entry->end(), block->getOperations(),
+                                Block::iterator(root));
+
+  // Terminate the entry block so that the temporary function is well formed,
+  // the terminator is removed again in 'inlineBack'.
+  FuncBuilder builder(entry, entry->end());
+  builder.create<ReturnOp>(root->getLoc());
+
+  // Remap the operands defined outside of the temporary function.  Constants
+  // are cloned so that they still fold within the partition, any other value
+  // becomes an argument, which is also a valid affine symbol.
+  builder.setInsertionPoint(root);
+  DenseMap<Value *, Value *> mapping;
+  root->walk([&](Operation *op) {
+    for (unsigned i = 0, e = op->getNumOperands(); i != e; ++i) {
+      auto *operand = op->getOperand(i);
+      if (operand->getFunction() == fn.get())
+        continue;
+      auto &mapped = mapping[operand];
+      if (!mapped) {
+        auto *def = operand->getDefiningOp();
+        if (def && def->isa<ConstantOp>()) {
+          mapped = builder.clone(*def)->getResult(0);
+        } else {
+          mapped = entry->addArgument(operand->getType());
+          capturedValues.push_back(operand);
+        }
+      }
+      op->setOperand(i, mapped);
+    }
+  });
+
+  // Update the signature of the temporary function to match the arguments
+  // that were added to its entry block.
+  SmallVector<Type, 4> argTypes;
+  for (auto *arg : entry->getArguments())
+    argTypes.push_back(arg->getType());
+  fn->setType(FunctionType::get(argTypes, {}, context));
+}
+
+void RegionPartition::inlineBack() {
+  Block *entry = &fn->front();
+  for (unsigned i = 0, e = capturedValues.size(); i != e; ++i)
+    entry->getArgument(i)->replaceAllUsesWith(capturedValues[i]);
+
+  assert(entry->back().isa<ReturnOp>() && "expected the temporary terminator");
+  entry->back().erase();
+  auto insertPt = prev ? std::next(Block::iterator(prev)) : block->begin();
+  block->getOperations().splice(insertPt, entry->getOperations());
+  fn.reset();
+}
+
+/// Collect the operations at the top level of `fn`, split by whether they
+/// have regions.
+static void collectTopLevelOps(Function &fn,
+                               SmallVectorImpl<Operation *> &withRegions,
+                               SmallVectorImpl<Operation *> &withoutRegions) {
+  for (auto &block : fn)
+    for (auto &op : block)
+      (op.getNumRegions() != 0 ? withRegions : withoutRegions).push_back(&op);
+}
+
+/// Returns true if the given operations can be rewritten as separate
+/// partitions, see RegionPartition.
+static bool canPartition(ArrayRef<Operation *> roots) {
+  return roots.size() >= 2 && llvm::all_of(roots, [](Operation *op) {
+           return op->getNumResults() == 0;
+         });
+}
+
+/// Rewrite the specified function, rewriting the operations with regions at
+/// the top level of the function concurrently.
+///
+void mlir::applyPatternsGreedilyInParallel(
+    Function &fn, llvm::function_ref<OwningRewritePatternList()> getPatterns) {
+  SmallVector<Operation *, 8> roots, others;
+  collectTopLevelOps(fn, roots, others);
+  if (!llvm::llvm_is_multithreaded() || !canPartition(roots)) {
+    applyPatternsGreedily(fn, getPatterns());
+    return;
+  }
+
+  // Rewrite the top-level operations first, so that the constants they fold
+  // to are propagated into the partitions.  This may also rewrite the users of
+  // these operations within the partitions, so the partitions are only
+  // collected afterwards.
+  applyPatternsGreedily(others, getPatterns());
+  roots.clear();
+  others.clear();
+  collectTopLevelOps(fn, roots, others);
+  if (!canPartition(roots)) {
+    applyPatternsGreedily(fn, getPatterns());
+    return;
+  }
+
+  // Move each partition into its own function.  The pattern lists are also
+  // created here, as 'getPatterns' is not required to be thread-safe.
+  std::vector<RegionPartition> partitions;
+  std::vector<OwningRewritePatternList> patternLists;
+  partitions.reserve(roots.size());
+  patternLists.reserve(roots.size());
+  for (auto *root : roots) {
+    partitions.emplace_back(root);
+    patternLists.push_back(getPatterns());
+  }
+
+  // Rewrite the partitions concurrently, emitting the diagnostics in the order
+  // of the partitions.
+  {
+    ParallelDiagnosticHandler diagHandler(*fn.getContext());
+    llvm::parallel::for_each_n(
+        llvm::parallel::par, size_t(0), partitions.size(), [&](size_t i) {
+          diagHandler.setOrderIDForThread(i);
+          applyPatternsGreedily(*partitions[i].fn, std::move(patternLists[i]));
+        });
+  }
+
+  // Move the partitions back in reverse order: adjacent partitions record the
+  // same preceding operation, so this restores their relative order.
+  for (auto &partition : llvm::reverse(partitions))
+    partition.inlineBack();
+
+  // Finally, rewrite the top-level operations again to fold across the
+  // partition boundaries and to unique the constants hoisted out of the
+  // partitions.
+  SmallVector<Operation *, 16> topLevelOps;
+  for (auto &block : fn)
+    for (auto &op : block)
+      topLevelOps.push_back(&op);
+  applyPatternsGreedily(topLevelOps, getPatterns());
+}
@@ -25,6 +25,7 @@
 #include "mlir/Analysis/AffineAnalysis.h"
 #include "mlir/Analysis/AffineStructures.h"
 #include "mlir/Analysis/LoopAnalysis.h"
+#include "mlir/Analysis/Utils.h"
 #include "mlir/IR/AffineExpr.h"
 #include "mlir/IR/AffineMap.h"
 #include "mlir/IR/BlockAndValueMapping.h"
@@ -643,3 +644,130 @@ SmallVector<AffineForOp, 8> mlir::tile(ArrayRef<AffineForOp> forOps,
                                        AffineForOp target) {
   return tile(forOps, sizes, ArrayRef<AffineForOp>{target})[0];
 }
+
+LogicalResult mlir::parallelizeReductions(AffineForOp forOp,
+                                          ArrayRef<LoopReduction> reductions,
+                                          unsigned numPartials,
+                                          AffineForOp *partialLoop) {
+  if (reductions.empty() || numPartials < 2)
+    return failure();
+  // Single result lower bound maps only, as for unrolling.
+  if (forOp.getLowerBoundMap().getNumResults() != 1)
+    return failure();
+  Optional<uint64_t> mayBeConstantTripCount = getConstantTripCount(forOp);
+  if (mayBeConstantTripCount.hasValue() &&
+      mayBeConstantTripCount.getValue() < numPartials)
+    return failure();
+  for (auto &reduction : reductions)
+    if (reduction.load->getBlock() != forOp.getBody() ||
+        reduction.store->getBlock() != forOp.getBody())
+      return failure();
+
+  Operation *op = forOp.getOperation();
+  auto loc = forOp.getLoc();
+  FuncBuilder b(op);
+
+  // Allocate the partial accumulators and initialize them with the identity.
+  SmallVector<Value *, 4> partials;
+  SmallVector<Value *, 4> identities;
+  for (auto &reduction : reductions) {
+    auto eltType = reduction.load->getResult(0)->getType();
+    auto memRefType = b.getMemRefType({numPartials}, eltType);
+    partials.push_back(b.create<AllocOp>(loc, memRefType));
+  }
+  for (auto &reduction : reductions)
+    identities.push_back(reduction.buildIdentity(&b));
+  auto initLoop = b.create<AffineForOp>(loc, 0, numPartials);
+  FuncBuilder initBuilder = initLoop.getBodyBuilder();
+  for (unsigned i = 0, e = reductions.size(); i < e; ++i)
+    initBuilder.create<StoreOp>(loc, identities[i], partials[i],
+                                initLoop.getInductionVar());
+
+  // Generate the cleanup loop if trip count isn't a multiple of numPartials.
+  // It updates the original accumulators directly.
+  AffineForOp cleanupForOp;
+  if (getLargestDivisorOfTripCount(forOp) % numPartials != 0) {
+    FuncBuilder cleanupBuilder(op->getBlock(), ++Block::iterator(op));
+    cleanupForOp = cleanupBuilder.clone(*op)->cast<AffineForOp>();
+    AffineMap cleanupMap;
+    SmallVector<Value *, 4> cleanupOperands;
+    getCleanupLoopLowerBound(forOp, numPartials, &cleanupMap, &cleanupOperands,
+                             &b);
+    assert(cleanupMap &&
+           "cleanup loop lower bound map for single result lower bound maps "
+           "can always be determined");
+    cleanupForOp.setLowerBound(cleanupOperands, cleanupMap);
+    forOp.setUpperBound(cleanupOperands, cleanupMap);
+  }
+
+  // Combine the partial results into the original accumulators before the
+  // cleanup loop, and free the partial accumulators.
+  FuncBuilder combineBuilder(op->getBlock(), ++Block::iterator(op));
+  auto combineLoop = combineBuilder.create<AffineForOp>(loc, 0, numPartials);
+  FuncBuilder combineBodyBuilder = combineLoop.getBodyBuilder();
+  for (unsigned i = 0, e = reductions.size(); i < e; ++i) {
+    auto &reduction = reductions[i];
+    auto load = reduction.load->cast<LoadOp>();
+    SmallVector<Value *, 4> indices(load.getIndices());
+    Value *accumulator = combineBodyBuilder.create<LoadOp>(
+        loc, reduction.getMemRef(), indices);
+    Value *partial = combineBodyBuilder.create<LoadOp>(
+        loc, partials[i], combineLoop.getInductionVar());
+    Value *result =
+        reduction.buildCombine(&combineBodyBuilder, accumulator, partial);
+    combineBodyBuilder.create<StoreOp>(loc, result, reduction.getMemRef(),
+                                       indices);
+  }
+  for (auto *partial : partials)
+    combineBuilder.create<DeallocOp>(loc, partial);
+
+  // Strip-mine 'forOp' and move its body into a loop over the partial
+  // accumulators.
+  int64_t step = forOp.getStep();
+  forOp.setStep(step * numPartials);
+  Block *body = forOp.getBody();
+  FuncBuilder bodyBuilder(body, body->begin());
+  auto innerForOp = bodyBuilder.create<AffineForOp>(loc, 0, numPartials);
+  auto &innerOps = innerForOp.getBody()->getOperations();
+  innerOps.splice(innerOps.begin(), body->getOperations(),
+                  std::next(Block::iterator(innerForOp.getOperation())),
+                  std::prev(body->end()));
+
+  // iv' = iv + partial * step.
+  auto *forOpIV = forOp.getInductionVar();
+  auto *partialIV = innerForOp.getInductionVar();
+  if (!forOpIV->use_empty()) {
+    FuncBuilder innerBuilder(innerForOp.getBody(),
+                             innerForOp.getBody()->begin());
+    auto d0 = innerBuilder.getAffineDimExpr(0);
+    auto d1 = innerBuilder.getAffineDimExpr(1);
+    auto ivMap = innerBuilder.getAffineMap(2, 0, {d0 + d1 * step}, {});
+    auto ivApply = innerBuilder.create<AffineApplyOp>(
+        loc, ivMap, ArrayRef<Value *>{forOpIV, partialIV});
+    forOpIV->replaceAllUsesWith(ivApply);
+    ivApply.getOperation()->setOperand(0, forOpIV);
+  }
+
+  // Accumulate into the partial accumulator of the inner iteration.
+  for (unsigned i = 0, e = reductions.size(); i < e; ++i) {
+    auto &reduction = reductions[i];
+    FuncBuilder builder(reduction.load);
+    Value *partialLoad =
+        builder.create<LoadOp>(reduction.load->getLoc(), partials[i],
+                               partialIV);
+    reduction.load->getResult(0)->replaceAllUsesWith(partialLoad);
+    reduction.load->erase();
+    builder.setInsertionPoint(reduction.store);
+    builder.create<StoreOp>(reduction.store->getLoc(),
+                            reduction.store->getOperand(0), partials[i],
+                            partialIV);
+    reduction.store->erase();
+  }
+
+  if (cleanupForOp)
+    promoteIfSingleIteration(cleanupForOp);
+  promoteIfSingleIteration(forOp);
+  if (partialLoop)
+    *partialLoop = innerForOp;
+  return success();
+}
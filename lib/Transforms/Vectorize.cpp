@@ -34,6 +34,7 @@
 #include "mlir/StandardOps/Ops.h"
 #include "mlir/Support/Functional.h"
 #include "mlir/Support/LLVM.h"
+#include "mlir/Transforms/LoopUtils.h"
 #include "mlir/Transforms/Passes.h"
 #include "mlir/VectorOps/VectorOps.h"
 
@@ -560,6 +561,20 @@ static llvm::cl::list<int> clFastestVaryingPattern(
         " description and examples. This is used for testing purposes"),
     llvm::cl::ZeroOrMore, llvm::cl::cat(clOptionsCategory));
 
+static llvm::cl::opt<bool> clVectorizeReductions(
+    "vectorize-reductions",
+    llvm::cl::desc("Privatize the reductions of innermost loops into as many "
+                   "partial accumulators as the 1-D vector size so that they "
+                   "can be vectorized"),
+    llvm::cl::init(false), llvm::cl::cat(clOptionsCategory));
+
+static llvm::cl::opt<bool> clVectorizeReductionsReassociateFP(
+    "vectorize-reductions-reassociate-fp",
+    llvm::cl::desc("Also privatize the floating point additions and "
+                   "multiplications of -vectorize-reductions, which changes "
+                   "their rounding"),
+    llvm::cl::init(false), llvm::cl::cat(clOptionsCategory));
+
 /// Forward declaration.
 static FilterFunctionType
 isVectorizableLoopPtrFactory(const llvm::DenseSet<Operation *> &parallelLoops,
@@ -612,6 +627,11 @@ struct Vectorize : public FunctionPass<Vectorize> {
   // This is voluntarily restrictive and is meant to precisely target a
   // particular loop/op pair, for testing purposes.
   SmallVector<int64_t, 4> fastestVaryingPattern;
+  // Whether reductions carried by innermost loops are privatized into partial
+  // accumulators before vectorization.
+  bool vectorizeReductions;
+  // Whether floating point reductions are reassociated to be privatized.
+  bool reassociateFPReductions;
 };
 
 } // end anonymous namespace
@@ -619,7 +639,9 @@ struct Vectorize : public FunctionPass<Vectorize> {
 Vectorize::Vectorize()
     : vectorSizes(clVirtualVectorSize.begin(), clVirtualVectorSize.end()),
       fastestVaryingPattern(clFastestVaryingPattern.begin(),
-                            clFastestVaryingPattern.end()) {}
+                            clFastestVaryingPattern.end()),
+      vectorizeReductions(clVectorizeReductions),
+      reassociateFPReductions(clVectorizeReductionsReassociateFP) {}
 
 Vectorize::Vectorize(ArrayRef<int64_t> virtualVectorSize) : Vectorize() {
   if (!virtualVectorSize.empty()) {
@@ -1220,6 +1242,25 @@ void Vectorize::runOnFunction() {
   // Thread-safe RAII local context, BumpPtrAllocator freed on exit.
   NestedPatternContext mlContext;
 
+  // Privatize the reductions of innermost loops into one partial accumulator
+  // per vector lane: the loop over the partial accumulators is then parallel
+  // and the partial results are combined after the loop.
+  if (vectorizeReductions && vectorSizes.size() == 1) {
+    SmallVector<AffineForOp, 8> innermostLoops;
+    f.walk<AffineForOp>([&innermostLoops](AffineForOp loop) {
+      if (isInnermostLoop(loop))
+        innermostLoops.push_back(loop);
+    });
+    for (auto loop : innermostLoops) {
+      SmallVector<LoopReduction, 2> reductions;
+      if (!isLoopParallel(loop) &&
+          isLoopParallel(loop, /*dependences=*/nullptr, &reductions,
+                         reassociateFPReductions) &&
+          !reductions.empty())
+        (void)parallelizeReductions(loop, reductions, vectorSizes.front());
+    }
+  }
+
   llvm::DenseSet<Operation *> parallelLoops;
   f.walk<AffineForOp>([&parallelLoops](AffineForOp loop) {
     if (isLoopParallel(loop))
@@ -1262,6 +1303,21 @@ mlir::createVectorizePass(llvm::ArrayRef<int64_t> virtualVectorSize) {
   return new Vectorize(virtualVectorSize);
 }
 
+/// Allocate a vectorization pass configured from the options of a textual pass
+/// pipeline, e.g. 'vectorize{virtual-vector-size=32,256}'.
+static Pass *createRegisteredVectorizePass(const PassOptions &options) {
+  SmallVector<int64_t, 4> virtualVectorSize;
+  SmallVector<int64_t, 4> fastestVaryingPattern;
+  options.getListOption("virtual-vector-size", virtualVectorSize);
+  options.getListOption("test-fastest-varying", fastestVaryingPattern);
+  auto *pass = new Vectorize(virtualVectorSize, fastestVaryingPattern);
+  options.getOption("vectorize-reductions", pass->vectorizeReductions);
+  options.getOption("vectorize-reductions-reassociate-fp",
+                    pass->reassociateFPReductions);
+  return pass;
+}
+
 static PassRegistration<Vectorize>
     pass("vectorize",
-         "Vectorize to a target independent n-D vector abstraction");
+         "Vectorize to a target independent n-D vector abstraction",
+         createRegisteredVectorizePass);
@@ -0,0 +1,21 @@
+// RUN: %generate_benchmark cse --num-ops=1000 | mlir-opt -cse -pass-timing -pass-timing-display=list -o /dev/null 2>&1 | FileCheck %s
+// RUN: %generate_benchmark cse --num-ops=1000 | mlir-opt -cse | FileCheck %s --check-prefix=CSE
+
+// Times CSE on straight-line code in which about half of the operations
+// recompute a known value. This runs a small instance; generate 10^5 to 10^6
+// operations with --num-ops to measure the pass.
+
+// CHECK: Pass execution timing report
+// CHECK: Name
+// CHECK-DAG: CSE
+// CHECK-DAG: DominanceInfo
+// CHECK: Total
+
+// The redundant operations are erased and their uses replaced, which makes
+// operations on the replaced values redundant in turn.
+// CSE-LABEL: func @cse
+// CSE-NEXT:    %0 = addi %arg1, %arg0 : i32
+// CSE-NEXT:    %1 = subi %0, %0 : i32
+// CSE-NEXT:    %2 = xor %arg1, %0 : i32
+// CSE-NOT:     addi %arg1, %arg0
+// CSE:         return
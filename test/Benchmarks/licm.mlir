@@ -0,0 +1,23 @@
+// RUN: rm -f %t.db
+// RUN: %generate_benchmark licm --size=64 | mlir-tune -warmup=0 -repeats=1 -opt-level=0 -pipeline= -pipeline='func(loop-invariant-code-motion)' -results-db=%t.db -o /dev/null
+// RUN: FileCheck %s < %t.db
+// RUN: %generate_benchmark licm --size=16 --num-invariants=2 | mlir-opt -loop-invariant-code-motion | FileCheck %s --check-prefix=HOIST
+
+// Times a loop nest with loop invariant loads and index computations with the
+// JIT, without and with LICM. LLVM's optimizations are disabled so that its own
+// LICM doesn't hoist them in both cases. This runs a small instance; the
+// default --size of the generator measures the work saved by hoisting.
+
+// CHECK:      "pipeline":"",{{.*}}"status":"ok"}
+// CHECK-NEXT: "pipeline":"func(loop-invariant-code-motion)",{{.*}}"status":"ok"}
+
+// The loads and their subscripts are hoisted out of the inner loop.
+// HOIST-LABEL: func @main
+// HOIST:       affine.for %i0 = 0 to 16 {
+// HOIST-NEXT:    affine.apply
+// HOIST-NEXT:    load %arg0[
+// HOIST-NEXT:    affine.apply
+// HOIST-NEXT:    load %arg0[
+// HOIST-NEXT:    affine.for %i1 = 0 to 16 {
+// HOIST-NOT:       affine.apply
+// HOIST:           store
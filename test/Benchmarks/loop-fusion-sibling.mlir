@@ -0,0 +1,13 @@
+// RUN: rm -f %t.db
+// RUN: %generate_benchmark siblings --num-nests=4 --size=4096 | mlir-tune -warmup=0 -repeats=1 -pipeline= -pipeline='func(loop-fusion{mode=sibling})' -pipeline='func(loop-fusion{mode=sibling sibling-min-savings=0.5})' -results-db=%t.db -o /dev/null
+// RUN: FileCheck %s < %t.db
+
+// Times sibling loop nests streaming the same buffer with the JIT unfused,
+// fused, and with a savings threshold that none of the pairs of nests meets.
+// This runs a small instance; the default --size of the generator, 64 MiB per
+// buffer, exceeds the caches so that the timings measure the memory bandwidth
+// saved by fusion.
+
+// CHECK:      "pipeline":"",{{.*}}"status":"ok"}
+// CHECK-NEXT: "pipeline":"func(loop-fusion{mode=sibling})",{{.*}}"status":"ok"}
+// CHECK-NEXT: "pipeline":"func(loop-fusion{mode=sibling sibling-min-savings=0.5})",{{.*}}"status":"ok"}
@@ -0,0 +1,18 @@
+// RUN: %generate_benchmark fusion --num-nests=100 --size=64 | mlir-opt -loop-fusion -pass-timing -pass-timing-display=list -o /dev/null 2>&1 | FileCheck %s
+// RUN: %generate_benchmark fusion --num-nests=100 --size=64 --fan-in=1 | mlir-opt -loop-fusion | FileCheck %s --check-prefix=CHAIN
+
+// Times loop fusion on a pipeline of producer/consumer loop nests, each of
+// which also consumes the buffer of a nest before its producer. This runs a
+// small instance; generate 1000 nests or more with --num-nests to measure the
+// construction and the updates of the dependence graph.
+
+// CHECK: Pass execution timing report
+// CHECK: Name
+// CHECK: LoopFusion
+// CHECK: Total
+
+// A chain of nests is fused into a single loop nest.
+// CHAIN-LABEL: func @fusion
+// CHAIN:       affine.for
+// CHAIN-NOT:   affine.for
+// CHAIN:       return
@@ -0,0 +1,12 @@
+// RUN: rm -f %t.db
+// RUN: %generate_benchmark matmul --size=64 | mlir-tune -warmup=0 -repeats=1 -pipeline= -pipeline='func(loop-tile{cache-size=32})' -pipeline='func(loop-tile{cache-sizes=32,1024})' -results-db=%t.db -o /dev/null
+// RUN: FileCheck %s < %t.db
+
+// Times a matrix multiplication with the JIT untiled, with the tile sizes
+// derived from its memory footprint, and with those selected from the reuse
+// along each loop. This runs a small instance; generate matrices of 1024 rows
+// or more with --size, and use more -repeats, to compare the tile sizes.
+
+// CHECK:      "pipeline":"",{{.*}}"status":"ok"}
+// CHECK-NEXT: "pipeline":"func(loop-tile{cache-size=32})",{{.*}}"status":"ok"}
+// CHECK-NEXT: "pipeline":"func(loop-tile{cache-sizes=32,1024})",{{.*}}"status":"ok"}
@@ -0,0 +1,20 @@
+// RUN: %generate_benchmark dma --num-loops=50 | mlir-opt -pass-pipeline='func(pipeline-data-transfer{compute-stages=true})' -pass-timing -pass-timing-display=list -o /dev/null 2>&1 | FileCheck %s
+// RUN: %generate_benchmark dma --num-loops=1 | mlir-opt -pass-pipeline='func(pipeline-data-transfer{compute-stages=true})' | FileCheck %s --check-prefix=STAGES
+
+// Times the pipelining of loops computing on tiles copied with DMAs, with the
+// loop nests of their bodies as compute stages. This runs a small instance;
+// generate more loops with --num-loops to measure the dependence checks on the
+// memrefs passed between the stages.
+
+// CHECK: Pass execution timing report
+// CHECK: Name
+// CHECK: PipelineDataTransfer
+// CHECK: Total
+
+// Both the DMA buffer and the buffer passed between the stages are
+// double-buffered.
+// STAGES-LABEL: func @dma
+// STAGES:       alloc() : memref<2x32xf32, 1>
+// STAGES-NEXT:  alloc() : memref<2x1xi32>
+// STAGES-NEXT:  alloc() : memref<2x32xf32, 1>
+// STAGES:       affine.for %i{{[0-9]+}} = 64 to 4096 step 32 {
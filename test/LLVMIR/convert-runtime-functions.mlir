@@ -0,0 +1,31 @@
+// RUN: mlir-opt -convert-to-llvmir %s | FileCheck %s
+
+// Functions are converted concurrently.  The declarations of the runtime
+// functions inserted by the conversion are appended to the module, sorted by
+// name, regardless of the order in which the functions were converted.
+
+// CHECK-LABEL: func @first_dealloc(%arg0: !llvm<"float*">) {
+func @first_dealloc(%arg0: memref<f32>) {
+// CHECK:  llvm.call @free(%{{.*}}) : (!llvm<"i8*">) -> ()
+  dealloc %arg0 : memref<f32>
+  return
+}
+
+// CHECK-LABEL: func @then_alloc() -> !llvm<"float*"> {
+func @then_alloc() -> memref<f32> {
+// CHECK:  llvm.call @malloc(%{{.*}}) : (!llvm.i64) -> !llvm<"i8*">
+  %0 = alloc() : memref<f32>
+  return %0 : memref<f32>
+}
+
+// CHECK-LABEL: func @both(%arg0: !llvm<"float*">) {
+func @both(%arg0: memref<f32>) {
+// CHECK:  llvm.call @malloc(%{{.*}}) : (!llvm.i64) -> !llvm<"i8*">
+// CHECK:  llvm.call @free(%{{.*}}) : (!llvm<"i8*">) -> ()
+  %0 = alloc() : memref<f32>
+  dealloc %0 : memref<f32>
+  return
+}
+
+// CHECK: func @free(!llvm<"i8*">)
+// CHECK: func @malloc(!llvm.i64) -> !llvm<"i8*">
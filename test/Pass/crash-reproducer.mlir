@@ -0,0 +1,46 @@
+// RUN: not mlir-opt %s -cse -test-pass-failure -canonicalize -pass-pipeline-crash-reproducer=%t 2>&1 | FileCheck -check-prefix=ERROR %s
+// RUN: cat %t | FileCheck -check-prefix=REPRO %s
+// RUN: mlir-reduce %t -o - 2>/dev/null | FileCheck -check-prefix=REDUCE %s
+// RUN: not mlir-opt %s -pass-pipeline='func(loop-unroll{unroll-factor=2},cse),func(test-pass-failure)' -pass-pipeline-crash-reproducer=%t.nested 2>/dev/null
+// RUN: cat %t.nested | FileCheck -check-prefix=NESTED %s
+// RUN: mlir-reduce %t.nested -o - 2>/dev/null | FileCheck -check-prefix=REDUCE-NESTED %s
+// RUN: not mlir-opt %s -pass-pipeline='func(loop-tile{tile-sizes="4, 4"}),func(test-pass-failure)' -pass-pipeline-crash-reproducer=%t.quoted 2>/dev/null
+// RUN: cat %t.quoted | FileCheck -check-prefix=QUOTED %s
+// RUN: mlir-reduce %t.quoted -o - 2>/dev/null | FileCheck -check-prefix=REDUCE-QUOTED %s
+
+func @foo() {
+  %0 = constant 1 : i32
+  %1 = constant 1 : i32
+  return
+}
+
+func @bar() attributes {test.fail: true} {
+  %0 = constant 1 : i32
+  return
+}
+
+// ERROR: A failure has been detected while processing the MLIR module, a reproducer has been generated in
+
+// The reproducer contains the original input, before CSE was run.
+// REPRO: // configuration: -pass-pipeline='func(cse,test-pass-failure,canonicalize)'
+// REPRO-NEXT: // note: pass settings provided through command line flags rather than pass options are not part of the configuration
+// REPRO: func @foo()
+// REPRO-NEXT: %c1_i32 = constant 1 : i32
+// REPRO-NEXT: %c1_i32_0 = constant 1 : i32
+// REPRO: func @bar()
+
+// REDUCE: // configuration: -pass-pipeline='func(test-pass-failure)'
+// REDUCE-NOT: func @foo()
+// REDUCE: func @bar()
+// REDUCE-NOT: constant
+// REDUCE: return
+
+// The reproducer keeps the nesting and the options of the pipeline.
+// NESTED: // configuration: -pass-pipeline='func(loop-unroll{unroll-factor=2},cse),func(test-pass-failure)'
+
+// REDUCE-NESTED: // configuration: -pass-pipeline='func(test-pass-failure)'
+
+// Option values containing spaces are quoted so that the pipeline parses back.
+// QUOTED: // configuration: -pass-pipeline='func(loop-tile{tile-sizes="4, 4"}),func(test-pass-failure)'
+
+// REDUCE-QUOTED: // configuration: -pass-pipeline='func(test-pass-failure)'
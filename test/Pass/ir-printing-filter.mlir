@@ -0,0 +1,60 @@
+// RUN: mlir-opt %s -cse -canonicalize -print-ir-after-all -print-ir-function-filter=ba -o /dev/null 2>&1 | FileCheck -check-prefix=FILTER %s
+// RUN: mlir-opt %s -cse -canonicalize -print-ir-before=cse -print-ir-module-scope -print-ir-function-filter="^foo$" -o /dev/null 2>&1 | FileCheck -check-prefix=FILTER_MODULE %s
+// RUN: mlir-opt %s -cse -canonicalize -print-ir-after-all -print-ir-after-change -o /dev/null 2>&1 | FileCheck -check-prefix=CHANGE %s
+// RUN: rm -rf %t && mlir-opt %s -cse -canonicalize -print-ir-after=cse -print-ir-output-dir=%t -o /dev/null 2>&1 | FileCheck -allow-empty -check-prefix=DIR_STDERR %s
+// RUN: FileCheck -check-prefix=DIR %s < %t/CSE.mlir
+// RUN: not mlir-opt %s -cse -print-ir-after-all -print-ir-function-filter='(' -o /dev/null 2>&1 | FileCheck -check-prefix=BAD_FILTER %s
+// RUN: rm -rf %t.file && touch %t.file && not mlir-opt %s -cse -print-ir-after-all -print-ir-output-dir=%t.file/dir -o /dev/null 2>&1 | FileCheck -check-prefix=BAD_DIR %s
+
+func @foo() {
+  return
+}
+
+func @bar() {
+  return
+}
+
+func @baz() -> (i32, i32) {
+  %0 = constant 1 : i32
+  %1 = constant 1 : i32
+  return %0, %1 : i32, i32
+}
+
+// FILTER-NOT: func @foo()
+// FILTER: *** IR Dump After{{.*}}CSE ***
+// FILTER-NEXT: func @bar()
+// FILTER: *** IR Dump After{{.*}}Canonicalizer ***
+// FILTER-NEXT: func @bar()
+// FILTER: *** IR Dump After{{.*}}CSE ***
+// FILTER-NEXT: func @baz()
+// FILTER: *** IR Dump After{{.*}}Canonicalizer ***
+// FILTER-NEXT: func @baz()
+// FILTER-NOT: func @foo()
+
+// FILTER_MODULE: *** IR Dump Before{{.*}}CSE *** (function: foo)
+// FILTER_MODULE-NEXT: func @foo()
+// FILTER_MODULE-NOT: func @bar()
+// FILTER_MODULE-NOT: func @baz()
+// FILTER_MODULE-NOT: *** IR Dump
+
+// CHANGE-NOT: func @foo()
+// CHANGE-NOT: func @bar()
+// CHANGE: *** IR Dump After{{.*}}CSE ***
+// CHANGE-NEXT: func @baz()
+// CHANGE-NOT: func @foo()
+// CHANGE-NOT: func @bar()
+
+// DIR_STDERR-NOT: *** IR Dump
+
+// DIR: *** IR Dump After{{.*}}CSE ***
+// DIR-NEXT: func @foo()
+// DIR: *** IR Dump After{{.*}}CSE ***
+// DIR-NEXT: func @bar()
+// DIR: *** IR Dump After{{.*}}CSE ***
+// DIR-NEXT: func @baz()
+
+// BAD_FILTER: error: invalid IR printing function filter '('
+// BAD_FILTER-NOT: *** IR Dump
+
+// BAD_DIR: error: could not create IR dump directory
+// BAD_DIR-NOT: *** IR Dump
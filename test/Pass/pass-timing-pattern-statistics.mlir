@@ -0,0 +1,28 @@
+// RUN: mlir-opt %s -canonicalize -pass-timing -pass-timing-pattern-statistics 2>&1 | FileCheck %s
+// RUN: mlir-opt %s -canonicalize -pass-timing 2>&1 | FileCheck -check-prefix=NO_STATS %s
+// RUN: mlir-opt %s -experimental-mt-pm=true -canonicalize -pass-timing -pass-timing-pattern-statistics 2>&1 | FileCheck %s
+
+// CHECK: Pass execution timing report
+// CHECK: Total
+// CHECK: Pattern rewrite statistics
+// CHECK: Canonicalizer
+// CHECK-NEXT: Driver runs: 2, iterations: {{[0-9]+}} (max: {{[0-9]+}}, not converged: 0)
+// CHECK-NEXT: Folded operations: {{[0-9]+}}, constant folded operations: {{[1-9][0-9]*}}
+// CHECK-NEXT: ---Wall Time---  ---Attempts---  ---Successes---  --- Pattern ---
+// CHECK-DAG: 1 std.dealloc #1
+// CHECK-DAG: 1 std.alloc #1
+
+// NO_STATS-NOT: Pattern rewrite statistics
+
+func @simplify() -> i32 {
+  %0 = alloc() : memref<4xf32>
+  dealloc %0 : memref<4xf32>
+  %c1 = constant 1 : i32
+  %c2 = constant 2 : i32
+  %1 = addi %c1, %c2 : i32
+  return %1 : i32
+}
+
+func @nothing_to_simplify() {
+  return
+}
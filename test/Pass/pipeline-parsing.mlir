@@ -0,0 +1,52 @@
+// RUN: mlir-opt %s -pass-pipeline='module(func(cse,canonicalize),func(cse))' -verify-each=false -pass-timing -pass-timing-display=pipeline 2>&1 | FileCheck -check-prefix=NESTED %s
+// RUN: mlir-opt %s -pass-pipeline='func(loop-unroll{unroll-factor=2})' | FileCheck -check-prefix=OPTIONS %s
+// RUN: mlir-opt %s -pass-pipeline='func(loop-unroll{unroll-factor="2"})' | FileCheck -check-prefix=OPTIONS %s
+// RUN: not mlir-opt %s -pass-pipeline='func(loop-unroll{unroll-factor="2})' 2>&1 | FileCheck -check-prefix=UNTERMINATED_VALUE %s
+// RUN: not mlir-opt %s -pass-pipeline='module(cse' 2>&1 | FileCheck -check-prefix=UNTERMINATED %s
+// RUN: not mlir-opt %s -pass-pipeline='func(module(cse))' 2>&1 | FileCheck -check-prefix=NESTED_MODULE %s
+// RUN: not mlir-opt %s -pass-pipeline='unknown-pass' 2>&1 | FileCheck -check-prefix=UNKNOWN_PASS %s
+// RUN: not mlir-opt %s -pass-pipeline='func(loop-unroll{bad-option=1})' 2>&1 | FileCheck -check-prefix=UNKNOWN_OPTION %s
+// RUN: not mlir-opt %s -pass-pipeline='func(loop-unroll{unroll-factor=abc})' 2>&1 | FileCheck -check-prefix=INVALID_VALUE %s
+// RUN: not mlir-opt %s -pass-pipeline='cse' -canonicalize 2>&1 | FileCheck -check-prefix=COMBINED %s
+
+// Each 'func' scope forms a distinct function pipeline.
+// NESTED: Pass execution timing report
+// NESTED: Name
+// NESTED-NEXT: Function Pipeline
+// NESTED-NEXT:   CSE
+// NESTED-NEXT:     (A) DominanceInfo
+// NESTED-NEXT:   Canonicalizer
+// NESTED-NEXT: Function Pipeline
+// NESTED-NEXT:   CSE
+// NESTED-NEXT:     (A) DominanceInfo
+// NESTED-NEXT: Total
+
+// UNTERMINATED: error: expected ',' or ')' to end 'module' scope
+// UNTERMINATED-NEXT: module(cse
+// UNTERMINATED-NEXT: ^
+
+// NESTED_MODULE: error: 'module' scope cannot be nested within a 'func' scope
+// NESTED_MODULE-NEXT: func(module(cse))
+// NESTED_MODULE-NEXT: ^
+
+// UNKNOWN_PASS: error: 'unknown-pass' does not refer to a registered pass or pass pipeline
+
+// UNTERMINATED_VALUE: error: expected '}' to end pass options
+
+// UNKNOWN_OPTION: error: pass 'loop-unroll' does not support option 'bad-option'
+
+// INVALID_VALUE: error: invalid value 'abc' for option 'unroll-factor' of pass 'loop-unroll'
+
+// COMBINED: '-pass-pipeline' cannot be combined with individual pass options
+
+// OPTIONS-LABEL: func @unroll_by_option
+func @unroll_by_option() {
+  // OPTIONS: affine.for %{{.*}} = 0 to 4 step 2 {
+  // OPTIONS-NEXT: "foo"()
+  // OPTIONS-NEXT: "foo"()
+  // OPTIONS-NEXT: }
+  affine.for %i = 0 to 4 {
+    "foo"() : () -> ()
+  }
+  return
+}
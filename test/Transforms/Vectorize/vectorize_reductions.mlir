@@ -0,0 +1,68 @@
+// RUN: mlir-opt %s -vectorize -virtual-vector-size 4 -vectorize-reductions -vectorize-reductions-reassociate-fp | FileCheck %s
+// RUN: mlir-opt %s -vectorize -virtual-vector-size 4 -vectorize-reductions | FileCheck %s --check-prefix=NOFP
+
+// CHECK-LABEL: func @vec_sum
+// NOFP-LABEL: func @vec_sum
+func @vec_sum(%A : memref<1024xf32>, %sum : memref<f32>) {
+  // Without -vectorize-reductions-reassociate-fp, the floating point sum is
+  // left unchanged.
+  // NOFP-NOT:   alloc
+  // NOFP:       affine.for %{{.*}} = 0 to 1024 {
+  // NOFP-NEXT:    %{{.*}} = load %arg0[%{{.*}}] : memref<1024xf32>
+  // NOFP-NEXT:    %{{.*}} = load %arg1[] : memref<f32>
+  // NOFP-NEXT:    %{{.*}} = addf %{{.*}}, %{{.*}} : f32
+  // NOFP-NEXT:    store %{{.*}}, %arg1[] : memref<f32>
+  // NOFP-NEXT:  }
+  // The accumulator is privatized into one partial sum per vector lane.
+  // CHECK:      %[[PARTIALS:[0-9]+]] = alloc() : memref<4xf32>
+  // CHECK:      affine.for %{{.*}} = 0 to 1024 step 4 {
+  // CHECK-NEXT:   affine.for %{{.*}} = 0 to 4 step 4 {
+  // CHECK:          vector.transfer_read %arg0
+  // CHECK:          vector.transfer_read %[[PARTIALS]]
+  // CHECK:          addf %{{.*}}, %{{.*}} : vector<4xf32>
+  // CHECK:          vector.transfer_write %{{.*}}, %[[PARTIALS]]
+  // The partial sums are combined after the loop.
+  // CHECK:      affine.for %[[P:i[0-9]+]] = 0 to 4 {
+  // CHECK-NEXT:   %[[ACC:[0-9]+]] = load %arg1[] : memref<f32>
+  // CHECK-NEXT:   %[[PARTIAL:[0-9]+]] = load %[[PARTIALS]][%[[P]]] : memref<4xf32>
+  // CHECK-NEXT:   %[[RES:[0-9]+]] = addf %[[ACC]], %[[PARTIAL]] : f32
+  // CHECK-NEXT:   store %[[RES]], %arg1[] : memref<f32>
+  // CHECK-NEXT: }
+  // CHECK-NEXT: dealloc %[[PARTIALS]] : memref<4xf32>
+  affine.for %i = 0 to 1024 {
+    %a = load %A[%i] : memref<1024xf32>
+    %s = load %sum[] : memref<f32>
+    %s1 = addf %s, %a : f32
+    store %s1, %sum[] : memref<f32>
+  }
+  return
+}
+
+// CHECK-LABEL: func @vec_max_with_cleanup
+// NOFP-LABEL: func @vec_max_with_cleanup
+// NOFP:       alloc() : memref<4xi32>
+func @vec_max_with_cleanup(%A : memref<1022xi32>, %max : memref<i32>) {
+  // CHECK:      %[[PARTIALS:[0-9]+]] = alloc() : memref<4xi32>
+  // CHECK:      -2147483648
+  // CHECK:      affine.for %{{.*}} = 0 to 1020 step 4 {
+  // CHECK:      affine.for %[[P:i[0-9]+]] = 0 to 4 {
+  // CHECK-NEXT:   %[[ACC:[0-9]+]] = load %arg1[] : memref<i32>
+  // CHECK-NEXT:   %[[PARTIAL:[0-9]+]] = load %[[PARTIALS]][%[[P]]] : memref<4xi32>
+  // CHECK-NEXT:   %[[CMP:[0-9]+]] = cmpi "sgt", %[[ACC]], %[[PARTIAL]] : i32
+  // CHECK-NEXT:   %[[RES:[0-9]+]] = select %[[CMP]], %[[ACC]], %[[PARTIAL]] : i32
+  // CHECK-NEXT:   store %[[RES]], %arg1[] : memref<i32>
+  // CHECK-NEXT: }
+  // CHECK-NEXT: dealloc %[[PARTIALS]] : memref<4xi32>
+  // The remaining iterations update the accumulator directly.
+  // CHECK-NEXT: affine.for %[[I:i[0-9]+]] = 1020 to 1022 {
+  // CHECK-NEXT:   %{{.*}} = load %arg0[%[[I]]] : memref<1022xi32>
+  // CHECK-NEXT:   %{{.*}} = load %arg1[] : memref<i32>
+  affine.for %i = 0 to 1022 {
+    %a = load %A[%i] : memref<1022xi32>
+    %m = load %max[] : memref<i32>
+    %c = cmpi "sgt", %m, %a : i32
+    %m1 = select %c, %m, %a : i32
+    store %m1, %max[] : memref<i32>
+  }
+  return
+}
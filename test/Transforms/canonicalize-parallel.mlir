@@ -0,0 +1,80 @@
+// RUN: mlir-opt %s -pass-pipeline='func(canonicalize{parallel-regions=true})' | FileCheck %s
+// RUN: mlir-opt %s -pass-pipeline='func(canonicalize)' | FileCheck %s
+
+// Canonicalizing the sibling loop nests concurrently produces the same result
+// as the serial canonicalizer.
+
+// CHECK-LABEL: func @sibling_nests
+func @sibling_nests(%arg0: memref<8xi32>) {
+  // CHECK-DAG: %c3_i32 = constant 3 : i32
+  // CHECK-DAG: %c4_i32 = constant 4 : i32
+  // CHECK-NOT: constant
+  // CHECK: affine.for %{{.*}} = 0 to 8 {
+  // CHECK-NEXT: store %c3_i32, %arg0[%{{.*}}] : memref<8xi32>
+  // CHECK-NEXT: }
+  // CHECK-NEXT: affine.for %{{.*}} = 0 to 8 {
+  // CHECK-NEXT: store %c4_i32, %arg0[%{{.*}}] : memref<8xi32>
+  // CHECK-NEXT: }
+  // CHECK-NEXT: return
+  %c1 = constant 1 : i32
+  %c2 = constant 2 : i32
+  affine.for %i = 0 to 8 {
+    %0 = addi %c1, %c2 : i32
+    store %0, %arg0[%i] : memref<8xi32>
+  }
+  affine.for %i = 0 to 8 {
+    %0 = muli %c2, %c2 : i32
+    store %0, %arg0[%i] : memref<8xi32>
+  }
+  return
+}
+
+// CHECK-LABEL: func @unique_constants
+func @unique_constants(%arg0: memref<8xi32>) {
+  // The constants folded within each loop nest are uniqued afterwards.
+  // CHECK-NEXT: %c3_i32 = constant 3 : i32
+  // CHECK-NEXT: affine.for %{{.*}} = 0 to 8 {
+  // CHECK-NEXT: store %c3_i32, %arg0[%{{.*}}] : memref<8xi32>
+  // CHECK-NEXT: }
+  // CHECK-NEXT: affine.for %{{.*}} = 0 to 8 {
+  // CHECK-NEXT: store %c3_i32, %arg0[%{{.*}}] : memref<8xi32>
+  // CHECK-NEXT: }
+  // CHECK-NEXT: return
+  %c1 = constant 1 : i32
+  %c2 = constant 2 : i32
+  affine.for %i = 0 to 8 {
+    %0 = addi %c1, %c2 : i32
+    store %0, %arg0[%i] : memref<8xi32>
+  }
+  affine.for %i = 0 to 8 {
+    %0 = addi %c2, %c1 : i32
+    store %0, %arg0[%i] : memref<8xi32>
+  }
+  return
+}
+
+// CHECK-LABEL: func @captured_values
+func @captured_values(%arg0: memref<?xi32>, %arg1: i32) {
+  // The values defined outside of the loop nests are used as symbols and
+  // operands within them.
+  // CHECK-NEXT: [[N:%.*]] = dim %arg0, 0 : memref<?xi32>
+  // CHECK-NEXT: affine.for %{{.*}} = 0 to [[N]] {
+  // CHECK-NEXT: store %arg1, %arg0[%{{.*}}] : memref<?xi32>
+  // CHECK-NEXT: }
+  // CHECK-NEXT: affine.for %{{.*}} = 0 to [[N]] {
+  // CHECK-NEXT: store %arg1, %arg0[%{{.*}}] : memref<?xi32>
+  // CHECK-NEXT: }
+  // CHECK-NEXT: return
+  %c0 = constant 0 : i32
+  %c1 = constant 1 : i32
+  %n = dim %arg0, 0 : memref<?xi32>
+  affine.for %i = 0 to %n {
+    %0 = addi %arg1, %c0 : i32
+    store %0, %arg0[%i] : memref<?xi32>
+  }
+  affine.for %i = 0 to %n {
+    %0 = muli %arg1, %c1 : i32
+    store %0, %arg0[%i] : memref<?xi32>
+  }
+  return
+}
@@ -0,0 +1,40 @@
+// RUN: mlir-opt %s -test-canonicalize-roots | FileCheck %s
+
+// Only the operations marked as roots, and the operations affected by their
+// rewrites, are canonicalized.
+
+// CHECK-LABEL: func @roots
+func @roots(%arg0: i32) -> (i32, i32) {
+  // CHECK-NEXT: %c0_i32 = constant 0 : i32
+  // CHECK-NEXT: %0 = addi %arg0, %c0_i32 : i32
+  // CHECK-NEXT: return %arg0, %0 : i32, i32
+  %c0 = constant 0 : i32
+  %0 = addi %arg0, %c0 {test.root: true} : i32
+  %1 = addi %arg0, %c0 : i32
+  return %0, %1 : i32, i32
+}
+
+// CHECK-LABEL: func @dead_chain
+func @dead_chain(%arg0: i32) {
+  // The dead operations feeding a root are erased along with it, while the
+  // unrelated dead operations are left untouched.
+  // CHECK-NEXT: %0 = muli %arg0, %arg0 : i32
+  // CHECK-NEXT: return
+  %0 = addi %arg0, %arg0 : i32
+  %1 = addi %0, %arg0 {test.root: true} : i32
+  %2 = muli %arg0, %arg0 : i32
+  return
+}
+
+// CHECK-LABEL: func @folded_chain
+func @folded_chain() -> i32 {
+  // The users of a rewritten root, and the operands that became dead, are
+  // revisited.
+  // CHECK-NEXT: %c6_i32 = constant 6 : i32
+  // CHECK-NEXT: return %c6_i32 : i32
+  %c1 = constant 1 : i32
+  %c2 = constant 2 : i32
+  %0 = addi %c1, %c2 {test.root: true} : i32
+  %1 = muli %0, %c2 : i32
+  return %1 : i32
+}
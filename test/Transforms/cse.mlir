@@ -93,6 +93,22 @@ func @different_attributes(index, index) -> (i1, i1, i1) {
   return %0, %1, %2 : i1, i1, i1
 }
 
+/// Check that operations are eliminated regardless of the order in which their
+/// attributes were specified.
+// CHECK-LABEL: @attribute_order
+func @attribute_order(f32, f32) -> (f32, f32, f32) {
+^bb0(%a : f32, %b : f32):
+  // CHECK-NEXT: %0 = addf %arg0, %arg1 {{.*}}: f32
+  %0 = "std.addf"(%a, %b) {bar: 2, foo: 1} : (f32, f32) -> f32
+  %1 = "std.addf"(%a, %b) {foo: 1, bar: 2} : (f32, f32) -> f32
+
+  // CHECK-NEXT: %1 = addf %arg0, %arg1 : f32
+  %2 = addf %a, %b : f32
+
+  // CHECK-NEXT: return %0, %0, %1 : f32, f32, f32
+  return %0, %1, %2 : f32, f32, f32
+}
+
 /// Check that operations with side effects are not eliminated.
 // CHECK-LABEL: @side_effect
 func @side_effect() -> (memref<2x1xf32>, memref<2x1xf32>) {
@@ -0,0 +1,53 @@
+// RUN: mlir-opt %s -gvn | FileCheck %s
+
+#set0 = (d0) : (d0 >= 0)
+
+// CHECK-LABEL: func @commutative
+func @commutative(%arg0: i32, %arg1: i32) -> (i32, i32, i32, i32) {
+  // The operands of commutative operations are compared regardless of their
+  // order, the operands of the other operations aren't.
+  // CHECK-NEXT: %0 = addi %arg0, %arg1 : i32
+  // CHECK-NEXT: %1 = subi %arg0, %arg1 : i32
+  // CHECK-NEXT: %2 = subi %arg1, %arg0 : i32
+  // CHECK-NEXT: return %0, %0, %1, %2 : i32, i32, i32, i32
+  %0 = addi %arg0, %arg1 : i32
+  %1 = addi %arg1, %arg0 : i32
+  %2 = subi %arg0, %arg1 : i32
+  %3 = subi %arg1, %arg0 : i32
+  return %0, %1, %2, %3 : i32, i32, i32, i32
+}
+
+// CHECK-LABEL: func @composed_apply
+func @composed_apply() {
+  // The chains of affine.apply operations are compared by their composed map.
+  // CHECK: affine.for %i0 = 0 to 8 {
+  // CHECK-NEXT: [[A:%.*]] = affine.apply #map{{[0-9]+}}(%i0)
+  // CHECK-NEXT: [[B:%.*]] = affine.apply #map{{[0-9]+}}([[A]])
+  // CHECK-NEXT: [[C:%.*]] = affine.apply #map{{[0-9]+}}(%i0)
+  // CHECK-NEXT: "foo"([[B]], [[B]], [[C]]) : (index, index, index) -> ()
+  affine.for %i = 0 to 8 {
+    %0 = affine.apply (d0) -> (d0 + 1)(%i)
+    %1 = affine.apply (d0) -> (d0 * 2)(%0)
+    %2 = affine.apply (d0) -> (d0 * 2 + 2)(%i)
+    %3 = affine.apply (d0) -> (d0 * 2 + 1)(%i)
+    "foo"(%1, %2, %3) : (index, index, index) -> ()
+  }
+  return
+}
+
+// CHECK-LABEL: func @nested_regions
+func @nested_regions(%arg0: index, %arg1: index) {
+  // The values computed outside of the loop nest are reused within it.
+  // CHECK-NEXT: %0 = addi %arg0, %arg1 : index
+  // CHECK-NEXT: affine.for %i0 = 0 to 8 {
+  // CHECK-NEXT: affine.if #set0(%i0) {
+  // CHECK-NEXT: "foo"(%0) : (index) -> ()
+  %0 = addi %arg0, %arg1 : index
+  affine.for %i = 0 to 8 {
+    affine.if #set0(%i) {
+      %1 = addi %arg1, %arg0 : index
+      "foo"(%1) : (index) -> ()
+    }
+  }
+  return
+}
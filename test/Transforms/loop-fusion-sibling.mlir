@@ -0,0 +1,66 @@
+// RUN: mlir-opt %s -loop-fusion -fusion-mode=sibling -split-input-file | FileCheck %s
+// RUN: mlir-opt %s -pass-pipeline='func(loop-fusion{mode=sibling sibling-min-savings=0.5})' -split-input-file | FileCheck %s --check-prefix=THRESHOLD
+// RUN: mlir-opt %s -loop-fusion -fusion-sibling-min-savings=0.5 -split-input-file | FileCheck %s --check-prefix=THRESHOLD
+// RUN: mlir-opt %s -loop-fusion -fusion-mode=producer-consumer -split-input-file | FileCheck %s --check-prefix=PRODUCER
+
+// CHECK-LABEL: func @fuse_siblings_reading_same_input
+// THRESHOLD-LABEL: func @fuse_siblings_reading_same_input
+// PRODUCER-LABEL: func @fuse_siblings_reading_same_input
+func @fuse_siblings_reading_same_input(%in: memref<1024xf32>, %out0: memref<1024xf32>, %out1: memref<1024xf32>) {
+  affine.for %i0 = 0 to 1024 {
+    %v0 = load %in[%i0] : memref<1024xf32>
+    %v1 = addf %v0, %v0 : f32
+    store %v1, %out0[%i0] : memref<1024xf32>
+  }
+  affine.for %i1 = 0 to 1024 {
+    %v2 = load %in[%i1] : memref<1024xf32>
+    %v3 = mulf %v2, %v2 : f32
+    store %v3, %out1[%i1] : memref<1024xf32>
+  }
+  // Both nests stream '%in', so fusing them saves 4KiB out of the 16KiB
+  // accessed by the unfused nests.
+  // CHECK:      affine.for %i0 = 0 to 1024 {
+  // CHECK-NEXT:   %0 = load %arg0[%i0] : memref<1024xf32>
+  // CHECK-NEXT:   %1 = addf %0, %0 : f32
+  // CHECK-NEXT:   store %1, %arg1[%i0] : memref<1024xf32>
+  // CHECK-NEXT:   %2 = load %arg0[%i0] : memref<1024xf32>
+  // CHECK-NEXT:   %3 = mulf %2, %2 : f32
+  // CHECK-NEXT:   store %3, %arg2[%i0] : memref<1024xf32>
+  // CHECK-NEXT: }
+  // CHECK-NEXT: return
+
+  // A quarter of the bytes is less than the required savings.
+  // THRESHOLD:      affine.for %i0 = 0 to 1024 {
+  // THRESHOLD:      affine.for %i1 = 0 to 1024 {
+
+  // Sibling nests are not fused in the producer-consumer mode.
+  // PRODUCER:      affine.for %i0 = 0 to 1024 {
+  // PRODUCER:      affine.for %i1 = 0 to 1024 {
+  return
+}
+
+// -----
+
+// CHECK-LABEL: func @sibling_mode_does_not_fuse_producer_consumer
+func @sibling_mode_does_not_fuse_producer_consumer(%in: memref<1024xf32>) {
+  %tmp = alloc() : memref<1024xf32>
+  affine.for %i0 = 0 to 1024 {
+    %v0 = load %in[%i0] : memref<1024xf32>
+    store %v0, %tmp[%i0] : memref<1024xf32>
+  }
+  affine.for %i1 = 0 to 1024 {
+    %v1 = load %tmp[%i1] : memref<1024xf32>
+    "use"(%v1) : (f32) -> ()
+  }
+  // CHECK:      %0 = alloc() : memref<1024xf32>
+  // CHECK-NEXT: affine.for %i0 = 0 to 1024 {
+  // CHECK-NEXT:   %1 = load %arg0[%i0] : memref<1024xf32>
+  // CHECK-NEXT:   store %1, %0[%i0] : memref<1024xf32>
+  // CHECK-NEXT: }
+  // CHECK-NEXT: affine.for %i1 = 0 to 1024 {
+  // CHECK-NEXT:   %2 = load %0[%i1] : memref<1024xf32>
+  // CHECK-NEXT:   "use"(%2) : (f32) -> ()
+  // CHECK-NEXT: }
+  // CHECK-NEXT: return
+  return
+}
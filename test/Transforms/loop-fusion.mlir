@@ -1,5 +1,7 @@
 // RUN: mlir-opt %s -loop-fusion -split-input-file -verify | FileCheck %s
 // RUN: mlir-opt %s -loop-fusion -fusion-maximal -split-input-file -verify | FileCheck %s --check-prefix=MAXIMAL
+// RUN: mlir-opt %s -loop-fusion -fusion-depth-budget=1 -split-input-file -verify | FileCheck %s --check-prefix=BUDGET
+// RUN: mlir-opt %s -loop-fusion -fusion-parallel-depths -split-input-file -verify | FileCheck %s
 
 // TODO(andydavis) Add more tests:
 // *) Add nested fusion test cases when non-constant loop bound support is
@@ -261,6 +263,83 @@ func @should_fuse_all_loops() {
 
 // CHECK: [[MAP0:#map[0-9]+]] = (d0, d1) -> (-d0 + d1)
 
+// Synthetic pipeline of several producer loop nests feeding one consumer. The
+// same shape, scaled up to hundreds of producers, can be used to measure
+// fusion time with -pass-timing.
+
+// CHECK-LABEL: func @should_fuse_many_producers_into_consumer() {
+func @should_fuse_many_producers_into_consumer() {
+  %a = alloc() : memref<10xf32>
+  %b = alloc() : memref<10xf32>
+  %c = alloc() : memref<10xf32>
+  %d = alloc() : memref<10xf32>
+  %e = alloc() : memref<10xf32>
+  %f = alloc() : memref<10xf32>
+  %cf7 = constant 7.0 : f32
+
+  affine.for %i0 = 0 to 10 {
+    store %cf7, %a[%i0] : memref<10xf32>
+  }
+  affine.for %i1 = 0 to 10 {
+    store %cf7, %b[%i1] : memref<10xf32>
+  }
+  affine.for %i2 = 0 to 10 {
+    store %cf7, %c[%i2] : memref<10xf32>
+  }
+  affine.for %i3 = 0 to 10 {
+    store %cf7, %d[%i3] : memref<10xf32>
+  }
+  affine.for %i4 = 0 to 10 {
+    store %cf7, %e[%i4] : memref<10xf32>
+  }
+  affine.for %i5 = 0 to 10 {
+    store %cf7, %f[%i5] : memref<10xf32>
+  }
+  affine.for %i6 = 0 to 10 {
+    %v0 = load %a[%i6] : memref<10xf32>
+    %v1 = load %b[%i6] : memref<10xf32>
+    %v2 = load %c[%i6] : memref<10xf32>
+    %v3 = load %d[%i6] : memref<10xf32>
+    %v4 = load %e[%i6] : memref<10xf32>
+    %v5 = load %f[%i6] : memref<10xf32>
+  }
+
+  // All producers should be fused into the consumer, each with a private
+  // single element memref.
+  // CHECK:      affine.for %i0 = 0 to 10 {
+  // CHECK-NEXT:   affine.apply [[MAP0]](%i0, %i0)
+  // CHECK-NEXT:   store %cst, %{{[0-9]+}}[%{{[0-9]+}}] : memref<1xf32>
+  // CHECK-NEXT:   affine.apply [[MAP0]](%i0, %i0)
+  // CHECK-NEXT:   store %cst, %{{[0-9]+}}[%{{[0-9]+}}] : memref<1xf32>
+  // CHECK-NEXT:   affine.apply [[MAP0]](%i0, %i0)
+  // CHECK-NEXT:   store %cst, %{{[0-9]+}}[%{{[0-9]+}}] : memref<1xf32>
+  // CHECK-NEXT:   affine.apply [[MAP0]](%i0, %i0)
+  // CHECK-NEXT:   store %cst, %{{[0-9]+}}[%{{[0-9]+}}] : memref<1xf32>
+  // CHECK-NEXT:   affine.apply [[MAP0]](%i0, %i0)
+  // CHECK-NEXT:   store %cst, %{{[0-9]+}}[%{{[0-9]+}}] : memref<1xf32>
+  // CHECK-NEXT:   affine.apply [[MAP0]](%i0, %i0)
+  // CHECK-NEXT:   store %cst, %{{[0-9]+}}[%{{[0-9]+}}] : memref<1xf32>
+  // CHECK-NEXT:   affine.apply [[MAP0]](%i0, %i0)
+  // CHECK-NEXT:   load %{{[0-9]+}}[%{{[0-9]+}}] : memref<1xf32>
+  // CHECK-NEXT:   affine.apply [[MAP0]](%i0, %i0)
+  // CHECK-NEXT:   load %{{[0-9]+}}[%{{[0-9]+}}] : memref<1xf32>
+  // CHECK-NEXT:   affine.apply [[MAP0]](%i0, %i0)
+  // CHECK-NEXT:   load %{{[0-9]+}}[%{{[0-9]+}}] : memref<1xf32>
+  // CHECK-NEXT:   affine.apply [[MAP0]](%i0, %i0)
+  // CHECK-NEXT:   load %{{[0-9]+}}[%{{[0-9]+}}] : memref<1xf32>
+  // CHECK-NEXT:   affine.apply [[MAP0]](%i0, %i0)
+  // CHECK-NEXT:   load %{{[0-9]+}}[%{{[0-9]+}}] : memref<1xf32>
+  // CHECK-NEXT:   affine.apply [[MAP0]](%i0, %i0)
+  // CHECK-NEXT:   load %{{[0-9]+}}[%{{[0-9]+}}] : memref<1xf32>
+  // CHECK-NEXT: }
+  // CHECK-NEXT: return
+  return
+}
+
+// -----
+
+// CHECK: [[MAP0:#map[0-9]+]] = (d0, d1) -> (-d0 + d1)
+
 // CHECK-LABEL: func @should_fuse_first_and_second_loops() {
 func @should_fuse_first_and_second_loops() {
   %a = alloc() : memref<10xf32>
@@ -892,6 +971,27 @@ func @should_fuse_at_src_depth1_and_dst_depth1() {
   // CHECK-NEXT:    }
   // CHECK-NEXT:  }
   // CHECK-NEXT:  return
+
+  // Only the deepest destination loop depth is evaluated within a budget of
+  // one depth, and fusing there is not profitable.
+  // BUDGET-LABEL: func @should_fuse_at_src_depth1_and_dst_depth1
+  // BUDGET:       affine.for %i0 = 0 to 100 {
+  // BUDGET-NEXT:    affine.for %i1 = 0 to 16 {
+  // BUDGET-NEXT:      %2 = load %0[%i0, %i1] : memref<100x16xf32>
+  // BUDGET-NEXT:      "op0"(%2) : (f32) -> ()
+  // BUDGET-NEXT:    }
+  // BUDGET-NEXT:    affine.for %i2 = 0 to 16 {
+  // BUDGET-NEXT:      %3 = "op1"() : () -> f32
+  // BUDGET-NEXT:      store %3, %1[%i0, %i2] : memref<100x16xf32>
+  // BUDGET-NEXT:    }
+  // BUDGET-NEXT:  }
+  // BUDGET-NEXT:  affine.for %i3 = 0 to 100 {
+  // BUDGET-NEXT:    affine.for %i4 = 0 to 16 {
+  // BUDGET-NEXT:      %4 = load %1[%i3, %i4] : memref<100x16xf32>
+  // BUDGET-NEXT:      "op2"(%4) : (f32) -> ()
+  // BUDGET-NEXT:    }
+  // BUDGET-NEXT:  }
+  // BUDGET-NEXT:  return
   return
 }
 
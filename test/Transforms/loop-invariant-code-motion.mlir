@@ -1,4 +1,9 @@
 // RUN: mlir-opt %s -loop-invariant-code-motion -split-input-file -verify | FileCheck %s
+// RUN: mlir-opt %s -loop-invariant-code-motion -licm-unswitch-limit=1 | FileCheck %s --check-prefix=LIMIT
+// RUN: mlir-opt %s -pass-pipeline='func(loop-invariant-code-motion{unswitch-size-threshold=4})' | FileCheck %s --check-prefix=SIZE
+
+// CHECK-DAG: [[SET_NON_ZERO_TRIP:#set[0-9]+]] = ()[s0] : (s0 - 1 >= 0)
+// CHECK-DAG: [[SET_N_GE_50:#set[0-9]+]] = ()[s0] : (s0 - 50 >= 0)
 
 func @nested_loops_both_having_invariant_code() {
   %m = alloc() : memref<10xf32>
@@ -127,15 +132,17 @@ func @nested_loops_with_common_and_uncommon_invariant_code() {
     }
   }
 
+  // The invariant store can't be hoisted since the other store of the loop
+  // writes the same memref.
   // CHECK: %0 = alloc() : memref<10xf32>
   // CHECK-NEXT: %cst = constant 7.000000e+00 : f32
   // CHECK-NEXT: %cst_0 = constant 8.000000e+00 : f32
   // CHECK-NEXT: %1 = addf %cst, %cst_0 : f32
   // CHECK-NEXT: %2 = addf %cst, %cst : f32
   // CHECK-NEXT: affine.for %i0 = 0 to 10 {
-  // CHECK-NEXT: store %1, %0[%i0] : memref<10xf32>
   // CHECK-NEXT: affine.for %i1 = 0 to 10 {
   // CHECK-NEXT:   store %1, %0[%i1] : memref<10xf32>
+  // CHECK-NEXT:   store %1, %0[%i0] : memref<10xf32>
   // CHECK-NEXT:  }
   // CHECK-NEXT: }
   // CHECK-NEXT: return
@@ -176,10 +183,11 @@ func @invariant_constant_and_load() {
     store %v, %m[%i0] : memref<100xf32>
   }
 
+  // The load isn't hoisted since the loop writes the memref it reads.
   // CHECK: %0 = alloc() : memref<100xf32>
   // CHECK-NEXT: %c0 = constant 0 : index
-  // CHECK-NEXT: %1 = load %0[%c0] : memref<100xf32>
   // CHECK-NEXT: affine.for %i0 = 0 to 5 {
+  // CHECK-NEXT:  %1 = load %0[%c0] : memref<100xf32>
   // CHECK-NEXT:  store %1, %0[%i0] : memref<100xf32>
   // CHECK-NEXT: }
   // CHECK-NEXT: return
@@ -187,3 +195,184 @@ func @invariant_constant_and_load() {
   return
 }
 
+
+// CHECK-LABEL: func @invariant_load_from_read_only_memref
+func @invariant_load_from_read_only_memref(%A: memref<100xf32>, %B: memref<100xf32>) {
+  %c5 = constant 5 : index
+  affine.for %i0 = 0 to 100 {
+    %v = load %A[%c5] : memref<100xf32>
+    %w = addf %v, %v : f32
+    store %w, %B[%i0] : memref<100xf32>
+  }
+
+  // CHECK: %0 = load %arg0[%c5] : memref<100xf32>
+  // CHECK-NEXT: %1 = addf %0, %0 : f32
+  // CHECK-NEXT: affine.for %i0 = 0 to 100 {
+  // CHECK-NEXT:  store %1, %arg1[%i0] : memref<100xf32>
+  // CHECK-NEXT: }
+  // CHECK-NEXT: return
+
+  return
+}
+
+// An operation with unknown side effects may write any memref.
+// CHECK-LABEL: func @invariant_load_with_unknown_side_effects
+func @invariant_load_with_unknown_side_effects(%A: memref<100xf32>) {
+  %c5 = constant 5 : index
+  affine.for %i0 = 0 to 100 {
+    %v = load %A[%c5] : memref<100xf32>
+    "foo"(%v) : (f32) -> ()
+  }
+
+  // CHECK: affine.for %i0 = 0 to 100 {
+  // CHECK-NEXT:  %0 = load %arg0[%c5] : memref<100xf32>
+  // CHECK-NEXT:  "foo"(%0) : (f32) -> ()
+  // CHECK-NEXT: }
+
+  return
+}
+
+// Loads are only hoisted out of a loop that may not run under a check that it
+// runs at least once.
+// CHECK-LABEL: func @invariant_load_zero_trip_check
+func @invariant_load_zero_trip_check(%A: memref<100xf32>, %B: memref<100xf32>, %N: index) {
+  %c5 = constant 5 : index
+  affine.for %i0 = 0 to %N {
+    %v = load %A[%c5] : memref<100xf32>
+    store %v, %B[%i0] : memref<100xf32>
+  }
+
+  // CHECK: affine.if [[SET_NON_ZERO_TRIP]]()[%arg2] {
+  // CHECK-NEXT:  %0 = load %arg0[%c5] : memref<100xf32>
+  // CHECK-NEXT:  affine.for %i0 = 0 to %arg2 {
+  // CHECK-NEXT:    store %0, %arg1[%i0] : memref<100xf32>
+  // CHECK-NEXT:  }
+  // CHECK-NEXT: }
+  // CHECK-NEXT: return
+
+  return
+}
+
+// CHECK-LABEL: func @invariant_load_zero_trip_loop
+func @invariant_load_zero_trip_loop(%A: memref<100xf32>, %B: memref<100xf32>) {
+  %c5 = constant 5 : index
+  affine.for %i0 = 0 to 0 {
+    %v = load %A[%c5] : memref<100xf32>
+    store %v, %B[%i0] : memref<100xf32>
+  }
+
+  // CHECK: affine.for %i0 = 0 to 0 {
+  // CHECK-NEXT:  %0 = load %arg0[%c5] : memref<100xf32>
+  // CHECK-NEXT:  store %0, %arg1[%i0] : memref<100xf32>
+  // CHECK-NEXT: }
+
+  return
+}
+
+// The loop is unswitched on the invariant condition, with a copy of the loop
+// for each branch.
+// CHECK-LABEL: func @unswitch_invariant_affine_if
+// SIZE-LABEL: func @unswitch_invariant_affine_if
+func @unswitch_invariant_affine_if(%A: memref<100xf32>, %N: index) {
+  %cf1 = constant 1.0 : f32
+  %cf2 = constant 2.0 : f32
+  affine.for %i0 = 0 to 100 {
+    affine.if ()[s0] : (s0 - 50 >= 0) ()[%N] {
+      store %cf1, %A[%i0] : memref<100xf32>
+    } else {
+      store %cf2, %A[%i0] : memref<100xf32>
+    }
+  }
+
+  // CHECK: affine.if [[SET_N_GE_50]]()[%arg1] {
+  // CHECK-NEXT:  affine.for %i0 = 0 to 100 {
+  // CHECK-NEXT:    store %cst, %arg0[%i0] : memref<100xf32>
+  // CHECK-NEXT:  }
+  // CHECK-NEXT: } else {
+  // CHECK-NEXT:  affine.for %i1 = 0 to 100 {
+  // CHECK-NEXT:    store %cst_0, %arg0[%i1] : memref<100xf32>
+  // CHECK-NEXT:  }
+  // CHECK-NEXT: }
+  // CHECK-NEXT: return
+
+  // The loop has more operations than the size threshold.
+  // SIZE:      affine.for %i0 = 0 to 100 {
+  // SIZE-NEXT:   affine.if
+
+  return
+}
+
+// Unswitching exposes invariant code in the loops of both branches.
+// CHECK-LABEL: func @unswitch_and_hoist
+func @unswitch_and_hoist(%A: memref<100xf32>, %B: memref<100xf32>, %N: index) {
+  %c0 = constant 0 : index
+  affine.for %i0 = 0 to 100 {
+    affine.if ()[s0] : (s0 - 50 >= 0) ()[%N] {
+      %v = load %A[%c0] : memref<100xf32>
+      store %v, %B[%i0] : memref<100xf32>
+    }
+  }
+
+  // CHECK: affine.if [[SET_N_GE_50]]()[%arg2] {
+  // CHECK-NEXT:  %0 = load %arg0[%c0] : memref<100xf32>
+  // CHECK-NEXT:  affine.for %i0 = 0 to 100 {
+  // CHECK-NEXT:    store %0, %arg1[%i0] : memref<100xf32>
+  // CHECK-NEXT:  }
+  // CHECK-NEXT: }
+  // CHECK-NEXT: return
+
+  return
+}
+
+// The loop is unswitched on both invariant conditions, or only on the first
+// one with a limit of one unswitching.
+// CHECK-LABEL: func @unswitch_twice
+// LIMIT-LABEL: func @unswitch_twice
+func @unswitch_twice(%A: memref<100xf32>, %B: memref<100xf32>, %N: index, %M: index) {
+  %cf1 = constant 1.0 : f32
+  %cf2 = constant 2.0 : f32
+  affine.for %i0 = 0 to 100 {
+    affine.if ()[s0] : (s0 - 50 >= 0) ()[%N] {
+      store %cf1, %A[%i0] : memref<100xf32>
+    }
+    affine.if ()[s0] : (s0 - 50 >= 0) ()[%M] {
+      store %cf2, %B[%i0] : memref<100xf32>
+    }
+  }
+
+  // CHECK: affine.if [[SET_N_GE_50]]()[%arg2] {
+  // CHECK-NEXT:  affine.if [[SET_N_GE_50]]()[%arg3] {
+  // CHECK-NEXT:    affine.for %i0 = 0 to 100 {
+  // CHECK-NEXT:      store %cst, %arg0[%i0] : memref<100xf32>
+  // CHECK-NEXT:      store %cst_0, %arg1[%i0] : memref<100xf32>
+  // CHECK-NEXT:    }
+  // CHECK-NEXT:  } else {
+  // CHECK-NEXT:    affine.for %i1 = 0 to 100 {
+  // CHECK-NEXT:      store %cst, %arg0[%i1] : memref<100xf32>
+  // CHECK-NEXT:    }
+  // CHECK-NEXT:  }
+  // CHECK-NEXT: } else {
+  // CHECK-NEXT:  affine.if [[SET_N_GE_50]]()[%arg3] {
+  // CHECK-NEXT:    affine.for %i2 = 0 to 100 {
+  // CHECK-NEXT:      store %cst_0, %arg1[%i2] : memref<100xf32>
+  // CHECK-NEXT:    }
+  // CHECK-NEXT:  }
+  // CHECK-NEXT: }
+  // CHECK-NEXT: return
+
+  // LIMIT:      affine.if #set{{[0-9]+}}()[%arg2] {
+  // LIMIT-NEXT:   affine.for %i0 = 0 to 100 {
+  // LIMIT-NEXT:     store %cst, %arg0[%i0] : memref<100xf32>
+  // LIMIT-NEXT:     affine.if #set{{[0-9]+}}()[%arg3] {
+  // LIMIT:        }
+  // LIMIT-NEXT:   }
+  // LIMIT-NEXT: } else {
+  // LIMIT-NEXT:   affine.for %i1 = 0 to 100 {
+  // LIMIT-NEXT:     affine.if #set{{[0-9]+}}()[%arg3] {
+  // LIMIT:        }
+  // LIMIT-NEXT:   }
+  // LIMIT-NEXT: }
+  // LIMIT-NEXT: return
+
+  return
+}
@@ -1,5 +1,11 @@
 // RUN: mlir-opt %s -split-input-file  -loop-tile -tile-size=32 | FileCheck %s
+// RUN: mlir-opt %s -split-input-file -pass-pipeline='func(loop-tile{tile-size=32})' | FileCheck %s
 // RUN: mlir-opt %s -split-input-file -loop-tile -tile-cache-size=512 | FileCheck %s --check-prefix=MODEL
+// RUN: mlir-opt %s -split-input-file -pass-pipeline='func(loop-tile{cache-size=512})' | FileCheck %s --check-prefix=MODEL
+// RUN: mlir-opt %s -split-input-file -loop-tile -tile-cache-sizes=4,32 | FileCheck %s --check-prefix=REUSE
+// RUN: mlir-opt %s -split-input-file -pass-pipeline='func(loop-tile{cache-sizes=4,32})' | FileCheck %s --check-prefix=REUSE
+// RUN: mlir-opt %s -split-input-file -loop-tile -tile-cache-sizes=4,32 -tile-multi-level -tile-register-sizes=4,4 | FileCheck %s --check-prefix=HIER
+// RUN: mlir-opt %s -split-input-file -pass-pipeline='func(loop-tile{cache-sizes=4,32 multi-level register-sizes=4,4})' | FileCheck %s --check-prefix=HIER
 
 // -----
 
@@ -166,3 +172,97 @@ func @tile_with_loop_upper_bounds_in_two_symbols(%arg0: memref<?xf32>, %limit: i
 // CHECK-NEXT:      %1 = load %arg0[%i1] : memref<?xf32>
 // CHECK-NEXT:    }
 // CHECK-NEXT:  }
+
+// -----
+
+// With 64-byte lines, a 16 x 16 x 16 tile touches 16 lines of each matrix,
+// i.e. 3 KiB, which fits in the 4 KiB level. Doubling any tile size would not
+// fit, and the larger tiles that fit in the 32 KiB level do not fit in the
+// 4 KiB one, which then sees the traffic of the untiled loop nest.
+
+// REUSE-LABEL: func @matmul_f32
+func @matmul_f32(%A: memref<64x64xf32>, %B: memref<64x64xf32>, %C: memref<64x64xf32>) {
+  affine.for %i = 0 to 64 {
+    affine.for %j = 0 to 64 {
+      affine.for %k = 0 to 64 {
+        %a = load %A[%i, %k] : memref<64x64xf32>
+        %b = load %B[%k, %j] : memref<64x64xf32>
+        %c = load %C[%i, %j] : memref<64x64xf32>
+        %m = mulf %a, %b : f32
+        %s = addf %c, %m : f32
+        store %s, %C[%i, %j] : memref<64x64xf32>
+      }
+    }
+  }
+  return
+}
+// REUSE:       affine.for %i0 = 0 to 64 step 16 {
+// REUSE-NEXT:    affine.for %i1 = 0 to 64 step 16 {
+// REUSE-NEXT:      affine.for %i2 = 0 to 64 step 16 {
+
+// -----
+
+// %x is read along the innermost loop, with a stride of 1: tiling that loop by
+// 16 f32 elements covers a cache line of %A and of %x. %y doesn't depend on the
+// innermost loop and is reused across its tiles. Doubling either tile size
+// would exceed the 4 KiB level.
+
+// REUSE-LABEL: func @matvec_f32
+func @matvec_f32(%A: memref<512x512xf32>, %x: memref<512xf32>, %y: memref<512xf32>) {
+  affine.for %i = 0 to 512 {
+    affine.for %j = 0 to 512 {
+      %a = load %A[%i, %j] : memref<512x512xf32>
+      %b = load %x[%j] : memref<512xf32>
+      %c = load %y[%i] : memref<512xf32>
+      %m = mulf %a, %b : f32
+      %s = addf %c, %m : f32
+      store %s, %y[%i] : memref<512xf32>
+    }
+  }
+  return
+}
+// REUSE:       affine.for %i0 = 0 to 512 step 32 {
+// REUSE-NEXT:    affine.for %i1 = 0 to 512 step 16 {
+
+// -----
+
+// The 32 KiB level selects 64 x 64 x 16 tiles, and the 4 KiB level 16 x 16 x 16
+// tiles within them. The tile-space loop along %k of the inner level has a
+// single iteration and is promoted. The intra-tile loops along %i and %j of the
+// inner level are then unroll-and-jammed by 4.
+
+// HIER-LABEL: func @matmul_hierarchy
+func @matmul_hierarchy(%A: memref<256x256xf32>, %B: memref<256x256xf32>, %C: memref<256x256xf32>) {
+  affine.for %i = 0 to 256 {
+    affine.for %j = 0 to 256 {
+      affine.for %k = 0 to 256 {
+        %a = load %A[%i, %k] : memref<256x256xf32>
+        %b = load %B[%k, %j] : memref<256x256xf32>
+        %c = load %C[%i, %j] : memref<256x256xf32>
+        %m = mulf %a, %b : f32
+        %s = addf %c, %m : f32
+        store %s, %C[%i, %j] : memref<256x256xf32>
+      }
+    }
+  }
+  return
+}
+// HIER:       affine.for %i0 = 0 to 256 step 64 {
+// HIER-NEXT:    affine.for %i1 = 0 to 256 step 64 {
+// HIER-NEXT:      affine.for %i2 = 0 to 256 step 16 {
+// HIER-NEXT:        affine.for %i3 = #map{{[0-9]+}}(%i0) to #map{{[0-9]+}}(%i0) step 16 {
+// HIER-NEXT:          affine.for %i4 = #map{{[0-9]+}}(%i1) to #map{{[0-9]+}}(%i1) step 16 {
+// HIER-NEXT:            affine.for %i5 = #map{{[0-9]+}}(%i3) to #map{{[0-9]+}}(%i3) step 4 {
+// HIER-NEXT:              affine.for %i6 = #map{{[0-9]+}}(%i4) to #map{{[0-9]+}}(%i4) step 4 {
+// HIER-NEXT:                affine.for %i7 = #map{{[0-9]+}}(%i2) to #map{{[0-9]+}}(%i2) {
+// HIER-NEXT:                  {{.*}} = load %arg0[%i5, %i7] : memref<256x256xf32>
+// HIER-NEXT:                  {{.*}} = load %arg1[%i7, %i6] : memref<256x256xf32>
+// HIER-NEXT:                  {{.*}} = load %arg2[%i5, %i6] : memref<256x256xf32>
+// HIER-NEXT:                  {{.*}} = mulf
+// HIER-NEXT:                  {{.*}} = addf
+// HIER-NEXT:                  store {{.*}}, %arg2[%i5, %i6] : memref<256x256xf32>
+// HIER-NEXT:                  [[I1:%[0-9]+]] = affine.apply #map{{[0-9]+}}(%i5)
+// HIER-NEXT:                  {{.*}} = load %arg0[[[I1]], %i7] : memref<256x256xf32>
+// HIER:                       [[J1:%[0-9]+]] = affine.apply #map{{[0-9]+}}(%i6)
+// HIER-NEXT:                  {{.*}} = load %arg0[%i5, %i7] : memref<256x256xf32>
+// HIER-NEXT:                  {{.*}} = load %arg1[%i7, [[J1]]] : memref<256x256xf32>
@@ -0,0 +1,69 @@
+// RUN: mlir-opt %s -memref-dataflow-opt -memref-dataflow-unroll-factor=2 | FileCheck %s
+// RUN: mlir-opt %s -pass-pipeline='func(memref-dataflow-opt{unroll-factor=2})' | FileCheck %s
+
+// CHECK-DAG: [[MAP_MINUS_1:#map[0-9]+]] = (d0) -> (d0 - 1)
+// CHECK-DAG: [[MAP_PLUS_1:#map[0-9]+]] = (d0) -> (d0 + 1)
+
+// Each iteration loads the element loaded by the previous one.
+// CHECK-LABEL: func @stencil
+func @stencil(%A : memref<1024xf32>, %B : memref<1024xf32>) {
+  affine.for %i = 1 to 1023 {
+    %im1 = affine.apply (d0) -> (d0 - 1) (%i)
+    %a0 = load %A[%im1] : memref<1024xf32>
+    %a1 = load %A[%i] : memref<1024xf32>
+    %s = addf %a0, %a1 : f32
+    store %s, %B[%i] : memref<1024xf32>
+  }
+  return
+// CHECK:       affine.for %i0 = 1 to 1023 step 2 {
+// CHECK-NEXT:    %0 = affine.apply [[MAP_MINUS_1]](%i0)
+// CHECK-NEXT:    %1 = load %arg0[%0] : memref<1024xf32>
+// CHECK-NEXT:    %2 = load %arg0[%i0] : memref<1024xf32>
+// CHECK-NEXT:    %3 = addf %1, %2 : f32
+// CHECK-NEXT:    store %3, %arg1[%i0] : memref<1024xf32>
+// CHECK-NEXT:    %4 = affine.apply [[MAP_PLUS_1]](%i0)
+// CHECK-NEXT:    %5 = affine.apply [[MAP_MINUS_1]](%4)
+// CHECK-NEXT:    %6 = load %arg0[%4] : memref<1024xf32>
+// CHECK-NEXT:    %7 = addf %2, %6 : f32
+// CHECK-NEXT:    store %7, %arg1[%4] : memref<1024xf32>
+// CHECK-NEXT:  }
+// CHECK-NEXT:  return
+}
+
+// The accumulator is kept in a register across the unrolled iterations, and
+// only stored once per unrolled iteration.
+// CHECK-LABEL: func @reduction
+func @reduction(%A : memref<1024xf32>, %sum : memref<1xf32>) {
+  %c0 = constant 0 : index
+  affine.for %i = 0 to 1024 {
+    %a = load %A[%i] : memref<1024xf32>
+    %s = load %sum[%c0] : memref<1xf32>
+    %s1 = addf %s, %a : f32
+    store %s1, %sum[%c0] : memref<1xf32>
+  }
+  return
+// CHECK:       affine.for %i0 = 0 to 1024 step 2 {
+// CHECK-NEXT:    %0 = load %arg0[%i0] : memref<1024xf32>
+// CHECK-NEXT:    %1 = load %arg1[%c0] : memref<1xf32>
+// CHECK-NEXT:    %2 = addf %1, %0 : f32
+// CHECK-NEXT:    %3 = affine.apply [[MAP_PLUS_1]](%i0)
+// CHECK-NEXT:    %4 = load %arg0[%3] : memref<1024xf32>
+// CHECK-NEXT:    %5 = addf %2, %4 : f32
+// CHECK-NEXT:    store %5, %arg1[%c0] : memref<1xf32>
+// CHECK-NEXT:  }
+// CHECK-NEXT:  return
+}
+
+// No element is reused across iterations: the loop isn't unrolled.
+// CHECK-LABEL: func @no_reuse
+func @no_reuse(%A : memref<1024xf32>, %B : memref<1024xf32>) {
+  affine.for %i = 0 to 1024 {
+    %a = load %A[%i] : memref<1024xf32>
+    store %a, %B[%i] : memref<1024xf32>
+  }
+  return
+// CHECK:       affine.for %i0 = 0 to 1024 {
+// CHECK-NEXT:    %0 = load %arg0[%i0] : memref<1024xf32>
+// CHECK-NEXT:    store %0, %arg1[%i0] : memref<1024xf32>
+// CHECK-NEXT:  }
+}
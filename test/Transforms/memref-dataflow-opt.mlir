@@ -247,3 +247,66 @@ func @store_load_store_nested_fwd(%N : index) -> f32 {
 // CHECK-NEXT:  %3 = load %0[%c1] : memref<10xf32>
 // CHECK-NEXT:  return %3 : f32
 }
+
+// The second load reads the element already loaded by the first one.
+// CHECK-LABEL: func @redundant_load
+func @redundant_load(%A : memref<100xf32>, %B : memref<100xf32>) {
+  affine.for %i0 = 0 to 100 {
+    %v0 = load %A[%i0] : memref<100xf32>
+    %idx = affine.apply (d0) -> (d0 + 1) (%i0)
+    store %v0, %B[%idx] : memref<100xf32>
+    %v1 = load %A[%i0] : memref<100xf32>
+    %v2 = addf %v0, %v1 : f32
+    store %v2, %B[%i0] : memref<100xf32>
+  }
+  return
+// CHECK:       affine.for %i0 = 0 to 100 {
+// CHECK-NEXT:    %0 = load %arg0[%i0] : memref<100xf32>
+// CHECK-NEXT:    %1 = affine.apply [[MAP4]](%i0)
+// CHECK-NEXT:    store %0, %arg1[%1] : memref<100xf32>
+// CHECK-NEXT:    %2 = addf %0, %0 : f32
+// CHECK-NEXT:    store %2, %arg1[%i0] : memref<100xf32>
+// CHECK-NEXT:  }
+// CHECK-NEXT:  return
+}
+
+// The first store in the loop is overwritten before being read, while the store
+// before the call is kept since the call may read it.
+// CHECK-LABEL: func @dead_store
+func @dead_store(%A : memref<100xf32>, %x : f32, %y : f32) -> f32 {
+  %c0 = constant 0 : index
+  affine.for %i0 = 0 to 100 {
+    store %x, %A[%i0] : memref<100xf32>
+    store %y, %A[%i0] : memref<100xf32>
+  }
+  store %x, %A[%c0] : memref<100xf32>
+  %v = load %A[%c0] : memref<100xf32>
+  "foo"(%A) : (memref<100xf32>) -> ()
+  store %y, %A[%c0] : memref<100xf32>
+  return %v : f32
+// CHECK:       affine.for %i0 = 0 to 100 {
+// CHECK-NEXT:    store %arg2, %arg0[%i0] : memref<100xf32>
+// CHECK-NEXT:  }
+// CHECK-NEXT:  store %arg1, %arg0[%c0] : memref<100xf32>
+// CHECK-NEXT:  "foo"(%arg0) : (memref<100xf32>) -> ()
+// CHECK-NEXT:  store %arg2, %arg0[%c0] : memref<100xf32>
+// CHECK-NEXT:  return %arg1 : f32
+}
+
+// The accesses through a cast of a memref access the elements of the memref:
+// the second load reads the value stored through the memref rather than the
+// one loaded first, and that store is overwritten through the cast.
+// CHECK-LABEL: func @memref_cast
+func @memref_cast(%A : memref<100xf32>, %x : f32, %y : f32) -> (f32, f32) {
+  %c0 = constant 0 : index
+  %C = memref_cast %A : memref<100xf32> to memref<?xf32>
+  %v0 = load %C[%c0] : memref<?xf32>
+  store %x, %A[%c0] : memref<100xf32>
+  %v1 = load %C[%c0] : memref<?xf32>
+  store %y, %C[%c0] : memref<?xf32>
+  return %v0, %v1 : f32, f32
+// CHECK:       %0 = memref_cast %arg0 : memref<100xf32> to memref<?xf32>
+// CHECK-NEXT:  %1 = load %0[%c0] : memref<?xf32>
+// CHECK-NEXT:  store %arg2, %0[%c0] : memref<?xf32>
+// CHECK-NEXT:  return %1, %arg1 : f32, f32
+}
@@ -850,3 +850,39 @@ func @strided_loop_with_loop_carried_dependence_at_depth1() {
   }
   return
 }
+
+// -----
+
+// Stores 0 and 2 perform the same access, and so do load 1 and store 0 modulo
+// the identity affine.apply. Their dependences at depth 2 still depend on their
+// relative order.
+// CHECK-LABEL: func @equivalent_accesses
+func @equivalent_accesses() {
+  %m = alloc() : memref<10xf32>
+  %cf7 = constant 7.0 : f32
+  affine.for %i0 = 0 to 10 {
+    store %cf7, %m[%i0] : memref<10xf32>
+    // expected-note@-1 {{dependence from 0 to 0 at depth 1 = false}}
+    // expected-note@-2 {{dependence from 0 to 0 at depth 2 = false}}
+    // expected-note@-3 {{dependence from 0 to 1 at depth 1 = false}}
+    // expected-note@-4 {{dependence from 0 to 1 at depth 2 = true}}
+    // expected-note@-5 {{dependence from 0 to 2 at depth 1 = false}}
+    // expected-note@-6 {{dependence from 0 to 2 at depth 2 = true}}
+    %a0 = affine.apply (d0) -> (d0)(%i0)
+    %v0 = load %m[%a0] : memref<10xf32>
+    // expected-note@-1 {{dependence from 1 to 0 at depth 1 = false}}
+    // expected-note@-2 {{dependence from 1 to 0 at depth 2 = false}}
+    // expected-note@-3 {{dependence from 1 to 1 at depth 1 = false}}
+    // expected-note@-4 {{dependence from 1 to 1 at depth 2 = false}}
+    // expected-note@-5 {{dependence from 1 to 2 at depth 1 = false}}
+    // expected-note@-6 {{dependence from 1 to 2 at depth 2 = true}}
+    store %cf7, %m[%i0] : memref<10xf32>
+    // expected-note@-1 {{dependence from 2 to 0 at depth 1 = false}}
+    // expected-note@-2 {{dependence from 2 to 0 at depth 2 = false}}
+    // expected-note@-3 {{dependence from 2 to 1 at depth 1 = false}}
+    // expected-note@-4 {{dependence from 2 to 1 at depth 2 = false}}
+    // expected-note@-5 {{dependence from 2 to 2 at depth 1 = false}}
+    // expected-note@-6 {{dependence from 2 to 2 at depth 2 = false}}
+  }
+  return
+}
@@ -1,4 +1,4 @@
-// RUN: mlir-opt %s -test-detect-parallel -split-input-file -verify | FileCheck %s
+// RUN: mlir-opt %s -test-detect-parallel -test-detect-parallel-reassociate-fp -split-input-file -verify | FileCheck %s
 
 // CHECK-LABEL: func @loop_nest_3d_outer_two_parallel
 func @loop_nest_3d_outer_two_parallel(%N : index) {
@@ -10,14 +10,65 @@ func @loop_nest_3d_outer_two_parallel(%N : index) {
     affine.for %j = 0 to %N {
     // expected-note@-1 {{parallel loop}}
       affine.for %k = 0 to %N {
+      // expected-note@-1 {{parallel loop with reductions}}
         %5 = load %0[%i, %k] : memref<1024x1024xvector<64xf32>>
         %6 = load %1[%k, %j] : memref<1024x1024xvector<64xf32>>
         %7 = load %2[%i, %j] : memref<1024x1024xvector<64xf32>>
         %8 = mulf %5, %6 : vector<64xf32>
         %9 = addf %7, %8 : vector<64xf32>
         store %9, %2[%i, %j] : memref<1024x1024xvector<64xf32>>
+        // expected-note@-1 {{add reduction}}
       }
     }
   }
   return
 }
+
+// -----
+
+// CHECK-LABEL: func @reductions
+func @reductions(%A : memref<1024xi32>, %sum : memref<i32>, %max : memref<i32>, %min : memref<1xi32>) {
+  %c0 = constant 0 : index
+  affine.for %i = 0 to 1024 {
+  // expected-note@-1 {{parallel loop with reductions}}
+    %a = load %A[%i] : memref<1024xi32>
+    %s = load %sum[] : memref<i32>
+    %s1 = addi %a, %s : i32
+    store %s1, %sum[] : memref<i32>
+    // expected-note@-1 {{add reduction}}
+    %m = load %max[] : memref<i32>
+    %c = cmpi "sgt", %m, %a : i32
+    %m1 = select %c, %m, %a : i32
+    store %m1, %max[] : memref<i32>
+    // expected-note@-1 {{max reduction}}
+    %n = load %min[%c0] : memref<1xi32>
+    %d = cmpi "ult", %a, %n : i32
+    %n1 = select %d, %a, %n : i32
+    store %n1, %min[%c0] : memref<1xi32>
+    // expected-note@-1 {{min reduction}}
+  }
+  return
+}
+
+// -----
+
+// CHECK-LABEL: func @not_reductions
+func @not_reductions(%A : memref<1024xf32>, %sum : memref<f32>, %B : memref<1024xf32>) {
+  // The accumulator is also read by another load.
+  affine.for %i = 0 to 1024 {
+    %a = load %A[%i] : memref<1024xf32>
+    %s = load %sum[] : memref<f32>
+    %s1 = addf %a, %s : f32
+    store %s1, %sum[] : memref<f32>
+    %t = load %sum[] : memref<f32>
+    store %t, %B[%i] : memref<1024xf32>
+  }
+  // The combiner is not associative.
+  affine.for %k = 0 to 1024 {
+    %a = load %A[%k] : memref<1024xf32>
+    %s = load %sum[] : memref<f32>
+    %s1 = subf %s, %a : f32
+    store %s1, %sum[] : memref<f32>
+  }
+  return
+}
@@ -0,0 +1,240 @@
+// RUN: mlir-opt %s -pipeline-data-transfer | FileCheck %s
+// RUN: mlir-opt %s -pipeline-data-transfer -pipeline-data-transfer-num-buffers=3 | FileCheck %s --check-prefix=THREE
+// RUN: mlir-opt %s -pass-pipeline='func(pipeline-data-transfer{num-buffers=0 fast-mem-capacity=2})' | FileCheck %s --check-prefix=FOUR
+// RUN: mlir-opt %s -pass-pipeline='func(pipeline-data-transfer{num-buffers=0 fast-mem-capacity=1})' | FileCheck %s --check-prefix=CAP1
+// RUN: mlir-opt %s -pipeline-data-transfer -pipeline-data-transfer-num-buffers=0 -pipeline-data-transfer-fast-mem-capacity=0 | FileCheck %s --check-prefix=NOFIT
+// RUN: mlir-opt %s -pass-pipeline='func(pipeline-data-transfer{compute-stages=true})' | FileCheck %s --check-prefix=STAGES
+
+// The same loop pipelined with two, three, and a number of buffers picked from
+// the fast memory capacity: DMAs are started one iteration ahead of their use
+// per additional buffer.
+
+// CHECK-LABEL: func @dma_num_buffers
+// THREE-LABEL: func @dma_num_buffers
+// FOUR-LABEL: func @dma_num_buffers
+// CAP1-LABEL: func @dma_num_buffers
+// NOFIT-LABEL: func @dma_num_buffers
+func @dma_num_buffers(%A: memref<4096xf32>) {
+  %Ah = alloc() : memref<128xf32, 1>
+  %tag = alloc() : memref<1xi32>
+  %c0 = constant 0 : index
+  %c128 = constant 128 : index
+  affine.for %i = 0 to 4096 step 128 {
+    dma_start %A[%i], %Ah[%c0], %c128, %tag[%c0] : memref<4096xf32>, memref<128xf32, 1>, memref<1xi32>
+    dma_wait %tag[%c0], %c128 : memref<1xi32>
+    %v = load %Ah[%c0] : memref<128xf32, 1>
+    "compute"(%v) : (f32) -> ()
+  }
+  dealloc %Ah : memref<128xf32, 1>
+  return
+}
+// CHECK:      [[BUF:%[0-9]+]] = alloc() : memref<2x128xf32, 1>
+// CHECK-NEXT: [[TAG:%[0-9]+]] = alloc() : memref<2x1xi32>
+// CHECK:      dma_start %arg0[
+// CHECK:      affine.for %i0 = 128 to 4096 step 128 {
+// CHECK:        dma_start %arg0[%i0], [[BUF]][{{.*}}], %c128, [[TAG]][{{.*}}]
+// CHECK:        dma_wait [[TAG]][
+// CHECK:        load [[BUF]][
+// CHECK:        "compute"
+// CHECK-NEXT: }
+// CHECK:      dma_wait [[TAG]][
+// CHECK:      dealloc [[TAG]] : memref<2x1xi32>
+// CHECK-NEXT: dealloc [[BUF]] : memref<2x128xf32, 1>
+
+// THREE:      [[BUF:%[0-9]+]] = alloc() : memref<3x128xf32, 1>
+// THREE-NEXT: [[TAG:%[0-9]+]] = alloc() : memref<3x1xi32>
+// THREE-NEXT: affine.for %i0 = 0 to 256 step 128 {
+// THREE:        dma_start %arg0[%i0], [[BUF]][{{.*}}], %c128, [[TAG]][{{.*}}]
+// THREE-NEXT: }
+// THREE-NEXT: affine.for %i1 = 256 to 4096 step 128 {
+// THREE:        dma_start %arg0[%i1], [[BUF]][{{.*}}], %c128, [[TAG]][{{.*}}]
+// THREE:        dma_wait [[TAG]][
+// THREE:        load [[BUF]][
+// THREE:        "compute"
+// THREE-NEXT: }
+// THREE-NEXT: affine.for %i2 = 4096 to 4352 step 128 {
+// THREE:        dma_wait [[TAG]][
+// THREE:        load [[BUF]][
+// THREE:        "compute"
+// THREE-NEXT: }
+// THREE-NEXT: dealloc [[TAG]] : memref<3x1xi32>
+// THREE-NEXT: dealloc [[BUF]] : memref<3x128xf32, 1>
+
+// Four buffers of 512 bytes fit in 2 KiB.
+// FOUR:      [[BUF:%[0-9]+]] = alloc() : memref<4x128xf32, 1>
+// FOUR-NEXT: [[TAG:%[0-9]+]] = alloc() : memref<4x1xi32>
+// FOUR-NEXT: affine.for %i0 = 0 to 384 step 128 {
+// FOUR:        dma_start %arg0[%i0]
+// FOUR-NEXT: }
+// FOUR-NEXT: affine.for %i1 = 384 to 4096 step 128 {
+// FOUR:        dma_start %arg0[%i1]
+// FOUR:        dma_wait [[TAG]][
+// FOUR:      affine.for %i2 = 4096 to 4480 step 128 {
+// FOUR:        dma_wait [[TAG]][
+
+// Only double buffering fits in 1 KiB.
+// CAP1:      alloc() : memref<2x128xf32, 1>
+// CAP1-NEXT: alloc() : memref<2x1xi32>
+// CAP1:      affine.for %i0 = 128 to 4096 step 128 {
+
+// Not even double buffering fits; the loop is left alone.
+// NOFIT:      alloc() : memref<128xf32, 1>
+// NOFIT:      affine.for %i0 = 0 to 4096 step 128 {
+// NOFIT-NEXT:   dma_start %arg0[%i0], %0[%c0], %c128, %1[%c0]
+// NOFIT-NEXT:   dma_wait %1[%c0], %c128
+// NOFIT-NOT:  memref<2x
+
+// The loop nests of the body are pipelined as two compute stages passing
+// values through %tmp, which gets a buffer for each of the two iterations in
+// flight between the stages.
+
+// CHECK-LABEL: func @compute_stages
+// STAGES-LABEL: func @compute_stages
+func @compute_stages(%A: memref<512xf32>, %B: memref<512xf32>) {
+  %Ah = alloc() : memref<32xf32, 1>
+  %tmp = alloc() : memref<32xf32, 1>
+  %tag = alloc() : memref<1xi32>
+  %c0 = constant 0 : index
+  %c32 = constant 32 : index
+  affine.for %i = 0 to 512 step 32 {
+    dma_start %A[%i], %Ah[%c0], %c32, %tag[%c0] : memref<512xf32>, memref<32xf32, 1>, memref<1xi32>
+    dma_wait %tag[%c0], %c32 : memref<1xi32>
+    affine.for %j = 0 to 32 {
+      %v = load %Ah[%j] : memref<32xf32, 1>
+      %r = "compute"(%v) : (f32) -> f32
+      store %r, %tmp[%j] : memref<32xf32, 1>
+    }
+    affine.for %k = 0 to 32 {
+      %t = load %tmp[%k] : memref<32xf32, 1>
+      %idx = affine.apply (d0, d1) -> (d0 + d1)(%i, %k)
+      store %t, %B[%idx] : memref<512xf32>
+    }
+  }
+  dealloc %tmp : memref<32xf32, 1>
+  dealloc %Ah : memref<32xf32, 1>
+  return
+}
+// Without compute stages, both loop nests are shifted alike and %tmp is left
+// alone.
+// CHECK:      [[TMP:%[0-9]+]] = alloc() : memref<32xf32, 1>
+// CHECK:      alloc() : memref<2x32xf32, 1>
+// CHECK-NEXT: alloc() : memref<2x1xi32>
+// CHECK:      affine.for %i{{[0-9]+}} = 32 to 512 step 32 {
+// CHECK:        dma_start %arg0[
+// CHECK:        dma_wait
+// CHECK:        affine.for %i{{[0-9]+}} = 0 to 32 {
+// CHECK:          store %{{.*}}, [[TMP]][
+// CHECK:        }
+// CHECK-NEXT:   affine.for %i{{[0-9]+}} = 0 to 32 {
+// CHECK:          load [[TMP]][
+// CHECK:          store %{{.*}}, %arg1[
+// CHECK:        }
+// CHECK-NEXT: }
+
+// With compute stages, the DMA runs one iteration ahead of the first stage,
+// which in turn runs one iteration ahead of the second one.
+// STAGES:      [[BUF:%[0-9]+]] = alloc() : memref<2x32xf32, 1>
+// STAGES-NEXT: [[TAG:%[0-9]+]] = alloc() : memref<2x1xi32>
+// STAGES-NEXT: [[TMP:%[0-9]+]] = alloc() : memref<2x32xf32, 1>
+// STAGES:      dma_start %arg0[
+// STAGES-NOT:  affine.for
+// STAGES:      dma_start %arg0[
+// STAGES:      dma_wait [[TAG]][
+// STAGES:      affine.for %i{{[0-9]+}} = 0 to 32 {
+// STAGES:        store %{{.*}}, [[TMP]][
+// STAGES:      affine.for %i{{[0-9]+}} = 64 to 512 step 32 {
+// STAGES:        dma_start %arg0[
+// STAGES:        dma_wait [[TAG]][
+// STAGES:        affine.for %i{{[0-9]+}} = 0 to 32 {
+// STAGES:          load [[BUF]][
+// STAGES:          store %{{.*}}, [[TMP]][
+// STAGES:        }
+// STAGES:        affine.for %i{{[0-9]+}} = 0 to 32 {
+// STAGES:          load [[TMP]][
+// STAGES:          store %{{.*}}, %arg1[
+// STAGES:        }
+// STAGES-NEXT: }
+// STAGES:      dma_wait [[TAG]][
+// STAGES:      store %{{.*}}, [[TMP]][
+// STAGES:      load [[TMP]][
+// STAGES:      load [[TMP]][
+// STAGES-NOT:  dma_
+// STAGES:      dealloc
+
+// %acc carries values from the second loop nest back to the first one of the
+// next iteration; the stages can't be shifted with respect to each other.
+
+// STAGES-LABEL: func @compute_stages_not_bufferable
+func @compute_stages_not_bufferable(%A: memref<512xf32>, %acc: memref<32xf32>) {
+  %Ah = alloc() : memref<32xf32, 1>
+  %tag = alloc() : memref<1xi32>
+  %c0 = constant 0 : index
+  %c32 = constant 32 : index
+  affine.for %i = 0 to 512 step 32 {
+    dma_start %A[%i], %Ah[%c0], %c32, %tag[%c0] : memref<512xf32>, memref<32xf32, 1>, memref<1xi32>
+    dma_wait %tag[%c0], %c32 : memref<1xi32>
+    affine.for %j = 0 to 32 {
+      %v = load %Ah[%j] : memref<32xf32, 1>
+      %a = load %acc[%j] : memref<32xf32>
+      %s = addf %v, %a : f32
+      store %s, %Ah[%j] : memref<32xf32, 1>
+    }
+    affine.for %k = 0 to 32 {
+      %t = load %Ah[%k] : memref<32xf32, 1>
+      store %t, %acc[%k] : memref<32xf32>
+    }
+  }
+  dealloc %Ah : memref<32xf32, 1>
+  return
+}
+// STAGES:      alloc() : memref<2x32xf32, 1>
+// STAGES-NEXT: alloc() : memref<2x1xi32>
+// STAGES:      affine.for %i{{[0-9]+}} = 32 to 512 step 32 {
+// STAGES:        dma_start %arg0[
+// STAGES:        affine.for %i{{[0-9]+}} = 0 to 32 {
+// STAGES:          load %arg1[
+// STAGES:        affine.for %i{{[0-9]+}} = 0 to 32 {
+// STAGES:          store %{{.*}}, %arg1[
+// STAGES:        }
+// STAGES-NEXT: }
+
+// The second loop nest reads elements of %tmp that the first one only wrote in
+// an earlier iteration; multi-buffering %tmp would make it read other values.
+
+// STAGES-LABEL: func @compute_stages_partial_rewrite
+func @compute_stages_partial_rewrite(%A: memref<512xf32>, %B: memref<512xf32>) {
+  %Ah = alloc() : memref<32xf32, 1>
+  %tmp = alloc() : memref<32xf32, 1>
+  %tag = alloc() : memref<1xi32>
+  %c0 = constant 0 : index
+  %c32 = constant 32 : index
+  affine.for %i = 0 to 512 step 32 {
+    dma_start %A[%i], %Ah[%c0], %c32, %tag[%c0] : memref<512xf32>, memref<32xf32, 1>, memref<1xi32>
+    dma_wait %tag[%c0], %c32 : memref<1xi32>
+    affine.for %j = 0 to 16 {
+      %v = load %Ah[%j] : memref<32xf32, 1>
+      store %v, %tmp[%j] : memref<32xf32, 1>
+    }
+    affine.for %k = 0 to 32 {
+      %t = load %tmp[%k] : memref<32xf32, 1>
+      %idx = affine.apply (d0, d1) -> (d0 + d1)(%i, %k)
+      store %t, %B[%idx] : memref<512xf32>
+    }
+  }
+  dealloc %tmp : memref<32xf32, 1>
+  dealloc %Ah : memref<32xf32, 1>
+  return
+}
+// STAGES:      [[TMP:%[0-9]+]] = alloc() : memref<32xf32, 1>
+// STAGES:      alloc() : memref<2x32xf32, 1>
+// STAGES-NEXT: alloc() : memref<2x1xi32>
+// STAGES:      affine.for %i{{[0-9]+}} = 32 to 512 step 32 {
+// STAGES:        dma_start %arg0[
+// STAGES:        affine.for %i{{[0-9]+}} = 0 to 16 {
+// STAGES:          store %{{.*}}, [[TMP]][
+// STAGES:        }
+// STAGES-NEXT:   affine.for %i{{[0-9]+}} = 0 to 32 {
+// STAGES:          load [[TMP]][
+// STAGES:          store %{{.*}}, %arg1[
+// STAGES:        }
+// STAGES-NEXT: }
@@ -52,7 +52,7 @@ llvm_config.with_environment('PATH', config.llvm_tools_dir, append_path=True)
 
 tool_dirs = [config.mlir_tools_dir, config.llvm_tools_dir]
 tools = [
-    'mlir-opt', 'mlir-tblgen', 'mlir-translate',
+    'mlir-opt', 'mlir-reduce', 'mlir-tblgen', 'mlir-translate', 'mlir-tune',
 ]
 
 # The following tools are optional
@@ -65,3 +65,8 @@ tools.extend([
 ])
 
 llvm_config.add_tool_substitutions(tools, tool_dirs)
+
+# The generator of the synthetic inputs of the benchmark tests.
+config.substitutions.append(('%generate_benchmark', '"%s" "%s"' % (
+    config.python_executable,
+    os.path.join(config.mlir_src_root, 'utils', 'benchmark', 'generate.py'))))
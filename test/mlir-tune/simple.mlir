@@ -0,0 +1,37 @@
+// RUN: rm -f %t.db
+// RUN: mlir-tune %s -tune-tile-sizes=4,8 -tune-unroll-factors=2 -warmup=0 -repeats=1 -results-db=%t.db | FileCheck %s
+// RUN: FileCheck %s --check-prefix=DB < %t.db
+// RUN: mlir-tune %s -e foo -tune-tile-sizes=0,4,8 -max-variants=1 -repeats=1 -results-db=%t.db
+// RUN: FileCheck %s --check-prefix=SAMPLE < %t.db
+
+func @main(%A : memref<16x16xf32>, %B : memref<16x16xf32>) {
+  affine.for %i = 0 to 16 {
+    affine.for %j = 0 to 16 {
+      %a = load %A[%i, %j] : memref<16x16xf32>
+      %b = addf %a, %a : f32
+      store %b, %B[%i, %j] : memref<16x16xf32>
+    }
+  }
+  return
+}
+
+func @foo(%A : memref<16xf32>) {
+  affine.for %i = 0 to 16 {
+    %a = load %A[%i] : memref<16xf32>
+    %b = mulf %a, %a : f32
+    store %b, %A[%i] : memref<16xf32>
+  }
+  return
+}
+
+// The fastest variant is printed as a pass pipeline.
+// CHECK: func(loop-tile{tile-size={{4|8}}},loop-unroll{unroll-factor=2})
+
+// DB-DAG: "function":"main",{{.*}}"pipeline":"func(loop-tile{tile-size=4},loop-unroll{unroll-factor=2})",{{.*}}"status":"ok",{{.*}}"tile_size":4
+// DB-DAG: "function":"main",{{.*}}"pipeline":"func(loop-tile{tile-size=8},loop-unroll{unroll-factor=2})",{{.*}}"status":"ok",{{.*}}"tile_size":8
+
+// A single variant of @foo is sampled, and appended to the database.
+// SAMPLE: "function":"main"
+// SAMPLE-NEXT: "function":"main"
+// SAMPLE-NEXT: "function":"foo"
+// SAMPLE-NOT: "function"
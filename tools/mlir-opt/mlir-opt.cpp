@@ -68,6 +68,12 @@ static cl::opt<bool>
                  cl::desc("Run the verifier after each transformation pass"),
                  cl::init(true));
 
+static cl::opt<std::string> passPipeline(
+    "pass-pipeline",
+    cl::desc("A textual description of the pass pipeline to run, e.g. "
+             "'module(func(cse,canonicalize),loop-fusion{maximal})'"),
+    cl::init(""));
+
 static std::vector<const mlir::PassRegistryEntry *> *passList;
 
 enum OptResult { OptSuccess, OptFailure };
@@ -127,11 +133,17 @@ static OptResult performActions(SourceMgr &sourceMgr, MLIRContext *context) {
 
   // Run each of the passes that were selected.
   PassManager pm(verifyPasses);
-  for (const auto *passEntry : *passList)
-    passEntry->addToPipeline(pm);
+  if (!passPipeline.empty()) {
+    if (failed(parsePassPipeline(passPipeline, pm, llvm::errs())))
+      return OptFailure;
+  } else {
+    for (const auto *passEntry : *passList)
+      passEntry->addToPipeline(pm);
+  }
 
   // Apply any pass manager command line options.
-  applyPassManagerCLOptions(pm);
+  if (failed(applyPassManagerCLOptions(pm)))
+    return OptFailure;
 
   // Run the pipeline.
   if (failed(pm.run(module.get())))
@@ -376,6 +388,13 @@ int main(int argc, char **argv) {
   ::passList = &passList;
   cl::ParseCommandLineOptions(argc, argv, "MLIR modular optimizer driver\n");
 
+  // A textual pass pipeline replaces the individual pass flags.
+  if (!passPipeline.empty() && !passList.empty()) {
+    llvm::errs() << "'-pass-pipeline' cannot be combined with individual pass "
+                    "options\n";
+    return OptFailure;
+  }
+
   // Set up the input file.
   std::string errorMessage;
   auto file = openInputFile(inputFilename, &errorMessage);
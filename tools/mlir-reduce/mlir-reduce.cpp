@@ -0,0 +1,630 @@
+//===- mlir-reduce.cpp - MLIR Test Case Reduction Tool --------------------===//
+//
+// Copyright 2019 The MLIR Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =============================================================================
+//
+// This is a utility that reduces a failing 'mlir-opt' test case, e.g. a crash
+// reproducer generated by the pass manager, to a smaller test case that still
+// fails. The reduction removes passes from the pipeline, functions from the
+// module, and operations from the remaining functions. Each candidate is
+// checked by running 'mlir-opt' in a separate process, and the candidates of a
+// given reduction step are checked in parallel.
+//
+//===----------------------------------------------------------------------===//
+
+#include "mlir/IR/Attributes.h"
+#include "mlir/IR/Function.h"
+#include "mlir/IR/MLIRContext.h"
+#include "mlir/IR/Module.h"
+#include "mlir/Parser.h"
+#include "mlir/Support/FileUtilities.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/Regex.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/ToolOutputFile.h"
+
+using namespace mlir;
+using namespace llvm;
+
+static cl::opt<std::string> inputFilename(cl::Positional,
+                                          cl::desc("<input file>"),
+                                          cl::init("-"));
+
+static cl::opt<std::string> outputFilename("o", cl::desc("Output filename"),
+                                           cl::value_desc("filename"),
+                                           cl::init("-"));
+
+static cl::opt<std::string> optTool(
+    "opt-tool",
+    cl::desc("The 'mlir-opt' executable used to check each test case. "
+             "Defaults to the 'mlir-opt' next to this executable"),
+    cl::value_desc("path"));
+
+static cl::opt<std::string> pipelineArgs(
+    "pipeline",
+    cl::desc("The 'mlir-opt' arguments that cause the failure. Defaults to "
+             "the '// configuration:' line of the input file"),
+    cl::value_desc("arguments"));
+
+static cl::opt<std::string> failureRegex(
+    "match",
+    cl::desc("Only consider a test case as failing if the error output of "
+             "'mlir-opt' matches the given regex"),
+    cl::value_desc("regex"));
+
+static cl::opt<unsigned> numThreads(
+    "j",
+    cl::desc("The number of test cases to check concurrently. Defaults to "
+             "the number of hardware threads"),
+    cl::init(0));
+
+/// The prefix of the line in a reproducer that describes the pipeline.
+static constexpr const char *kConfigurationPrefix = "// configuration:";
+
+/// The prefix of the 'mlir-opt' argument providing a textual pass pipeline.
+static constexpr const char *kPassPipelinePrefix = "-pass-pipeline=";
+
+namespace {
+/// A pass within a textual pass pipeline, along with the function scope that
+/// it is nested within. Passes with the same non-zero scope are printed within
+/// the same 'func' scope, and passes with a zero scope are printed at module
+/// scope.
+struct PipelinePass {
+  std::string pass;
+  unsigned scope;
+};
+
+/// A single test case, i.e. a module along with the 'mlir-opt' arguments used
+/// to process it. If the arguments included a textual pass pipeline, the
+/// passes of the pipeline are held separately so that they may be reduced
+/// individually.
+struct TestCase {
+  std::string module;
+  std::vector<std::string> args;
+  std::vector<PipelinePass> pipeline;
+};
+
+/// A generator for reduced test cases. Given a test case and a range of
+/// elements to remove, returns the reduced test case or None if the range
+/// could not be removed.
+using ReductionFn =
+    std::function<Optional<TestCase>(const TestCase &, unsigned, unsigned)>;
+
+/// Returns the number of reducible elements within a test case.
+using CountFn = std::function<unsigned(const TestCase &)>;
+
+/// This class drives the reduction of a test case.
+class Reducer {
+public:
+  Reducer(StringRef optTool, Optional<Regex> &&matcher, unsigned numThreads)
+      : optTool(optTool), matcher(std::move(matcher)),
+        threadPool(numThreads ? numThreads : llvm::hardware_concurrency()) {}
+
+  /// Returns true if the given test case still exhibits the failure.
+  bool isInteresting(const TestCase &testCase);
+
+  /// Reduce the given test case by repeatedly removing chunks of the elements
+  /// enumerated by 'countFn', in the style of delta debugging. Returns true if
+  /// the test case was reduced.
+  bool reduce(TestCase &testCase, StringRef kind, const CountFn &countFn,
+              const ReductionFn &reductionFn);
+
+private:
+  /// The 'mlir-opt' executable used to check test cases.
+  std::string optTool;
+
+  /// An optional matcher for the failure output.
+  Optional<Regex> matcher;
+
+  /// The thread pool used to check candidates concurrently.
+  ThreadPool threadPool;
+};
+} // end anonymous namespace
+
+/// Parse the given module in a fresh context, returning null on failure. Any
+/// diagnostics are dropped.
+static std::unique_ptr<Module> parseModule(StringRef moduleStr,
+                                           MLIRContext &context) {
+  context.registerDiagnosticHandler(
+      [](Location, StringRef, MLIRContext::DiagnosticKind) {});
+  return std::unique_ptr<Module>(parseSourceString(moduleStr, &context));
+}
+
+/// Print the given module to a string.
+static std::string printModule(Module &module) {
+  std::string result;
+  llvm::raw_string_ostream os(result);
+  module.print(os);
+  return os.str();
+}
+
+/// Split the given textual pass pipeline into its passes. Returns false if the
+/// pipeline contains an unknown scope.
+static bool parsePipeline(StringRef pipeline,
+                          std::vector<PipelinePass> &passes) {
+  unsigned scope = 0, numScopes = 0;
+  bool inOptions = false;
+  std::string current;
+  auto addPass = [&] {
+    StringRef pass = StringRef(current).trim();
+    if (!pass.empty())
+      passes.push_back({pass.str(), scope});
+    current.clear();
+  };
+  bool inQuotes = false, isEscaped = false;
+  for (char c : pipeline) {
+    // Pass options may contain any character but '}', outside of a quoted
+    // value.
+    if (inOptions || c == '{') {
+      if (isEscaped)
+        isEscaped = false;
+      else if (inQuotes && c == '\\')
+        isEscaped = true;
+      else if (c == '"')
+        inQuotes = !inQuotes;
+      else
+        inOptions = inQuotes || c != '}';
+      current += c;
+      continue;
+    }
+    switch (c) {
+    case '(': {
+      StringRef name = StringRef(current).trim();
+      if (name != "func" && name != "module")
+        return false;
+      scope = name == "func" ? ++numScopes : 0;
+      current.clear();
+      break;
+    }
+    case ')':
+      addPass();
+      scope = 0;
+      break;
+    case ',':
+      addPass();
+      break;
+    default:
+      current += c;
+    }
+  }
+  addPass();
+  return true;
+}
+
+/// Print the given passes as a textual pass pipeline.
+static std::string printPipeline(ArrayRef<PipelinePass> passes) {
+  std::string result;
+  llvm::raw_string_ostream os(result);
+  for (unsigned i = 0, e = passes.size(); i != e;) {
+    if (i != 0)
+      os << ',';
+    unsigned scope = passes[i].scope;
+    if (scope == 0) {
+      os << passes[i++].pass;
+      continue;
+    }
+    os << "func(" << passes[i++].pass;
+    for (; i != e && passes[i].scope == scope; ++i)
+      os << ',' << passes[i].pass;
+    os << ')';
+  }
+  return os.str();
+}
+
+/// Returns the 'mlir-opt' arguments of the given test case, including the
+/// textual pass pipeline if there is one.
+static std::vector<std::string> getOptArgs(const TestCase &testCase) {
+  std::vector<std::string> args = testCase.args;
+  if (!testCase.pipeline.empty())
+    args.push_back(kPassPipelinePrefix + printPipeline(testCase.pipeline));
+  return args;
+}
+
+/// Split the given configuration into 'mlir-opt' arguments. Arguments are
+/// separated by spaces, single quotes group an argument containing spaces, and
+/// a backslash outside of quotes escapes the next character, as in a shell
+/// command.
+static std::vector<std::string> splitArgs(StringRef config) {
+  std::vector<std::string> args;
+  std::string current;
+  bool inQuotes = false, inArg = false;
+  for (unsigned i = 0, e = config.size(); i != e; ++i) {
+    char c = config[i];
+    if (!inQuotes && c == '\\' && i + 1 != e) {
+      current += config[++i];
+      inArg = true;
+    } else if (c == '\'') {
+      inQuotes = !inQuotes;
+      inArg = true;
+    } else if (!inQuotes && isspace(c)) {
+      if (inArg)
+        args.push_back(std::move(current));
+      current.clear();
+      inArg = false;
+    } else {
+      current += c;
+      inArg = true;
+    }
+  }
+  if (inArg)
+    args.push_back(std::move(current));
+  return args;
+}
+
+/// Write the given contents to a new temporary file, returning the path of
+/// the file.
+static Optional<std::string> writeTemporaryFile(StringRef contents) {
+  int fd;
+  SmallString<128> path;
+  if (sys::fs::createTemporaryFile("mlir-reduce", "mlir", fd, path))
+    return llvm::None;
+  raw_fd_ostream os(fd, /*shouldClose=*/true);
+  os << contents;
+  return std::string(path.str());
+}
+
+bool Reducer::isInteresting(const TestCase &testCase) {
+  // Only consider test cases that are valid, otherwise the failure is simply a
+  // parse or verification error.
+  {
+    MLIRContext context;
+    auto module = parseModule(testCase.module, context);
+    if (!module || failed(module->verify()))
+      return false;
+  }
+
+  auto inputFile = writeTemporaryFile(testCase.module);
+  auto errorFile = writeTemporaryFile("");
+  if (!inputFile || !errorFile)
+    return false;
+
+  std::vector<std::string> optArgs = getOptArgs(testCase);
+  std::vector<StringRef> args{optTool};
+  for (auto &arg : optArgs)
+    args.push_back(arg);
+  args.push_back(*inputFile);
+  args.push_back("-o");
+  args.push_back("/dev/null");
+
+  Optional<StringRef> redirects[] = {llvm::None, StringRef(""),
+                                     StringRef(*errorFile)};
+  bool executionFailed = false;
+  int result = sys::ExecuteAndWait(optTool, args, /*Env=*/llvm::None,
+                                   redirects, /*SecondsToWait=*/0,
+                                   /*MemoryLimit=*/0, /*ErrMsg=*/nullptr,
+                                   &executionFailed);
+
+  // Check the error output against the failure matcher.
+  bool interesting = !executionFailed && result != 0;
+  if (interesting && matcher) {
+    auto errorOutput = MemoryBuffer::getFile(*errorFile);
+    interesting = errorOutput && matcher->match((*errorOutput)->getBuffer());
+  }
+
+  sys::fs::remove(*inputFile);
+  sys::fs::remove(*errorFile);
+  return interesting;
+}
+
+bool Reducer::reduce(TestCase &testCase, StringRef kind, const CountFn &countFn,
+                     const ReductionFn &reductionFn) {
+  bool changed = false;
+  unsigned numElements = countFn(testCase);
+  unsigned chunkSize = std::max(1u, numElements / 2);
+  while (numElements != 0) {
+    chunkSize = std::min(chunkSize, numElements);
+
+    // Generate a candidate for each chunk of elements.
+    std::vector<TestCase> candidates;
+    for (unsigned i = 0; i < numElements; i += chunkSize) {
+      auto candidate =
+          reductionFn(testCase, i, std::min(i + chunkSize, numElements));
+      if (candidate)
+        candidates.push_back(std::move(*candidate));
+    }
+
+    // Check each of the candidates concurrently.
+    std::vector<char> results(candidates.size(), false);
+    for (size_t i = 0, e = candidates.size(); i != e; ++i)
+      threadPool.async(
+          [&, i] { results[i] = isInteresting(candidates[i]); });
+    threadPool.wait();
+
+    // Take the first interesting candidate to keep the reduction
+    // deterministic.
+    auto it = llvm::find(results, true);
+    if (it != results.end()) {
+      testCase = std::move(candidates[it - results.begin()]);
+      numElements = countFn(testCase);
+      changed = true;
+      continue;
+    }
+
+    // Otherwise, try again with a smaller chunk size.
+    if (chunkSize == 1)
+      break;
+    chunkSize /= 2;
+  }
+
+  errs() << "reduced " << kind << " to " << numElements << "\n";
+  return changed;
+}
+
+//===----------------------------------------------------------------------===//
+// Reductions
+//===----------------------------------------------------------------------===//
+
+/// Pass Pipeline: Remove passes from the textual pass pipeline.
+static unsigned countPipelinePasses(const TestCase &testCase) {
+  return testCase.pipeline.size();
+}
+static Optional<TestCase> removePipelinePasses(const TestCase &testCase,
+                                               unsigned begin, unsigned end) {
+  TestCase result = testCase;
+  result.pipeline.erase(result.pipeline.begin() + begin,
+                        result.pipeline.begin() + end);
+  return result;
+}
+
+/// Arguments: Remove other arguments, e.g. passes provided as individual
+/// 'mlir-opt' flags.
+static unsigned countArgs(const TestCase &testCase) {
+  return testCase.args.size();
+}
+static Optional<TestCase> removeArgs(const TestCase &testCase, unsigned begin,
+                                     unsigned end) {
+  TestCase result = testCase;
+  result.args.erase(result.args.begin() + begin, result.args.begin() + end);
+  return result;
+}
+
+/// Returns true if the given function is referenced by an attribute within the
+/// module.
+static bool isReferenced(Function *function, Module &module) {
+  auto referencesFunction = [&](ArrayRef<NamedAttribute> attrs) {
+    return llvm::any_of(attrs, [&](const NamedAttribute &attr) {
+      auto funcAttr = attr.second.dyn_cast<FunctionAttr>();
+      return funcAttr && funcAttr.getValue() == function;
+    });
+  };
+
+  bool referenced = false;
+  for (auto &func : module) {
+    if (referencesFunction(func.getAttrs()))
+      return true;
+    func.walk([&](Operation *op) {
+      referenced |= referencesFunction(op->getAttrs());
+    });
+    if (referenced)
+      return true;
+  }
+  return false;
+}
+
+/// Functions: Remove the bodies of functions, and then erase functions that
+/// are no longer referenced.
+static unsigned countFunctions(const TestCase &testCase) {
+  MLIRContext context;
+  auto module = parseModule(testCase.module, context);
+  return module ? std::distance(module->begin(), module->end()) : 0;
+}
+static Optional<TestCase> removeFunctions(const TestCase &testCase,
+                                          unsigned begin, unsigned end) {
+  MLIRContext context;
+  auto module = parseModule(testCase.module, context);
+  if (!module)
+    return llvm::None;
+
+  std::vector<Function *> functions;
+  for (auto &function : *module)
+    functions.push_back(&function);
+
+  bool changed = false;
+  for (auto *function :
+       llvm::makeArrayRef(functions).slice(begin, end - begin)) {
+    // External functions are erased if they aren't referenced.
+    if (function->isExternal()) {
+      if (!isReferenced(function, *module)) {
+        function->erase();
+        changed = true;
+      }
+      continue;
+    }
+
+    // Otherwise, drop the body to make the function external. References are
+    // dropped first, as values may be used across blocks.
+    for (auto &block : *function)
+      block.dropAllReferences();
+    function->getBlocks().clear();
+    changed = true;
+  }
+  if (!changed)
+    return llvm::None;
+  return TestCase{printModule(*module), testCase.args, testCase.pipeline};
+}
+
+/// Collect the operations that may be removed, i.e. non-terminators, within
+/// the given module.
+static std::vector<Operation *> getRemovableOps(Module &module) {
+  std::vector<Operation *> ops;
+  for (auto &function : module)
+    function.walk([&](Operation *op) {
+      if (!op->isKnownTerminator())
+        ops.push_back(op);
+    });
+  return ops;
+}
+
+/// Operations: Remove operations without any uses from function bodies.
+static unsigned countOperations(const TestCase &testCase) {
+  MLIRContext context;
+  auto module = parseModule(testCase.module, context);
+  return module ? getRemovableOps(*module).size() : 0;
+}
+static Optional<TestCase> removeOperations(const TestCase &testCase,
+                                           unsigned begin, unsigned end) {
+  MLIRContext context;
+  auto module = parseModule(testCase.module, context);
+  if (!module)
+    return llvm::None;
+
+  // Collect the operations to remove. Operations whose parents are also being
+  // removed are skipped, as they will be erased along with the parent.
+  auto ops = getRemovableOps(*module);
+  SmallPtrSet<Operation *, 16> opsToRemove(ops.begin() + begin,
+                                           ops.begin() + end);
+  auto hasRemovedParent = [&](Operation *op) {
+    for (auto *parent = op->getParentOp(); parent;
+         parent = parent->getParentOp())
+      if (opsToRemove.count(parent))
+        return true;
+    return false;
+  };
+
+  // Erase the operations in reverse order so that users are erased before the
+  // operations that they use.
+  bool changed = false;
+  auto opRange = llvm::makeArrayRef(ops).slice(begin, end - begin);
+  for (auto *op : llvm::reverse(opRange)) {
+    if (hasRemovedParent(op) || !op->use_empty())
+      continue;
+    op->erase();
+    changed = true;
+  }
+  if (!changed)
+    return llvm::None;
+  return TestCase{printModule(*module), testCase.args, testCase.pipeline};
+}
+
+//===----------------------------------------------------------------------===//
+// Driver
+//===----------------------------------------------------------------------===//
+
+/// Returns the default path to 'mlir-opt', i.e. the one next to this
+/// executable.
+static std::string getDefaultOptTool(const char *argv0) {
+  static int anchor;
+  SmallString<128> path(sys::path::parent_path(
+      sys::fs::getMainExecutable(argv0, &anchor)));
+  sys::path::append(path, "mlir-opt");
+  return path.str().str();
+}
+
+int main(int argc, char **argv) {
+  InitLLVM y(argc, argv);
+  cl::ParseCommandLineOptions(argc, argv, "MLIR test case reduction tool\n");
+
+  std::string errorMessage;
+  auto file = openInputFile(inputFilename, &errorMessage);
+  if (!file) {
+    errs() << errorMessage << "\n";
+    return 1;
+  }
+
+  // Extract the pipeline arguments, either from the command line or from the
+  // configuration line within the input.
+  TestCase testCase;
+  testCase.module = file->getBuffer().str();
+  StringRef config = pipelineArgs;
+  if (config.empty()) {
+    StringRef buffer = file->getBuffer();
+    size_t pos = buffer.find(kConfigurationPrefix);
+    if (pos == StringRef::npos) {
+      errs() << "error: no '" << kConfigurationPrefix
+             << "' line found in the input, and no -pipeline provided\n";
+      return 1;
+    }
+    config = buffer.drop_front(pos + strlen(kConfigurationPrefix))
+                 .take_until([](char c) { return c == '\n'; });
+  }
+  for (auto &arg : splitArgs(config)) {
+    StringRef argRef(arg);
+    if (!argRef.startswith(kPassPipelinePrefix)) {
+      testCase.args.push_back(arg);
+      continue;
+    }
+    if (!testCase.pipeline.empty() ||
+        !parsePipeline(argRef.drop_front(strlen(kPassPipelinePrefix)),
+                       testCase.pipeline)) {
+      errs() << "error: unsupported pass pipeline '" << arg << "'\n";
+      return 1;
+    }
+  }
+
+  // Set up the failure matcher.
+  Optional<Regex> matcher;
+  if (!failureRegex.empty()) {
+    matcher.emplace(failureRegex);
+    std::string regexError;
+    if (!matcher->isValid(regexError)) {
+      errs() << "error: invalid -match regex: " << regexError << "\n";
+      return 1;
+    }
+  }
+
+  Reducer reducer(optTool.empty() ? getDefaultOptTool(argv[0]) : optTool,
+                  std::move(matcher), numThreads);
+  if (!reducer.isInteresting(testCase)) {
+    errs() << "error: the input test case does not fail\n";
+    return 1;
+  }
+
+  // Reduce the test case until a fixed point is reached.
+  bool changed;
+  do {
+    changed = reducer.reduce(testCase, "pipeline", countPipelinePasses,
+                             removePipelinePasses);
+    changed |= reducer.reduce(testCase, "arguments", countArgs, removeArgs);
+    changed |=
+        reducer.reduce(testCase, "functions", countFunctions, removeFunctions);
+    changed |= reducer.reduce(testCase, "operations", countOperations,
+                              removeOperations);
+  } while (changed);
+
+  auto output = openOutputFile(outputFilename, &errorMessage);
+  if (!output) {
+    errs() << errorMessage << "\n";
+    return 1;
+  }
+  auto &os = output->os();
+  os << kConfigurationPrefix;
+  for (auto &arg : testCase.args)
+    os << ' ' << arg;
+  if (!testCase.pipeline.empty()) {
+    os << ' ' << kPassPipelinePrefix << '\'';
+    for (char c : printPipeline(testCase.pipeline)) {
+      if (c == '\'')
+        os << "'\\''";
+      else
+        os << c;
+    }
+    os << '\'';
+  }
+  os << "\n\n";
+
+  // Print the module without any previous configuration comment.
+  MLIRContext context;
+  auto module = parseModule(testCase.module, context);
+  os << printModule(*module);
+  output->keep();
+  return 0;
+}
@@ -0,0 +1,442 @@
+//===- mlir-tune.cpp - MLIR Autotuning Driver -----------------------------===//
+//
+// Copyright 2019 The MLIR Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =============================================================================
+//
+// This is a utility that searches for the parameters of the loop tiling,
+// unroll-and-jam, vectorization and unrolling passes that minimize the
+// execution time of a function. Each point of the tuning space is turned into
+// a textual pass pipeline producing a variant of the input, which is lowered to
+// LLVM IR and JIT-compiled with the ExecutionEngine, then timed over a number
+// of runs after warmup runs. Variants are compiled in parallel and timed one at
+// a time. The pipeline of the fastest variant is printed in the form accepted
+// by 'mlir-opt -pass-pipeline', and the results of all variants can be appended
+// to a database, one JSON object per line. Pipelines can also be provided
+// directly with -pipeline, e.g. to compare the tile sizes selected by a pass
+// with those of another configuration of it.
+//
+//===----------------------------------------------------------------------===//
+
+#include "mlir/ExecutionEngine/ExecutionEngine.h"
+#include "mlir/ExecutionEngine/MemRefUtils.h"
+#include "mlir/ExecutionEngine/OptUtils.h"
+#include "mlir/IR/Function.h"
+#include "mlir/IR/MLIRContext.h"
+#include "mlir/IR/Module.h"
+#include "mlir/LLVMIR/Transforms.h"
+#include "mlir/Parser.h"
+#include "mlir/Pass/PassManager.h"
+#include "mlir/Pass/PassRegistry.h"
+#include "mlir/Support/FileUtilities.h"
+#include "mlir/Transforms/Passes.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+using namespace mlir;
+
+static llvm::cl::opt<std::string> inputFilename(llvm::cl::Positional,
+                                                llvm::cl::desc("<input file>"),
+                                                llvm::cl::init("-"));
+
+static llvm::cl::opt<std::string> outputFilename(
+    "o", llvm::cl::desc("Output filename for the pipeline of the fastest "
+                        "variant"),
+    llvm::cl::value_desc("filename"), llvm::cl::init("-"));
+
+static llvm::cl::opt<std::string> resultsFilename(
+    "results-db",
+    llvm::cl::desc("Append the results of all variants to this file, one JSON "
+                   "object per line"),
+    llvm::cl::value_desc("filename"));
+
+static llvm::cl::opt<std::string>
+    mainFuncName("e", llvm::cl::desc("The function to be tuned"),
+                 llvm::cl::value_desc("<function name>"),
+                 llvm::cl::init("main"));
+
+static llvm::cl::opt<float>
+    initValue("init-value", llvm::cl::desc("Initial value of MemRef elements"),
+              llvm::cl::init(0.0f));
+
+static llvm::cl::opt<unsigned>
+    optLevel("opt-level",
+             llvm::cl::desc("Optimization level of the LLVM passes run on "
+                            "each variant"),
+             llvm::cl::init(3));
+
+static llvm::cl::opt<unsigned>
+    numWarmups("warmup",
+               llvm::cl::desc("The number of untimed runs of each variant"),
+               llvm::cl::init(1));
+
+static llvm::cl::opt<unsigned>
+    numRepeats("repeats",
+               llvm::cl::desc("The number of timed runs of each variant"),
+               llvm::cl::init(5));
+
+static llvm::cl::opt<unsigned> numThreads(
+    "j",
+    llvm::cl::desc("The number of variants to compile concurrently. Defaults "
+                   "to the number of hardware threads"),
+    llvm::cl::init(0));
+
+static llvm::cl::list<std::string> pipelines(
+    "pipeline",
+    llvm::cl::desc("Time the variant produced by this textual pass pipeline "
+                   "instead of those of the tuning space. May be repeated, "
+                   "and empty for no passes"),
+    llvm::cl::ZeroOrMore);
+
+static llvm::cl::OptionCategory tuningCategory("tuning space options");
+
+static llvm::cl::list<unsigned> tileSizes(
+    "tune-tile-sizes",
+    llvm::cl::desc("Candidate tile sizes for all loops of each perfect loop "
+                   "nest, 0 for no tiling"),
+    llvm::cl::CommaSeparated, llvm::cl::cat(tuningCategory));
+
+static llvm::cl::list<unsigned> unrollJamFactors(
+    "tune-unroll-jam-factors",
+    llvm::cl::desc("Candidate unroll-and-jam factors, 1 for no unroll-and-jam"),
+    llvm::cl::CommaSeparated, llvm::cl::cat(tuningCategory));
+
+static llvm::cl::list<unsigned> vectorSizes(
+    "tune-vector-sizes",
+    llvm::cl::desc("Candidate 1-D virtual vector sizes, 0 for no "
+                   "vectorization"),
+    llvm::cl::CommaSeparated, llvm::cl::cat(tuningCategory));
+
+static llvm::cl::list<unsigned> unrollFactors(
+    "tune-unroll-factors",
+    llvm::cl::desc("Candidate unroll factors of the innermost loops, 1 for no "
+                   "unrolling"),
+    llvm::cl::CommaSeparated, llvm::cl::cat(tuningCategory));
+
+static llvm::cl::opt<unsigned> maxVariants(
+    "max-variants",
+    llvm::cl::desc("Time at most this many variants, sampled at random from "
+                   "the tuning space. Defaults to all of them"),
+    llvm::cl::init(0), llvm::cl::cat(tuningCategory));
+
+static llvm::cl::opt<unsigned>
+    seed("seed", llvm::cl::desc("The seed of the sampling of -max-variants"),
+         llvm::cl::init(0), llvm::cl::cat(tuningCategory));
+
+namespace {
+/// A point of the tuning space, i.e. the parameters of the passes producing a
+/// variant of the input.
+struct Config {
+  unsigned tileSize;
+  unsigned unrollJamFactor;
+  unsigned vectorSize;
+  unsigned unrollFactor;
+
+  /// Returns the textual pass pipeline producing this variant, or an empty
+  /// string if no pass applies.
+  std::string getPipeline() const;
+};
+
+/// A variant of the input, along with its compiled form and its timings.
+struct Variant {
+  /// The point of the tuning space of the variant, if it wasn't provided with
+  /// -pipeline.
+  Optional<Config> config;
+  std::string pipeline;
+
+  /// The compiled variant and the arguments it is run with. These are released
+  /// once the variant is timed.
+  std::unique_ptr<MLIRContext> context;
+  std::unique_ptr<Module> module;
+  std::unique_ptr<ExecutionEngine> engine;
+  void (*fptr)(void **) = nullptr;
+  SmallVector<void *, 8> args;
+
+  /// The first error that prevented the variant from being compiled, if any.
+  std::string error;
+
+  /// The minimum and median execution times, in nanoseconds.
+  uint64_t minTime = 0;
+  uint64_t medianTime = 0;
+};
+} // end anonymous namespace
+
+std::string Config::getPipeline() const {
+  SmallVector<std::string, 4> passes;
+  if (tileSize != 0)
+    passes.push_back("loop-tile{tile-size=" + std::to_string(tileSize) + "}");
+  if (unrollJamFactor > 1)
+    passes.push_back("loop-unroll-jam{unroll-jam-factor=" +
+                     std::to_string(unrollJamFactor) + "}");
+  if (vectorSize != 0) {
+    passes.push_back("vectorize{virtual-vector-size=" +
+                     std::to_string(vectorSize) + "}");
+    passes.push_back("lower-vector-transfers");
+  }
+  if (unrollFactor > 1)
+    passes.push_back("loop-unroll{unroll-factor=" +
+                     std::to_string(unrollFactor) + "}");
+  if (passes.empty())
+    return "";
+  return "func(" + llvm::join(passes, ",") + ")";
+}
+
+/// Returns the candidate values of a parameter of the tuning space, or the
+/// value disabling the corresponding pass if none was provided.
+static std::vector<unsigned> getCandidates(llvm::cl::list<unsigned> &values,
+                                           unsigned disabledValue) {
+  if (values.empty())
+    return {disabledValue};
+  return std::vector<unsigned>(values.begin(), values.end());
+}
+
+/// Append the passes lowering a variant to the LLVM IR dialect, as done by
+/// default by the ExecutionEngine.
+static void addLoweringPasses(PassManager &pm) {
+  pm.addPass(createCanonicalizerPass());
+  pm.addPass(createCSEPass());
+  pm.addPass(createCanonicalizerPass());
+  pm.addPass(createLowerAffinePass());
+  pm.addPass(createConvertToLLVMIRPass());
+}
+
+/// Parse the input in a fresh context, allocate the arguments of the tuned
+/// function, and JIT-compile the variant. Sets the error of the variant on
+/// failure.
+static void compileVariant(Variant &variant, StringRef source) {
+  std::string &error = variant.error;
+  variant.context = llvm::make_unique<MLIRContext>();
+  variant.context->registerDiagnosticHandler(
+      [&error](Location, StringRef message, MLIRContext::DiagnosticKind kind) {
+        if (kind == MLIRContext::DiagnosticKind::Error && error.empty())
+          error = message;
+      });
+
+  variant.module.reset(parseSourceString(source, variant.context.get()));
+  if (!variant.module) {
+    if (error.empty())
+      error = "could not parse the input IR";
+    return;
+  }
+  Function *mainFunction = variant.module->getNamedFunction(mainFuncName);
+  if (!mainFunction || mainFunction->getBlocks().empty()) {
+    error = "entry point not found";
+    return;
+  }
+  auto expectedArguments = allocateMemRefArguments(mainFunction, initValue);
+  if (!expectedArguments) {
+    error = llvm::toString(expectedArguments.takeError());
+    return;
+  }
+  variant.args = std::move(*expectedArguments);
+
+  PassManager pm;
+  if (!variant.pipeline.empty()) {
+    std::string pipelineError;
+    llvm::raw_string_ostream os(pipelineError);
+    if (failed(parsePassPipeline(variant.pipeline, pm, os))) {
+      error = os.str();
+      return;
+    }
+  }
+  addLoweringPasses(pm);
+
+  auto expectedEngine =
+      ExecutionEngine::create(variant.module.get(), &pm,
+                              makeOptimizingTransformer(optLevel,
+                                                        /*sizeLevel=*/0));
+  if (!expectedEngine) {
+    std::string engineError = llvm::toString(expectedEngine.takeError());
+    if (error.empty())
+      error = engineError;
+    return;
+  }
+  variant.engine = std::move(*expectedEngine);
+
+  auto expectedFPtr = variant.engine->lookup(mainFuncName);
+  if (!expectedFPtr) {
+    error = llvm::toString(expectedFPtr.takeError());
+    return;
+  }
+  variant.fptr = *expectedFPtr;
+}
+
+/// Run a compiled variant 'numWarmups' times, then time 'numRepeats' runs.
+static void timeVariant(Variant &variant) {
+  for (unsigned i = 0; i < numWarmups; ++i)
+    (*variant.fptr)(variant.args.data());
+
+  std::vector<uint64_t> times;
+  for (unsigned i = 0, e = std::max<unsigned>(1, numRepeats); i < e; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    (*variant.fptr)(variant.args.data());
+    auto end = std::chrono::steady_clock::now();
+    times.push_back(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+            .count());
+  }
+  std::sort(times.begin(), times.end());
+  variant.minTime = times.front();
+  variant.medianTime = times[times.size() / 2];
+}
+
+/// Release the compiled form of a variant and the arguments it was run with.
+static void releaseVariant(Variant &variant) {
+  freeMemRefArguments(variant.args);
+  variant.args.clear();
+  variant.fptr = nullptr;
+  variant.engine.reset();
+  variant.module.reset();
+  variant.context.reset();
+}
+
+/// Print the results of a variant as a single line JSON object.
+static void printResults(const Variant &variant, llvm::raw_ostream &os) {
+  llvm::json::Object results{
+      {"input", inputFilename.getValue()},
+      {"function", mainFuncName.getValue()},
+      {"pipeline", variant.pipeline},
+      {"status", variant.error.empty() ? "ok" : "failed"},
+  };
+  if (const auto &config = variant.config) {
+    results["tile_size"] = config->tileSize;
+    results["unroll_jam_factor"] = config->unrollJamFactor;
+    results["vector_size"] = config->vectorSize;
+    results["unroll_factor"] = config->unrollFactor;
+  }
+  if (variant.error.empty()) {
+    results["repeats"] = static_cast<int64_t>(numRepeats);
+    results["min_ns"] = static_cast<int64_t>(variant.minTime);
+    results["median_ns"] = static_cast<int64_t>(variant.medianTime);
+  } else {
+    results["error"] = variant.error;
+  }
+  os << llvm::json::Value(std::move(results)) << '\n';
+}
+
+int main(int argc, char **argv) {
+  llvm::InitLLVM y(argc, argv);
+  llvm::InitializeNativeTarget();
+  llvm::InitializeNativeTargetAsmPrinter();
+  initializeLLVMPasses();
+  llvm::cl::ParseCommandLineOptions(argc, argv, "MLIR autotuning driver\n");
+
+  std::string errorMessage;
+  auto file = openInputFile(inputFilename, &errorMessage);
+  if (!file) {
+    llvm::errs() << errorMessage << "\n";
+    return 1;
+  }
+  StringRef source = file->getBuffer();
+
+  std::unique_ptr<llvm::raw_fd_ostream> resultsFile;
+  if (!resultsFilename.empty()) {
+    std::error_code error;
+    resultsFile = llvm::make_unique<llvm::raw_fd_ostream>(
+        resultsFilename, error, llvm::sys::fs::F_Append);
+    if (error) {
+      llvm::errs() << "error: cannot open '" << resultsFilename
+                   << "': " << error.message() << "\n";
+      return 1;
+    }
+  }
+
+  // Enumerate the tuning space, skipping the points that result in the same
+  // pipeline as a previous one, unless pipelines were provided.
+  std::vector<Variant> variants;
+  llvm::StringSet<> seenPipelines;
+  if (!pipelines.empty()) {
+    for (const std::string &pipeline : pipelines) {
+      if (!seenPipelines.insert(pipeline).second)
+        continue;
+      variants.emplace_back();
+      variants.back().pipeline = pipeline;
+    }
+  } else {
+    for (unsigned tileSize : getCandidates(tileSizes, 0))
+      for (unsigned unrollJamFactor : getCandidates(unrollJamFactors, 1))
+        for (unsigned vectorSize : getCandidates(vectorSizes, 0))
+          for (unsigned unrollFactor : getCandidates(unrollFactors, 1)) {
+            Config config{tileSize, unrollJamFactor, vectorSize, unrollFactor};
+            std::string pipeline = config.getPipeline();
+            if (!seenPipelines.insert(pipeline).second)
+              continue;
+            variants.emplace_back();
+            variants.back().config = config;
+            variants.back().pipeline = std::move(pipeline);
+          }
+  }
+  if (maxVariants != 0 && variants.size() > maxVariants) {
+    std::mt19937 generator(seed);
+    std::shuffle(variants.begin(), variants.end(), generator);
+    variants.resize(maxVariants);
+  }
+
+  // Compile the variants in batches of the size of the thread pool, and time
+  // the variants of a batch one at a time so that their timings aren't
+  // disturbed by each other.
+  unsigned batchSize = numThreads ? numThreads : llvm::hardware_concurrency();
+  llvm::ThreadPool threadPool(batchSize);
+  const Variant *best = nullptr;
+  for (size_t begin = 0, e = variants.size(); begin < e; begin += batchSize) {
+    size_t end = std::min<size_t>(begin + batchSize, e);
+    for (size_t i = begin; i != end; ++i)
+      threadPool.async([&, i] { compileVariant(variants[i], source); });
+    threadPool.wait();
+
+    for (size_t i = begin; i != end; ++i) {
+      Variant &variant = variants[i];
+      if (variant.error.empty()) {
+        timeVariant(variant);
+        llvm::errs() << variant.medianTime << " ns: ";
+        if (!best || variant.medianTime < best->medianTime)
+          best = &variant;
+      } else {
+        llvm::errs() << "failed (" << variant.error << "): ";
+      }
+      llvm::errs() << (variant.pipeline.empty() ? "<no passes>"
+                                                : variant.pipeline)
+                   << "\n";
+      if (resultsFile)
+        printResults(variant, *resultsFile);
+      releaseVariant(variant);
+    }
+  }
+
+  if (!best) {
+    llvm::errs() << "error: no variant could be compiled\n";
+    return 1;
+  }
+
+  auto output = openOutputFile(outputFilename, &errorMessage);
+  if (!output) {
+    llvm::errs() << errorMessage << "\n";
+    return 1;
+  }
+  output->os() << best->pipeline << "\n";
+  output->keep();
+  return 0;
+}
@@ -0,0 +1,281 @@
+//===- AffineStructuresTest.cpp - FlatAffineConstraints unit tests --------===//
+//
+// Copyright 2019 The MLIR Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =============================================================================
+
+#include "mlir/Analysis/AffineStructures.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gtest/gtest.h"
+#include <chrono>
+
+using namespace mlir;
+
+namespace {
+
+/// A linear congruential generator, so that the generated constraint systems
+/// are the same on all platforms.
+class Generator {
+public:
+  /// Returns a number in [0, range).
+  int64_t next(int64_t range) {
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    return static_cast<int64_t>((seed >> 33) % range);
+  }
+
+private:
+  uint64_t seed = 1;
+};
+
+/// Generate the dependence system between iterations i and j of a loop nest of
+/// `depth` loops of `n` iterations each, accessing a[f(i)] and a[g(j)]
+/// respectively with a `depth`-dimensional memref 'a', where i precedes j at
+/// the outermost loop.  The coefficients of the affine access functions f and
+/// g are small random numbers.
+static FlatAffineConstraints generateDependenceSystem(Generator &gen,
+                                                      unsigned depth,
+                                                      int64_t n) {
+  unsigned numDims = 2 * depth;
+  FlatAffineConstraints cst(numDims);
+  for (unsigned pos = 0; pos < numDims; ++pos) {
+    cst.addConstantLowerBound(pos, 0);
+    cst.addConstantUpperBound(pos, n - 1);
+  }
+
+  // f(i) == g(j) for each dimension of the memref.
+  SmallVector<int64_t, 16> row(numDims + 1, 0);
+  for (unsigned d = 0; d < depth; ++d) {
+    for (unsigned pos = 0; pos < depth; ++pos) {
+      row[pos] = gen.next(4);
+      row[depth + pos] = -gen.next(4);
+    }
+    int64_t fConstant = gen.next(5);
+    row[numDims] = fConstant - gen.next(5);
+    cst.addEquality(row);
+  }
+
+  // j0 >= i0 + 1.
+  std::fill(row.begin(), row.end(), 0);
+  row[0] = -1;
+  row[depth] = 1;
+  row[numDims] = -1;
+  cst.addInequality(row);
+  return cst;
+}
+
+/// Returns the time taken by `fn`, in microseconds.
+template <typename FnT> static int64_t timeInMicroseconds(FnT &&fn) {
+  auto start = std::chrono::steady_clock::now();
+  fn();
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::microseconds>(end - start)
+      .count();
+}
+
+TEST(FlatAffineConstraintsTest, IntegerEmptiness) {
+  // 27 <= 11x + 13y <= 45, -10 <= 7x - 9y <= 4 has rational solutions but no
+  // integer one.
+  FlatAffineConstraints cst(/*numDims=*/2);
+  cst.addInequality({11, 13, -27});
+  cst.addInequality({-11, -13, 45});
+  cst.addInequality({7, -9, 10});
+  cst.addInequality({-7, 9, 4});
+  EXPECT_TRUE(cst.isEmpty());
+}
+
+TEST(FlatAffineConstraintsTest, RemoveRedundantInequalities) {
+  // 0 <= x <= 10, x >= -5, 2x <= 21.
+  FlatAffineConstraints cst(/*numDims=*/1);
+  cst.addInequality({1, 0});
+  cst.addInequality({-1, 10});
+  cst.addInequality({1, 5});
+  cst.addInequality({-2, 21});
+  cst.removeRedundantInequalities();
+  ASSERT_EQ(cst.getNumInequalities(), 2u);
+  EXPECT_EQ(cst.atIneq(0, 0), 1);
+  EXPECT_EQ(cst.atIneq(1, 0), -1);
+  EXPECT_EQ(cst.atIneq(1, 1), 10);
+}
+
+TEST(FlatAffineConstraintsTest, ConstantBounds) {
+  // 0 <= x <= 10, 2x <= y <= 2x + 1, y <= 7.
+  FlatAffineConstraints cst(/*numDims=*/2);
+  cst.addConstantLowerBound(0, 0);
+  cst.addConstantUpperBound(0, 10);
+  cst.addInequality({-2, 1, 0});
+  cst.addInequality({2, -1, 1});
+  cst.addConstantUpperBound(1, 7);
+  EXPECT_EQ(cst.getConstantLowerBound(0), Optional<int64_t>(0));
+  EXPECT_EQ(cst.getConstantUpperBound(0), Optional<int64_t>(3));
+  EXPECT_EQ(cst.getConstantLowerBound(1), Optional<int64_t>(0));
+  EXPECT_EQ(cst.getConstantUpperBound(1), Optional<int64_t>(7));
+
+  // Unbounded identifiers have no constant bound.
+  FlatAffineConstraints unbounded(/*numDims=*/2);
+  unbounded.addConstantLowerBound(0, 0);
+  unbounded.addInequality({-1, 1, 0});
+  EXPECT_FALSE(unbounded.getConstantUpperBound(1).hasValue());
+  EXPECT_EQ(unbounded.getConstantLowerBound(1), Optional<int64_t>(0));
+}
+
+TEST(FlatAffineConstraintsTest, AddAndRemoveIds) {
+  // x + 2y - 3 >= 0, x - y == 0.
+  FlatAffineConstraints cst(/*numDims=*/2);
+  cst.addInequality({1, 2, -3});
+  cst.addEquality({1, -1, 0});
+
+  // Interleave the new columns with the existing ones, past the reserved
+  // columns.
+  for (unsigned i = 0; i < 8; ++i) {
+    cst.addDimId(/*pos=*/1);
+    cst.addLocalId(/*pos=*/0);
+  }
+  ASSERT_EQ(cst.getNumCols(), 19u);
+  EXPECT_EQ(cst.atIneq(0, 0), 1);
+  EXPECT_EQ(cst.atIneq(0, 9), 2);
+  EXPECT_EQ(cst.atIneq(0, 18), -3);
+  EXPECT_EQ(cst.atEq(0, 9), -1);
+  for (unsigned c = 1; c < 9; ++c)
+    EXPECT_EQ(cst.atIneq(0, c), 0);
+  for (unsigned c = 10; c < 18; ++c)
+    EXPECT_EQ(cst.atEq(0, c), 0);
+
+  // Copies share the layout of the original.
+  FlatAffineConstraints copy(cst);
+  for (unsigned i = 0; i < 8; ++i)
+    copy.removeId(/*pos=*/1);
+  for (unsigned i = 0; i < 8; ++i)
+    copy.removeId(/*pos=*/2);
+  ASSERT_EQ(copy.getNumCols(), 3u);
+  int64_t ineq[] = {1, 2, -3}, eq[] = {1, -1, 0};
+  for (unsigned c = 0; c < 3; ++c) {
+    EXPECT_EQ(copy.atIneq(0, c), ineq[c]);
+    EXPECT_EQ(copy.atEq(0, c), eq[c]);
+  }
+  EXPECT_EQ(cst.getNumCols(), 19u);
+
+  // x = y, x + 2y >= 3 implies x >= 1.
+  copy.projectOut(1);
+  EXPECT_EQ(copy.getConstantLowerBound(0), Optional<int64_t>(1));
+}
+
+/// Check the emptiness of generated dependence systems against an enumeration
+/// of their integer points: iterations i < j of a loop of n iterations
+/// accessing a[c0 * i + c1] and a[c2 * j + c3] respectively.
+TEST(FlatAffineConstraintsTest, GeneratedDependenceSystems) {
+  Generator gen;
+  for (unsigned iter = 0; iter < 200; ++iter) {
+    int64_t n = 1 + gen.next(8);
+    int64_t c0 = 1 + gen.next(4), c1 = gen.next(5), c2 = 1 + gen.next(4),
+            c3 = gen.next(5);
+
+    FlatAffineConstraints cst(/*numDims=*/2);
+    for (unsigned pos = 0; pos < 2; ++pos) {
+      cst.addConstantLowerBound(pos, 0);
+      cst.addConstantUpperBound(pos, n - 1);
+    }
+    cst.addEquality({c0, -c2, c1 - c3});
+    cst.addInequality({-1, 1, -1});
+
+    bool hasPoint = false;
+    for (int64_t i = 0; i < n; ++i)
+      for (int64_t j = i + 1; j < n; ++j)
+        hasPoint |= c0 * i + c1 == c2 * j + c3;
+    EXPECT_EQ(cst.isEmpty(), !hasPoint) << "iteration " << iter;
+  }
+}
+
+/// Fourier-Motzkin elimination is exact over the rationals, so the systems it
+/// finds empty have no integer point either.  Check that the simplex agrees on
+/// generated dependence systems of loop nests.
+TEST(FlatAffineConstraintsTest, SimplexAgreesWithFourierMotzkin) {
+  Generator gen;
+  for (unsigned depth = 1; depth <= 3; ++depth) {
+    for (unsigned iter = 0; iter < 50; ++iter) {
+      FlatAffineConstraints cst = generateDependenceSystem(gen, depth, 8);
+      if (cst.isEmptyByFourierMotzkin())
+        EXPECT_TRUE(cst.isEmpty()) << "depth " << depth << ", iteration "
+                                   << iter;
+    }
+  }
+}
+
+/// Compare the time taken to check the emptiness of generated dependence
+/// systems by simplex and by Fourier-Motzkin elimination, for loop nests of
+/// increasing depth.  This is a benchmark rather than a test, and is disabled
+/// by default.  Run it with:
+///   MLIRAnalysisTests --gtest_also_run_disabled_tests
+///       --gtest_filter=FlatAffineConstraintsTest.DISABLED_BenchmarkEmptiness
+TEST(FlatAffineConstraintsTest, DISABLED_BenchmarkEmptiness) {
+  const unsigned kNumSystems = 200;
+  for (unsigned depth = 1; depth <= 5; ++depth) {
+    Generator gen;
+    std::vector<FlatAffineConstraints> systems;
+    for (unsigned i = 0; i < kNumSystems; ++i)
+      systems.push_back(generateDependenceSystem(gen, depth, 64));
+
+    unsigned numEmptyBySimplex = 0, numEmptyByFM = 0;
+    int64_t simplexTime = timeInMicroseconds([&] {
+      for (auto &cst : systems)
+        numEmptyBySimplex += cst.isEmpty();
+    });
+    int64_t fmTime = timeInMicroseconds([&] {
+      for (auto &cst : systems)
+        numEmptyByFM += cst.isEmptyByFourierMotzkin();
+    });
+    llvm::outs() << llvm::formatv(
+        "depth {0}: simplex {1} us ({2} empty), fourier-motzkin {3} us "
+        "({4} empty)\n",
+        depth, simplexTime, numEmptyBySimplex, fmTime, numEmptyByFM);
+  }
+}
+
+/// Time projection-heavy workloads on generated dependence systems: projecting
+/// out the iterations of the destination access, which is what slicing does,
+/// and growing the systems with local identifiers one at a time, then removing
+/// them.  This is a benchmark rather than a test, and is disabled by default.
+/// Run it with:
+///   MLIRAnalysisTests --gtest_also_run_disabled_tests
+///       --gtest_filter=FlatAffineConstraintsTest.DISABLED_BenchmarkProjection
+TEST(FlatAffineConstraintsTest, DISABLED_BenchmarkProjection) {
+  const unsigned kNumSystems = 200, kNumLocals = 64;
+  for (unsigned depth = 1; depth <= 5; ++depth) {
+    Generator gen;
+    std::vector<FlatAffineConstraints> systems;
+    for (unsigned i = 0; i < kNumSystems; ++i)
+      systems.push_back(generateDependenceSystem(gen, depth, 64));
+
+    std::vector<FlatAffineConstraints> projected(systems);
+    int64_t projectionTime = timeInMicroseconds([&] {
+      for (auto &cst : projected)
+        cst.projectOut(/*pos=*/depth, /*num=*/depth);
+    });
+
+    std::vector<FlatAffineConstraints> grown(systems);
+    int64_t addRemoveTime = timeInMicroseconds([&] {
+      for (auto &cst : grown) {
+        for (unsigned i = 0; i < kNumLocals; ++i)
+          cst.addLocalId(/*pos=*/0);
+        for (unsigned i = 0; i < kNumLocals; ++i)
+          cst.removeId(cst.getNumDimAndSymbolIds());
+      }
+    });
+    llvm::outs() << llvm::formatv(
+        "depth {0}: projection {1} us, adding and removing {2} ids {3} us\n",
+        depth, projectionTime, kNumLocals, addRemoveTime);
+  }
+}
+
+} // end anonymous namespace
@@ -0,0 +1,117 @@
+//===- SimplexTest.cpp - Simplex unit tests -------------------------------===//
+//
+// Copyright 2019 The MLIR Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =============================================================================
+
+#include "mlir/Analysis/Simplex.h"
+#include "gtest/gtest.h"
+
+using namespace mlir;
+
+namespace {
+
+TEST(SimplexTest, RationalEmptiness) {
+  // 0 <= x <= 10, x >= 11.
+  Simplex simplex(1);
+  simplex.addInequality({1, 0});
+  simplex.addInequality({-1, 10});
+  EXPECT_FALSE(simplex.isEmpty());
+
+  unsigned snapshot = simplex.getSnapshot();
+  simplex.addInequality({1, -11});
+  EXPECT_TRUE(simplex.isEmpty());
+
+  // Rolling back drops the constraint and the emptiness.
+  simplex.rollback(snapshot);
+  EXPECT_FALSE(simplex.isEmpty());
+  EXPECT_EQ(simplex.getNumConstraints(), 2u);
+}
+
+TEST(SimplexTest, IntegerEmptiness) {
+  // 27 <= 11x + 13y <= 45, -10 <= 7x - 9y <= 4 has rational solutions but no
+  // integer one.
+  Simplex simplex(2);
+  simplex.addInequality({11, 13, -27});
+  simplex.addInequality({-11, -13, 45});
+  simplex.addInequality({7, -9, 10});
+  simplex.addInequality({-7, 9, 4});
+  EXPECT_FALSE(simplex.isEmpty());
+  EXPECT_EQ(simplex.findIntegerSample(64), Simplex::IntegerResult::Infeasible);
+
+  // 2x == y + 1, 0 <= y <= 4 has integer solutions, e.g. x = 1, y = 1.
+  Simplex other(2);
+  other.addEquality({2, -1, -1});
+  other.addInequality({0, 1, 0});
+  other.addInequality({0, -1, 4});
+  EXPECT_EQ(other.findIntegerSample(64), Simplex::IntegerResult::Feasible);
+
+  // The search is cut short without a budget.
+  Simplex unbounded(2);
+  unbounded.addInequality({3, -3, -1});
+  unbounded.addInequality({-3, 3, 2});
+  EXPECT_EQ(unbounded.findIntegerSample(0), Simplex::IntegerResult::Unknown);
+}
+
+TEST(SimplexTest, Optimum) {
+  // 0 <= x <= 10, 2x <= y <= 2x + 1, y <= 7.
+  Simplex simplex(2);
+  simplex.addInequality({1, 0, 0});
+  simplex.addInequality({-1, 0, 10});
+  simplex.addInequality({-2, 1, 0});
+  simplex.addInequality({2, -1, 1});
+  simplex.addInequality({0, -1, 7});
+
+  // The maximum of x is 7/2 over the rationals, and 3 over the integers.
+  auto max = simplex.computeOptimum(Simplex::Direction::Up, {1, 0, 0});
+  ASSERT_TRUE(max.hasValue());
+  EXPECT_EQ(max->num * 2, max->den * 7);
+  EXPECT_EQ(simplex.computeIntegerOptimum(Simplex::Direction::Up, 0, 64),
+            Optional<int64_t>(3));
+  EXPECT_EQ(simplex.computeIntegerOptimum(Simplex::Direction::Down, 1, 64),
+            Optional<int64_t>(0));
+
+  // x - y is unbounded below once the upper bound of y is dropped.
+  Simplex unbounded(2);
+  unbounded.addInequality({1, 0, 0});
+  unbounded.addInequality({-1, 1, 0});
+  EXPECT_FALSE(unbounded.computeOptimum(Simplex::Direction::Down, {1, -1, 0}));
+  EXPECT_FALSE(unbounded.computeIntegerOptimum(Simplex::Direction::Up, 1, 64));
+}
+
+TEST(SimplexTest, Redundancy) {
+  // x >= 0, x <= 10, x >= -5, x <= 20.
+  Simplex simplex(1);
+  simplex.addInequality({1, 0});
+  simplex.addInequality({-1, 10});
+  simplex.addInequality({1, 5});
+  simplex.addInequality({-1, 20});
+  simplex.detectRedundant();
+  EXPECT_FALSE(simplex.isMarkedRedundant(0));
+  EXPECT_FALSE(simplex.isMarkedRedundant(1));
+  EXPECT_TRUE(simplex.isMarkedRedundant(2));
+  EXPECT_TRUE(simplex.isMarkedRedundant(3));
+
+  // 2x >= 1 is implied by x >= 1 over the integers, and checked first.
+  Simplex integer(1);
+  integer.addInequality({2, -1});
+  integer.addInequality({1, -1});
+  integer.addInequality({-1, 5});
+  integer.detectRedundant();
+  EXPECT_TRUE(integer.isMarkedRedundant(0));
+  EXPECT_FALSE(integer.isMarkedRedundant(1));
+  EXPECT_FALSE(integer.isMarkedRedundant(2));
+}
+
+} // end anonymous namespace
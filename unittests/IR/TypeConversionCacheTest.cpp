@@ -0,0 +1,61 @@
+//===- TypeConversionCacheTest.cpp - TypeConversionCache unit tests -------===//
+//
+// Copyright 2019 The MLIR Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =============================================================================
+
+#include "mlir/IR/TypeConversionCache.h"
+#include "mlir/IR/MLIRContext.h"
+#include "mlir/IR/StandardTypes.h"
+#include "gtest/gtest.h"
+
+using namespace mlir;
+
+namespace {
+
+TEST(TypeConversionCacheTest, ConvertsOncePerType) {
+  MLIRContext context;
+  Type i32 = IntegerType::get(32, &context);
+  Type i64 = IntegerType::get(64, &context);
+  Type f32 = FloatType::getF32(&context);
+
+  // Convert every integer type to f32, and count the calls to the converter.
+  unsigned numConversions = 0;
+  auto convert = [&](Type type) -> Type {
+    ++numConversions;
+    return type.isa<IntegerType>() ? f32 : Type();
+  };
+
+  TypeConversionCache cache;
+  EXPECT_EQ(cache.lookupOrConvert(i32, convert), f32);
+  EXPECT_EQ(cache.lookupOrConvert(i32, convert), f32);
+  EXPECT_EQ(cache.lookupOrConvert(i64, convert), f32);
+  EXPECT_EQ(numConversions, 2u);
+  EXPECT_EQ(cache.getNumHits(), 1u);
+  EXPECT_EQ(cache.getNumMisses(), 2u);
+
+  // Failed conversions are cached as well.
+  EXPECT_FALSE(cache.lookupOrConvert(f32, convert));
+  EXPECT_FALSE(cache.lookupOrConvert(f32, convert));
+  EXPECT_EQ(numConversions, 3u);
+
+  // Clearing the cache drops the conversions and resets the counters.
+  cache.clear();
+  EXPECT_EQ(cache.getNumHits(), 0u);
+  EXPECT_EQ(cache.getNumMisses(), 0u);
+  EXPECT_EQ(cache.lookupOrConvert(i32, convert), f32);
+  EXPECT_EQ(numConversions, 4u);
+}
+
+} // end namespace
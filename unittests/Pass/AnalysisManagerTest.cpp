@@ -32,6 +32,12 @@ struct OtherAnalysis {
   OtherAnalysis(Function *) {}
   OtherAnalysis(Module *) {}
 };
+/// An analysis that is computed from MyAnalysis.
+struct DependentAnalysis {
+  using Dependencies = AnalysisDependencies<MyAnalysis>;
+  DependentAnalysis(Function *) {}
+  DependentAnalysis(Module *) {}
+};
 
 TEST(AnalysisManagerTest, FineGrainModuleAnalysisPreservation) {
   MLIRContext context;
@@ -109,4 +115,100 @@ TEST(AnalysisManagerTest, FineGrainChildFunctionAnalysisPreservation) {
   EXPECT_FALSE(mam.getCachedFunctionAnalysis<OtherAnalysis>(func1).hasValue());
 }
 
+TEST(AnalysisManagerTest, DependentAnalysisInvalidation) {
+  MLIRContext context;
+
+  std::unique_ptr<Module> module(new Module(&context));
+  ModuleAnalysisManager mam(&*module, /*passInstrumentor=*/nullptr);
+
+  // Preserve the dependent analysis, but not the analysis it depends on.
+  mam.getAnalysis<MyAnalysis>();
+  mam.getAnalysis<OtherAnalysis>();
+  mam.getAnalysis<DependentAnalysis>();
+
+  detail::PreservedAnalyses pa;
+  pa.preserve<OtherAnalysis, DependentAnalysis>();
+  mam.invalidate(pa);
+
+  // Check that the invalidation cascaded to DependentAnalysis.
+  EXPECT_FALSE(mam.getCachedAnalysis<MyAnalysis>().hasValue());
+  EXPECT_TRUE(mam.getCachedAnalysis<OtherAnalysis>().hasValue());
+  EXPECT_FALSE(mam.getCachedAnalysis<DependentAnalysis>().hasValue());
+
+  // Check that the dependent analysis is kept if its dependencies are
+  // preserved.
+  mam.getAnalysis<MyAnalysis>();
+  mam.getAnalysis<DependentAnalysis>();
+
+  detail::PreservedAnalyses pa2;
+  pa2.preserve<MyAnalysis, DependentAnalysis>();
+  mam.invalidate(pa2);
+
+  EXPECT_TRUE(mam.getCachedAnalysis<MyAnalysis>().hasValue());
+  EXPECT_TRUE(mam.getCachedAnalysis<DependentAnalysis>().hasValue());
+}
+
+TEST(AnalysisManagerTest, ChangedFunctionAnalysisInvalidation) {
+  MLIRContext context;
+  Builder builder(&context);
+
+  // Create a module with two functions.
+  std::unique_ptr<Module> module(new Module(&context));
+  Function *func1 =
+      new Function(builder.getUnknownLoc(), "foo",
+                   builder.getFunctionType(llvm::None, llvm::None));
+  Function *func2 =
+      new Function(builder.getUnknownLoc(), "bar",
+                   builder.getFunctionType(llvm::None, llvm::None));
+  module->getFunctions().push_back(func1);
+  module->getFunctions().push_back(func2);
+
+  ModuleAnalysisManager mam(&*module, /*passInstrumentor=*/nullptr);
+  mam.getAnalysis<MyAnalysis>();
+  mam.getFunctionAnalysis<MyAnalysis>(func1);
+  mam.getFunctionAnalysis<MyAnalysis>(func2);
+
+  // Invalidate all analyses, but only for the first function.
+  llvm::SmallPtrSet<Function *, 4> changedFunctions;
+  changedFunctions.insert(func1);
+  mam.invalidate(detail::PreservedAnalyses(), &changedFunctions);
+
+  // Check that only the analyses of the module and the changed function were
+  // invalidated.
+  EXPECT_FALSE(mam.getCachedAnalysis<MyAnalysis>().hasValue());
+  EXPECT_FALSE(mam.getCachedFunctionAnalysis<MyAnalysis>(func1).hasValue());
+  EXPECT_TRUE(mam.getCachedFunctionAnalysis<MyAnalysis>(func2).hasValue());
+}
+
+TEST(AnalysisManagerTest, ErasedFunctionAnalysisInvalidation) {
+  MLIRContext context;
+  Builder builder(&context);
+
+  // Create a module with two functions.
+  std::unique_ptr<Module> module(new Module(&context));
+  Function *func1 =
+      new Function(builder.getUnknownLoc(), "foo",
+                   builder.getFunctionType(llvm::None, llvm::None));
+  Function *func2 =
+      new Function(builder.getUnknownLoc(), "bar",
+                   builder.getFunctionType(llvm::None, llvm::None));
+  module->getFunctions().push_back(func1);
+  module->getFunctions().push_back(func2);
+
+  ModuleAnalysisManager mam(&*module, /*passInstrumentor=*/nullptr);
+  mam.getFunctionAnalysis<MyAnalysis>(func1);
+  mam.getFunctionAnalysis<MyAnalysis>(func2);
+
+  // Preserve all analyses, but mark the first function as erased.
+  llvm::SmallPtrSet<Function *, 4> changedFunctions, erasedFunctions;
+  erasedFunctions.insert(func1);
+  detail::PreservedAnalyses pa;
+  pa.preserveAll();
+  mam.invalidate(pa, &changedFunctions, &erasedFunctions);
+
+  // Check that only the analyses of the erased function were dropped.
+  EXPECT_FALSE(mam.getCachedFunctionAnalysis<MyAnalysis>(func1).hasValue());
+  EXPECT_TRUE(mam.getCachedFunctionAnalysis<MyAnalysis>(func2).hasValue());
+}
+
 } // end namespace
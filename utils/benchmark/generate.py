@@ -0,0 +1,322 @@
+#!/usr/bin/env python
+#
+# Copyright 2019 The MLIR Authors.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+# ==============================================================================
+"""Generates synthetic MLIR inputs to benchmark passes.
+
+Each subcommand prints a module to stdout whose size is controlled by its
+options, e.g. to time CSE on a million operations:
+
+  generate.py cse --num-ops=1000000 | \\
+      mlir-opt -cse -pass-timing -pass-timing-display=list -o /dev/null
+
+The inputs whose function is @main are run with mlir-tune instead, e.g. to
+compare the tile sizes selected from the memory footprint and from the reuse
+model of the tiling pass with the JIT:
+
+  generate.py matmul --size=1024 | mlir-tune -pipeline= \\
+      -pipeline='func(loop-tile{cache-size=1024})' \\
+      -pipeline='func(loop-tile{cache-sizes=32,1024})'
+
+The output only depends on the options, including --seed, so that timings
+can be compared across revisions. The small instances used in the benchmark
+tests under test/Benchmarks check that the inputs stay valid.
+"""
+
+from __future__ import print_function
+
+import argparse
+import sys
+
+
+class Generator(object):
+  """A linear congruential generator, so that the output doesn't depend on the
+  version of the Python random module."""
+
+  def __init__(self, seed):
+    self.state = seed
+
+  def next(self, bound):
+    """Returns a pseudo-random integer in [0, bound)."""
+    self.state = (self.state * 6364136223846793005 + 1442695040888963407) % (
+        1 << 64)
+    return (self.state >> 33) % bound
+
+
+def generate_cse(args, out):
+  """A function of --num-ops integer operations in a single block. About
+  --redundancy of the operations recompute a value computed before, possibly
+  from operands that are themselves redundant, and are erased by CSE."""
+  gen = Generator(args.seed)
+  binary_ops = ['addi', 'subi', 'muli', 'and', 'or', 'xor']
+  # The names of the values computed so far, the index of the first value each
+  # of them is equal to, and the values equal to each of those.
+  names = ['%arg0', '%arg1']
+  leaders = [0, 1]
+  aliases = {0: [0], 1: [1]}
+  # The leader of the value computed by each distinct operation, and the list
+  # of the distinct operations.
+  known = {}
+  distinct = []
+
+  out.write('func @cse(%arg0: i32, %arg1: i32) -> i32 {\n')
+  for i in range(args.num_ops):
+    name = '%' + str(i)
+    if distinct and gen.next(1000) < args.redundancy * 1000:
+      # Recompute a known value, from any of the values equal to its operands.
+      key = distinct[gen.next(len(distinct))]
+      operands = []
+      if key[0] != 'constant':
+        for leader in key[1:]:
+          equal = aliases[leader]
+          operands.append(names[equal[gen.next(len(equal))]])
+    elif gen.next(8) == 0:
+      key = ('constant', gen.next(64))
+      operands = []
+    else:
+      lhs = gen.next(len(names))
+      rhs = gen.next(len(names))
+      key = (binary_ops[gen.next(len(binary_ops))], leaders[lhs], leaders[rhs])
+      operands = [names[lhs], names[rhs]]
+
+    if key[0] == 'constant':
+      out.write('  %s = constant %d : i32\n' % (name, key[1]))
+    else:
+      out.write('  %s = %s %s : i32\n' % (name, key[0], ', '.join(operands)))
+    if key not in known:
+      known[key] = len(names)
+      aliases[len(names)] = []
+      distinct.append(key)
+    aliases[known[key]].append(len(names))
+    names.append(name)
+    leaders.append(known[key])
+  out.write('  return %s : i32\n' % names[-1])
+  out.write('}\n')
+
+
+def generate_fusion(args, out):
+  """A pipeline of --num-nests loop nests, each of which consumes the buffer
+  produced by the previous one and those of --fan-in - 1 nests before, and
+  produces a buffer of its own."""
+  gen = Generator(args.seed)
+  memref = 'memref<%dxf32>' % args.size
+  # The buffers produced so far, the input of the pipeline first.
+  buffers = ['%in']
+  out.write('func @fusion(%%in: %s, %%out: %s) {\n' % (memref, memref))
+  for k in range(1, args.num_nests):
+    out.write('  %%m%d = alloc() : %s\n' % (k, memref))
+  for k in range(1, args.num_nests + 1):
+    inputs = [buffers[-1]]
+    for _ in range(1, args.fan_in):
+      inputs.append(buffers[gen.next(len(buffers))])
+    output = '%out' if k == args.num_nests else '%%m%d' % k
+    out.write('  affine.for %%i%d = 0 to %d {\n' % (k, args.size))
+    value = None
+    for n, buf in enumerate(inputs):
+      out.write('    %%v%d_%d = load %s[%%i%d] : %s\n' % (k, n, buf, k, memref))
+      if value is None:
+        value = '%%v%d_%d' % (k, n)
+        continue
+      out.write('    %%s%d_%d = addf %s, %%v%d_%d : f32\n' % (k, n, value, k,
+                                                                n))
+      value = '%%s%d_%d' % (k, n)
+    out.write('    %%r%d = mulf %s, %s : f32\n' % (k, value, value))
+    out.write('    store %%r%d, %s[%%i%d] : %s\n' % (k, output, k, memref))
+    out.write('  }\n')
+    buffers.append(output)
+  out.write('  return\n')
+  out.write('}\n')
+
+
+def generate_siblings(args, out):
+  """--num-nests sibling loop nests streaming the same input buffer of --size
+  elements into buffers of their own, to be run with mlir-tune. Fusing them
+  reads the input once instead of once per nest."""
+  memref = 'memref<%dxf32>' % args.size
+  outputs = ['%%out%d: %s' % (k, memref) for k in range(args.num_nests)]
+  out.write('func @main(%%in: %s, %s) {\n' % (memref, ', '.join(outputs)))
+  for k in range(args.num_nests):
+    out.write('  affine.for %%i%d = 0 to %d {\n' % (k, args.size))
+    out.write('    %%v%d = load %%in[%%i%d] : %s\n' % (k, k, memref))
+    out.write('    %%r%d = mulf %%v%d, %%v%d : f32\n' % (k, k, k))
+    out.write('    store %%r%d, %%out%d[%%i%d] : %s\n' % (k, k, k, memref))
+    out.write('  }\n')
+  out.write('  return\n')
+  out.write('}\n')
+
+
+def generate_dma(args, out):
+  """--num-loops loops, each copying a tile of --tile-size elements of the input
+  buffer to the fast memory space with a DMA and computing on it in two loop
+  nests that pass values through a buffer of the fast memory space."""
+  memref = 'memref<%dxf32>' % args.size
+  tile = 'memref<%dxf32, 1>' % args.tile_size
+  out.write('func @dma(%%in: %s, %%out: %s) {\n' % (memref, memref))
+  out.write('  %c0 = constant 0 : index\n')
+  out.write('  %%c%d = constant %d : index\n' % (args.tile_size,
+                                                args.tile_size))
+  for k in range(args.num_loops):
+    out.write('  %%buf%d = alloc() : %s\n' % (k, tile))
+    out.write('  %%tmp%d = alloc() : %s\n' % (k, tile))
+    out.write('  %%tag%d = alloc() : memref<1xi32>\n' % k)
+    out.write('  affine.for %%i%d = 0 to %d step %d {\n' % (k, args.size,
+                                                           args.tile_size))
+    out.write('    dma_start %%in[%%i%d], %%buf%d[%%c0], %%c%d, %%tag%d[%%c0] '
+              ': %s, %s, memref<1xi32>\n' % (k, k, args.tile_size, k, memref,
+                                            tile))
+    out.write('    dma_wait %%tag%d[%%c0], %%c%d : memref<1xi32>\n' %
+              (k, args.tile_size))
+    out.write('    affine.for %%j%d = 0 to %d {\n' % (k, args.tile_size))
+    out.write('      %%v%d = load %%buf%d[%%j%d] : %s\n' % (k, k, k, tile))
+    out.write('      %%r%d = mulf %%v%d, %%v%d : f32\n' % (k, k, k))
+    out.write('      store %%r%d, %%tmp%d[%%j%d] : %s\n' % (k, k, k, tile))
+    out.write('    }\n')
+    out.write('    affine.for %%k%d = 0 to %d {\n' % (k, args.tile_size))
+    out.write('      %%t%d = load %%tmp%d[%%k%d] : %s\n' % (k, k, k, tile))
+    out.write('      %%idx%d = affine.apply (d0, d1) -> (d0 + d1)'
+              '(%%i%d, %%k%d)\n' % (k, k, k))
+    out.write('      store %%t%d, %%out[%%idx%d] : %s\n' % (k, k, memref))
+    out.write('    }\n')
+    out.write('  }\n')
+    out.write('  dealloc %%tag%d : memref<1xi32>\n' % k)
+    out.write('  dealloc %%tmp%d : %s\n' % (k, tile))
+    out.write('  dealloc %%buf%d : %s\n' % (k, tile))
+  out.write('  return\n')
+  out.write('}\n')
+
+
+def generate_licm(args, out):
+  """A loop nest over --size x --size matrices whose inner loop body adds
+  --num-invariants loads to each element, to be run with mlir-tune. The loads
+  and the index computations of their subscripts only depend on the outer loop,
+  and are hoisted out of the inner loop by LICM."""
+  memref = 'memref<%dx%dxf32>' % (args.size, args.size)
+  out.write('func @main(%%A: %s, %%B: %s) {\n' % (memref, memref))
+  out.write('  affine.for %%i = 0 to %d {\n' % args.size)
+  out.write('    affine.for %%j = 0 to %d {\n' % args.size)
+  out.write('      %%v = load %%A[%%i, %%j] : %s\n' % memref)
+  value = '%v'
+  for n in range(args.num_invariants):
+    out.write('      %%idx%d = affine.apply (d0) -> ((d0 + %d) mod %d)(%%i)\n' %
+              (n, n + 1, args.size))
+    out.write('      %%inv%d = load %%A[%%idx%d, %%i] : %s\n' % (n, n, memref))
+    out.write('      %%s%d = addf %s, %%inv%d : f32\n' % (n, value, n))
+    value = '%%s%d' % n
+  out.write('      store %s, %%B[%%i, %%j] : %s\n' % (value, memref))
+  out.write('    }\n')
+  out.write('  }\n')
+  out.write('  return\n')
+  out.write('}\n')
+
+
+def generate_matmul(args, out):
+  """A matrix multiplication of --size x --size matrices as a perfect loop nest,
+  to be run with mlir-tune."""
+  memref = 'memref<%dx%dxf32>' % (args.size, args.size)
+  out.write('func @main(%%A: %s, %%B: %s, %%C: %s) {\n' % ((memref,) * 3))
+  out.write('  affine.for %%i = 0 to %d {\n' % args.size)
+  out.write('    affine.for %%j = 0 to %d {\n' % args.size)
+  out.write('      affine.for %%k = 0 to %d {\n' % args.size)
+  out.write('        %%a = load %%A[%%i, %%k] : %s\n' % memref)
+  out.write('        %%b = load %%B[%%k, %%j] : %s\n' % memref)
+  out.write('        %%c = load %%C[%%i, %%j] : %s\n' % memref)
+  out.write('        %p = mulf %a, %b : f32\n')
+  out.write('        %s = addf %c, %p : f32\n')
+  out.write('        store %%s, %%C[%%i, %%j] : %s\n' % memref)
+  out.write('      }\n')
+  out.write('    }\n')
+  out.write('  }\n')
+  out.write('  return\n')
+  out.write('}\n')
+
+
+def main():
+  parser = argparse.ArgumentParser(
+      description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+  parser.add_argument(
+      '--seed', type=int, default=1, help='seed of the generated input')
+  subparsers = parser.add_subparsers(dest='kind')
+  subparsers.required = True
+
+  cse = subparsers.add_parser(
+      'cse', help='straight-line code with redundant operations')
+  cse.add_argument(
+      '--num-ops', type=int, default=100000, help='number of operations')
+  cse.add_argument(
+      '--redundancy',
+      type=float,
+      default=0.5,
+      help='fraction of the operations recomputing a known value')
+  cse.set_defaults(generate=generate_cse)
+
+  fusion = subparsers.add_parser(
+      'fusion', help='a pipeline of producer/consumer loop nests')
+  fusion.add_argument(
+      '--num-nests', type=int, default=1000, help='number of loop nests')
+  fusion.add_argument(
+      '--fan-in',
+      type=int,
+      default=2,
+      help='number of buffers consumed by each loop nest')
+  fusion.add_argument(
+      '--size', type=int, default=1024, help='number of buffer elements')
+  fusion.set_defaults(generate=generate_fusion)
+
+  siblings = subparsers.add_parser(
+      'siblings', help='sibling loop nests streaming the same buffer')
+  siblings.add_argument(
+      '--num-nests', type=int, default=4, help='number of loop nests')
+  siblings.add_argument(
+      '--size',
+      type=int,
+      default=1 << 24,
+      help='number of buffer elements')
+  siblings.set_defaults(generate=generate_siblings)
+
+  dma = subparsers.add_parser(
+      'dma', help='loops computing on tiles copied with DMAs')
+  dma.add_argument(
+      '--num-loops', type=int, default=1000, help='number of loops')
+  dma.add_argument(
+      '--size', type=int, default=4096, help='number of buffer elements')
+  dma.add_argument(
+      '--tile-size',
+      type=int,
+      default=32,
+      help='number of elements copied by each DMA')
+  dma.set_defaults(generate=generate_dma)
+
+  licm = subparsers.add_parser(
+      'licm', help='a loop nest with loop invariant loads')
+  licm.add_argument(
+      '--num-invariants',
+      type=int,
+      default=4,
+      help='number of loop invariant loads')
+  licm.add_argument(
+      '--size', type=int, default=1024, help='number of rows of the matrices')
+  licm.set_defaults(generate=generate_licm)
+
+  matmul = subparsers.add_parser('matmul', help='matrix multiplication')
+  matmul.add_argument(
+      '--size', type=int, default=1024, help='number of rows of the matrices')
+  matmul.set_defaults(generate=generate_matmul)
+
+  args = parser.parse_args()
+  args.generate(args, sys.stdout)
+
+
+if __name__ == '__main__':
+  main()